@@ -0,0 +1,299 @@
+//! Time to first frame for a new viewer of a C API session, in-process: from
+//! handing the viewer's offer to the library until the viewer has received a
+//! whole video frame. Compares sessions from webrtc_session_create, from a
+//! context, and from a context with warm connections.
+
+use std::ffi::{CStr, CString};
+use std::os::raw::{c_char, c_void};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{mpsc, Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use anyhow::{anyhow, Result};
+use clap::{AppSettings, Arg, Command};
+use webrtc::api::media_engine::MediaEngine;
+use webrtc::api::APIBuilder;
+use webrtc::ice_transport::ice_candidate::RTCIceCandidateInit;
+use webrtc::peer_connection::configuration::RTCConfiguration;
+use webrtc::peer_connection::sdp::session_description::RTCSessionDescription;
+use webrtc::peer_connection::RTCPeerConnection;
+use webrtc::rtp_transceiver::rtp_codec::RTPCodecType;
+use webrtc::rtp_transceiver::rtp_transceiver_direction::RTCRtpTransceiverDirection;
+use webrtc::rtp_transceiver::RTCRtpTransceiverInit;
+use webrtc::{
+    webrtc_context_create, webrtc_context_create_session, webrtc_context_destroy, webrtc_context_get_stats,
+    webrtc_context_stats_t, webrtc_context_t, webrtc_session_create,
+    webrtc_session_destroy, webrtc_session_send_frame, webrtc_session_set_remote_description,
+    webrtc_session_set_signal_callback, webrtc_session_t,
+};
+
+const SESSION_CONFIG: &str = r#"{"encoder": {"codec": "vp9", "bitrate_kbps": 1000}}"#;
+const FRAME_INTERVAL: Duration = Duration::from_micros(16_667);
+
+#[derive(Clone, Copy, PartialEq)]
+enum Mode {
+    /// webrtc_session_create: own runtime and connection per session.
+    Standalone,
+    /// webrtc_context_create_session without warm connections.
+    Context,
+    /// webrtc_context_create_session with one warm connection.
+    Warm,
+}
+
+impl Mode {
+    fn name(self) -> &'static str {
+        match self {
+            Mode::Standalone => "standalone",
+            Mode::Context => "context",
+            Mode::Warm => "warm",
+        }
+    }
+}
+
+/// Milliseconds from the offer to each startup step.
+struct Sample {
+    created_ms: f64,
+    answered_ms: f64,
+    first_frame_ms: f64,
+}
+
+/// The library's answer and candidates, as JSON, for the viewer.
+extern "C" fn on_signal(msg: *const c_char, user_data: *mut c_void) {
+    let signals = unsafe { &*(user_data as *const Mutex<mpsc::Sender<String>>) };
+    let msg = unsafe { CStr::from_ptr(msg) }.to_string_lossy().into_owned();
+    if let Ok(signals) = signals.lock() {
+        let _ = signals.send(msg);
+    }
+}
+
+/// A receive-only viewer, like a browser tab: default codecs, and a data
+/// channel so the offer negotiates SCTP for the library's input channel.
+/// Gathering completes before the offer is returned, so the offer carries
+/// its candidates.
+async fn viewer(first_frame: mpsc::Sender<Instant>) -> Result<(Arc<RTCPeerConnection>, RTCSessionDescription)> {
+    let mut m = MediaEngine::default();
+    m.register_default_codecs()?;
+    let api = APIBuilder::new().with_media_engine(m).build();
+    let pc = Arc::new(api.new_peer_connection(RTCConfiguration::default()).await?);
+    pc.add_transceiver_from_kind(
+        RTPCodecType::Video,
+        Some(RTCRtpTransceiverInit {
+            direction: RTCRtpTransceiverDirection::Recvonly,
+            send_encodings: Vec::new(),
+        }),
+    )
+    .await?;
+    pc.create_data_channel("viewer", None).await?;
+
+    let first_frame = Mutex::new(Some(first_frame));
+    pc.on_track(Box::new(move |track, _, _| {
+        let first_frame = first_frame.lock().unwrap().take();
+        Box::pin(async move {
+            let Some(first_frame) = first_frame else { return };
+            // The marker bit ends a frame
+            while let Ok((packet, _)) = track.read_rtp().await {
+                if packet.header.marker {
+                    let _ = first_frame.send(Instant::now());
+                    break;
+                }
+            }
+        })
+    }));
+
+    let offer = pc.create_offer(None).await?;
+    let mut gathered = pc.gathering_complete_promise().await;
+    pc.set_local_description(offer).await?;
+    let _ = gathered.recv().await;
+    let offer = pc.local_description().await.ok_or_else(|| anyhow!("viewer has no offer"))?;
+    Ok((pc, offer))
+}
+
+/// Sends a grey 60 fps stream until `running` is cleared.
+fn feed_frames(session: usize, width: i32, height: i32, running: Arc<AtomicBool>) -> std::thread::JoinHandle<()> {
+    std::thread::spawn(move || {
+        let luma = width as usize * height as usize;
+        let chroma = ((width as usize + 1) / 2) * ((height as usize + 1) / 2);
+        let frame = vec![128u8; luma + 2 * chroma];
+        while running.load(Ordering::Relaxed) {
+            webrtc_session_send_frame(session as *mut webrtc_session_t, width, height, frame.as_ptr());
+            std::thread::sleep(FRAME_INTERVAL);
+        }
+    })
+}
+
+fn run_once(rt: &tokio::runtime::Runtime, mode: Mode, context: *mut webrtc_context_t, width: i32, height: i32) -> Result<Sample> {
+    let (first_frame_tx, first_frame_rx) = mpsc::channel();
+    let (viewer_pc, offer) = rt.block_on(viewer(first_frame_tx))?;
+    let offer = CString::new(serde_json::to_string(&offer)?)?;
+    let config = CString::new(SESSION_CONFIG)?;
+    let (signal_tx, signal_rx) = mpsc::channel();
+    let signals = Box::new(Mutex::new(signal_tx));
+
+    let started = Instant::now();
+    let session = match mode {
+        Mode::Standalone => webrtc_session_create(config.as_ptr(), None, std::ptr::null_mut()),
+        Mode::Context | Mode::Warm => {
+            webrtc_context_create_session(context, config.as_ptr(), None, std::ptr::null_mut())
+        }
+    };
+    if session.is_null() {
+        return Err(anyhow!("session creation failed"));
+    }
+    let created = started.elapsed();
+    webrtc_session_set_signal_callback(
+        session,
+        Some(on_signal),
+        &*signals as *const Mutex<mpsc::Sender<String>> as *mut c_void,
+    );
+    webrtc_session_set_remote_description(session, offer.as_ptr());
+    let running = Arc::new(AtomicBool::new(true));
+    let feeder = feed_frames(session as usize, width, height, Arc::clone(&running));
+
+    // Relay the answer and trickled candidates until the first frame is in
+    let deadline = started + Duration::from_secs(10);
+    let mut answered = None;
+    let result = loop {
+        if let Ok(at) = first_frame_rx.try_recv() {
+            break Ok(at);
+        }
+        if Instant::now() > deadline {
+            break Err(anyhow!("no frame within 10 s"));
+        }
+        let msg = match signal_rx.recv_timeout(Duration::from_millis(1)) {
+            Ok(msg) => msg,
+            Err(_) => continue,
+        };
+        let value: serde_json::Value = serde_json::from_str(&msg)?;
+        if value.get("sdp").is_some() {
+            answered.get_or_insert_with(|| started.elapsed());
+            let answer: RTCSessionDescription = serde_json::from_value(value)?;
+            rt.block_on(viewer_pc.set_remote_description(answer))?;
+        } else {
+            let candidate: RTCIceCandidateInit = serde_json::from_value(value)?;
+            rt.block_on(viewer_pc.add_ice_candidate(candidate))?;
+        }
+    };
+
+    running.store(false, Ordering::Relaxed);
+    let _ = feeder.join();
+    webrtc_session_destroy(session);
+    let _ = rt.block_on(viewer_pc.close());
+    // The session is gone, so nothing calls on_signal with `signals` any more
+    drop(signals);
+
+    let first_frame = result?;
+    let ms = |d: Duration| d.as_secs_f64() * 1e3;
+    Ok(Sample {
+        created_ms: ms(created),
+        answered_ms: ms(answered.unwrap_or_default()),
+        first_frame_ms: ms(first_frame - started),
+    })
+}
+
+/// Waits for the pool to be full again, so each warm run starts like the first.
+fn wait_for_warm(context: *mut webrtc_context_t, warm: u32) {
+    let deadline = Instant::now() + Duration::from_secs(5);
+    let mut stats = webrtc_context_stats_t {
+        sessions: 0,
+        warm_connections: 0,
+        warm_hits: 0,
+        warm_misses: 0,
+    };
+    while Instant::now() < deadline {
+        if webrtc_context_get_stats(context, &mut stats) == 0 && stats.warm_connections >= warm {
+            return;
+        }
+        std::thread::sleep(Duration::from_millis(5));
+    }
+}
+
+fn percentile(sorted: &[f64], p: f64) -> f64 {
+    sorted[((sorted.len() - 1) as f64 * p).round() as usize]
+}
+
+fn report(mode: Mode, samples: &[Sample]) {
+    let column = |f: fn(&Sample) -> f64| {
+        let mut values: Vec<f64> = samples.iter().map(f).collect();
+        values.sort_by(|a, b| a.partial_cmp(b).unwrap());
+        format!(
+            "p50 {:7.1}  p90 {:7.1}  max {:7.1}",
+            percentile(&values, 0.5),
+            percentile(&values, 0.9),
+            values[values.len() - 1]
+        )
+    };
+    println!("{} ({} runs, ms from the offer)", mode.name(), samples.len());
+    println!("  created      {}", column(|s| s.created_ms));
+    println!("  answered     {}", column(|s| s.answered_ms));
+    println!("  first frame  {}", column(|s| s.first_frame_ms));
+}
+
+fn main() -> Result<()> {
+    let app = Command::new("session-startup-bench")
+        .version("0.1.0")
+        .about("Time to first frame for new C API sessions.")
+        .setting(AppSettings::DeriveDisplayOrder)
+        .arg(
+            Arg::new("iterations")
+                .long("iterations")
+                .takes_value(true)
+                .default_value("20")
+                .help("Sessions started per mode"),
+        )
+        .arg(
+            Arg::new("mode")
+                .long("mode")
+                .takes_value(true)
+                .possible_values(["standalone", "context", "warm", "all"])
+                .default_value("all")
+                .help("How sessions are created"),
+        )
+        .arg(
+            Arg::new("size")
+                .long("size")
+                .takes_value(true)
+                .default_value("640x480")
+                .help("Frame size, WIDTHxHEIGHT"),
+        );
+    let matches = app.get_matches();
+    let iterations = matches.value_of("iterations").unwrap().parse::<usize>()?.max(1);
+    let (width, height) = matches
+        .value_of("size")
+        .unwrap()
+        .split_once('x')
+        .and_then(|(w, h)| Some((w.parse::<i32>().ok()?, h.parse::<i32>().ok()?)))
+        .ok_or_else(|| anyhow!("--size must be WIDTHxHEIGHT"))?;
+    let modes = match matches.value_of("mode").unwrap() {
+        "standalone" => vec![Mode::Standalone],
+        "context" => vec![Mode::Context],
+        "warm" => vec![Mode::Warm],
+        _ => vec![Mode::Standalone, Mode::Context, Mode::Warm],
+    };
+
+    let rt = tokio::runtime::Runtime::new()?;
+    for mode in modes {
+        let context_config = match mode {
+            Mode::Warm => CString::new(r#"{"warm_connections": 1, "codecs": ["vp9"]}"#)?,
+            _ => CString::new(r#"{"codecs": ["vp9"]}"#)?,
+        };
+        let context = match mode {
+            Mode::Standalone => std::ptr::null_mut(),
+            _ => webrtc_context_create(context_config.as_ptr()),
+        };
+        if mode != Mode::Standalone && context.is_null() {
+            return Err(anyhow!("context creation failed"));
+        }
+        let mut samples = Vec::with_capacity(iterations);
+        for _ in 0..iterations {
+            if mode == Mode::Warm {
+                wait_for_warm(context, 1);
+            }
+            samples.push(run_once(&rt, mode, context, width, height)?);
+        }
+        if !context.is_null() {
+            webrtc_context_destroy(context);
+        }
+        report(mode, &samples);
+    }
+    Ok(())
+}
@@ -26,6 +26,8 @@ enum SignalMessage {
     Offer { sdp: String },
     Answer { sdp: String },
     IceCandidate { candidate: String, sdp_mid: String, sdp_mline_index: u32 },
+    /// Handled by the signalling server, which then relays only within the room.
+    Join { room: String },
 }
 
 #[tokio::main]
@@ -41,6 +43,16 @@ async fn main() {
         Ok((mut ws_stream, _)) => {
             info!("Connected to signaling server at {}", signaling_url);
 
+            // Optional first argument: the signalling room the vtk-cube joined with --room
+            if let Some(room) = std::env::args().nth(1) {
+                let join_msg = serde_json::to_string(&SignalMessage::Join { room: room.clone() }).unwrap();
+                if let Err(e) = ws_stream.send(Message::Text(join_msg)).await {
+                    log::error!("Failed to join room {}: {}", room, e);
+                    return;
+                }
+                info!("Joined signalling room {}", room);
+            }
+
             // Add a small delay to allow the C++ server to connect to the signaling server first
             info!("Waiting for 3 seconds before sending offer...");
             tokio::time::sleep(tokio::time::Duration::from_secs(3)).await;
@@ -259,6 +271,9 @@ async fn main() {
                                         pc.add_ice_candidate(ice).await.expect("add_ice_candidate failed");
                                         info!("ICE candidate added successfully");
                                     }
+                                    SignalMessage::Join { .. } => {
+                                        log::warn!("Received Join from signaling server; the server should not relay it");
+                                    }
                                     // Removed the unreachable '_' arm as SignalMessage is an enum with fixed variants.
                                     // If new variants are added to SignalMessage and not handled, the compiler will warn.
                                 }
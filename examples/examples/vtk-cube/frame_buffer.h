@@ -0,0 +1,73 @@
+// Reusable, SIMD-aligned frame buffers for the WebRTC streaming path
+#ifndef VTK_CUBE_FRAME_BUFFER_H
+#define VTK_CUBE_FRAME_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+// Cache-line alignment also satisfies every SSE/AVX2/NEON load and store.
+constexpr size_t kFrameBufferAlignment = 64;
+
+// Heap buffer that is aligned to kFrameBufferAlignment and only reallocates
+// when it has to grow, so per-frame resize() calls are free in steady state.
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t size) { resize(size); }
+
+    uint8_t* data() { return data_.get(); }
+    const uint8_t* data() const { return data_.get(); }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+    void resize(size_t size) {
+        if (size > capacity_) {
+            size_t capacity = (size + kFrameBufferAlignment - 1) / kFrameBufferAlignment * kFrameBufferAlignment;
+            data_.reset(static_cast<uint8_t*>(::operator new(capacity, std::align_val_t(kFrameBufferAlignment))));
+            capacity_ = capacity;
+        }
+        size_ = size;
+    }
+
+private:
+    struct AlignedDelete {
+        void operator()(uint8_t* p) const { ::operator delete(p, std::align_val_t(kFrameBufferAlignment)); }
+    };
+    std::unique_ptr<uint8_t[], AlignedDelete> data_;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
+// Tightly packed I420 frame (Y plane, then U, then V), the layout
+// webrtc_session_send_frame expects.
+struct Yuv420Frame {
+    AlignedBuffer data;
+    int width = 0;
+    int height = 0;
+    int64_t timestamp_us = 0; // capture time of the render this frame came from
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        data.resize(static_cast<size_t>(w) * h + 2 * chroma_stride() * ((static_cast<size_t>(h) + 1) / 2));
+    }
+    size_t chroma_stride() const { return (static_cast<size_t>(width) + 1) / 2; }
+    uint8_t* y() { return data.data(); }
+    uint8_t* u() { return y() + static_cast<size_t>(width) * height; }
+    uint8_t* v() { return u() + chroma_stride() * ((static_cast<size_t>(height) + 1) / 2); }
+    const uint8_t* y() const { return data.data(); }
+    const uint8_t* u() const { return y() + static_cast<size_t>(width) * height; }
+    const uint8_t* v() const { return u() + chroma_stride() * ((static_cast<size_t>(height) + 1) / 2); }
+};
+
+// RGBA pixels as read back from OpenGL: rows are bottom-up.
+struct RgbaFrame {
+    AlignedBuffer pixels;
+    int width = 0;
+    int height = 0;
+    int64_t timestamp_us = 0;
+};
+
+#endif // VTK_CUBE_FRAME_BUFFER_H
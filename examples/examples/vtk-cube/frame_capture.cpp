@@ -0,0 +1,38 @@
+// Render window readback + I420 conversion for the WebRTC pipeline
+#include "frame_capture.h"
+
+#include <vtkRenderWindow.h>
+
+RgbaReadback::RgbaReadback(vtkRenderWindow* window) : window_(window) {
+    pixels_->SetNumberOfComponents(4);
+}
+
+bool RgbaReadback::read(int64_t timestamp_us, RgbaFrame& out) {
+    const int* size = window_->GetSize();
+    const int width = size[0];
+    const int height = size[1];
+    if (width <= 0 || height <= 0) return false;
+
+    const size_t bytes = static_cast<size_t>(width) * height * 4;
+    out.pixels.resize(bytes);
+    out.width = width;
+    out.height = height;
+    out.timestamp_us = timestamp_us;
+
+    // Hand VTK our buffer (save=1: VTK must not free it). The readback sees an
+    // array of exactly the right size and writes into it instead of allocating.
+    pixels_->SetArray(out.pixels.data(), static_cast<vtkIdType>(bytes), 1);
+    window_->GetRGBACharPixelData(0, 0, width - 1, height - 1, 1, pixels_);
+    return true;
+}
+
+void convert_to_i420(const RgbaFrame& in, Yuv420Frame& out, const YuvConvertOptions& options) {
+    if (out.width != in.width || out.height != in.height) out.resize(in.width, in.height);
+    out.timestamp_us = in.timestamp_us;
+
+    // OpenGL rows are bottom-up; a negative stride converts them into a top-down frame.
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(in.width) * 4;
+    const ptrdiff_t chroma_stride = static_cast<ptrdiff_t>(out.chroma_stride());
+    rgb_to_yuv420p(in.pixels.data() + (in.height - 1) * stride, -stride, RgbLayout::RGBA32, in.width, in.height,
+                   out.y(), in.width, out.u(), chroma_stride, out.v(), chroma_stride, options);
+}
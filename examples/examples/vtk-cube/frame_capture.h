@@ -0,0 +1,33 @@
+// Render window readback + I420 conversion for the WebRTC pipeline
+#ifndef VTK_CUBE_FRAME_CAPTURE_H
+#define VTK_CUBE_FRAME_CAPTURE_H
+
+#include "frame_buffer.h"
+#include "yuv_convert.h"
+
+#include <vtkNew.h>
+#include <vtkUnsignedCharArray.h>
+
+class vtkRenderWindow;
+
+// Reads the render window's pixels straight into a caller-provided, aligned
+// buffer. The buffer is only reallocated when the window is resized, so
+// steady-state readback does no heap allocation and exactly one pixel copy
+// (the GPU readback itself).
+class RgbaReadback {
+public:
+    explicit RgbaReadback(vtkRenderWindow* window);
+
+    // Reads the frame the window has just rendered, stamped with the time that
+    // render started. Returns false if the window has no drawable area yet.
+    bool read(int64_t timestamp_us, RgbaFrame& out);
+
+private:
+    vtkRenderWindow* window_;
+    vtkNew<vtkUnsignedCharArray> pixels_; // wraps the output buffer for VTK
+};
+
+// Converts a bottom-up RGBA readback into a top-down I420 frame.
+void convert_to_i420(const RgbaFrame& in, Yuv420Frame& out, const YuvConvertOptions& options);
+
+#endif // VTK_CUBE_FRAME_CAPTURE_H
@@ -0,0 +1,64 @@
+// Deadline-based frame pacing for the WebRTC streaming loop
+#ifndef VTK_CUBE_FRAME_PACER_H
+#define VTK_CUBE_FRAME_PACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// Schedules frames on a fixed grid of steady_clock deadlines (1/fps apart).
+// Work time does not add to the period the way a fixed sleep does. When the
+// loop falls a whole frame or more behind, the missed slots are skipped instead
+// of being rendered back to back, so latency does not pile up.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FramePacer(double fps)
+        : interval_(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(1.0 / (fps > 0.0 ? fps : 30.0)))) {}
+
+    // Sleeps until the next frame slot and returns the time the frame starts.
+    Clock::time_point wait_next_frame() {
+        Clock::time_point now = Clock::now();
+        if (!started_) {
+            next_ = now;
+            started_ = true;
+        }
+        if (now < next_) {
+            std::this_thread::sleep_until(next_);
+            now = Clock::now();
+        } else if (now - next_ >= interval_) {
+            const auto missed = (now - next_) / interval_;
+            skipped_ += static_cast<uint64_t>(missed);
+            next_ += missed * interval_;
+        }
+        next_ += interval_;
+        return now;
+    }
+
+    // For event-driven loops: after an idle wait, restart the grid at the
+    // current time instead of counting the idle period as skipped frames.
+    void resync() {
+        const Clock::time_point now = Clock::now();
+        if (!started_ || now > next_) {
+            next_ = now;
+            started_ = true;
+        }
+    }
+
+    Clock::duration interval() const { return interval_; }
+    uint64_t skipped() const { return skipped_; }
+
+    static int64_t to_microseconds(Clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+    }
+
+private:
+    Clock::duration interval_;
+    Clock::time_point next_;
+    bool started_ = false;
+    uint64_t skipped_ = 0;
+};
+
+#endif // VTK_CUBE_FRAME_PACER_H
@@ -0,0 +1,118 @@
+// Benchmark for the library's frame path as vtk-cube drives it: frames/sec and encode
+// ms/frame through webrtc_c_api.h at several resolutions. No viewer is connected, so
+// frames are encoded but not packetized; `cargo bench -p webrtc --bench c_api_frame_path`
+// covers RTP, SRTP, packets/sec and allocations over a loopback connection.
+#include "webrtc_c_api.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Resolution {
+    const char* name;
+    int width, height;
+};
+
+// Packed I420 frames of a gradient with a square moving across it, so the encoder
+// always sees motion.
+std::vector<std::vector<uint8_t>> test_frames(int width, int height, int count) {
+    const size_t w = width, h = height, cw = (w + 1) / 2, ch = (h + 1) / 2;
+    const size_t side = h / 4;
+    std::vector<std::vector<uint8_t>> frames(count);
+    for (int n = 0; n < count; ++n) {
+        auto& frame = frames[n];
+        frame.assign(w * h + 2 * cw * ch, 128);
+        for (size_t y = 0; y < h; ++y)
+            for (size_t x = 0; x < w; ++x) frame[y * w + x] = static_cast<uint8_t>((x + y) * 255 / (w + h));
+        const size_t left = n * (w - side) / count;
+        for (size_t y = h / 2 - side / 2; y < h / 2 + side / 2; ++y)
+            std::fill_n(frame.begin() + y * w + left, side, 235);
+    }
+    return frames;
+}
+
+struct Result {
+    double fps = 0;
+    double encode_p50_ms = 0, encode_p99_ms = 0;
+    uint64_t encoded = 0, dropped = 0;
+};
+
+bool bench(const Resolution& r, const std::string& config, int frame_count, Result& out) {
+    webrtc_session_t* session = webrtc_session_create(config.c_str(), nullptr, nullptr);
+    if (!session) return false;
+    const auto frames = test_frames(r.width, r.height, 16);
+    // Capture timestamps advance at 30 fps whatever the send rate, so rate control
+    // behaves as it does in vtk-cube.
+    auto send = [&](int n) {
+        webrtc_session_send_frame_with_timestamp(session, r.width, r.height, frames[n % frames.size()].data(),
+                                                 int64_t(n) * 33333);
+    };
+    for (int n = 0; n < 10; ++n) send(n); // warm up the encoder
+    webrtc_session_stats_t stats;
+    webrtc_session_get_stats(session, &stats); // starts a new encode time window
+    const uint64_t encoded = stats.frames_encoded, dropped = stats.frames_dropped;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 10; n < 10 + frame_count; ++n) send(n);
+    auto end = std::chrono::steady_clock::now();
+    // With async_encode, queued frames are still being encoded; stats then cover fewer
+    // frames than were sent.
+    webrtc_session_get_stats(session, &stats);
+    out.fps = frame_count / std::chrono::duration<double>(end - start).count();
+    out.encode_p50_ms = stats.encode_time_p50_us / 1e3;
+    out.encode_p99_ms = stats.encode_time_p99_us / 1e3;
+    out.encoded = stats.frames_encoded - encoded;
+    out.dropped = stats.frames_dropped - dropped;
+    webrtc_session_destroy(session);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int frame_count = 300;
+    std::string codec = "vp9";
+    bool async_encode = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) frame_count = std::max(1, std::atoi(argv[++i]));
+        if (arg == "--codec" && i + 1 < argc) codec = argv[++i];
+        if (arg == "--async-encode") async_encode = true;
+        if (arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [--frames N] [--codec vp8|vp9] [--async-encode]\n";
+            return 0;
+        }
+    }
+    std::string config = R"({"encoder": {"codec": ")" + codec + R"(", "bitrate_kbps": 2500})";
+    if (async_encode) config += R"(, "async_encode": {"drop_policy": "drop_oldest"})";
+    config += "}";
+
+    const Resolution resolutions[] = {
+        {"640x480", 640, 480},
+        {"1280x720", 1280, 720},
+        {"1920x1080", 1920, 1080},
+    };
+
+    std::cout << codec << (async_encode ? ", async encode" : "") << ", " << frame_count << " frames\n";
+    std::cout << std::left << std::setw(12) << "resolution" << std::right << std::setw(12) << "frames/s"
+              << std::setw(14) << "encode p50" << std::setw(14) << "encode p99" << std::setw(10) << "encoded"
+              << std::setw(10) << "dropped" << "\n";
+    for (const auto& r : resolutions) {
+        Result result;
+        if (!bench(r, config, frame_count, result)) {
+            std::cerr << "Failed to create session with config " << config << "\n";
+            return 1;
+        }
+        std::cout << std::left << std::setw(12) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << result.fps << std::setprecision(2) << std::setw(11) << result.encode_p50_ms
+                  << " ms" << std::setw(11) << result.encode_p99_ms << " ms" << std::setw(10) << result.encoded
+                  << std::setw(10) << result.dropped << "\n";
+    }
+    return 0;
+}
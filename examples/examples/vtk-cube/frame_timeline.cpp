@@ -0,0 +1,110 @@
+// Glass-to-glass latency: per-frame pipeline timestamps joined with the browser's frame reports
+#include "frame_timeline.h"
+
+#include "async_logger.h"
+#include "webrtc_c_api.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include <nlohmann/json.hpp>
+
+namespace {
+
+// The browser's capture time estimate is rounded, and off by its clock offset estimate
+constexpr int64_t kMatchToleranceUs = 5000;
+
+const char* const kMetricNames[] = {"render", "convert", "encode", "network", "decode", "display", "total"};
+
+double percentile_ms(std::vector<int64_t>& sorted, double p) {
+    const size_t i = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+} // namespace
+
+void FrameTimeline::begin(int64_t capture_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_[next_frame_] = Frame{capture_us, -1, -1, -1};
+    next_frame_ = (next_frame_ + 1) % frames_.size();
+}
+
+void FrameTimeline::mark(int64_t capture_us, Stage stage, int64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Frame* frame = find(capture_us, 0);
+    if (!frame) return;
+    switch (stage) {
+    case Stage::Rendered: frame->rendered_us = now_us; break;
+    case Stage::Converted: frame->converted_us = now_us; break;
+    case Stage::Sent: frame->sent_us = now_us; break;
+    }
+}
+
+FrameTimeline::Frame* FrameTimeline::find(int64_t capture_us, int64_t tolerance_us) {
+    Frame* best = nullptr;
+    for (Frame& frame : frames_) {
+        if (frame.capture_us < 0) continue;
+        const int64_t distance = std::llabs(frame.capture_us - capture_us);
+        if (distance <= tolerance_us && (!best || distance < std::llabs(best->capture_us - capture_us))) {
+            best = &frame;
+        }
+    }
+    return best;
+}
+
+bool FrameTimeline::report(const Report& report) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Frame* frame = find(report.capture_us, kMatchToleranceUs);
+    if (!frame || frame->rendered_us < 0 || frame->converted_us < 0 || frame->sent_us < 0) {
+        ++unmatched_;
+        return false;
+    }
+    const int64_t values[kMetricCount] = {
+        frame->rendered_us - frame->capture_us,   frame->converted_us - frame->rendered_us,
+        frame->sent_us - frame->converted_us,     report.received_us - frame->sent_us,
+        report.decoded_us - report.received_us,   report.displayed_us - report.decoded_us,
+        report.displayed_us - frame->capture_us,
+    };
+    for (int m = 0; m < kMetricCount; ++m) {
+        if (samples_[m].size() < kWindow) samples_[m].push_back(values[m]);
+        else samples_[m][next_sample_] = values[m];
+    }
+    next_sample_ = (next_sample_ + 1) % kWindow;
+    // Each frame is reported once
+    frame->capture_us = -1;
+    ++reported_;
+    return true;
+}
+
+bool FrameTimeline::report_json(const std::string& message) {
+    const nlohmann::json j = nlohmann::json::parse(message, nullptr, false);
+    if (!j.is_object() || j.value("type", "") != "frame_timing") return false;
+    // Unix milliseconds -> library clock microseconds
+    const int64_t unix_offset_us = webrtc_monotonic_to_unix_us(0);
+    const auto to_library_us = [&](const char* key) {
+        return static_cast<int64_t>(std::llround(j.value(key, 0.0) * 1000.0)) - unix_offset_us;
+    };
+    Report r;
+    r.capture_us = to_library_us("capture_ms");
+    r.received_us = to_library_us("received_ms");
+    r.decoded_us = to_library_us("decoded_ms");
+    r.displayed_us = to_library_us("displayed_ms");
+    if (!report(r)) LOG_DEBUG("[WebRTC][Latency] No frame captured at ", r.capture_us, "us");
+    return true;
+}
+
+std::string FrameTimeline::summary() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reported_ == summarized_) return "";
+    summarized_ = reported_;
+    std::string line;
+    for (int m = 0; m < kMetricCount; ++m) {
+        std::vector<int64_t> sorted = samples_[m];
+        std::sort(sorted.begin(), sorted.end());
+        append_log_args(line, m > 0 ? " " : "", kMetricNames[m], " ", LogFixed{percentile_ms(sorted, 0.50), 1}, "/",
+                        LogFixed{percentile_ms(sorted, 0.95), 1}, "/", LogFixed{percentile_ms(sorted, 0.99), 1});
+    }
+    append_log_args(line, " ms p50/p95/p99 over ", samples_[kTotal].size(), " frames, ", unmatched_, " unmatched");
+    return line;
+}
@@ -0,0 +1,68 @@
+// Glass-to-glass latency: per-frame pipeline timestamps joined with the browser's frame reports
+#ifndef VTK_CUBE_FRAME_TIMELINE_H
+#define VTK_CUBE_FRAME_TIMELINE_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records when each frame, keyed by its capture timestamp, leaves each pipeline stage.
+// The browser reports when it received, decoded and displayed a frame, with the frame's
+// capture time as it learned it from abs-capture-time; report() matches that to the
+// recorded frame and adds one sample per stage to rolling windows. All times are
+// microseconds on the webrtc_monotonic_time_us clock. Methods may be called from any thread.
+class FrameTimeline {
+public:
+    enum class Stage { Rendered, Converted, Sent };
+
+    // Starts a frame captured (its render begun) at capture_us.
+    void begin(int64_t capture_us);
+    void mark(int64_t capture_us, Stage stage, int64_t now_us);
+
+    struct Report {
+        int64_t capture_us = 0; // the browser's estimate of the frame's capture time
+        int64_t received_us = 0;
+        int64_t decoded_us = 0;
+        int64_t displayed_us = 0;
+    };
+
+    // Adds the report's samples. False if no recent frame was captured at that time.
+    bool report(const Report& report);
+
+    // Parses a {"type": "frame_timing", ...} message from the browser's input channel and
+    // reports it. Browser times are Unix milliseconds, converted with
+    // webrtc_monotonic_to_unix_us. False if the message is not a frame timing report.
+    bool report_json(const std::string& message);
+
+    // One line of p50/p95/p99 per stage over the last kWindow reported frames, or an empty
+    // string if nothing was reported since the previous summary.
+    std::string summary();
+
+    static constexpr size_t kWindow = 600;
+
+private:
+    enum Metric { kRender, kConvert, kEncode, kNetwork, kDecode, kDisplay, kTotal, kMetricCount };
+
+    struct Frame {
+        int64_t capture_us = -1;
+        int64_t rendered_us = -1;
+        int64_t converted_us = -1;
+        int64_t sent_us = -1;
+    };
+
+    Frame* find(int64_t capture_us, int64_t tolerance_us);
+
+    std::mutex mutex_;
+    // Frames still in the pipeline or on their way to the browser, oldest overwritten first
+    std::array<Frame, 128> frames_{};
+    size_t next_frame_ = 0;
+    std::array<std::vector<int64_t>, kMetricCount> samples_;
+    size_t next_sample_ = 0;
+    uint64_t reported_ = 0;
+    uint64_t unmatched_ = 0;
+    uint64_t summarized_ = 0;
+};
+
+#endif // VTK_CUBE_FRAME_TIMELINE_H
@@ -0,0 +1,225 @@
+// GPU-side RGB -> I420 conversion with asynchronous PBO readback
+#include "gpu_frame_capture.h"
+#include "yuv_convert_internal.h"
+#include "async_logger.h"
+
+#include <vtkOpenGLFramebufferObject.h>
+#include <vtkOpenGLQuadHelper.h>
+#include <vtkOpenGLRenderWindow.h>
+#include <vtkOpenGLShaderCache.h>
+#include <vtkOpenGLState.h>
+#include <vtkShaderProgram.h>
+#include <vtkTextureObject.h>
+#include "vtk_glew.h"
+
+#include <cstring>
+
+namespace {
+
+// Each output texel is one byte of the packed I420 frame, in glReadPixels
+// order: byte index = row * width + x. Rows [0, H) hold Y, the rest hold U
+// then V. The source color buffer is bottom-up, so video row y samples GL row
+// H - 1 - y. Chroma samples the corner shared by a 2x2 block and lets linear
+// filtering do the average.
+const char* kConvertShader = R"(
+//VTK::System::Dec
+in vec2 texCoord;
+uniform sampler2D source;
+uniform ivec2 frameSize;
+uniform vec3 yCoeffs;
+uniform vec3 uCoeffs;
+uniform vec3 vCoeffs;
+uniform float yOffset;
+//VTK::Output::Dec
+
+vec3 fetchRgb(vec2 topDown)
+{
+  vec2 uv = vec2(topDown.x, float(frameSize.y) - topDown.y) / vec2(frameSize);
+  return texture(source, uv).rgb * 255.0;
+}
+
+void main()
+{
+  int w = frameSize.x;
+  int h = frameSize.y;
+  int x = int(gl_FragCoord.x);
+  int row = int(gl_FragCoord.y);
+  float value = 0.0;
+  if (row < h)
+  {
+    value = dot(fetchRgb(vec2(x, row) + 0.5), yCoeffs) + yOffset;
+  }
+  else
+  {
+    int cw = (w + 1) / 2;
+    int planeSize = cw * ((h + 1) / 2);
+    int i = (row - h) * w + x;
+    int plane = i / planeSize;
+    int j = i - plane * planeSize;
+    int cy = j / cw;
+    int cx = j - cy * cw;
+    vec3 rgb = fetchRgb(vec2(2 * cx + 1, 2 * cy + 1));
+    if (plane == 0) value = dot(rgb, uCoeffs) + 128.0;
+    else if (plane == 1) value = dot(rgb, vCoeffs) + 128.0;
+  }
+  gl_FragData[0] = vec4(clamp(floor(value + 0.5), 0.0, 255.0) / 255.0, 0.0, 0.0, 1.0);
+}
+)";
+
+// Waiting longer than this for a readback means the GPU has hung; give up on the frame.
+constexpr GLuint64 kFenceTimeoutNs = 100000000;
+
+} // namespace
+
+std::unique_ptr<GpuFrameCapture> GpuFrameCapture::create(vtkRenderWindow* window, const YuvConvertOptions& options,
+                                                         int pbo_count) {
+    vtkOpenGLRenderWindow* gl_window = vtkOpenGLRenderWindow::SafeDownCast(window);
+    if (!gl_window) {
+        LOG_ERROR("[GpuFrameCapture] Render window is not an OpenGL window");
+        return nullptr;
+    }
+    std::unique_ptr<GpuFrameCapture> capture(new GpuFrameCapture(gl_window, options, pbo_count));
+    if (!capture->initialize()) return nullptr;
+    return capture;
+}
+
+GpuFrameCapture::GpuFrameCapture(vtkOpenGLRenderWindow* window, const YuvConvertOptions& options, int pbo_count)
+    : window_(window), options_(options), ring_(pbo_count < 2 ? 2 : pbo_count) {}
+
+GpuFrameCapture::~GpuFrameCapture() {
+    window_->MakeCurrent();
+    release_readbacks();
+    if (quad_) quad_->ReleaseGraphicsResources(window_);
+    fbo_->ReleaseGraphicsResources(window_);
+    target_->ReleaseGraphicsResources(window_);
+}
+
+bool GpuFrameCapture::initialize() {
+    window_->Initialize();
+    window_->MakeCurrent();
+    quad_ = std::make_unique<vtkOpenGLQuadHelper>(window_, nullptr, kConvertShader, "");
+    if (!quad_->Program) {
+        LOG_ERROR("[GpuFrameCapture] Failed to build the I420 conversion shader");
+        return false;
+    }
+    fbo_->SetContext(window_);
+    target_->SetContext(window_);
+    return true;
+}
+
+void GpuFrameCapture::release_readbacks() {
+    for (auto& r : ring_) {
+        if (r.fence) glDeleteSync(r.fence);
+        if (r.pbo) glDeleteBuffers(1, &r.pbo);
+        r = Readback();
+    }
+    head_ = 0;
+    inflight_ = 0;
+}
+
+void GpuFrameCapture::resize(int width, int height) {
+    release_readbacks();
+    width_ = width;
+    height_ = height;
+    // Enough width-byte rows to hold both chroma planes below the Y plane.
+    const size_t chroma_bytes = 2 * ((static_cast<size_t>(width) + 1) / 2) * ((static_cast<size_t>(height) + 1) / 2);
+    target_height_ = height + static_cast<int>((chroma_bytes + width - 1) / width);
+
+    target_->ReleaseGraphicsResources(window_);
+    target_->SetContext(window_);
+    target_->Create2D(width, target_height_, 1, VTK_UNSIGNED_CHAR, false);
+
+    const GLsizeiptr bytes = static_cast<GLsizeiptr>(width) * target_height_;
+    for (auto& r : ring_) {
+        glGenBuffers(1, &r.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool GpuFrameCapture::capture(int64_t timestamp_us, Yuv420Frame& out) {
+    vtkOpenGLFramebufferObject* display = window_->GetDisplayFramebuffer();
+    vtkTextureObject* color = display ? display->GetColorAttachmentAsTextureObject(0) : nullptr;
+    if (!color) return false;
+    const int width = static_cast<int>(color->GetWidth());
+    const int height = static_cast<int>(color->GetHeight());
+    if (width <= 0 || height <= 0) return false;
+
+    window_->MakeCurrent();
+    if (width != width_ || height != height_) resize(width, height);
+
+    vtkOpenGLState* state = window_->GetState();
+    const YuvCoefficients& c = yuv_coefficients(options_.matrix, options_.range);
+    const float y_coeffs[3] = {c.yr / 256.0f, c.yg / 256.0f, c.yb / 256.0f};
+    const float u_coeffs[3] = {c.ur / 256.0f, c.ug / 256.0f, c.ub / 256.0f};
+    const float v_coeffs[3] = {c.vr / 256.0f, c.vg / 256.0f, c.vb / 256.0f};
+    const int frame_size[2] = {width, height};
+
+    // Conversion pass: color buffer -> packed I420 render target.
+    {
+        vtkOpenGLState::ScopedglViewport viewport_saver(state);
+        vtkOpenGLState::ScopedglEnableDisable blend_saver(state, GL_BLEND);
+        vtkOpenGLState::ScopedglEnableDisable depth_saver(state, GL_DEPTH_TEST);
+        state->PushFramebufferBindings();
+        fbo_->Bind();
+        fbo_->AddColorAttachment(0, target_);
+        fbo_->ActivateDrawBuffer(0);
+        state->vtkglViewport(0, 0, width, target_height_);
+        state->vtkglDisable(GL_BLEND);
+        state->vtkglDisable(GL_DEPTH_TEST);
+
+        color->SetMinificationFilter(vtkTextureObject::Linear);
+        color->SetMagnificationFilter(vtkTextureObject::Linear);
+        color->SetWrapS(vtkTextureObject::ClampToEdge);
+        color->SetWrapT(vtkTextureObject::ClampToEdge);
+        color->Activate();
+        window_->GetShaderCache()->ReadyShaderProgram(quad_->Program);
+        quad_->Program->SetUniformi("source", color->GetTextureUnit());
+        quad_->Program->SetUniform2i("frameSize", frame_size);
+        quad_->Program->SetUniform3f("yCoeffs", y_coeffs);
+        quad_->Program->SetUniform3f("uCoeffs", u_coeffs);
+        quad_->Program->SetUniform3f("vCoeffs", v_coeffs);
+        quad_->Program->SetUniformf("yOffset", static_cast<float>(c.y_bias >> 8));
+        quad_->Render();
+        color->Deactivate();
+
+        // Start the asynchronous readback into the next PBO of the ring.
+        Readback& r = ring_[head_];
+        fbo_->Bind(GL_READ_FRAMEBUFFER);
+        fbo_->ActivateReadBuffer(0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+        glReadPixels(0, 0, width, target_height_, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        r.timestamp_us = timestamp_us;
+        state->PopFramebufferBindings();
+    }
+    head_ = (head_ + 1) % ring_.size();
+    if (++inflight_ < ring_.size()) return false;
+
+    // The ring is full: the oldest readback was issued ring_.size() - 1 frames ago.
+    Readback& oldest = ring_[head_];
+    --inflight_;
+    GLenum wait = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeoutNs);
+    glDeleteSync(oldest.fence);
+    oldest.fence = nullptr;
+    if (wait == GL_TIMEOUT_EXPIRED || wait == GL_WAIT_FAILED) {
+        LOG_WARN("[GpuFrameCapture] Readback timed out, dropping frame");
+        return false;
+    }
+
+    if (out.width != width || out.height != height) out.resize(width, height);
+    out.timestamp_us = oldest.timestamp_us;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, oldest.pbo);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(out.data.size()),
+                                          GL_MAP_READ_BIT);
+    if (mapped) {
+        std::memcpy(out.data.data(), mapped, out.data.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return mapped != nullptr;
+}
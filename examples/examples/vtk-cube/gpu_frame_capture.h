@@ -0,0 +1,66 @@
+// GPU-side RGB -> I420 conversion with asynchronous PBO readback
+#ifndef VTK_CUBE_GPU_FRAME_CAPTURE_H
+#define VTK_CUBE_GPU_FRAME_CAPTURE_H
+
+#include "frame_buffer.h"
+#include "yuv_convert.h"
+
+#include <vtkNew.h>
+
+#include <memory>
+#include <vector>
+
+class vtkOpenGLFramebufferObject;
+class vtkOpenGLQuadHelper;
+class vtkOpenGLRenderWindow;
+class vtkRenderWindow;
+class vtkTextureObject;
+struct __GLsync;
+
+// Converts the window's color buffer to I420 in a fragment shader, writing all
+// three planes into one 8-bit render target, and reads it back through a ring
+// of pixel buffer objects. The readback of frame N completes while frame N+1
+// renders, and 1.5 bytes/pixel cross the bus instead of 4 (RGBA).
+//
+// The price is latency: capture() returns the frame rendered pbo_count - 1
+// calls earlier, and nothing during the first pbo_count - 1 calls.
+class GpuFrameCapture {
+public:
+    // Returns nullptr if the window is not an OpenGL window or the shader
+    // cannot be built, in which case callers should fall back to RgbaReadback
+    // and convert_to_i420.
+    static std::unique_ptr<GpuFrameCapture> create(vtkRenderWindow* window, const YuvConvertOptions& options,
+                                                   int pbo_count = 3);
+    ~GpuFrameCapture();
+
+    // Called right after the window rendered, with the time that render
+    // started. Fills out with an earlier frame (stamped with its own render
+    // time) and returns true, or returns false while readbacks are in flight.
+    bool capture(int64_t timestamp_us, Yuv420Frame& out);
+
+private:
+    GpuFrameCapture(vtkOpenGLRenderWindow* window, const YuvConvertOptions& options, int pbo_count);
+    bool initialize();
+    void resize(int width, int height);
+    void release_readbacks();
+
+    struct Readback {
+        unsigned int pbo = 0;
+        __GLsync* fence = nullptr;
+        int64_t timestamp_us = 0;
+    };
+
+    vtkOpenGLRenderWindow* window_;
+    YuvConvertOptions options_;
+    vtkNew<vtkOpenGLFramebufferObject> fbo_;
+    vtkNew<vtkTextureObject> target_; // width x target_height_ R8: Y rows, then U and V
+    std::unique_ptr<vtkOpenGLQuadHelper> quad_;
+    std::vector<Readback> ring_;
+    size_t head_ = 0;     // next ring slot to read into
+    size_t inflight_ = 0; // readbacks issued but not yet mapped
+    int width_ = 0;
+    int height_ = 0;
+    int target_height_ = 0;
+};
+
+#endif // VTK_CUBE_GPU_FRAME_CAPTURE_H
@@ -0,0 +1,247 @@
+// Hardware H.264/H.265 encoder backends for the WebRTC library, through FFmpeg's libavcodec
+#include "hw_encoder.h"
+
+#include "async_logger.h"
+#include "webrtc_c_api.h"
+
+#if defined(VTK_CUBE_HAVE_LIBAVCODEC)
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+struct BackendInfo {
+    std::string name;
+    int gpu_index;
+    double fps;
+};
+
+struct HwEncoder {
+    AVCodecContext* ctx = nullptr;
+    // System memory input: wraps the library's planes, or the NV12 staging copy for VAAPI
+    AVFrame* frame = nullptr;
+    AVFrame* hw_frame = nullptr; // VAAPI surface
+    AVPacket* packet = nullptr;
+    AVBufferRef* device = nullptr;
+    bool vaapi = false;
+
+    ~HwEncoder() {
+        av_packet_free(&packet);
+        av_frame_free(&hw_frame);
+        av_frame_free(&frame);
+        avcodec_free_context(&ctx);
+        av_buffer_unref(&device);
+    }
+};
+
+std::string av_error(int err) {
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(err, buf, sizeof(buf));
+    return buf;
+}
+
+const char* encoder_name(const std::string& backend, int codec) {
+    const bool hevc = codec == WEBRTC_CODEC_H265;
+    if (backend == "nvenc") return hevc ? "hevc_nvenc" : "h264_nvenc";
+    if (backend == "vaapi") return hevc ? "hevc_vaapi" : "h264_vaapi";
+    if (backend == "videotoolbox") return hevc ? "hevc_videotoolbox" : "h264_videotoolbox";
+    return nullptr;
+}
+
+// No B-frames and no lookahead, so every frame in gives one packet out
+void set_low_latency_options(AVCodecContext* c, const BackendInfo& info) {
+    c->max_b_frames = 0;
+    c->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    if (info.name == "nvenc") {
+        av_opt_set(c->priv_data, "preset", "p1", 0);
+        av_opt_set(c->priv_data, "tune", "ull", 0);
+        av_opt_set(c->priv_data, "rc", "cbr", 0);
+        av_opt_set_int(c->priv_data, "zerolatency", 1, 0);
+        // Forced keyframes become IDR frames, which a viewer can start decoding from
+        av_opt_set_int(c->priv_data, "forced-idr", 1, 0);
+        if (info.gpu_index >= 0) av_opt_set_int(c->priv_data, "gpu", info.gpu_index, 0);
+    } else if (info.name == "vaapi") {
+        av_opt_set(c->priv_data, "rc_mode", "CBR", 0);
+    } else if (info.name == "videotoolbox") {
+        av_opt_set_int(c->priv_data, "realtime", 1, 0);
+        av_opt_set_int(c->priv_data, "allow_sw", 0, 0);
+    }
+}
+
+// VAAPI encodes from surfaces: frames are repacked to NV12 in `frame` and uploaded
+bool init_vaapi(HwEncoder& e, const BackendInfo& info) {
+    const std::string node = "/dev/dri/renderD" + std::to_string(128 + std::max(0, info.gpu_index));
+    int err = av_hwdevice_ctx_create(&e.device, AV_HWDEVICE_TYPE_VAAPI, node.c_str(), nullptr, 0);
+    if (err < 0) {
+        LOG_ERROR("[Encoder] Failed to open VAAPI device ", node, ": ", av_error(err));
+        return false;
+    }
+    AVBufferRef* frames = av_hwframe_ctx_alloc(e.device);
+    if (!frames) return false;
+    auto* frames_ctx = reinterpret_cast<AVHWFramesContext*>(frames->data);
+    frames_ctx->format = AV_PIX_FMT_VAAPI;
+    frames_ctx->sw_format = AV_PIX_FMT_NV12;
+    frames_ctx->width = e.ctx->width;
+    frames_ctx->height = e.ctx->height;
+    frames_ctx->initial_pool_size = 4;
+    err = av_hwframe_ctx_init(frames);
+    if (err < 0) {
+        LOG_ERROR("[Encoder] Failed to create VAAPI surfaces: ", av_error(err));
+        av_buffer_unref(&frames);
+        return false;
+    }
+    e.ctx->hw_frames_ctx = frames; // takes the reference
+    e.ctx->pix_fmt = AV_PIX_FMT_VAAPI;
+
+    e.frame->format = AV_PIX_FMT_NV12;
+    e.frame->width = e.ctx->width;
+    e.frame->height = e.ctx->height;
+    e.hw_frame = av_frame_alloc();
+    e.vaapi = true;
+    return e.hw_frame && av_frame_get_buffer(e.frame, 0) >= 0;
+}
+
+void* create(const webrtc_encoder_params_t* params, void* user_data) {
+    const auto& info = *static_cast<const BackendInfo*>(user_data);
+    const char* name = encoder_name(info.name, params->codec);
+    if (!name || (params->codec != WEBRTC_CODEC_H264 && params->codec != WEBRTC_CODEC_H265)) {
+        LOG_ERROR("[Encoder] ", info.name, " only encodes h264 and h265");
+        return nullptr;
+    }
+    const AVCodec* codec = avcodec_find_encoder_by_name(name);
+    if (!codec) {
+        LOG_ERROR("[Encoder] libavcodec was built without ", name);
+        return nullptr;
+    }
+    auto e = std::make_unique<HwEncoder>();
+    e->ctx = avcodec_alloc_context3(codec);
+    e->frame = av_frame_alloc();
+    e->packet = av_packet_alloc();
+    if (!e->ctx || !e->frame || !e->packet) return nullptr;
+
+    AVCodecContext* c = e->ctx;
+    c->width = static_cast<int>(params->width);
+    c->height = static_cast<int>(params->height);
+    c->pix_fmt = AV_PIX_FMT_YUV420P;
+    c->time_base = AVRational{1, 1000000}; // the library's pts are microseconds
+    c->framerate = av_d2q(info.fps, 1000);
+    c->bit_rate = static_cast<int64_t>(params->bitrate_kbps) * 1000;
+    c->rc_max_rate = static_cast<int64_t>(params->max_bitrate_kbps) * 1000;
+    // Half a second of buffer: room for keyframes without letting latency grow
+    c->rc_buffer_size = static_cast<int>(c->rc_max_rate / 2);
+    // Without an interval, keyframes mostly come when the library forces them for a viewer
+    c->gop_size = params->keyframe_interval > 0 ? static_cast<int>(params->keyframe_interval)
+                                                : static_cast<int>(info.fps * 10);
+    if (info.name == "vaapi" && !init_vaapi(*e, info)) return nullptr;
+    set_low_latency_options(c, info);
+
+    const int err = avcodec_open2(c, codec, nullptr);
+    if (err < 0) {
+        LOG_ERROR("[Encoder] Failed to open ", name, ": ", av_error(err));
+        return nullptr;
+    }
+    LOG_INFO("[Encoder] ", name, " ", params->width, "x", params->height, " at ", params->bitrate_kbps, " kbps");
+    return e.release();
+}
+
+// I420 planes -> the NV12 staging frame
+void pack_nv12(const webrtc_video_frame_t& in, AVFrame* out) {
+    const int cw = (in.width + 1) / 2, ch = (in.height + 1) / 2;
+    for (int y = 0; y < in.height; ++y) {
+        std::memcpy(out->data[0] + y * out->linesize[0], in.planes[0] + y * in.strides[0], in.width);
+    }
+    for (int y = 0; y < ch; ++y) {
+        const uint8_t* u = in.planes[1] + y * in.strides[1];
+        const uint8_t* v = in.planes[2] + y * in.strides[2];
+        uint8_t* uv = out->data[1] + y * out->linesize[1];
+        for (int x = 0; x < cw; ++x) {
+            uv[2 * x] = u[x];
+            uv[2 * x + 1] = v[x];
+        }
+    }
+}
+
+int encode(void* encoder, const webrtc_video_frame_t* frame, webrtc_encoded_output_t output, void* output_context) {
+    auto& e = *static_cast<HwEncoder*>(encoder);
+    AVFrame* input = e.frame;
+    if (e.vaapi) {
+        int err = av_frame_make_writable(e.frame);
+        if (err >= 0) {
+            pack_nv12(*frame, e.frame);
+            av_frame_unref(e.hw_frame);
+            err = av_hwframe_get_buffer(e.ctx->hw_frames_ctx, e.hw_frame, 0);
+        }
+        if (err >= 0) err = av_hwframe_transfer_data(e.hw_frame, e.frame, 0);
+        if (err < 0) {
+            LOG_ERROR("[Encoder] VAAPI upload failed: ", av_error(err));
+            return -1;
+        }
+        input = e.hw_frame;
+    } else {
+        // Borrowed planes: libavcodec copies a frame it holds no reference to before queuing it
+        e.frame->format = AV_PIX_FMT_YUV420P;
+        e.frame->width = frame->width;
+        e.frame->height = frame->height;
+        for (int i = 0; i < 3; ++i) {
+            e.frame->data[i] = const_cast<uint8_t*>(frame->planes[i]);
+            e.frame->linesize[i] = frame->strides[i];
+        }
+    }
+    input->pts = frame->timestamp_us;
+    input->pict_type = (frame->flags & WEBRTC_FRAME_FLAG_KEYFRAME) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    int err = avcodec_send_frame(e.ctx, input);
+    if (!e.vaapi) std::fill(std::begin(e.frame->data), std::end(e.frame->data), nullptr);
+    if (err < 0) {
+        LOG_ERROR("[Encoder] Encode failed: ", av_error(err));
+        return -1;
+    }
+    while ((err = avcodec_receive_packet(e.ctx, e.packet)) >= 0) {
+        output(e.packet->data, static_cast<size_t>(e.packet->size), output_context);
+        av_packet_unref(e.packet);
+    }
+    return err == AVERROR(EAGAIN) || err == AVERROR_EOF ? 0 : -1;
+}
+
+// NVENC reconfigures itself on the next frame. VAAPI and VideoToolbox keep their opening
+// rate, so they register no set_bitrate.
+int set_bitrate(void* encoder, uint32_t bitrate_kbps) {
+    auto& e = *static_cast<HwEncoder*>(encoder);
+    const int64_t bit_rate = static_cast<int64_t>(bitrate_kbps) * 1000;
+    e.ctx->rc_max_rate = e.ctx->rc_max_rate * bit_rate / std::max<int64_t>(e.ctx->bit_rate, 1);
+    e.ctx->bit_rate = bit_rate;
+    return 0;
+}
+
+void destroy(void* encoder) {
+    delete static_cast<HwEncoder*>(encoder);
+}
+
+} // namespace
+
+bool register_hw_encoder(const std::string& name, int gpu_index, double fps) {
+    if (!encoder_name(name, WEBRTC_CODEC_H264)) {
+        LOG_ERROR("[Encoder] Unknown encoder ", name, "; use libvpx, nvenc, vaapi or videotoolbox");
+        return false;
+    }
+    // Registered for the life of the process, so user_data is never freed
+    auto* info = new BackendInfo{name, gpu_index, fps};
+    const webrtc_encoder_backend_t backend{create, encode, name == "nvenc" ? set_bitrate : nullptr, destroy, info};
+    return webrtc_register_encoder_backend(name.c_str(), &backend) == 0;
+}
+
+#else
+
+bool register_hw_encoder(const std::string& name, int, double) {
+    LOG_ERROR("[Encoder] --encoder ", name, " needs libavcodec, which was not found at build time");
+    return false;
+}
+
+#endif
@@ -0,0 +1,19 @@
+// Hardware H.264/H.265 encoder backends for the WebRTC library, through FFmpeg's libavcodec
+#ifndef VTK_CUBE_HW_ENCODER_H
+#define VTK_CUBE_HW_ENCODER_H
+
+#include <string>
+
+// Registers `name` (nvenc, vaapi or videotoolbox) with webrtc_register_encoder_backend, so
+// a session config with "backend": name encodes on that hardware encoder. gpu_index picks
+// the NVENC GPU or the VAAPI render node (/dev/dri/renderD128 + index); -1 is the default
+// device. fps is the nominal frame rate for rate control.
+//
+// Frames arrive as I420 in system memory, straight from the CPU converter or from the GPU
+// converter's pixel buffer objects. NVENC and VideoToolbox take them as they are; VAAPI
+// gets them repacked to NV12 and uploaded to a surface.
+//
+// Returns false if the name is unknown, or libavcodec was not found at build time.
+bool register_hw_encoder(const std::string& name, int gpu_index, double fps);
+
+#endif // VTK_CUBE_HW_ENCODER_H
@@ -5,51 +5,232 @@
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
 #include <vtkRenderer.h>
-#include <vtkWindowToImageFilter.h>
-#include <vtkImageExport.h>
 #include <vtkSmartPointer.h>
 #include <vtkCallbackCommand.h>
 #include <cstring>
 #include <iostream>
 #include <thread>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "webrtc_c_api.h"
+#include "frame_capture.h"
+#include "gpu_frame_capture.h"
+#include "frame_pacer.h"
+#include "frame_timeline.h"
+#include "hw_encoder.h"
+#include "offscreen_window.h"
+#include "remote_input.h"
+#include "spsc_queue.h"
+#include "stage_stats.h"
+#include "async_logger.h"
+#include "signalling_binary.h"
 #include <uWebSockets/App.h>
 #include <uWebSockets/WebSocket.h>
 #include <nlohmann/json.hpp> // For JSON parsing (add to project if not present)
 #include <ixwebsocket/IXWebSocket.h>
 
-// Stub for YUV conversion (replace with real implementation as needed)
-void rgb_to_yuv420p(const unsigned char* rgb, int width, int height, unsigned char* yuv) {
-    // This is a stub. In production, use a proper RGB to YUV420p conversion.
-    // For now, just zero the buffer.
-    size_t yuv_size = width * height * 3 / 2;
-    std::memset(yuv, 0, yuv_size);
-}
-
 struct WebRTCContext {
     webrtc_session_t* session = nullptr;
 };
 
-// Example input callback (stub)
+// Text messages on the input channel: the browser's frame timing reports. The client
+// sends input as binary events, which the render thread polls from the session instead
+// (see RemoteInput).
 void webrtc_input_callback(const void* data, int len, void* user_data) {
-    // Handle input events from the client (mouse, keyboard, etc.)
-    std::cout << "[WebRTC] Received input event of length " << len << std::endl;
+    auto* timeline = static_cast<FrameTimeline*>(user_data);
+    if (!timeline->report_json(std::string(static_cast<const char*>(data), len))) {
+        LOG_DEBUG("[WebRTC] Received text input message of length ", len);
+    }
 }
 
-void render_webrtc(WebRTCContext* ctx, int width, int height, const unsigned char* yuv_pixels, bool verbose, size_t frame_idx = 0) {
+// Frame timestamps are on the library's clock, which abs-capture-time maps to wall time
+int64_t library_time_us(std::chrono::steady_clock::time_point t) {
+    static const int64_t offset_us =
+        webrtc_monotonic_time_us() - FramePacer::to_microseconds(std::chrono::steady_clock::now());
+    return FramePacer::to_microseconds(t) + offset_us;
+}
+
+// Wakes the idle render thread when remote input arrives
+struct InputWake {
+    std::atomic<bool>* input_ready;
+    std::mutex* dirty_mutex;
+    std::condition_variable* dirty_cv;
+};
+
+void webrtc_input_ready_callback(void* user_data) {
+    auto* wake = static_cast<InputWake*>(user_data);
+    {
+        std::lock_guard<std::mutex> lock(*wake->dirty_mutex);
+        *wake->input_ready = true;
+    }
+    wake->dirty_cv->notify_one();
+}
+
+void render_webrtc(WebRTCContext* ctx, const Yuv420Frame& frame, size_t frame_idx = 0) {
+    const int width = frame.width;
+    const int height = frame.height;
     if (ctx && ctx->session) {
-        if (verbose) {
-            auto now = std::chrono::system_clock::now();
-            std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-            std::cout << "[WebRTC][Streaming] Frame " << frame_idx
-                      << ", size: " << width << "x" << height
-                      << ", timestamp: " << std::put_time(std::localtime(&now_c), "%F %T")
-                      << std::endl;
+        LOG_DEBUG("[WebRTC][Streaming] Frame ", frame_idx, ", size: ", width, "x", height);
+        // The planes are described in place; the library encodes them without repacking
+        webrtc_video_frame_t desc = {};
+        desc.format = WEBRTC_PIXEL_FORMAT_I420;
+        desc.width = width;
+        desc.height = height;
+        desc.planes[0] = frame.y();
+        desc.planes[1] = frame.u();
+        desc.planes[2] = frame.v();
+        desc.strides[0] = width;
+        desc.strides[1] = desc.strides[2] = static_cast<int>(frame.chroma_stride());
+        desc.timestamp_us = frame.timestamp_us;
+        if (webrtc_session_send_frame_ex(ctx->session, &desc) != 0) {
+            LOG_DEBUG("[WebRTC][Streaming] Frame ", frame_idx, " was not sent");
+        }
+    }
+}
+
+// Adaptive bitrate: the library reports how many pixels per frame its target bitrate can
+// carry, and the render thread shrinks the offscreen window to match
+void webrtc_bitrate_callback(const webrtc_bitrate_target_t* target, void* user_data) {
+    auto* max_pixels = static_cast<std::atomic<uint32_t>*>(user_data);
+    max_pixels->store(target->max_pixels, std::memory_order_relaxed);
+    LOG_INFO("[WebRTC][Bitrate] Target ", target->bitrate_kbps, " kbps, up to ", target->max_pixels,
+             " pixels per frame");
+}
+
+// Largest of full, half and quarter size that fits max_pixels (0 = no limit); quarter size
+// is the floor, and the library halves further if needed
+void fit_render_size(int width, int height, uint32_t max_pixels, int& out_width, int& out_height) {
+    int divisor = 1;
+    while (divisor < 4 && max_pixels != 0 &&
+           static_cast<uint64_t>(width / divisor) * (height / divisor) > max_pixels) {
+        divisor *= 2;
+    }
+    out_width = width / divisor;
+    out_height = height / divisor;
+}
+
+// The rendered scene: a unit cube on a blue background
+struct CubeScene {
+    vtkNew<vtkCubeSource> source;
+    vtkNew<vtkPolyDataMapper> mapper;
+    vtkNew<vtkActor> actor;
+    vtkNew<vtkRenderer> renderer;
+
+    CubeScene() {
+        source->SetXLength(1.0);
+        source->SetYLength(1.0);
+        source->SetZLength(1.0);
+        mapper->SetInputConnection(source->GetOutputPort());
+        actor->SetMapper(mapper);
+        renderer->AddActor(actor);
+        renderer->SetBackground(0.1, 0.2, 0.4);
+    }
+};
+
+// Timing of each streaming pipeline stage, reported periodically in verbose mode
+struct PipelineStats {
+    StageStats render{"render"};
+    StageStats readback{"readback"};
+    StageStats convert{"convert"};
+    StageStats encode{"encode"};
+    StageStats latency{"capture-to-sent"};
+    StageStats input{"input-to-rendered"};
+};
+
+void print_pipeline_stats(WebRTCContext* ctx, PipelineStats& stats, const FrameChannel<RgbaFrame>& rgba_channel,
+                          const FrameChannel<Yuv420Frame>& yuv_channel) {
+    if (!AsyncLogger::instance().enabled(LogLevel::Info)) return;
+    std::string line = "[WebRTC][Pipeline]";
+    for (StageStats* stage : {&stats.render, &stats.readback, &stats.convert, &stats.encode, &stats.latency,
+                              &stats.input}) {
+        StageStats::Snapshot s = stage->snapshot();
+        append_log_args(line, " ", stage->name(), " ", LogFixed{s.avg_ms, 2}, "/", LogFixed{s.max_ms, 2},
+                        "ms (", s.count, ")");
+    }
+    append_log_args(line, " | dropped readback->convert ", rgba_channel.dropped(),
+                    ", convert->encode ", yuv_channel.dropped());
+    webrtc_encode_queue_stats_t queue = {};
+    if (ctx->session && webrtc_session_get_encode_queue_stats(ctx->session, &queue) == 0) {
+        append_log_args(line, " | encoder: ", queue.encoded, "/", queue.submitted, " encoded, ",
+                        queue.dropped, " dropped, ", queue.queued, " queued");
+    }
+    LOG_INFO(line);
+}
+
+// The library's view of the stream, printed every --stats-interval seconds
+void print_session_stats(WebRTCContext* ctx) {
+    webrtc_session_stats_t s = {};
+    if (!ctx->session || webrtc_session_get_stats(ctx->session, &s) != 0) return;
+    std::string rtt = "n/a";
+    if (s.rtt_ms >= 0) {
+        rtt.clear();
+        append_log_args(rtt, LogFixed{s.rtt_ms, 1}, "ms");
+    }
+    LOG_INFO("[WebRTC][Stats] frames ", s.frames_encoded, "/", s.frames_submitted, " encoded, ",
+             s.frames_dropped, " dropped, ", s.frames_repeated, " repeated, ", s.encode_queue_depth, " queued",
+             " | encode p50 ", LogFixed{s.encode_time_p50_us / 1000.0, 2}, "ms p99 ",
+             LogFixed{s.encode_time_p99_us / 1000.0, 2}, "ms max ", LogFixed{s.encode_time_max_us / 1000.0, 2},
+             "ms (", s.encode_time_samples, ")",
+             " | bitrate ", s.send_bitrate_kbps, "/", s.target_bitrate_kbps, " kbps, ",
+             s.packets_sent, " packets, ", s.bytes_sent, " bytes",
+             " | rtt ", rtt, " | nack ", s.nack_count, " pli ", s.pli_count, " fir ", s.fir_count);
+}
+
+// Stage 2: RGBA readbacks -> I420. Only used when conversion runs on the CPU.
+void run_convert_stage(FrameChannel<RgbaFrame>& in, FrameChannel<Yuv420Frame>& out,
+                       const YuvConvertOptions& options, StageStats& stats, FrameTimeline& timeline) {
+    while (!in.closed()) {
+        RgbaFrame* rgba = in.wait_latest(std::chrono::milliseconds(100));
+        if (!rgba) continue;
+        if (Yuv420Frame* yuv = out.acquire()) {
+            auto start = std::chrono::steady_clock::now();
+            convert_to_i420(*rgba, *yuv, options);
+            const auto end = std::chrono::steady_clock::now();
+            stats.record(start, end);
+            timeline.mark(yuv->timestamp_us, FrameTimeline::Stage::Converted, library_time_us(end));
+            out.publish(yuv);
+        }
+        in.release(rgba);
+    }
+}
+
+// Stage 3: I420 frames -> encoder and network. Runs until the channel is closed.
+void run_encode_stage(FrameChannel<Yuv420Frame>& in, WebRTCContext* ctx, PipelineStats& stats,
+                      FrameTimeline& timeline, const FrameChannel<RgbaFrame>& rgba_channel, bool verbose,
+                      double stats_interval_s) {
+    using Clock = std::chrono::steady_clock;
+    constexpr auto kReportInterval = std::chrono::seconds(5);
+    auto next_report = Clock::now() + kReportInterval;
+    const auto stats_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(stats_interval_s));
+    auto next_stats = Clock::now() + stats_interval;
+    size_t frame_idx = 0;
+    while (!in.closed()) {
+        if (Yuv420Frame* frame = in.wait_latest(std::chrono::milliseconds(100))) {
+            auto start = Clock::now();
+            render_webrtc(ctx, *frame, frame_idx++);
+            auto end = Clock::now();
+            stats.encode.record(start, end);
+            stats.latency.record(library_time_us(end) - frame->timestamp_us);
+            timeline.mark(frame->timestamp_us, FrameTimeline::Stage::Sent, library_time_us(end));
+            in.release(frame);
+        }
+        if (verbose && Clock::now() >= next_report) {
+            print_pipeline_stats(ctx, stats, rgba_channel, in);
+            next_report += kReportInterval;
+        }
+        if (stats_interval_s > 0 && Clock::now() >= next_stats) {
+            print_session_stats(ctx);
+            const std::string latency = timeline.summary();
+            if (!latency.empty()) LOG_INFO("[WebRTC][Glass-to-glass] ", latency);
+            next_stats += stats_interval;
         }
-        webrtc_session_send_frame(ctx->session, width, height, yuv_pixels);
     }
 }
 
@@ -66,21 +247,31 @@ void render(int width, int height, const unsigned char* yuv_pixels, bool native_
 // Signaling client logic using ixwebsocket
 class SignalingClient {
 public:
-    SignalingClient(const std::string& url, std::function<void(const std::string&)> on_message)
-        : url_(url), on_message_(on_message) {}
+    // binary is set for binary signalling frames (signalling_binary.h), clear for JSON
+    using MessageHandler = std::function<void(const std::string& msg, bool binary)>;
+
+    // A non-empty room is joined on every (re)connect; otherwise the server's default room is used
+    SignalingClient(const std::string& url, MessageHandler on_message, const std::string& room = "")
+        : url_(url), on_message_(on_message), room_(room) {}
 
     void start() {
         ws_.setUrl(url_);
         ws_.setOnMessageCallback([this](const ix::WebSocketMessagePtr& msg) {
             if (msg->type == ix::WebSocketMessageType::Open) {
-                std::cout << "[SignalingClient] WebSocket connection opened to: " << url_ << std::endl;
+                LOG_INFO("[SignalingClient] WebSocket connection opened to: ", url_);
+                if (!room_.empty()) {
+                    ws_.send(nlohmann::json{{"type", "Join"}, {"data", {{"room", room_}}}}.dump());
+                    LOG_INFO("[SignalingClient] Joined room: ", room_);
+                }
             } else if (msg->type == ix::WebSocketMessageType::Message && on_message_) {
-                std::cout << "[SignalingClient] Message received: " << msg->str << std::endl; // Added log
-                on_message_(msg->str);
+                if (msg->binary) LOG_DEBUG("[SignalingClient] Binary message received: ", msg->str.size(), " bytes");
+                else LOG_DEBUG("[SignalingClient] Message received: ", msg->str);
+                on_message_(msg->str, msg->binary);
             } else if (msg->type == ix::WebSocketMessageType::Error) {
-                std::cerr << "[SignalingClient] WebSocket error: " << msg->errorInfo.reason << std::endl;
+                LOG_ERROR("[SignalingClient] WebSocket error: ", msg->errorInfo.reason);
             } else if (msg->type == ix::WebSocketMessageType::Close) {
-                std::cout << "[SignalingClient] WebSocket connection closed. Code: " << msg->closeInfo.code << " Reason: " << msg->closeInfo.reason << std::endl;
+                LOG_INFO("[SignalingClient] WebSocket connection closed. Code: ", msg->closeInfo.code,
+                         " Reason: ", msg->closeInfo.reason);
             }
         });
         ws_.start();
@@ -88,25 +279,116 @@ public:
     void stop() {
         ws_.stop();
     }
-    void send(const std::string& msg) {
-        ws_.send(msg);
+    void send(const std::string& msg, bool binary = false) {
+        if (binary) ws_.sendBinary(msg);
+        else ws_.send(msg);
     }
 private:
     std::string url_;
-    std::function<void(const std::string&)> on_message_;
+    MessageHandler on_message_;
+    std::string room_;
     ix::WebSocket ws_;
 };
 
-// Global verbose flag for C-style callbacks
-static bool verbose_global_for_signal_callback = false;
+// Completion of a signalling call made from the WebSocket thread, which only queues the
+// work so it never waits on the library. user_data names the call.
+void log_signal_result(int status, const char* result, void* user_data) {
+    if (status != 0) {
+        LOG_ERROR("[Signaling] ", static_cast<const char*>(user_data), " failed: ", result ? result : "");
+    }
+}
+
+// Applies a binary signalling frame from the browser through the typed C API
+void apply_binary_signal(webrtc_session_t* session, const std::string& frame) {
+    BinarySignal signal;
+    if (!decodeSignal(frame, signal)) {
+        LOG_ERROR("[Signaling] Malformed binary message (", frame.size(), " bytes)");
+        return;
+    }
+    switch (signal.kind) {
+    case SignalKind::Offer:
+    case SignalKind::Answer:
+        webrtc_session_set_remote_sdp_async(session,
+                                            signal.kind == SignalKind::Offer ? WEBRTC_SDP_TYPE_OFFER : WEBRTC_SDP_TYPE_ANSWER,
+                                            signal.text.data(), signal.text.size(), log_signal_result,
+                                            const_cast<char*>("remote description"));
+        break;
+    case SignalKind::IceCandidate: {
+        const std::string candidate(signal.text), sdp_mid(signal.sdp_mid);
+        webrtc_session_add_candidate_async(session, candidate.c_str(), sdp_mid.c_str(), signal.sdp_mline_index,
+                                           log_signal_result, const_cast<char*>("ICE candidate"));
+        break;
+    }
+    case SignalKind::Join:
+        break; // handled by the signalling server
+    }
+}
+
+// Where the library's answer and ICE candidates go: binary frames once the browser has
+// sent one, otherwise the nested JSON format of the Rust client
+struct SignalRoute {
+    SignalingClient* client = nullptr;
+    std::atomic<bool> binary{false};
+};
+
+void send_local_signal(const webrtc_signal_t* signal, void* user_data) {
+    auto* route = static_cast<SignalRoute*>(user_data);
+    const bool is_sdp = signal->kind == WEBRTC_SIGNAL_SDP;
+    if (route->binary.load(std::memory_order_relaxed)) {
+        BinarySignal frame;
+        if (is_sdp) {
+            frame.kind = signal->sdp_type == WEBRTC_SDP_TYPE_OFFER ? SignalKind::Offer : SignalKind::Answer;
+            frame.text = std::string_view(signal->sdp, signal->sdp_len);
+        } else {
+            frame.kind = SignalKind::IceCandidate;
+            frame.text = std::string_view(signal->candidate, signal->candidate_len);
+            frame.sdp_mid = signal->sdp_mid;
+            frame.sdp_mline_index = static_cast<uint16_t>(std::max(signal->sdp_mline_index, 0));
+        }
+        std::string out;
+        encodeSignal(frame, out);
+        LOG_DEBUG("[WebRTC App] Sending binary ", is_sdp ? "description" : "candidate", " (", out.size(), " bytes)");
+        route->client->send(out, true);
+        return;
+    }
+    nlohmann::json message;
+    if (is_sdp) {
+        message["type"] = signal->sdp_type == WEBRTC_SDP_TYPE_OFFER ? "Offer" : "Answer"; // Match Rust client's expected case
+        message["data"]["sdp"] = std::string(signal->sdp, signal->sdp_len);
+    } else {
+        // The Rust SignalMessage for IceCandidate has no usernameFragment, so it is omitted
+        message["type"] = "IceCandidate";
+        message["data"]["candidate"] = std::string(signal->candidate, signal->candidate_len);
+        message["data"]["sdp_mid"] = signal->sdp_mid;
+        message["data"]["sdp_mline_index"] = std::max(signal->sdp_mline_index, 0);
+    }
+    std::string message_str = message.dump();
+    LOG_DEBUG("[WebRTC App] Sending nested message: ", message_str);
+    route->client->send(message_str);
+}
 
 int main(int argc, char* argv[])
 {
+    AsyncLoggerGuard logger_guard; // flushes queued lines on every return path
     bool native_output = false;
     bool webrtc_output = false;
     bool verbose = false;
+    bool gpu_convert = false;
     int width = 640, height = 480;
+    double fps = 30.0;
+    bool async_encode = false;
+    bool adaptive_bitrate = false;
+    double stats_interval = 0.0; // seconds between library stats reports, 0 = off
+    int idle_keepalive_ms = 1000; // repeat the last frame after this long without changes, 0 = never
+    bool headless = false; // EGL or OSMesa offscreen window, no display server needed
+    int gpu_index = -1;    // EGL device for --headless, -1 = VTK's default
+    std::string encoder_config; // JSON object, passed through as the session's "encoder" settings
+    std::string encoder_backend = "libvpx"; // or a hardware encoder from hw_encoder.h
+    std::string encoder_codec = "h264";     // for hardware encoders, unless --encoder-config sets one
     std::string signalling_url = "ws://localhost:8888";
+    std::string signalling_room; // empty = the signalling server's default room
+    // Browsers assume BT.601 limited range for VP9 streams without color metadata
+    YuvConvertOptions yuv_options;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--native") native_output = true;
@@ -118,247 +400,297 @@ int main(int argc, char* argv[])
         if (arg == "--signalling" && i + 1 < argc) {
             signalling_url = argv[++i];
         }
+        if (arg == "--room" && i + 1 < argc) signalling_room = argv[++i];
         if (arg == "--verbose") verbose = true;
+        if (arg == "--log-json") AsyncLogger::instance().setFormat(LogFormat::Json);
+        if (arg == "--bt709") yuv_options.matrix = YuvMatrix::BT709;
+        if (arg == "--full-range") yuv_options.range = YuvRange::Full;
+        if (arg == "--gpu-convert") gpu_convert = true;
+        if (arg == "--fps" && i + 1 < argc) fps = std::stod(argv[++i]);
+        if (arg == "--async-encode") async_encode = true;
+        if (arg == "--adaptive-bitrate") adaptive_bitrate = true;
+        if (arg == "--stats-interval" && i + 1 < argc) stats_interval = std::stod(argv[++i]);
+        if (arg == "--encoder-config" && i + 1 < argc) encoder_config = argv[++i];
+        if (arg == "--encoder" && i + 1 < argc) encoder_backend = argv[++i];
+        if (arg == "--codec" && i + 1 < argc) encoder_codec = argv[++i];
+        if (arg == "--idle-keepalive" && i + 1 < argc) idle_keepalive_ms = std::stoi(argv[++i]);
+        if (arg == "--headless") headless = true;
+        if (arg == "--gpu" && i + 1 < argc) gpu_index = std::stoi(argv[++i]);
     }
     if (!native_output && !webrtc_output) native_output = true; // Default
-    verbose_global_for_signal_callback = verbose; // Set global verbose flag
+    if (verbose) AsyncLogger::instance().setLevel(LogLevel::Debug);
+    if (headless && native_output) {
+        LOG_WARN("[Render] --headless has no native window; streaming only");
+        native_output = false;
+        webrtc_output = true;
+    }
+
+    // A hardware encoder is registered with the library and named in the encoder settings
+    if (webrtc_output && encoder_backend != "libvpx") {
+        if (!register_hw_encoder(encoder_backend, gpu_index, fps)) return 1;
+        nlohmann::json encoder = encoder_config.empty() ? nlohmann::json::object()
+                                                        : nlohmann::json::parse(encoder_config, nullptr, false);
+        if (!encoder.is_object()) {
+            LOG_ERROR("[WebRTC] --encoder-config must be a JSON object");
+            return 1;
+        }
+        encoder["backend"] = encoder_backend;
+        if (!encoder.contains("codec")) encoder["codec"] = encoder_codec;
+        encoder_config = encoder.dump();
+    }
 
     WebRTCContext webrtc_ctx;
+    std::atomic<uint32_t> render_max_pixels{0}; // written by the bitrate callback, 0 = full size
     std::unique_ptr<SignalingClient> signalling_client;
+    SignalRoute signal_route; // outlives the session, which calls back into it
+    FrameTimeline frame_timeline; // likewise
     if (webrtc_output) {
-        // Create WebRTC session (config can be null or a stub for now)
-        webrtc_ctx.session = webrtc_session_create(nullptr, webrtc_input_callback, nullptr);
+        // Create WebRTC session; async encode hands frames to the library's encoder thread
+        std::vector<std::string> config_entries;
+        if (!encoder_config.empty()) config_entries.push_back("\"encoder\": " + encoder_config);
+        if (async_encode) config_entries.push_back(R"("async_encode": {"drop_policy": "drop_oldest"})");
+        if (adaptive_bitrate) config_entries.push_back(R"("adaptive_bitrate": {})");
+        if (idle_keepalive_ms > 0) config_entries.push_back(R"("repeat_frames": true)");
+        config_entries.push_back(R"("abs_capture_time": true)"); // see library_time_us
+        std::string session_config = "{";
+        for (size_t i = 0; i < config_entries.size(); ++i) {
+            if (i > 0) session_config += ", ";
+            session_config += config_entries[i];
+        }
+        session_config += "}";
+        webrtc_ctx.session = webrtc_session_create(session_config.c_str(), webrtc_input_callback, &frame_timeline);
+        if (!webrtc_ctx.session) {
+            LOG_ERROR("[WebRTC] Failed to create session with config ", session_config);
+            return 1;
+        }
+        if (adaptive_bitrate) {
+            webrtc_session_set_bitrate_callback(webrtc_ctx.session, webrtc_bitrate_callback, &render_max_pixels);
+        }
         // Print diagnostics (ICE credentials, selected candidate, etc.)
         if (verbose && webrtc_ctx.session) {
-            char* diag_json = webrtc_session_get_diagnostics(webrtc_ctx.session);
-            if (diag_json) {
-                std::cout << "[WebRTC][Diagnostics] " << diag_json << std::endl;
-                free(diag_json);
-            } else {
-                std::cout << "[WebRTC][Diagnostics] (unavailable)" << std::endl;
-            }
+            webrtc_session_get_diagnostics_async(
+                webrtc_ctx.session,
+                [](int status, const char* result, void*) {
+                    if (status == 0) LOG_INFO("[WebRTC][Diagnostics] ", result);
+                    else LOG_INFO("[WebRTC][Diagnostics] (unavailable: ", result ? result : "", ")");
+                },
+                nullptr);
         }
         // Set up signaling client
-        signalling_client = std::make_unique<SignalingClient>(signalling_url, [&](const std::string& msg) {
-            // This is the on_message_ callback passed to SignalingClient
-            // The [SignalingClient] Message received: log is now inside IXWebSocket's callback
-            if (verbose) std::cout << "[WebRTC App] Processing message from SignalingClient: " << msg << std::endl;
-            // Parse JSON and dispatch to WebRTC session
+        signalling_client = std::make_unique<SignalingClient>(signalling_url, [&](const std::string& msg, bool binary) {
+            // Answer in whichever framing the browser uses
+            signal_route.binary.store(binary, std::memory_order_relaxed);
+            if (binary) {
+                apply_binary_signal(webrtc_ctx.session, msg);
+                return;
+            }
+            LOG_DEBUG("[WebRTC App] Processing message from SignalingClient: ", msg);
+            // Parse JSON and hand the fields to the typed C API
             try {
                 auto j = nlohmann::json::parse(msg);
                 std::string type = j.value("type", ""); // Get type, default to empty string if not found
 
                 if (type == "Offer" || type == "Answer") { // Match "Offer" and "Answer" from Rust client
                     if (j.contains("data") && j["data"].contains("sdp")) {
-                        std::string sdp = j["data"]["sdp"].get<std::string>();
-                        // Construct the JSON string expected by webrtc_session_set_remote_description
-                        // It typically expects an object like: { "type": "offer", "sdp": "..." }
-                        // The C API might be parsing this directly.
-                        // We need to ensure the C API gets the correct format.
-                        // Let's try passing a reconstructed simple JSON if the C API expects that,
-                        // or check if the C API can handle just the SDP string directly (less likely for set_remote_description).
-                        // For now, let's assume the C API's webrtc_session_set_remote_description wants a JSON string
-                        // that looks like { "type": "offer/answer", "sdp": "..." }
-                        nlohmann::json sdp_payload;
-                        sdp_payload["type"] = type == "Offer" ? "offer" : "answer"; // C API might expect lowercase
-                        sdp_payload["sdp"] = sdp;
-                        std::string sdp_payload_str = sdp_payload.dump();
-                        if (verbose) std::cout << "[WebRTC App] Parsed SDP: " << sdp << std::endl;
-                        if (verbose) std::cout << "[WebRTC App] Passing to C API (set_remote_description): " << sdp_payload_str << std::endl;
-                        webrtc_session_set_remote_description(webrtc_ctx.session, sdp_payload_str.c_str());
+                        const std::string& sdp = j["data"]["sdp"].get_ref<const std::string&>();
+                        LOG_DEBUG("[WebRTC App] Parsed SDP: ", sdp);
+                        webrtc_session_set_remote_sdp_async(webrtc_ctx.session,
+                                                            type == "Offer" ? WEBRTC_SDP_TYPE_OFFER : WEBRTC_SDP_TYPE_ANSWER,
+                                                            sdp.data(), sdp.size(), log_signal_result,
+                                                            const_cast<char*>("remote description"));
                     } else {
-                        std::cerr << "[Signaling] Malformed Offer/Answer: missing data.sdp field: " << msg << std::endl;
+                        LOG_ERROR("[Signaling] Malformed Offer/Answer: missing data.sdp field: ", msg);
                     }
                 } else if (type == "IceCandidate") { // Match "IceCandidate" from Rust client
                     if (j.contains("data") && j["data"].contains("candidate") && j["data"].contains("sdp_mid") && j["data"].contains("sdp_mline_index")) {
-                        // Reconstruct the JSON string expected by webrtc_session_add_ice_candidate
-                        // e.g., { "candidate": "...", "sdpMid": "...", "sdpMLineIndex": ... }
-                        nlohmann::json ice_payload;
-                        ice_payload["candidate"] = j["data"]["candidate"].get<std::string>();
-                        ice_payload["sdpMid"] = j["data"]["sdp_mid"].get<std::string>(); // Ensure key case matches C API expectation
-                        ice_payload["sdpMLineIndex"] = j["data"]["sdp_mline_index"].get<unsigned int>(); // Ensure key case
-                        std::string ice_payload_str = ice_payload.dump();
-                        if (verbose) std::cout << "[WebRTC App] Parsed ICE Candidate: " << ice_payload_str << std::endl;
-                        if (verbose) std::cout << "[WebRTC App] Passing to C API (add_ice_candidate): " << ice_payload_str << std::endl;
-                        webrtc_session_add_ice_candidate(webrtc_ctx.session, ice_payload_str.c_str());
+                        const auto& data = j["data"];
+                        const std::string& candidate = data["candidate"].get_ref<const std::string&>();
+                        const std::string& sdp_mid = data["sdp_mid"].get_ref<const std::string&>();
+                        LOG_DEBUG("[WebRTC App] Parsed ICE Candidate: ", candidate);
+                        webrtc_session_add_candidate_async(webrtc_ctx.session, candidate.c_str(), sdp_mid.c_str(),
+                                                           data["sdp_mline_index"].get<int>(), log_signal_result,
+                                                           const_cast<char*>("ICE candidate"));
                     } else {
-                        std::cerr << "[Signaling] Malformed IceCandidate: missing fields: " << msg << std::endl;
+                        LOG_ERROR("[Signaling] Malformed IceCandidate: missing fields: ", msg);
                     }
                 }
             } catch (const nlohmann::json::parse_error& e) {
-                std::cerr << "[Signaling] Failed to parse JSON message: " << msg << " Error: " << e.what() << std::endl;
+                LOG_ERROR("[Signaling] Failed to parse JSON message: ", msg, " Error: ", e.what());
             } catch (const std::exception& e) {
-                std::cerr << "[Signaling] Error processing message: " << msg << " Error: " << e.what() << std::endl;
+                LOG_ERROR("[Signaling] Error processing message: ", msg, " Error: ", e.what());
             }
-        });
-        // Register callback to send local signaling messages to the browser
-        webrtc_session_set_signal_callback(
-            webrtc_ctx.session,
-            [](const char* flat_msg_cstr, void* user_data) {
-                if (user_data && flat_msg_cstr) {
-                    std::string flat_msg_str(flat_msg_cstr);
-                    if (verbose_global_for_signal_callback) {
-                        std::cout << "[WebRTC App] C API generated flat message: " << flat_msg_str << std::endl;
-                    }
-
-                    try {
-                        auto j_flat = nlohmann::json::parse(flat_msg_str);
-                        std::string type = j_flat.value("type", ""); 
-                        
-                        if (verbose_global_for_signal_callback) {
-                            std::cout << "[DEBUG C++ CB] Parsed type: \'" << type << "\'" << std::endl;
-                            std::cout << "[DEBUG C++ CB] j_flat.dump(2): " << j_flat.dump(2) << std::endl;
-                            std::cout << "[DEBUG C++ CB] j_flat.contains(\"candidate\"): " << (j_flat.contains("candidate") ? "true" : "false") << std::endl;
-                            std::cout << "[DEBUG C++ CB] j_flat.contains(\"sdpMid\"): " << (j_flat.contains("sdpMid") ? "true" : "false") << std::endl;
-                            std::cout << "[DEBUG C++ CB] j_flat.contains(\"sdpMLineIndex\"): " << (j_flat.contains("sdpMLineIndex") ? "true" : "false") << std::endl;
-                        }
-                        
-                        nlohmann::json j_nested_outer;
-                        nlohmann::json j_nested_data;
-                        bool message_handled = false;
-
-                        if (type == "answer") {
-                            j_nested_outer["type"] = "Answer"; // Match Rust client's expected case
-                            j_nested_data["sdp"] = j_flat.value("sdp", "");
-                            j_nested_outer["data"] = j_nested_data;
-                            message_handled = true;
-                        } else if (type == "offer") {
-                            // This case should ideally not happen if server is only answering.
-                            // But if C API could generate an offer (e.g. for renegotiation)
-                            j_nested_outer["type"] = "Offer";
-                            j_nested_data["sdp"] = j_flat.value("sdp", "");
-                            j_nested_outer["data"] = j_nested_data;
-                            message_handled = true;
-                        } else if (j_flat.contains("candidate") && j_flat.contains("sdpMid") && j_flat.contains("sdpMLineIndex")) {
-                            // This is an ICE candidate from the C API (which doesn't set a "type" field for candidates)
-                            // Let's ensure 'type' is empty or not 'answer'/'offer' to be more specific,
-                            // though checking for candidate fields is quite robust.
-                            if (type.empty() || (type != "answer" && type != "offer")) {
-                                j_nested_outer["type"] = "IceCandidate"; // Match Rust client's expected case
-                                j_nested_data["candidate"] = j_flat.value("candidate", "");
-                                // sdpMid from C API is often empty or "0", ensure it's string.
-                                j_nested_data["sdp_mid"] = j_flat.value("sdpMid", ""); 
-                                j_nested_data["sdp_mline_index"] = j_flat.value("sdpMLineIndex", 0);
-                                // usernameFragment is often null, Rust side expects it to be omitted or string.
-                                // The current Rust SignalMessage for IceCandidate doesn't include usernameFragment, so we omit it.
-                                j_nested_outer["data"] = j_nested_data;
-                                message_handled = true;
-                            }
-                        }
-                        
-                        if (message_handled) {
-                            std::string nested_msg_str = j_nested_outer.dump();
-                            if (verbose_global_for_signal_callback) {
-                                std::cout << "[WebRTC App] Sending nested message: " << nested_msg_str << std::endl;
-                            }
-                            static_cast<SignalingClient*>(user_data)->send(nested_msg_str);
-                        } else {
-                            // If type is unknown or not one we want to nest, send as-is or log error
-                            std::cerr << "[WebRTC App] Unknown message type or structure from C API for nesting: " << flat_msg_str << std::endl;
-                            static_cast<SignalingClient*>(user_data)->send(flat_msg_str); // Send original flat message
-                        }
-
-                    } catch (const nlohmann::json::parse_error& e) {
-                        std::cerr << "[WebRTC App] Failed to parse flat JSON from C API: " << flat_msg_str << " Error: " << e.what() << std::endl;
-                        static_cast<SignalingClient*>(user_data)->send(flat_msg_str); // Send original on error
-                    } catch (const std::exception& e) {
-                        std::cerr << "[WebRTC App] Error processing message from C API for nesting: " << flat_msg_str << " Error: " << e.what() << std::endl;
-                        static_cast<SignalingClient*>(user_data)->send(flat_msg_str); // Send original on error
-                    }
-                }
-            },
-            signalling_client.get()
-        );
-        if (verbose) std::cout << "[Signaling] Connecting to " << signalling_url << std::endl;
+        }, signalling_room);
+        // Send the library's answer and ICE candidates to the browser
+        signal_route.client = signalling_client.get();
+        webrtc_session_set_signal_message_callback(webrtc_ctx.session, send_local_signal, &signal_route);
+        LOG_DEBUG("[Signaling] Connecting to ", signalling_url);
         signalling_client->start();
     }
 
-    // Create a cube
-    vtkNew<vtkCubeSource> cubeSource;
-    cubeSource->SetXLength(1.0);
-    cubeSource->SetYLength(1.0);
-    cubeSource->SetZLength(1.0);
-
-    // Create a mapper
-    vtkNew<vtkPolyDataMapper> mapper;
-    mapper->SetInputConnection(cubeSource->GetOutputPort());
-
-    // Create an actor
-    vtkNew<vtkActor> actor;
-    actor->SetMapper(mapper);
-
-    // Create a renderer, render window, and interactor
-    vtkNew<vtkRenderer> renderer;
-    vtkNew<vtkRenderWindow> renderWindow;
-    renderWindow->AddRenderer(renderer);
-    renderWindow->SetSize(width, height);
+    // Streaming renders into an offscreen window; with --headless it needs no display server.
+    // Created after signalling has started, so a viewer's offer can be answered while the
+    // GL context comes up.
+    vtkSmartPointer<vtkRenderWindow> offscreenRenderWindow;
+    if (webrtc_output) {
+        offscreenRenderWindow = create_offscreen_window(headless, gpu_index);
+        if (!offscreenRenderWindow) {
+            signalling_client->stop();
+            webrtc_session_destroy(webrtc_ctx.session);
+            return 1;
+        }
+    }
 
-    // Add the actor to the scene
-    renderer->AddActor(actor);
-    renderer->SetBackground(0.1, 0.2, 0.4); // Background color
+    // One scene for whichever window shows it: the native window, or the streaming
+    // thread's offscreen window. Only one of them renders it.
+    CubeScene scene;
 
     std::atomic<bool> running{true};
     std::atomic<bool> scene_dirty{true}; // Start dirty to send first frame
+    std::atomic<bool> input_ready{false}; // remote input queued; it may or may not change the scene
     std::mutex dirty_mutex;
     std::condition_variable dirty_cv;
+    // Streaming pipeline: render+readback -> convert -> encode/send, one thread per stage,
+    // connected by lock-free channels that always hand over the newest frame
+    FrameChannel<RgbaFrame> rgba_channel;
+    FrameChannel<Yuv420Frame> yuv_channel;
+    PipelineStats pipeline_stats;
     std::thread webrtc_thread;
+    std::thread encode_thread;
+    InputWake input_wake{&input_ready, &dirty_mutex, &dirty_cv};
     if (webrtc_output) {
-        webrtc_thread = std::thread([=, &running, &scene_dirty, &dirty_mutex, &dirty_cv, &webrtc_ctx]() {
-            // Create a separate VTK pipeline for the webrtc thread
-            vtkNew<vtkCubeSource> cubeSourceW;
-            cubeSourceW->SetXLength(1.0);
-            cubeSourceW->SetYLength(1.0);
-            cubeSourceW->SetZLength(1.0);
-            vtkNew<vtkPolyDataMapper> mapperW;
-            mapperW->SetInputConnection(cubeSourceW->GetOutputPort());
-            vtkNew<vtkActor> actorW;
-            actorW->SetMapper(mapperW);
-            vtkNew<vtkRenderer> rendererW;
-            vtkNew<vtkRenderWindow> offscreenRenderWindow;
-            offscreenRenderWindow->AddRenderer(rendererW);
+        webrtc_session_set_input_ready_callback(webrtc_ctx.session, webrtc_input_ready_callback, &input_wake);
+        encode_thread = std::thread([&]() {
+            run_encode_stage(yuv_channel, &webrtc_ctx, pipeline_stats, frame_timeline, rgba_channel, verbose,
+                             stats_interval);
+        });
+        webrtc_thread = std::thread([=, &running, &scene_dirty, &input_ready, &dirty_mutex, &dirty_cv,
+                                     &rgba_channel, &yuv_channel, &pipeline_stats, &render_max_pixels, &frame_timeline,
+                                     &scene, &offscreenRenderWindow]() {
+            // Its GL context is created on first render, on this thread
+            offscreenRenderWindow->AddRenderer(scene.renderer);
             offscreenRenderWindow->SetSize(width, height);
-            offscreenRenderWindow->OffScreenRenderingOn();
-            rendererW->AddActor(actorW);
-            rendererW->SetBackground(0.1, 0.2, 0.4);
-            size_t frame_idx = 0;
+            // Readback and conversion buffers are pooled in the channels; no per-frame filters or vectors
+            std::unique_ptr<GpuFrameCapture> gpu_capture;
+            if (gpu_convert) {
+                gpu_capture = GpuFrameCapture::create(offscreenRenderWindow, yuv_options);
+                if (!gpu_capture) LOG_WARN("[WebRTC] GPU color conversion unavailable, using CPU path");
+            }
+            RgbaReadback readback(offscreenRenderWindow);
+            // Browser pointer and key events move this window's camera
+            RemoteInput remote_input(offscreenRenderWindow);
+            // The GPU path delivers I420 directly and skips the convert stage
+            std::thread convert_thread;
+            if (!gpu_capture) {
+                convert_thread = std::thread([&]() {
+                    run_convert_stage(rgba_channel, yuv_channel, yuv_options, pipeline_stats.convert, frame_timeline);
+                });
+            }
+            FramePacer pacer(fps);
+            uint64_t skipped_reported = 0;
+            int render_width = width, render_height = height;
+            // Damage-driven: a frame is rendered, converted and encoded only when the scene
+            // changed. The GPU path hands over each readback two renders late, so a change is
+            // followed by that many more renders to flush it.
+            const int settle_frames = gpu_capture ? 2 : 0;
+            int frames_owed = 0;
+            bool keyframe_owed = false; // the first idle repeat after a change is a keyframe
             while (running) {
-                if (native_output) { // Only use condition variable if native output is also active
+                bool dirty;
+                if (frames_owed > 0) {
+                    dirty = scene_dirty.exchange(false);
+                } else {
                     std::unique_lock<std::mutex> lock(dirty_mutex);
-                    dirty_cv.wait(lock, [&]() { return scene_dirty || !running; });
+                    const auto woken = [&]() { return scene_dirty || input_ready || !running; };
+                    bool woke = true;
+                    if (idle_keepalive_ms > 0) {
+                        woke = dirty_cv.wait_for(lock, std::chrono::milliseconds(idle_keepalive_ms), woken);
+                    } else {
+                        dirty_cv.wait(lock, woken);
+                    }
                     if (!running) break;
-                    scene_dirty = false;
+                    if (!woke) {
+                        lock.unlock();
+                        // Idle for a keepalive interval: the library re-sends its last frame,
+                        // which costs a fraction of a real one
+                        webrtc_session_repeat_frame(webrtc_ctx.session, webrtc_monotonic_time_us(),
+                                                    keyframe_owed ? WEBRTC_FRAME_FLAG_KEYFRAME : 0);
+                        keyframe_owed = false;
+                        continue;
+                    }
+                    dirty = scene_dirty.exchange(false);
                     lock.unlock();
-                } else { // If not native_output, we are in WebRTC-only mode, stream continuously
-                    // Ensure we don't spin too fast if rendering is very quick,
-                    // though render_webrtc itself has a sleep.
-                    // We might also want to set scene_dirty = true here if other logic depends on it,
-                    // but for simple continuous streaming, just proceeding to render is fine.
+                    pacer.resync(); // idle time is not lag
                 }
 
+                int fit_width, fit_height;
+                fit_render_size(width, height, render_max_pixels.load(std::memory_order_relaxed), fit_width, fit_height);
+                if (fit_width != render_width || fit_height != render_height) {
+                    render_width = fit_width;
+                    render_height = fit_height;
+                    offscreenRenderWindow->SetSize(render_width, render_height);
+                    remote_input.set_size(render_width, render_height);
+                    LOG_INFO("[WebRTC][Bitrate] Rendering at ", render_width, "x", render_height);
+                    dirty = true;
+                }
+
+                const auto frame_start = pacer.wait_next_frame();
+                // Input is applied right before rendering, so the frame shows everything received so far.
+                // Cleared first: input queued from here on wakes the loop again.
+                input_ready = false;
+                const RemoteInput::Drained input = remote_input.drain(webrtc_ctx.session);
+                if (dirty || input.changed) {
+                    frames_owed = settle_frames;
+                    keyframe_owed = true;
+                } else if (frames_owed > 0) {
+                    --frames_owed;
+                } else {
+                    continue; // only hover moves: nothing to show
+                }
                 offscreenRenderWindow->Render();
-                vtkNew<vtkWindowToImageFilter> windowToImageFilter;
-                windowToImageFilter->SetInput(offscreenRenderWindow);
-                windowToImageFilter->Update();
-                vtkImageData* image = windowToImageFilter->GetOutput();
-                int dims[3];
-                image->GetDimensions(dims);
-                int num_pixels = dims[0] * dims[1];
-                std::vector<unsigned char> rgb(num_pixels * 3);
-                vtkNew<vtkImageExport> exporter;
-                exporter->SetInputData(image);
-                exporter->ImageLowerLeftOn();
-                exporter->Update();
-                exporter->Export(rgb.data());
-                std::vector<unsigned char> yuv(num_pixels * 3 / 2);
-                rgb_to_yuv420p(rgb.data(), dims[0], dims[1], yuv.data());
-                render_webrtc(&webrtc_ctx, dims[0], dims[1], yuv.data(), verbose, frame_idx++);
-                std::this_thread::sleep_for(std::chrono::milliseconds(33)); // ~30 FPS
+                const auto rendered = std::chrono::steady_clock::now();
+                pipeline_stats.render.record(frame_start, rendered);
+                if (input.oldest_received_us >= 0) {
+                    pipeline_stats.input.record(webrtc_monotonic_time_us() - input.oldest_received_us);
+                }
+                const int64_t timestamp_us = library_time_us(frame_start);
+                frame_timeline.begin(timestamp_us);
+                frame_timeline.mark(timestamp_us, FrameTimeline::Stage::Rendered, library_time_us(rendered));
+                if (gpu_capture) {
+                    if (Yuv420Frame* frame = yuv_channel.acquire()) {
+                        if (gpu_capture->capture(timestamp_us, *frame)) {
+                            // The readback that completed belongs to an earlier render
+                            frame_timeline.mark(frame->timestamp_us, FrameTimeline::Stage::Converted,
+                                                webrtc_monotonic_time_us());
+                            yuv_channel.publish(frame);
+                        } else {
+                            yuv_channel.recycle(frame);
+                        }
+                    }
+                } else if (RgbaFrame* frame = rgba_channel.acquire()) {
+                    if (readback.read(timestamp_us, *frame)) rgba_channel.publish(frame);
+                    else rgba_channel.recycle(frame);
+                }
+                pipeline_stats.readback.record(rendered, std::chrono::steady_clock::now());
+                if (verbose && pacer.skipped() > skipped_reported) {
+                    LOG_INFO("[WebRTC][Pacing] Behind schedule, skipped ", pacer.skipped() - skipped_reported,
+                             " frame(s), ", pacer.skipped(), " total");
+                    skipped_reported = pacer.skipped();
+                }
             }
+            rgba_channel.close();
+            if (convert_thread.joinable()) convert_thread.join();
+            yuv_channel.close();
+            // GL resources go while the context is still current on this thread
+            gpu_capture.reset();
+            offscreenRenderWindow->Finalize();
         });
     }
 
     if (native_output && !webrtc_output) {
         // Native-only mode: interactive VTK window
+        vtkNew<vtkRenderWindow> renderWindow;
+        renderWindow->AddRenderer(scene.renderer);
+        renderWindow->SetSize(width, height);
         // Attach observers to mark scene as dirty on interaction
         struct DirtyData {
             std::atomic<bool>* scene_dirty;
@@ -373,7 +705,7 @@ int main(int argc, char* argv[])
         callback->SetCallback(mark_dirty_cb);
         callback->SetClientData(&dirtyData);
         renderWindow->AddObserver(vtkCommand::ModifiedEvent, callback);
-        renderer->AddObserver(vtkCommand::ModifiedEvent, callback);
+        scene.renderer->AddObserver(vtkCommand::ModifiedEvent, callback);
         renderWindow->AddObserver(vtkCommand::WindowResizeEvent, callback);
         renderWindow->AddObserver(vtkCommand::RenderEvent, callback);
         // Add more events as needed (e.g., mouse, keyboard)
@@ -386,7 +718,7 @@ int main(int argc, char* argv[])
         dirty_cv.notify_one();
     } else if (webrtc_output) {
         // WebRTC mode (with or without native): keep main thread alive for signaling
-        if (verbose) std::cout << "WebRTC mode active, waiting for signaling..." << std::endl;
+        LOG_DEBUG("WebRTC mode active, waiting for signaling...");
         while (running) {
             std::this_thread::sleep_for(std::chrono::seconds(1));
         }
@@ -398,6 +730,9 @@ int main(int argc, char* argv[])
         dirty_cv.notify_one();
         webrtc_thread.join();
     }
+    if (encode_thread.joinable()) {
+        encode_thread.join(); // exits once the render thread has closed the pipeline
+    }
 
     if (webrtc_output && signalling_client) {
         signalling_client->stop();
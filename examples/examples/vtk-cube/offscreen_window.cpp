@@ -0,0 +1,37 @@
+// Offscreen render windows for streaming, optionally without a display server
+#include "offscreen_window.h"
+
+#include "async_logger.h"
+
+#include <string>
+
+#include <vtkRenderingOpenGLConfigure.h>
+#if defined(VTK_OPENGL_HAS_EGL)
+#include <vtkEGLRenderWindow.h>
+#elif defined(VTK_OPENGL_HAS_OSMESA)
+#include <vtkOSOpenGLRenderWindow.h>
+#endif
+
+vtkSmartPointer<vtkRenderWindow> create_offscreen_window(bool headless, int gpu_index) {
+    vtkSmartPointer<vtkRenderWindow> window;
+    if (!headless) {
+        window = vtkSmartPointer<vtkRenderWindow>::New();
+    } else {
+#if defined(VTK_OPENGL_HAS_EGL)
+        auto egl = vtkSmartPointer<vtkEGLRenderWindow>::New();
+        // Must be set before the window is initialized, which picks the device
+        if (gpu_index >= 0) egl->SetDeviceIndex(gpu_index);
+        LOG_INFO("[Render] Headless EGL window on GPU device ", gpu_index >= 0 ? std::to_string(gpu_index) : "default");
+        window = egl;
+#elif defined(VTK_OPENGL_HAS_OSMESA)
+        if (gpu_index >= 0) LOG_WARN("[Render] VTK has no EGL support; --gpu ignored, rendering with OSMesa");
+        else LOG_INFO("[Render] Headless OSMesa window");
+        window = vtkSmartPointer<vtkOSOpenGLRenderWindow>::New();
+#else
+        LOG_ERROR("[Render] --headless needs VTK built with EGL (VTK_OPENGL_HAS_EGL) or OSMesa");
+        return nullptr;
+#endif
+    }
+    window->OffScreenRenderingOn();
+    return window;
+}
@@ -0,0 +1,17 @@
+// Offscreen render windows for streaming, optionally without a display server
+#ifndef VTK_CUBE_OFFSCREEN_WINDOW_H
+#define VTK_CUBE_OFFSCREEN_WINDOW_H
+
+#include <vtkRenderWindow.h>
+#include <vtkSmartPointer.h>
+
+// Without headless, the platform's default window with offscreen rendering turned on,
+// which on most builds still connects to the display (X11, Cocoa, Win32).
+//
+// With headless, a window that needs no display at all: an EGL window on GPU device
+// gpu_index (-1 = VTK's default device) if VTK was built with EGL, otherwise an OSMesa
+// window, which renders on the CPU and ignores gpu_index. Returns nullptr if VTK has
+// neither.
+vtkSmartPointer<vtkRenderWindow> create_offscreen_window(bool headless, int gpu_index);
+
+#endif // VTK_CUBE_OFFSCREEN_WINDOW_H
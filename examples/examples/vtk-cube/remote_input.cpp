@@ -0,0 +1,112 @@
+// Browser input from the session's binary input queue, replayed on the offscreen render window
+#include "remote_input.h"
+
+#include <vtkCommand.h>
+#include <vtkObjectFactory.h>
+#include <vtkRenderWindow.h>
+
+namespace {
+
+// The base interactor without a platform subclass: vtkRenderWindowInteractor::New()
+// would create one for the window system, which an offscreen window may not have.
+class EventOnlyInteractor : public vtkRenderWindowInteractor {
+public:
+    static EventOnlyInteractor* New();
+    vtkTypeMacro(EventOnlyInteractor, vtkRenderWindowInteractor);
+};
+vtkStandardNewMacro(EventOnlyInteractor);
+
+unsigned long button_event(uint8_t button, bool down) {
+    switch (button) {
+    case 1: return down ? vtkCommand::MiddleButtonPressEvent : vtkCommand::MiddleButtonReleaseEvent;
+    case 2: return down ? vtkCommand::RightButtonPressEvent : vtkCommand::RightButtonReleaseEvent;
+    default: return down ? vtkCommand::LeftButtonPressEvent : vtkCommand::LeftButtonReleaseEvent;
+    }
+}
+
+} // namespace
+
+RemoteInput::RemoteInput(vtkRenderWindow* window)
+    : window_(window), interactor_(vtkSmartPointer<EventOnlyInteractor>::New()) {
+    // The style would render after every camera change; the render loop does that once per frame
+    interactor_->EnableRenderOff();
+    interactor_->SetRenderWindow(window);
+    interactor_->SetInteractorStyle(style_);
+    interactor_->Initialize();
+    const int* size = window->GetSize();
+    set_size(size[0], size[1]);
+}
+
+RemoteInput::~RemoteInput() {
+    // The window keeps a plain pointer to its interactor
+    window_->SetInteractor(nullptr);
+    interactor_->SetInteractorStyle(nullptr);
+    interactor_->SetRenderWindow(nullptr);
+}
+
+void RemoteInput::set_size(int width, int height) {
+    interactor_->SetSize(width, height);
+}
+
+RemoteInput::Drained RemoteInput::drain(webrtc_session_t* session) {
+    Drained drained;
+    int n;
+    do {
+        n = webrtc_session_poll_input(session, events_.data(), static_cast<int>(events_.size()),
+                                      WEBRTC_INPUT_POLL_COALESCE_MOVES);
+        for (int i = 0; i < n; ++i) {
+            const webrtc_input_event_t& event = events_[i];
+            if (drained.oldest_received_us < 0 || event.received_us < drained.oldest_received_us) {
+                drained.oldest_received_us = event.received_us;
+            }
+            // The trackball style only moves the camera while a button is held
+            if (event.kind != WEBRTC_INPUT_POINTER_MOVE || event.buttons != 0) drained.changed = true;
+            apply(event);
+        }
+    } while (n == static_cast<int>(events_.size()));
+    return drained;
+}
+
+void RemoteInput::apply(const webrtc_input_event_t& event) {
+    const int* size = interactor_->GetSize();
+    // The browser's origin is top-left, VTK's bottom-left
+    const int x = static_cast<int>(event.x * size[0]);
+    const int y = static_cast<int>((1.0f - event.y) * size[1]);
+    const int ctrl = (event.modifiers & WEBRTC_INPUT_MOD_CTRL) != 0;
+    const int shift = (event.modifiers & WEBRTC_INPUT_MOD_SHIFT) != 0;
+    interactor_->SetAltKey((event.modifiers & WEBRTC_INPUT_MOD_ALT) != 0);
+
+    switch (event.kind) {
+    case WEBRTC_INPUT_POINTER_MOVE:
+        interactor_->SetEventInformation(x, y, ctrl, shift);
+        interactor_->InvokeEvent(vtkCommand::MouseMoveEvent);
+        break;
+    case WEBRTC_INPUT_POINTER_DOWN:
+    case WEBRTC_INPUT_POINTER_UP:
+        interactor_->SetEventInformation(x, y, ctrl, shift);
+        interactor_->InvokeEvent(button_event(event.button, event.kind == WEBRTC_INPUT_POINTER_DOWN));
+        break;
+    case WEBRTC_INPUT_WHEEL:
+        if (event.delta_y == 0.0f) break;
+        interactor_->SetEventInformation(x, y, ctrl, shift);
+        interactor_->InvokeEvent(event.delta_y < 0.0f ? vtkCommand::MouseWheelForwardEvent
+                                                      : vtkCommand::MouseWheelBackwardEvent);
+        break;
+    case WEBRTC_INPUT_KEY_DOWN:
+    case WEBRTC_INPUT_KEY_UP: {
+        // Only printable ASCII maps onto VTK's key codes and the style's shortcuts
+        if (event.key < 0x20 || event.key > 0x7e) break;
+        const char keysym[2] = {static_cast<char>(event.key), '\0'};
+        interactor_->SetKeyEventInformation(ctrl, shift, keysym[0], 0, keysym);
+        if (event.kind == WEBRTC_INPUT_KEY_DOWN) {
+            interactor_->InvokeEvent(vtkCommand::KeyPressEvent);
+            interactor_->InvokeEvent(vtkCommand::CharEvent);
+        } else {
+            interactor_->InvokeEvent(vtkCommand::KeyReleaseEvent);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
@@ -0,0 +1,46 @@
+// Browser input from the session's binary input queue, replayed on the offscreen render window
+#ifndef VTK_CUBE_REMOTE_INPUT_H
+#define VTK_CUBE_REMOTE_INPUT_H
+
+#include "webrtc_c_api.h"
+
+#include <array>
+#include <cstdint>
+
+#include <vtkInteractorStyleTrackballCamera.h>
+#include <vtkNew.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkSmartPointer.h>
+
+class vtkRenderWindow;
+
+// Drives the offscreen window's camera with a trackball interactor style, as a native
+// window would. The interactor has no event loop or window system connection: drained
+// events are injected into it directly, and rendering stays with the render loop. Used
+// only on the render thread.
+class RemoteInput {
+public:
+    explicit RemoteInput(vtkRenderWindow* window);
+    ~RemoteInput();
+
+    // Call when the window is resized, so positions map to the new size.
+    void set_size(int width, int height);
+
+    struct Drained {
+        int64_t oldest_received_us = -1; // webrtc_monotonic_time_us, -1 if nothing was queued
+        bool changed = false;            // false if there was nothing but hover moves
+    };
+
+    // Applies every event queued in the session, coalescing pointer moves.
+    Drained drain(webrtc_session_t* session);
+
+private:
+    void apply(const webrtc_input_event_t& event);
+
+    vtkRenderWindow* window_;
+    vtkSmartPointer<vtkRenderWindowInteractor> interactor_;
+    vtkNew<vtkInteractorStyleTrackballCamera> style_;
+    std::array<webrtc_input_event_t, 64> events_{};
+};
+
+#endif // VTK_CUBE_REMOTE_INPUT_H
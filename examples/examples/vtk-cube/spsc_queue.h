@@ -0,0 +1,158 @@
+// Lock-free single-producer/single-consumer queues for the streaming pipeline
+#ifndef VTK_CUBE_SPSC_QUEUE_H
+#define VTK_CUBE_SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Bounded wait-free ring buffer. Exactly one thread may push and exactly one
+// (other) thread may pop.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : capacity_(capacity < 1 ? 1 : capacity) {
+        size_t slots = 1;
+        while (slots < capacity_) slots <<= 1;
+        slots_.resize(slots);
+        mask_ = slots - 1;
+    }
+
+    bool try_push(T value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= capacity_) return false;
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& out) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        out = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    // Head and tail sit on separate cache lines so the two threads do not
+    // invalidate each other's line on every operation.
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t capacity_;
+    size_t mask_ = 0;
+    std::vector<T> slots_;
+};
+
+// Hands pooled frames from one pipeline stage to the next with a "latest frame
+// wins" policy. The pool is allocated up front; frames move between the
+// producer and the consumer through two SpscQueues (ready and free), so the
+// steady state neither allocates nor takes a lock. A mutex is only touched when
+// the consumer runs out of frames and goes to sleep.
+template <typename T>
+class FrameChannel {
+public:
+    // depth frames may wait between the stages. The pool holds depth + 2, one
+    // more being filled by the producer and one more held by the consumer.
+    // Both queues can hold the whole pool, so pushes never fail.
+    explicit FrameChannel(size_t depth = 1) : ready_(depth + 2), free_(depth + 2) {
+        for (size_t i = 0; i < depth + 2; ++i) {
+            frames_.push_back(std::make_unique<T>());
+            free_.try_push(frames_.back().get());
+        }
+    }
+
+    // Producer side: an empty frame to fill, or nullptr if every frame is queued
+    // or held by the consumer. The producer should then skip this frame rather
+    // than wait; once the consumer catches up it keeps only the newest anyway.
+    T* acquire() {
+        if (spare_) return std::exchange(spare_, nullptr);
+        T* frame = nullptr;
+        if (!free_.try_pop(frame)) dropped_.fetch_add(1, std::memory_order_relaxed);
+        return frame;
+    }
+
+    // Producer side: returns an acquired frame that was not filled after all.
+    void recycle(T* frame) { spare_ = frame; }
+
+    // Producer side: passes a filled frame on.
+    void publish(T* frame) {
+        ready_.try_push(frame);
+        // Pairs with the fence in wait_latest: either the consumer sees the frame
+        // or this sees waiting_, so a sleeping consumer is always woken.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
+        }
+    }
+
+    // Consumer side: the newest published frame; older ones are dropped
+    // unprocessed. Returns nullptr if nothing is ready.
+    T* take_latest() {
+        T* latest = nullptr;
+        T* frame = nullptr;
+        while (ready_.try_pop(frame)) {
+            if (latest) {
+                free_.try_push(latest);
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            latest = frame;
+        }
+        return latest;
+    }
+
+    // Consumer side: like take_latest, but sleeps up to timeout for a frame.
+    // Returns nullptr on timeout or once the channel is closed and drained.
+    T* wait_latest(std::chrono::milliseconds timeout) {
+        if (T* frame = take_latest()) return frame;
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait_for(lock, timeout, [this] { return !ready_.empty() || closed_.load(); });
+        waiting_.store(false);
+        lock.unlock();
+        return take_latest();
+    }
+
+    // Consumer side: gives a processed frame back to the producer.
+    void release(T* frame) { free_.try_push(frame); }
+
+    // Wakes and stops the consumer; called by the producer when it exits.
+    void close() {
+        closed_.store(true);
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_all();
+    }
+
+    bool closed() const { return closed_.load() && ready_.empty(); }
+    size_t queued() const { return ready_.size(); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<std::unique_ptr<T>> frames_;
+    SpscQueue<T*> ready_;
+    SpscQueue<T*> free_;
+    T* spare_ = nullptr; // producer-only
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> waiting_{false};
+    std::atomic<bool> closed_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+#endif // VTK_CUBE_SPSC_QUEUE_H
@@ -0,0 +1,59 @@
+// Per-stage timing for the streaming pipeline
+#ifndef VTK_CUBE_STAGE_STATS_H
+#define VTK_CUBE_STAGE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Accumulates the duration of one pipeline stage. record() is called only by
+// the stage's own thread; snapshot() is called by one reporting thread and returns
+// the totals since the previous snapshot.
+class StageStats {
+public:
+    struct Snapshot {
+        uint64_t count = 0;
+        double avg_ms = 0.0;
+        double max_ms = 0.0;
+    };
+
+    explicit StageStats(const char* name) : name_(name) {}
+
+    void record(int64_t duration_us) {
+        count_.fetch_add(1, std::memory_order_relaxed);
+        total_us_.fetch_add(duration_us, std::memory_order_relaxed);
+        if (duration_us > max_us_.load(std::memory_order_relaxed)) {
+            max_us_.store(duration_us, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename TimePoint>
+    void record(TimePoint start, TimePoint end) {
+        record(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    }
+
+    Snapshot snapshot() {
+        const uint64_t count = count_.load(std::memory_order_relaxed);
+        const int64_t total = total_us_.load(std::memory_order_relaxed);
+        Snapshot s;
+        s.count = count - last_count_;
+        if (s.count > 0) s.avg_ms = (total - last_total_us_) / 1000.0 / s.count;
+        s.max_ms = max_us_.exchange(0, std::memory_order_relaxed) / 1000.0;
+        last_count_ = count;
+        last_total_us_ = total;
+        return s;
+    }
+
+    const char* name() const { return name_; }
+
+private:
+    const char* name_;
+    std::atomic<uint64_t> count_{0};
+    std::atomic<int64_t> total_us_{0};
+    std::atomic<int64_t> max_us_{0};
+    // Reader-side state
+    uint64_t last_count_ = 0;
+    int64_t last_total_us_ = 0;
+};
+
+#endif // VTK_CUBE_STAGE_STATS_H
@@ -1,6 +1,7 @@
 #ifndef WEBRTC_C_API_H
 #define WEBRTC_C_API_H
 
+#include <stddef.h>
 #include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
@@ -10,18 +11,421 @@ typedef struct webrtc_session webrtc_session_t;
 typedef void (*webrtc_input_callback_t)(const void* data, int len, void* user_data);
 typedef void (*webrtc_signal_callback_t)(const char* msg, void* user_data);
 
+// config_json may be NULL or "" for the defaults. Recognized keys:
+//   "encoder": {
+//       "backend": "libvpx",             or a name given to webrtc_register_encoder_backend
+//       "codec": "vp9" | "vp8",          (default "vp9"; "h264" and "h265" need another backend)
+//       "bitrate_kbps": 1000,            target bitrate
+//       "max_bitrate_kbps": N,           rate control overshoot limit (default: the target)
+//       "cpu_used": 8,                   libvpx speed, VP9 -9..9 / VP8 -16..16; higher is faster
+//       "deadline": "realtime" | "good" | "best",
+//       "threads": 0,                    0 = available cores, up to 8
+//       "tile_columns_log2": N,          VP9 only (default: one column per thread)
+//       "keyframe_interval": 0,          max frames between keyframes, 0 = encoder decides
+//       "error_resilient": true }
+//   "async_encode": {"queue_depth": 2, "drop_policy": "drop_oldest" | "drop_newest" | "block"}
+//       Encode on a dedicated thread: send_frame calls only queue the frame and return.
+//       When the queue is full, drop the oldest queued frame, the new frame, or wait.
+//   "adaptive_bitrate": {"min_bitrate_kbps": 150, "max_bitrate_kbps": N, "kbps_per_megapixel": 400}
+//       Follow the receiver's RTCP loss reports and REMB: start at encoder.bitrate_kbps and
+//       move between the min and max (default max: encoder.bitrate_kbps). Frames larger than
+//       the target allows (kbps_per_megapixel) are halved, up to 3 times, before encoding.
+//   "repeat_frames": false
+//       Keep the encoder's last input so webrtc_session_repeat_frame can send it again.
+//       Costs one copy per I420 or NV12 frame, which is otherwise only borrowed.
+//   "abs_capture_time": false
+//       Stamp each frame's RTP packets with its capture time as the abs-capture-time header
+//       extension, when the browser negotiates it, so the receiver can measure latency from
+//       capture. Frame timestamps must then be webrtc_monotonic_time_us() values.
+// Returns NULL if the config is invalid.
+// The answer offers only the session's codec. ICE gathering starts here rather than when
+// the offer arrives; candidates found before a signal callback is set are sent in the
+// answer instead of one by one.
 webrtc_session_t* webrtc_session_create(const char* config_json, webrtc_input_callback_t cb, void* user_data);
+
+// A context shares one runtime (thread pool), codec setup and optionally one UDP socket
+// between many sessions, e.g. one render host streaming to many viewers. Sessions created
+// in it start no threads of their own apart from their encoder threads.
+// config_json may be NULL or "" for the defaults. Recognized keys:
+//   "worker_threads": 0,    runtime threads for all sessions, 0 = available cores, up to 4
+//   "blocking_threads": 2,  threads for blocking work such as name lookups
+//   "udp_mux_port": N,      ICE for every session over one IPv4 UDP socket on this port
+//                           (0 = any free port); without it each session binds its own
+//   "warm_connections": 0,  peer connections kept ready for new sessions, up to 64, with
+//                           their candidates gathered; refilled as sessions take them
+//   "codecs": [...]         the codecs sessions may encode, e.g. ["vp9"]; answers offer
+//                           only these (default: every codec)
+// Returns NULL if the config is invalid or the UDP port cannot be bound.
+typedef struct webrtc_context webrtc_context_t;
+webrtc_context_t* webrtc_context_create(const char* config_json);
+// Like webrtc_session_create, on the context's runtime. Destroy the session with
+// webrtc_session_destroy as usual.
+webrtc_session_t* webrtc_context_create_session(webrtc_context_t* context, const char* config_json,
+                                                webrtc_input_callback_t cb, void* user_data);
+// Releases the caller's reference. Sessions still open keep the context running until
+// the last of them is destroyed.
+void webrtc_context_destroy(webrtc_context_t* context);
+typedef struct {
+    uint32_t sessions;          // created in the context and not yet destroyed
+    uint32_t warm_connections;  // ready for the next sessions
+    uint64_t warm_hits;         // sessions that started on a warm connection
+    uint64_t warm_misses;       // sessions that found the pool empty
+} webrtc_context_stats_t;
+int webrtc_context_get_stats(webrtc_context_t* context, webrtc_context_stats_t* stats);
 void webrtc_session_send_frame(webrtc_session_t* session, int width, int height, const uint8_t* yuv);
+// Same as webrtc_session_send_frame, with the frame's capture time in microseconds on any
+// monotonic clock. Only differences between frames are used: they become the encoder pts
+// and the RTP timestamp increments, so both follow wall time instead of a fixed frame rate.
+void webrtc_session_send_frame_with_timestamp(webrtc_session_t* session, int width, int height,
+                                              const uint8_t* yuv, int64_t timestamp_us);
 void webrtc_session_destroy(webrtc_session_t* session);
 
+// Pixel layouts accepted by webrtc_session_send_frame_ex.
+typedef enum webrtc_pixel_format {
+    WEBRTC_PIXEL_FORMAT_I420 = 0, // planes: Y, U, V (4:2:0)
+    WEBRTC_PIXEL_FORMAT_NV12 = 1, // planes: Y, interleaved UV (4:2:0)
+    WEBRTC_PIXEL_FORMAT_RGBA = 2, // plane: R, G, B, A bytes per pixel, top row first
+    WEBRTC_PIXEL_FORMAT_BGRA = 3, // plane: B, G, R, A bytes per pixel, top row first
+} webrtc_pixel_format_t;
+
+// Encode this frame as a keyframe, e.g. when a new viewer joins.
+#define WEBRTC_FRAME_FLAG_KEYFRAME (1u << 0)
+
+typedef void (*webrtc_frame_release_callback_t)(void* release_user_data);
+
+// Describes a caller-owned frame without copying it.
+typedef struct webrtc_video_frame {
+    webrtc_pixel_format_t format;
+    int width;
+    int height;
+    const uint8_t* planes[3]; // unused planes are ignored
+    int strides[3];           // bytes per row; 0 means tightly packed
+    int64_t timestamp_us;     // capture time, as for webrtc_session_send_frame_with_timestamp
+    uint32_t flags;           // WEBRTC_FRAME_FLAG_*
+    // Optional. Called exactly once when the library no longer reads the planes,
+    // including when the frame is rejected. It may run on another thread.
+    webrtc_frame_release_callback_t release;
+    void* release_user_data;
+} webrtc_video_frame_t;
+
+// Encodes and sends the described frame. I420 is encoded straight from the caller's
+// planes; NV12 and RGB(A) are converted (RGB with BT.601 limited range).
+// In async_encode mode a frame with a release callback stays borrowed until the encoder
+// thread is done with it; a frame without one is copied before this returns.
+// Returns 0 on success (in async mode: queued, or dropped by the drop policy),
+// -1 if the frame was rejected or could not be encoded.
+int webrtc_session_send_frame_ex(webrtc_session_t* session, const webrtc_video_frame_t* frame);
+
+// For a scene that has not changed: encodes the last frame again, stamped timestamp_us,
+// without conversion or scaling. An unchanged frame costs the encoder little and codes to
+// a few bytes, so an idle renderer can send it at a low rate as a keepalive instead of
+// streaming at full rate, or send nothing at all. With WEBRTC_FRAME_FLAG_KEYFRAME in
+// flags it is sent as a keyframe, which repairs anything the viewer lost since.
+// Needs "repeat_frames" in config_json. In async_encode mode the repeat is queued and
+// skipped if a new frame is already waiting. Returns 0 on success, -1 if there is no frame
+// to repeat or encoding failed.
+int webrtc_session_repeat_frame(webrtc_session_t* session, int64_t timestamp_us, uint32_t flags);
+
+// Frame counters since the session was created.
+typedef struct webrtc_encode_queue_stats {
+    uint64_t submitted; // frames accepted by the send_frame calls
+    uint64_t encoded;
+    uint64_t dropped;   // discarded by the async_encode drop policy
+    uint32_t queued;    // waiting for the encoder thread right now (0 in sync mode)
+} webrtc_encode_queue_stats_t;
+
+// Fills *stats; returns 0 on success, -1 on error.
+int webrtc_session_get_encode_queue_stats(webrtc_session_t* session, webrtc_encode_queue_stats_t* stats);
+
+// Session-wide counters. Frame counts are live; encode times cover the frames encoded
+// since the previous webrtc_session_get_stats call, so poll from a single thread; transport
+// figures come from the peer connection's stats, refreshed once a second.
+typedef struct webrtc_session_stats {
+    uint64_t frames_submitted;
+    uint64_t frames_encoded;
+    uint64_t frames_dropped;      // by the async_encode drop policy
+    uint64_t frames_repeated;     // by webrtc_session_repeat_frame, not in frames_encoded
+    uint32_t encode_queue_depth;  // 0 in sync mode
+    uint32_t encode_time_samples; // frames behind the encode_time_* figures
+    uint32_t encode_time_p50_us;  // conversion, scaling and encoding, within ~10%
+    uint32_t encode_time_p99_us;
+    uint32_t encode_time_max_us;
+    uint32_t target_bitrate_kbps; // adaptive_bitrate target, or encoder.bitrate_kbps
+    uint32_t send_bitrate_kbps;   // measured over the last second
+    uint64_t bytes_sent;          // RTP payload bytes
+    uint64_t packets_sent;
+    double rtt_ms;                // -1 until measured
+    uint64_t nack_count;          // received from the viewer
+    uint64_t pli_count;
+    uint64_t fir_count;
+} webrtc_session_stats_t;
+
+// Fills *stats without blocking on the encoder; returns 0 on success, -1 on error.
+int webrtc_session_get_stats(webrtc_session_t* session, webrtc_session_stats_t* stats);
+
+// What the adaptive_bitrate controller currently allows.
+typedef struct webrtc_bitrate_target {
+    uint32_t bitrate_kbps;
+    uint32_t max_pixels; // largest width * height worth encoding at this bitrate
+} webrtc_bitrate_target_t;
+
+typedef void (*webrtc_bitrate_callback_t)(const webrtc_bitrate_target_t* target, void* user_data);
+
+// Called once right away with the current target, then whenever the bitrate changes by 5%
+// or more, on a library thread. Rendering at most max_pixels saves the encoder from
+// downscaling. Returns -1 if adaptive_bitrate is not enabled. Pass NULL to unset.
+int webrtc_session_set_bitrate_callback(webrtc_session_t* session, webrtc_bitrate_callback_t cb, void* user_data);
+
+// Simulcast: one frame encoded at up to four sizes, each session forwarded one of them, so
+// viewers on different links share a single conversion and one encode per layer instead of
+// one encode each. config_json (NULL or "" for defaults):
+//   "encoder": shared by every layer's encoder, with the keys of webrtc_session_create
+//   "layers": [{"scale_down_log2": 0..3, "bitrate_kbps": N}, ...], largest first; the
+//       layer is the frame halved scale_down_log2 times. Default: full, half and quarter
+//       size at encoder.bitrate_kbps, a quarter and a sixteenth of it (at least 100).
+// Returns NULL if the config is invalid.
+typedef struct webrtc_simulcast webrtc_simulcast_t;
+webrtc_simulcast_t* webrtc_simulcast_create(const char* config_json);
+// Subscribed sessions receive nothing more; they need not unsubscribe first.
+void webrtc_simulcast_destroy(webrtc_simulcast_t* simulcast);
+
+// Converts the frame, downscales it and encodes every layer that has a subscriber, on the
+// calling thread, then sends each subscribed session its layer. The release callback runs
+// before this returns. Returns 0 on success, -1 if the frame was rejected or encoding failed.
+int webrtc_simulcast_send_frame(webrtc_simulcast_t* simulcast, const webrtc_video_frame_t* frame);
+
+// Sends the session's track the given layer of simulcast from the next frame on, starting
+// with a keyframe; -1 picks the layer by the receiver's bandwidth. That needs
+// "adaptive_bitrate" in the session's config_json (without it layer 0 is sent): the session
+// gets the largest layer whose bitrate fits its target, moving up only with 30% to spare.
+// The session's codec must match the simulcast encoder's, and frames should then no longer
+// be sent to the session directly. Replaces an earlier subscription. Returns 0 on success.
+int webrtc_session_subscribe_simulcast(webrtc_session_t* session, webrtc_simulcast_t* simulcast, int layer);
+int webrtc_session_unsubscribe_simulcast(webrtc_session_t* session);
+
+typedef struct webrtc_simulcast_layer_stats {
+    uint32_t width;  // 0 until the layer is first encoded
+    uint32_t height;
+    uint32_t bitrate_kbps;
+    uint32_t subscribers; // sessions sent the last frame's layer
+    uint64_t frames_encoded;
+    uint64_t keyframes;
+} webrtc_simulcast_layer_stats_t;
+
+// Fills *stats for layer 0..n-1; returns 0 on success, -1 on error.
+int webrtc_simulcast_get_layer_stats(webrtc_simulcast_t* simulcast, int layer, webrtc_simulcast_layer_stats_t* stats);
+
+// Fan-out: one encoder and one video track shared by every session created from it, for
+// many viewers of the same stream. Each frame is encoded and packetized once; the sessions
+// share its packets and only rewrite RTP headers, so encoding costs the same for any
+// number of viewers and a viewer costs only its connection. Viewers' keyframe requests
+// (PLI, FIR) are merged: at most one keyframe per keyframe_min_interval_ms answers all of
+// them. config_json (NULL or "" for defaults):
+//   "encoder", "repeat_frames", "abs_capture_time": as for webrtc_session_create
+//   "keyframe_min_interval_ms": 300
+// Returns NULL if the config is invalid.
+typedef struct webrtc_fanout webrtc_fanout_t;
+webrtc_fanout_t* webrtc_context_create_fanout(webrtc_context_t* context, const char* config_json);
+// Open sessions keep the encoder running until they are destroyed.
+void webrtc_fanout_destroy(webrtc_fanout_t* fanout);
+// A viewer session on the context's runtime, sending the fan-out's track. The video keys of
+// config_json are ignored; adaptive_bitrate and async_encode are rejected, since viewers
+// share one encoder. Signalling, input and stats work as for any session, and frames sent
+// to the session go to every viewer. Destroy it with webrtc_session_destroy.
+webrtc_session_t* webrtc_fanout_create_session(webrtc_fanout_t* fanout, const char* config_json,
+                                               webrtc_input_callback_t cb, void* user_data);
+// As webrtc_session_send_frame_ex and webrtc_session_repeat_frame, for every viewer at once.
+// Frames are encoded on the calling thread, with or without viewers.
+int webrtc_fanout_send_frame(webrtc_fanout_t* fanout, const webrtc_video_frame_t* frame);
+int webrtc_fanout_repeat_frame(webrtc_fanout_t* fanout, int64_t timestamp_us, uint32_t flags);
+
+typedef struct webrtc_fanout_stats {
+    uint32_t viewers;                // sessions not yet destroyed
+    uint64_t frames_encoded;
+    uint64_t keyframe_requests;      // PLI and FIR received from all viewers
+    uint64_t keyframes_for_requests; // keyframes those requests caused
+} webrtc_fanout_stats_t;
+
+// Fills *stats; returns 0 on success, -1 on error.
+int webrtc_fanout_get_stats(webrtc_fanout_t* fanout, webrtc_fanout_stats_t* stats);
+
+// Encoder backends. Sessions encode with libvpx unless "encoder": {"backend": NAME} names
+// a backend the application registered, e.g. a hardware H.264 or H.265 encoder; "codec"
+// may then be "h264" or "h265" too. libvpx-only keys (cpu_used, deadline, tile_columns_log2,
+// error_resilient) are ignored by other backends, and an unregistered name makes session
+// creation fail. The library calls a backend's encoders from one thread at a time each.
+typedef enum webrtc_codec {
+    WEBRTC_CODEC_VP8 = 0,
+    WEBRTC_CODEC_VP9 = 1,
+    WEBRTC_CODEC_H264 = 2,
+    WEBRTC_CODEC_H265 = 3,
+} webrtc_codec_t;
+
+typedef struct webrtc_encoder_params {
+    int codec; // webrtc_codec_t
+    uint32_t width;
+    uint32_t height;
+    uint32_t bitrate_kbps;
+    uint32_t max_bitrate_kbps;
+    uint32_t keyframe_interval; // 0 = only when forced
+    uint32_t threads;
+} webrtc_encoder_params_t;
+
+// Takes one encoded frame: a VP8/VP9 frame, or an H.264/H.265 access unit in Annex B
+// format with parameter sets in front of every keyframe. data is only valid during the call.
+typedef void (*webrtc_encoded_output_t)(const uint8_t* data, size_t len, void* output_context);
+
+typedef struct webrtc_encoder_backend {
+    // Returns a new encoder for params, or NULL on failure.
+    void* (*create)(const webrtc_encoder_params_t* params, void* user_data);
+    // Encodes an I420 frame of the created size. timestamp_us is the pts in microseconds;
+    // WEBRTC_FRAME_FLAG_KEYFRAME in flags forces a keyframe. The planes are only valid
+    // during the call. Calls output for each encoded frame; returns 0 on success.
+    int (*encode)(void* encoder, const webrtc_video_frame_t* frame, webrtc_encoded_output_t output,
+                  void* output_context);
+    // Optional: changes the target bitrate of a running encoder; returns 0 on success.
+    // NULL if the rate is fixed at create, which the library then keeps to.
+    int (*set_bitrate)(void* encoder, uint32_t bitrate_kbps);
+    void (*destroy)(void* encoder);
+    void* user_data; // passed to create
+} webrtc_encoder_backend_t;
+
+// Adds or replaces the backend called name ("libvpx" is reserved). The struct is copied;
+// user_data must stay valid while encoders from it exist. Returns 0 on success.
+int webrtc_register_encoder_backend(const char* name, const webrtc_encoder_backend_t* backend);
+
+// Binary input events. Text messages on the "input" data channel still go to the
+// webrtc_input_callback_t given at creation; binary messages are one or more 32-byte
+// little-endian records, queued in a lock-free ring for webrtc_session_poll_input:
+//   u8 type, u8 button, u8 buttons, u8 modifiers, u32 key,
+//   f32 x, f32 y, f32 delta_x, f32 delta_y, f64 timestamp in milliseconds
+// Records of an unknown type are skipped; a message of any other length is dropped.
+typedef enum webrtc_input_event_type {
+    WEBRTC_INPUT_POINTER_MOVE = 1,
+    WEBRTC_INPUT_POINTER_DOWN = 2,
+    WEBRTC_INPUT_POINTER_UP = 3,
+    WEBRTC_INPUT_WHEEL = 4,
+    WEBRTC_INPUT_KEY_DOWN = 5,
+    WEBRTC_INPUT_KEY_UP = 6
+} webrtc_input_event_type_t;
+
+#define WEBRTC_INPUT_MOD_SHIFT (1u << 0)
+#define WEBRTC_INPUT_MOD_CTRL (1u << 1)
+#define WEBRTC_INPUT_MOD_ALT (1u << 2)
+#define WEBRTC_INPUT_MOD_META (1u << 3)
+
+typedef struct webrtc_input_event {
+    uint8_t kind;         // webrtc_input_event_type_t
+    uint8_t button;       // pointer down/up: 0 left, 1 middle, 2 right
+    uint8_t buttons;      // buttons held, bit 0 left, bit 1 right, bit 2 middle (as DOM MouseEvent.buttons)
+    uint8_t modifiers;    // WEBRTC_INPUT_MOD_*
+    uint32_t key;         // key events: Unicode code point, or the DOM keyCode | 0x80000000 for other keys
+    float x, y;           // pointer position as a fraction of the video, origin top-left
+    float delta_x, delta_y; // wheel, in pixels; positive delta_y scrolls down
+    int64_t timestamp_us; // when the event happened, on the sender's clock
+    int64_t received_us;  // when the library received it, on the webrtc_monotonic_time_us clock
+} webrtc_input_event_t;
+
+// Collapse each run of pointer moves with the same buttons and modifiers into its last
+// move. The merged event keeps the received_us of the first one.
+#define WEBRTC_INPUT_POLL_COALESCE_MOVES (1u << 0)
+
+// Copies up to max_events queued events into events, oldest first, and returns how many
+// (0 if none), or -1 on error. Takes no locks and does not allocate; meant to be called
+// once per frame on the render thread. At most 4096 events wait; newer ones are dropped.
+int webrtc_session_poll_input(webrtc_session_t* session, webrtc_input_event_t* events, int max_events,
+                              uint32_t flags);
+
+typedef void (*webrtc_input_ready_callback_t)(void* user_data);
+
+// Called on a library thread when events arrive and the queue has been polled since the
+// previous call, so a renderer that sleeps while idle can wake up. Pass NULL to unset.
+// Returns 0 on success, -1 on error.
+int webrtc_session_set_input_ready_callback(webrtc_session_t* session, webrtc_input_ready_callback_t cb,
+                                            void* user_data);
+
+// Microseconds on the library's monotonic clock.
+int64_t webrtc_monotonic_time_us(void);
+// Unix time in microseconds of a webrtc_monotonic_time_us() value. The offset is fixed when
+// the library first reads its clock, and is the one abs-capture-time timestamps use.
+int64_t webrtc_monotonic_to_unix_us(int64_t monotonic_us);
+
 // New signaling API:
+// The callback gets the answer as {"type": "answer", "sdp": ...} and each local ICE candidate
+// as {"candidate": ..., "sdpMid": ..., "sdpMLineIndex": ...}.
 void webrtc_session_set_signal_callback(webrtc_session_t* session, webrtc_signal_callback_t cb, void* user_data);
+// Neither call waits for the work it queues; errors are only logged. All the remote
+// description and candidate calls, _async or not, share one queue per session: each is
+// applied once the one queued before it has completed, so a candidate queued after its
+// description never reaches the peer connection first. Signalling and the diagnostics
+// calls below take no lock shared with the frame path or with each other.
 void webrtc_session_set_remote_description(webrtc_session_t* session, const char* sdp_json);
 void webrtc_session_add_ice_candidate(webrtc_session_t* session, const char* candidate_json);
 
+// Reports the outcome of an _async call, once, on a library thread. status is 0 on success,
+// with result the call's JSON output or NULL, and -1 on failure, with result the error
+// message. result is only valid during the callback.
+typedef void (*webrtc_completion_callback_t)(int status, const char* result, void* user_data);
+
+// Non-blocking variants that report completion through cb, which may be NULL. They return
+// -1 without calling cb if the session is NULL or the input does not parse, and 0 once the
+// work is queued. Completions arrive in the order the calls were made, and an offer's
+// follows the answer's signal callback.
+int webrtc_session_set_remote_description_async(webrtc_session_t* session, const char* sdp_json,
+                                                webrtc_completion_callback_t cb, void* user_data);
+int webrtc_session_add_ice_candidate_async(webrtc_session_t* session, const char* candidate_json,
+                                           webrtc_completion_callback_t cb, void* user_data);
+
+// Typed signaling: the same messages without JSON on either side.
+typedef enum webrtc_sdp_type {
+    WEBRTC_SDP_TYPE_OFFER = 0,
+    WEBRTC_SDP_TYPE_ANSWER = 1,
+    WEBRTC_SDP_TYPE_PRANSWER = 2,
+} webrtc_sdp_type_t;
+
+typedef enum webrtc_signal_kind {
+    WEBRTC_SIGNAL_SDP = 0,       // sdp_type, sdp, sdp_len are set
+    WEBRTC_SIGNAL_CANDIDATE = 1, // candidate, candidate_len, sdp_mid, sdp_mline_index are set
+} webrtc_signal_kind_t;
+
+// A local description or ICE candidate to send to the peer. The strings are
+// NUL-terminated and only valid during the callback.
+typedef struct webrtc_signal {
+    int kind;            // webrtc_signal_kind_t
+    int sdp_type;        // webrtc_sdp_type_t
+    const char* sdp;
+    size_t sdp_len;
+    const char* candidate;
+    size_t candidate_len;
+    const char* sdp_mid;
+    int sdp_mline_index; // -1 if unset
+} webrtc_signal_t;
+
+typedef void (*webrtc_signal_message_callback_t)(const webrtc_signal_t* signal, void* user_data);
+
+// Use instead of webrtc_session_set_signal_callback; setting either replaces the other.
+// Called on a library thread. Returns 0 on success, -1 on error.
+int webrtc_session_set_signal_message_callback(webrtc_session_t* session, webrtc_signal_message_callback_t cb,
+                                               void* user_data);
+// Applies len bytes of SDP (no NUL terminator needed); an offer is answered through the
+// signal callback. Returns -1 if the type is unknown or the SDP is not UTF-8.
+int webrtc_session_set_remote_sdp(webrtc_session_t* session, webrtc_sdp_type_t type, const char* sdp, size_t len);
+// sdp_mid may be NULL and sdp_mline_index -1 when the peer did not send them.
+int webrtc_session_add_candidate(webrtc_session_t* session, const char* candidate, const char* sdp_mid,
+                                 int sdp_mline_index);
+// Non-blocking variants of the two above, as for webrtc_session_set_remote_description_async.
+int webrtc_session_set_remote_sdp_async(webrtc_session_t* session, webrtc_sdp_type_t type, const char* sdp, size_t len,
+                                        webrtc_completion_callback_t cb, void* user_data);
+int webrtc_session_add_candidate_async(webrtc_session_t* session, const char* candidate, const char* sdp_mid,
+                                       int sdp_mline_index, webrtc_completion_callback_t cb, void* user_data);
+
 // Returns a JSON string with local ICE credentials and selected remote candidate info.
-// The returned string must be freed with free().
+// The returned string must be freed with free(). Blocks the caller until the library's
+// runtime has answered, so it must not be called from a library callback.
 char* webrtc_session_get_diagnostics(webrtc_session_t* session);
+// The same JSON as the result of cb, without blocking. Returns 0 once the request is
+// queued, -1 if the session is NULL.
+int webrtc_session_get_diagnostics_async(webrtc_session_t* session, webrtc_completion_callback_t cb, void* user_data);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,193 @@
+// RGB -> I420 conversion: scalar reference kernel and runtime dispatch
+#include "yuv_convert_internal.h"
+
+#include <initializer_list>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Rows of each table sum to 220 (limited) / 256 (full) for luma and to 0 for
+// chroma, so white maps to 235/255 and greys map to exactly 128 chroma.
+const YuvCoefficients kBt601Limited = {66, 129, 25, -38, -74, 112, 112, -94, -18, (16 << 8) + 128, 0x8080};
+const YuvCoefficients kBt601Full = {77, 150, 29, -43, -85, 128, 128, -107, -21, 128, 0x807F};
+const YuvCoefficients kBt709Limited = {47, 157, 16, -26, -86, 112, 112, -102, -10, (16 << 8) + 128, 0x8080};
+const YuvCoefficients kBt709Full = {54, 183, 19, -29, -99, 128, 128, -116, -12, 128, 0x807F};
+
+inline uint8_t luma(const YuvCoefficients& c, int r, int g, int b) {
+    return static_cast<uint8_t>((c.yr * r + c.yg * g + c.yb * b + c.y_bias) >> 8);
+}
+
+inline uint8_t chroma(int cr, int cg, int cb, uint16_t bias, int r, int g, int b) {
+    return static_cast<uint8_t>((cr * r + cg * g + cb * b + bias) >> 8);
+}
+
+bool cpu_has_sse41() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("sse4.1");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_has_avx2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+YuvRowPairKernel kernel_function(YuvKernel kernel) {
+    switch (kernel) {
+#if defined(YUV_CONVERT_HAVE_AVX2)
+    case YuvKernel::AVX2: return yuv_row_pair_avx2;
+#endif
+#if defined(YUV_CONVERT_HAVE_SSE41)
+    case YuvKernel::SSE41: return yuv_row_pair_sse41;
+#endif
+#if defined(YUV_CONVERT_HAVE_NEON)
+    case YuvKernel::NEON: return yuv_row_pair_neon;
+#endif
+    default: return yuv_row_pair_scalar;
+    }
+}
+
+} // namespace
+
+const YuvCoefficients& yuv_coefficients(YuvMatrix matrix, YuvRange range) {
+    if (matrix == YuvMatrix::BT709) {
+        return range == YuvRange::Full ? kBt709Full : kBt709Limited;
+    }
+    return range == YuvRange::Full ? kBt601Full : kBt601Limited;
+}
+
+int yuv_row_pair_scalar(const uint8_t* src0, const uint8_t* src1, int width,
+                        RgbLayout layout, const YuvCoefficients& c,
+                        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    const RgbOffsets o = rgb_offsets(layout);
+    for (int x = 0; x < width; x += 2) {
+        // The last column of an odd width is paired with itself.
+        const int step = (x + 1 < width) ? o.bpp : 0;
+        const uint8_t* a = src0 + x * o.bpp;
+        const uint8_t* b = src1 + x * o.bpp;
+        y0[x] = luma(c, a[o.r], a[o.g], a[o.b]);
+        y1[x] = luma(c, b[o.r], b[o.g], b[o.b]);
+        if (step) {
+            y0[x + 1] = luma(c, a[step + o.r], a[step + o.g], a[step + o.b]);
+            y1[x + 1] = luma(c, b[step + o.r], b[step + o.g], b[step + o.b]);
+        }
+        int r = (a[o.r] + a[step + o.r] + b[o.r] + b[step + o.r] + 2) >> 2;
+        int g = (a[o.g] + a[step + o.g] + b[o.g] + b[step + o.g] + 2) >> 2;
+        int bl = (a[o.b] + a[step + o.b] + b[o.b] + b[step + o.b] + 2) >> 2;
+        u[x / 2] = chroma(c.ur, c.ug, c.ub, c.c_bias, r, g, bl);
+        v[x / 2] = chroma(c.vr, c.vg, c.vb, c.c_bias, r, g, bl);
+    }
+    return width;
+}
+
+bool yuv_kernel_supported(YuvKernel kernel) {
+    switch (kernel) {
+    case YuvKernel::Auto:
+    case YuvKernel::Scalar:
+        return true;
+    case YuvKernel::SSE41:
+#if defined(YUV_CONVERT_HAVE_SSE41)
+        return cpu_has_sse41();
+#else
+        return false;
+#endif
+    case YuvKernel::AVX2:
+#if defined(YUV_CONVERT_HAVE_AVX2)
+        return cpu_has_avx2();
+#else
+        return false;
+#endif
+    case YuvKernel::NEON:
+#if defined(YUV_CONVERT_HAVE_NEON)
+        return true; // Mandatory on AArch64, and the build only enables it there
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+YuvKernel yuv_kernel_resolve(YuvKernel kernel) {
+    if (kernel != YuvKernel::Auto) {
+        return yuv_kernel_supported(kernel) ? kernel : YuvKernel::Scalar;
+    }
+    // Probing the CPU is not free, so the Auto choice is made once.
+    static const YuvKernel best = [] {
+        for (YuvKernel k : {YuvKernel::AVX2, YuvKernel::SSE41, YuvKernel::NEON}) {
+            if (yuv_kernel_supported(k)) return k;
+        }
+        return YuvKernel::Scalar;
+    }();
+    return best;
+}
+
+const char* yuv_kernel_name(YuvKernel kernel) {
+    switch (kernel) {
+    case YuvKernel::Auto: return "auto";
+    case YuvKernel::Scalar: return "scalar";
+    case YuvKernel::SSE41: return "sse4.1";
+    case YuvKernel::AVX2: return "avx2";
+    case YuvKernel::NEON: return "neon";
+    }
+    return "unknown";
+}
+
+void rgb_to_yuv420p(const uint8_t* src, ptrdiff_t src_stride, RgbLayout layout,
+                    int width, int height,
+                    uint8_t* dst_y, ptrdiff_t y_stride,
+                    uint8_t* dst_u, ptrdiff_t u_stride,
+                    uint8_t* dst_v, ptrdiff_t v_stride,
+                    const YuvConvertOptions& options) {
+    if (!src || !dst_y || !dst_u || !dst_v || width <= 0 || height <= 0) return;
+
+    const YuvCoefficients& c = yuv_coefficients(options.matrix, options.range);
+    const YuvRowPairKernel kernel = kernel_function(yuv_kernel_resolve(options.kernel));
+    const int bpp = rgb_offsets(layout).bpp;
+
+    for (int row = 0; row < height; row += 2) {
+        const bool pair = row + 1 < height;
+        const uint8_t* s0 = src + row * src_stride;
+        const uint8_t* s1 = pair ? s0 + src_stride : s0;
+        uint8_t* y0 = dst_y + row * y_stride;
+        uint8_t* y1 = pair ? y0 + y_stride : y0;
+        uint8_t* u = dst_u + (row / 2) * u_stride;
+        uint8_t* v = dst_v + (row / 2) * v_stride;
+
+        int done = kernel(s0, s1, width, layout, c, y0, y1, u, v);
+        if (done < width) {
+            yuv_row_pair_scalar(s0 + done * bpp, s1 + done * bpp, width - done, layout, c,
+                                y0 + done, y1 + done, u + done / 2, v + done / 2);
+        }
+    }
+}
+
+void rgb_to_yuv420p(const unsigned char* rgb, int width, int height, unsigned char* yuv,
+                    const YuvConvertOptions& options) {
+    if (width <= 0 || height <= 0) return;
+    const ptrdiff_t cw = (width + 1) / 2;
+    const ptrdiff_t ch = (height + 1) / 2;
+    uint8_t* y = yuv;
+    uint8_t* u = y + static_cast<ptrdiff_t>(width) * height;
+    uint8_t* v = u + cw * ch;
+    rgb_to_yuv420p(rgb, static_cast<ptrdiff_t>(width) * 3, RgbLayout::RGB24, width, height,
+                   y, width, u, cw, v, cw, options);
+}
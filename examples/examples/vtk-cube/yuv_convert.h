@@ -0,0 +1,68 @@
+// RGB -> I420 (YUV420p) color conversion for the WebRTC streaming path
+#ifndef VTK_CUBE_YUV_CONVERT_H
+#define VTK_CUBE_YUV_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte order of the interleaved source pixels.
+enum class RgbLayout {
+    RGB24,  // vtkImageExport / vtkWindowToImageFilter default
+    RGBA32, // vtkRenderWindow::GetRGBACharPixelData
+    BGRA32,
+};
+
+enum class YuvMatrix {
+    BT601,
+    BT709,
+};
+
+enum class YuvRange {
+    Limited, // Y in [16, 235], UV in [16, 240]
+    Full,    // Y and UV in [0, 255]
+};
+
+// Conversion kernels. Auto picks the fastest one supported by the running CPU.
+enum class YuvKernel {
+    Auto,
+    Scalar,
+    SSE41,
+    AVX2,
+    NEON,
+};
+
+struct YuvConvertOptions {
+    YuvMatrix matrix = YuvMatrix::BT601;
+    YuvRange range = YuvRange::Limited;
+    YuvKernel kernel = YuvKernel::Auto;
+};
+
+// Converts an interleaved RGB image to planar I420.
+// Two source rows are processed per pass so the 2x2 chroma average is computed
+// in the same loop as luma. A negative src_stride walks the source bottom-up,
+// which flips VTK's lower-left-origin images into top-down video frames.
+// Odd widths/heights are supported; the chroma planes are ((w+1)/2)x((h+1)/2).
+void rgb_to_yuv420p(const uint8_t* src, ptrdiff_t src_stride, RgbLayout layout,
+                    int width, int height,
+                    uint8_t* dst_y, ptrdiff_t y_stride,
+                    uint8_t* dst_u, ptrdiff_t u_stride,
+                    uint8_t* dst_v, ptrdiff_t v_stride,
+                    const YuvConvertOptions& options = YuvConvertOptions());
+
+// Convenience overload: tightly packed top-down RGB24 in, tightly packed I420 out.
+void rgb_to_yuv420p(const unsigned char* rgb, int width, int height, unsigned char* yuv,
+                    const YuvConvertOptions& options = YuvConvertOptions());
+
+// Size in bytes of a tightly packed I420 frame.
+inline size_t yuv420p_size(int width, int height) {
+    size_t cw = (static_cast<size_t>(width) + 1) / 2;
+    size_t ch = (static_cast<size_t>(height) + 1) / 2;
+    return static_cast<size_t>(width) * height + 2 * cw * ch;
+}
+
+bool yuv_kernel_supported(YuvKernel kernel);
+// Maps Auto (or an unsupported kernel) to the kernel that will actually run.
+YuvKernel yuv_kernel_resolve(YuvKernel kernel);
+const char* yuv_kernel_name(YuvKernel kernel);
+
+#endif // VTK_CUBE_YUV_CONVERT_H
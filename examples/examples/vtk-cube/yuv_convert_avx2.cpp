@@ -0,0 +1,121 @@
+// RGB -> I420 conversion, AVX2 kernel (32 pixels per iteration)
+#include "yuv_convert_internal.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Coeffs {
+    __m256i yr, yg, yb, ur, ug, ub, vr, vg, vb, y_bias, c_bias;
+    explicit Coeffs(const YuvCoefficients& c)
+        : yr(_mm256_set1_epi16(c.yr)), yg(_mm256_set1_epi16(c.yg)), yb(_mm256_set1_epi16(c.yb)),
+          ur(_mm256_set1_epi16(c.ur)), ug(_mm256_set1_epi16(c.ug)), ub(_mm256_set1_epi16(c.ub)),
+          vr(_mm256_set1_epi16(c.vr)), vg(_mm256_set1_epi16(c.vg)), vb(_mm256_set1_epi16(c.vb)),
+          y_bias(_mm256_set1_epi16(static_cast<short>(c.y_bias))),
+          c_bias(_mm256_set1_epi16(static_cast<short>(c.c_bias))) {}
+};
+
+// The 256-bit pack/hadd instructions work per 128-bit lane; this puts the
+// four 64-bit quarters back into pixel order after each of them.
+inline __m256i fix_lanes(__m256i v) {
+    return _mm256_permute4x64_epi64(v, 0xD8);
+}
+
+// 32 pixels of one row, one channel per register pair, widened to 16 bits.
+struct Pixels32 {
+    __m256i r[2], g[2], b[2];
+};
+
+template <int BPP, int RO, int GO, int BO>
+inline Pixels32 load_pixels(const uint8_t* p) {
+    // Eight pixels per register as 32-bit lanes.
+    __m256i px[4];
+    if (BPP == 3) {
+        // The low lane takes pixels 0-3 from p[0..15], the high lane pixels
+        // 4-7 from p[8..23], so no load reaches past the 24 bytes of the group.
+        const __m256i shuf = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                              4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+        for (int i = 0; i < 4; ++i) {
+            const uint8_t* q = p + 24 * i;
+            __m256i raw = _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(q)));
+            raw = _mm256_inserti128_si256(raw, _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + 8)), 1);
+            px[i] = _mm256_shuffle_epi8(raw, shuf);
+        }
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            px[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+        }
+    }
+
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    auto channel = [&](int offset, int half) {
+        __m256i lo = _mm256_and_si256(_mm256_srli_epi32(px[2 * half], 8 * offset), mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(px[2 * half + 1], 8 * offset), mask);
+        return fix_lanes(_mm256_packus_epi32(lo, hi));
+    };
+    Pixels32 out;
+    for (int half = 0; half < 2; ++half) {
+        out.r[half] = channel(RO, half);
+        out.g[half] = channel(GO, half);
+        out.b[half] = channel(BO, half);
+    }
+    return out;
+}
+
+inline __m256i weighted(__m256i r, __m256i g, __m256i b,
+                        __m256i cr, __m256i cg, __m256i cb, __m256i bias) {
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(r, cr), _mm256_mullo_epi16(g, cg));
+    sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_mullo_epi16(b, cb), bias));
+    return _mm256_srli_epi16(sum, 8);
+}
+
+inline void store_luma(uint8_t* dst, const Pixels32& p, const Coeffs& k) {
+    __m256i lo = weighted(p.r[0], p.g[0], p.b[0], k.yr, k.yg, k.yb, k.y_bias);
+    __m256i hi = weighted(p.r[1], p.g[1], p.b[1], k.yr, k.yg, k.yb, k.y_bias);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), fix_lanes(_mm256_packus_epi16(lo, hi)));
+}
+
+// Rounded average of each 2x2 block: 16 output lanes.
+inline __m256i average_2x2(const __m256i a[2], const __m256i b[2]) {
+    __m256i sum = fix_lanes(_mm256_hadd_epi16(_mm256_add_epi16(a[0], b[0]),
+                                              _mm256_add_epi16(a[1], b[1])));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+inline void store_chroma(uint8_t* dst, __m256i c) {
+    __m256i packed = fix_lanes(_mm256_packus_epi16(c, c));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(packed));
+}
+
+template <int BPP, int RO, int GO, int BO>
+int convert(const uint8_t* src0, const uint8_t* src1, int width, const YuvCoefficients& c,
+            uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    const Coeffs k(c);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const Pixels32 a = load_pixels<BPP, RO, GO, BO>(src0 + x * BPP);
+        const Pixels32 b = load_pixels<BPP, RO, GO, BO>(src1 + x * BPP);
+        store_luma(y0 + x, a, k);
+        store_luma(y1 + x, b, k);
+
+        const __m256i r = average_2x2(a.r, b.r);
+        const __m256i g = average_2x2(a.g, b.g);
+        const __m256i bl = average_2x2(a.b, b.b);
+        store_chroma(u + x / 2, weighted(r, g, bl, k.ur, k.ug, k.ub, k.c_bias));
+        store_chroma(v + x / 2, weighted(r, g, bl, k.vr, k.vg, k.vb, k.c_bias));
+    }
+    return x;
+}
+
+} // namespace
+
+int yuv_row_pair_avx2(const uint8_t* src0, const uint8_t* src1, int width,
+                      RgbLayout layout, const YuvCoefficients& c,
+                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    switch (layout) {
+    case RgbLayout::RGBA32: return convert<4, 0, 1, 2>(src0, src1, width, c, y0, y1, u, v);
+    case RgbLayout::BGRA32: return convert<4, 2, 1, 0>(src0, src1, width, c, y0, y1, u, v);
+    case RgbLayout::RGB24:
+    default: return convert<3, 0, 1, 2>(src0, src1, width, c, y0, y1, u, v);
+    }
+}
@@ -0,0 +1,93 @@
+// Microbenchmark for rgb_to_yuv420p: ns/frame per kernel and resolution
+#include "yuv_convert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Resolution {
+    const char* name;
+    int width, height;
+};
+
+double bench_ns_per_frame(int width, int height, RgbLayout layout, const YuvConvertOptions& options,
+                          int iterations) {
+    const int bpp = layout == RgbLayout::RGB24 ? 3 : 4;
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * bpp);
+    std::mt19937 rng(42);
+    for (auto& p : rgb) p = static_cast<uint8_t>(rng());
+
+    std::vector<uint8_t> yuv(yuv420p_size(width, height));
+    const int cw = (width + 1) / 2;
+    const int ch = (height + 1) / 2;
+    uint8_t* y = yuv.data();
+    uint8_t* u = y + static_cast<size_t>(width) * height;
+    uint8_t* v = u + static_cast<size_t>(cw) * ch;
+
+    auto run = [&]() {
+        rgb_to_yuv420p(rgb.data(), static_cast<ptrdiff_t>(width) * bpp, layout, width, height,
+                       y, width, u, cw, v, cw, options);
+    };
+    run(); // warm up caches and the dispatcher
+
+    // Best of several batches filters out scheduler noise.
+    double best = 1e300;
+    for (int batch = 0; batch < 5; ++batch) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) run();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        best = std::min(best, ns);
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = 20;
+    RgbLayout layout = RgbLayout::RGB24;
+    YuvConvertOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) iterations = std::max(1, std::atoi(argv[++i]));
+        if (arg == "--rgba") layout = RgbLayout::RGBA32;
+        if (arg == "--bt709") options.matrix = YuvMatrix::BT709;
+        if (arg == "--full-range") options.range = YuvRange::Full;
+        if (arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [--iterations N] [--rgba] [--bt709] [--full-range]\n";
+            return 0;
+        }
+    }
+
+    const Resolution resolutions[] = {
+        {"640x480", 640, 480},
+        {"1920x1080", 1920, 1080},
+        {"3840x2160", 3840, 2160},
+    };
+    const YuvKernel kernels[] = {YuvKernel::Scalar, YuvKernel::SSE41, YuvKernel::AVX2, YuvKernel::NEON};
+
+    std::cout << "auto kernel: " << yuv_kernel_name(yuv_kernel_resolve(YuvKernel::Auto)) << "\n";
+    std::cout << std::left << std::setw(10) << "kernel";
+    for (const auto& r : resolutions) std::cout << std::right << std::setw(16) << r.name;
+    std::cout << "   (ns/frame)\n";
+
+    for (YuvKernel kernel : kernels) {
+        if (!yuv_kernel_supported(kernel)) continue;
+        options.kernel = kernel;
+        std::cout << std::left << std::setw(10) << yuv_kernel_name(kernel);
+        for (const auto& r : resolutions) {
+            double ns = bench_ns_per_frame(r.width, r.height, layout, options, iterations);
+            std::cout << std::right << std::setw(16) << std::fixed << std::setprecision(0) << ns;
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Shared definitions for the yuv_convert kernels. Not part of the public API.
+#ifndef VTK_CUBE_YUV_CONVERT_INTERNAL_H
+#define VTK_CUBE_YUV_CONVERT_INTERNAL_H
+
+#include "yuv_convert.h"
+
+// 8.8 fixed-point coefficients. Every kernel evaluates
+//   Y = (yr*R + yg*G + yb*B + y_bias) >> 8
+//   U = (ur*R + ug*G + ub*B + c_bias) >> 8   (on the 2x2 averaged RGB)
+// with wrapping 16-bit arithmetic; the coefficients are chosen so the exact
+// result always lies in [0, 65535], which keeps SIMD and scalar bit-exact.
+struct YuvCoefficients {
+    int16_t yr, yg, yb;
+    int16_t ur, ug, ub;
+    int16_t vr, vg, vb;
+    uint16_t y_bias;
+    uint16_t c_bias;
+};
+
+const YuvCoefficients& yuv_coefficients(YuvMatrix matrix, YuvRange range);
+
+// Byte offsets of R/G/B inside one source pixel.
+struct RgbOffsets {
+    int bpp, r, g, b;
+};
+
+inline RgbOffsets rgb_offsets(RgbLayout layout) {
+    switch (layout) {
+    case RgbLayout::RGBA32: return {4, 0, 1, 2};
+    case RgbLayout::BGRA32: return {4, 2, 1, 0};
+    case RgbLayout::RGB24:
+    default: return {3, 0, 1, 2};
+    }
+}
+
+// Converts one pair of source rows. src1/y1 may alias src0/y0 for the last row
+// of an odd-height image. Returns the number of leading pixels converted (always
+// even); the caller finishes the remainder with the scalar kernel.
+using YuvRowPairKernel = int (*)(const uint8_t* src0, const uint8_t* src1, int width,
+                                 RgbLayout layout, const YuvCoefficients& c,
+                                 uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+
+int yuv_row_pair_scalar(const uint8_t* src0, const uint8_t* src1, int width,
+                        RgbLayout layout, const YuvCoefficients& c,
+                        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+#if defined(YUV_CONVERT_HAVE_SSE41)
+int yuv_row_pair_sse41(const uint8_t* src0, const uint8_t* src1, int width,
+                       RgbLayout layout, const YuvCoefficients& c,
+                       uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+#endif
+#if defined(YUV_CONVERT_HAVE_AVX2)
+int yuv_row_pair_avx2(const uint8_t* src0, const uint8_t* src1, int width,
+                      RgbLayout layout, const YuvCoefficients& c,
+                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+#endif
+#if defined(YUV_CONVERT_HAVE_NEON)
+int yuv_row_pair_neon(const uint8_t* src0, const uint8_t* src1, int width,
+                      RgbLayout layout, const YuvCoefficients& c,
+                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+#endif
+
+#endif // VTK_CUBE_YUV_CONVERT_INTERNAL_H
@@ -0,0 +1,80 @@
+// RGB -> I420 conversion, NEON kernel (16 pixels per iteration)
+#include "yuv_convert_internal.h"
+
+#include <arm_neon.h>
+
+namespace {
+
+struct Rows16 {
+    uint8x16_t r, g, b;
+};
+
+template <int BPP, int RO, int GO, int BO>
+inline Rows16 load_pixels(const uint8_t* p) {
+    if (BPP == 3) {
+        uint8x16x3_t px = vld3q_u8(p);
+        return {px.val[RO], px.val[GO], px.val[BO]};
+    }
+    uint8x16x4_t px = vld4q_u8(p);
+    return {px.val[RO], px.val[GO], px.val[BO]};
+}
+
+inline uint8x8_t luma8(uint8x8_t r, uint8x8_t g, uint8x8_t b, const YuvCoefficients& c) {
+    uint16x8_t y = vmull_u8(r, vdup_n_u8(static_cast<uint8_t>(c.yr)));
+    y = vmlal_u8(y, g, vdup_n_u8(static_cast<uint8_t>(c.yg)));
+    y = vmlal_u8(y, b, vdup_n_u8(static_cast<uint8_t>(c.yb)));
+    return vshrn_n_u16(vaddq_u16(y, vdupq_n_u16(c.y_bias)), 8);
+}
+
+inline void store_luma(uint8_t* dst, const Rows16& p, const YuvCoefficients& c) {
+    uint8x8_t lo = luma8(vget_low_u8(p.r), vget_low_u8(p.g), vget_low_u8(p.b), c);
+    uint8x8_t hi = luma8(vget_high_u8(p.r), vget_high_u8(p.g), vget_high_u8(p.b), c);
+    vst1q_u8(dst, vcombine_u8(lo, hi));
+}
+
+// Rounded average of each 2x2 block: 8 output lanes.
+inline uint16x8_t average_2x2(uint8x16_t a, uint8x16_t b) {
+    return vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(a), b), 2);
+}
+
+// Signed coefficients are applied with wrapping unsigned arithmetic, exactly
+// as the x86 kernels do.
+inline uint8x8_t chroma8(uint16x8_t r, uint16x8_t g, uint16x8_t b,
+                         int16_t cr, int16_t cg, int16_t cb, uint16_t bias) {
+    uint16x8_t sum = vmulq_n_u16(r, static_cast<uint16_t>(cr));
+    sum = vmlaq_n_u16(sum, g, static_cast<uint16_t>(cg));
+    sum = vmlaq_n_u16(sum, b, static_cast<uint16_t>(cb));
+    return vshrn_n_u16(vaddq_u16(sum, vdupq_n_u16(bias)), 8);
+}
+
+template <int BPP, int RO, int GO, int BO>
+int convert(const uint8_t* src0, const uint8_t* src1, int width, const YuvCoefficients& c,
+            uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const Rows16 a = load_pixels<BPP, RO, GO, BO>(src0 + x * BPP);
+        const Rows16 b = load_pixels<BPP, RO, GO, BO>(src1 + x * BPP);
+        store_luma(y0 + x, a, c);
+        store_luma(y1 + x, b, c);
+
+        const uint16x8_t r = average_2x2(a.r, b.r);
+        const uint16x8_t g = average_2x2(a.g, b.g);
+        const uint16x8_t bl = average_2x2(a.b, b.b);
+        vst1_u8(u + x / 2, chroma8(r, g, bl, c.ur, c.ug, c.ub, c.c_bias));
+        vst1_u8(v + x / 2, chroma8(r, g, bl, c.vr, c.vg, c.vb, c.c_bias));
+    }
+    return x;
+}
+
+} // namespace
+
+int yuv_row_pair_neon(const uint8_t* src0, const uint8_t* src1, int width,
+                      RgbLayout layout, const YuvCoefficients& c,
+                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    switch (layout) {
+    case RgbLayout::RGBA32: return convert<4, 0, 1, 2>(src0, src1, width, c, y0, y1, u, v);
+    case RgbLayout::BGRA32: return convert<4, 2, 1, 0>(src0, src1, width, c, y0, y1, u, v);
+    case RgbLayout::RGB24:
+    default: return convert<3, 0, 1, 2>(src0, src1, width, c, y0, y1, u, v);
+    }
+}
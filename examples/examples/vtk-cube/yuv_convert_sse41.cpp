@@ -0,0 +1,109 @@
+// RGB -> I420 conversion, SSE4.1 kernel (16 pixels per iteration)
+#include "yuv_convert_internal.h"
+
+#include <smmintrin.h>
+
+namespace {
+
+struct Coeffs {
+    __m128i yr, yg, yb, ur, ug, ub, vr, vg, vb, y_bias, c_bias;
+    explicit Coeffs(const YuvCoefficients& c)
+        : yr(_mm_set1_epi16(c.yr)), yg(_mm_set1_epi16(c.yg)), yb(_mm_set1_epi16(c.yb)),
+          ur(_mm_set1_epi16(c.ur)), ug(_mm_set1_epi16(c.ug)), ub(_mm_set1_epi16(c.ub)),
+          vr(_mm_set1_epi16(c.vr)), vg(_mm_set1_epi16(c.vg)), vb(_mm_set1_epi16(c.vb)),
+          y_bias(_mm_set1_epi16(static_cast<short>(c.y_bias))),
+          c_bias(_mm_set1_epi16(static_cast<short>(c.c_bias))) {}
+};
+
+// 16 pixels of one row, one channel per register pair, widened to 16 bits.
+struct Pixels16 {
+    __m128i r[2], g[2], b[2];
+};
+
+template <int BPP, int RO, int GO, int BO>
+inline Pixels16 load_pixels(const uint8_t* p) {
+    // Four pixels per register as 32-bit lanes.
+    __m128i px[4];
+    if (BPP == 3) {
+        const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+        px[0] = _mm_shuffle_epi8(a, shuf);
+        px[1] = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuf);
+        px[2] = _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuf);
+        px[3] = _mm_shuffle_epi8(_mm_srli_si128(c, 4), shuf);
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            px[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        }
+    }
+
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    auto channel = [&](int offset, int half) {
+        __m128i lo = _mm_and_si128(_mm_srli_epi32(px[2 * half], 8 * offset), mask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(px[2 * half + 1], 8 * offset), mask);
+        return _mm_packus_epi32(lo, hi);
+    };
+    Pixels16 out;
+    for (int half = 0; half < 2; ++half) {
+        out.r[half] = channel(RO, half);
+        out.g[half] = channel(GO, half);
+        out.b[half] = channel(BO, half);
+    }
+    return out;
+}
+
+inline __m128i weighted(__m128i r, __m128i g, __m128i b,
+                        __m128i cr, __m128i cg, __m128i cb, __m128i bias) {
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, cr), _mm_mullo_epi16(g, cg));
+    sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, cb), bias));
+    return _mm_srli_epi16(sum, 8);
+}
+
+inline void store_luma(uint8_t* dst, const Pixels16& p, const Coeffs& k) {
+    __m128i lo = weighted(p.r[0], p.g[0], p.b[0], k.yr, k.yg, k.yb, k.y_bias);
+    __m128i hi = weighted(p.r[1], p.g[1], p.b[1], k.yr, k.yg, k.yb, k.y_bias);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(lo, hi));
+}
+
+// Rounded average of each 2x2 block: 8 output lanes.
+inline __m128i average_2x2(const __m128i a[2], const __m128i b[2]) {
+    __m128i sum = _mm_hadd_epi16(_mm_add_epi16(a[0], b[0]), _mm_add_epi16(a[1], b[1]));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+template <int BPP, int RO, int GO, int BO>
+int convert(const uint8_t* src0, const uint8_t* src1, int width, const YuvCoefficients& c,
+            uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    const Coeffs k(c);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const Pixels16 a = load_pixels<BPP, RO, GO, BO>(src0 + x * BPP);
+        const Pixels16 b = load_pixels<BPP, RO, GO, BO>(src1 + x * BPP);
+        store_luma(y0 + x, a, k);
+        store_luma(y1 + x, b, k);
+
+        const __m128i r = average_2x2(a.r, b.r);
+        const __m128i g = average_2x2(a.g, b.g);
+        const __m128i bl = average_2x2(a.b, b.b);
+        const __m128i cu = weighted(r, g, bl, k.ur, k.ug, k.ub, k.c_bias);
+        const __m128i cv = weighted(r, g, bl, k.vr, k.vg, k.vb, k.c_bias);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_packus_epi16(cv, cv));
+    }
+    return x;
+}
+
+} // namespace
+
+int yuv_row_pair_sse41(const uint8_t* src0, const uint8_t* src1, int width,
+                       RgbLayout layout, const YuvCoefficients& c,
+                       uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    switch (layout) {
+    case RgbLayout::RGBA32: return convert<4, 0, 1, 2>(src0, src1, width, c, y0, y1, u, v);
+    case RgbLayout::BGRA32: return convert<4, 2, 1, 0>(src0, src1, width, c, y0, y1, u, v);
+    case RgbLayout::RGB24:
+    default: return convert<3, 0, 1, 2>(src0, src1, width, c, y0, y1, u, v);
+    }
+}
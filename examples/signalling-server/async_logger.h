@@ -0,0 +1,332 @@
+// Asynchronous logging for the signalling server and vtk-cube
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error, Off };
+
+enum class LogFormat : uint8_t {
+    Text, // [INFO] 2024-01-01 12:00:00.000 message, local time
+    Json, // {"time":"2024-01-01T12:00:00.000Z","level":"info","msg":"message"}, UTC
+};
+
+// A double printed with a fixed number of decimals: LOG_INFO("took ", LogFixed{ms, 2}, "ms")
+struct LogFixed {
+    double value;
+    int precision;
+};
+
+// Appends one log argument to a line. Strings are copied, numbers are formatted
+// in place; nothing goes through iostreams.
+template <typename T>
+void append_log_arg(std::string& out, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        out += value ? "true" : "false";
+    } else if constexpr (std::is_same_v<T, char>) {
+        out += value;
+    } else if constexpr (std::is_integral_v<T>) {
+        char buf[24];
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+    } else if constexpr (std::is_enum_v<T>) {
+        append_log_arg(out, static_cast<std::underlying_type_t<T>>(value));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        char buf[32];
+        int n = std::snprintf(buf, sizeof(buf), "%g", static_cast<double>(value));
+        out.append(buf, n > 0 ? static_cast<size_t>(n) : 0);
+    } else if constexpr (std::is_same_v<T, LogFixed>) {
+        char buf[64];
+        int n = std::snprintf(buf, sizeof(buf), "%.*f", value.precision, value.value);
+        out.append(buf, n > 0 ? std::min(static_cast<size_t>(n), sizeof(buf) - 1) : 0);
+    } else {
+        out += std::string_view(value);
+    }
+}
+
+template <typename... Args>
+void append_log_args(std::string& out, const Args&... args) {
+    (append_log_arg(out, args), ...);
+}
+
+// Process-wide logger. Any thread may log: a line is formatted into a
+// thread-local buffer, which is swapped into a slot of a bounded lock-free
+// MPSC ring, so the caller never takes a lock, flushes or waits for I/O. A
+// writer thread adds the timestamp (formatted once per second) and writes
+// whatever has queued up in one call per stream. When the ring is full the
+// line is dropped and counted rather than blocking the caller.
+class AsyncLogger {
+public:
+    static constexpr size_t kCapacity = 8192;
+
+    // Never destroyed, so threads that outlive main can still log.
+    static AsyncLogger& instance() {
+        static AsyncLogger* logger = new AsyncLogger();
+        return *logger;
+    }
+
+    void setLevel(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    void setFormat(LogFormat format) { format_.store(format, std::memory_order_relaxed); }
+
+    bool enabled(LogLevel level) const {
+        return level != LogLevel::Off && level >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Use the LOG_* macros instead, which skip evaluating the arguments when the
+    // level is disabled.
+    template <typename... Args>
+    void log(LogLevel level, const Args&... args) {
+        thread_local std::string line;
+        line.clear();
+        append_log_args(line, args...);
+        const int64_t time_us = nowUs();
+        if (synchronous_.load(std::memory_order_acquire)) {
+            writeSync(level, time_us, line);
+            return;
+        }
+        if (!tryPush(level, time_us, line)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Pairs with the fence in run(): either the writer sees the slot or this
+        // sees writer_sleeping_, so a sleeping writer is always woken.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writer_sleeping_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
+        }
+    }
+
+    // Lines dropped because the ring was full.
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Writes out everything queued and stops the writer thread; lines logged
+    // after it returns are written synchronously. Lines logged while this runs
+    // may be lost.
+    void shutdown() {
+        if (stopped_.exchange(true)) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
+        }
+        if (writer_.joinable()) writer_.join();
+        // Only once the writer is gone, so the two never format at the same time
+        synchronous_.store(true, std::memory_order_release);
+    }
+
+private:
+    // seq == position: free for the producer claiming that position;
+    // seq == position + 1: filled, ready for the writer.
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        LogLevel level = LogLevel::Info;
+        int64_t time_us = 0;
+        std::string text;
+    };
+
+    AsyncLogger() : slots_(std::make_unique<Slot[]>(kCapacity)) {
+        for (size_t i = 0; i < kCapacity; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+        writer_ = std::thread([this]() { run(); });
+    }
+
+    // Vyukov's bounded queue, producer side. The formatted line is swapped in,
+    // and the slot's previous buffer goes back to the caller for reuse, so the
+    // steady state does not allocate.
+    bool tryPush(LogLevel level, int64_t time_us, std::string& line) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[pos & (kCapacity - 1)];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->level = level;
+        slot->time_us = time_us;
+        slot->text.swap(line);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool hasQueued() const {
+        return slots_[head_ & (kCapacity - 1)].seq.load(std::memory_order_acquire) == head_ + 1;
+    }
+
+    void run() {
+        std::string out, err;
+        uint64_t dropped_reported = 0;
+        for (;;) {
+            // Batch what is queued so each stream gets one write
+            size_t batch = 0;
+            while (batch < kCapacity && hasQueued()) {
+                Slot& slot = slots_[head_ & (kCapacity - 1)];
+                format(slot.level, slot.time_us, slot.text, slot.level == LogLevel::Error ? err : out);
+                slot.text.clear();
+                slot.seq.store(head_ + kCapacity, std::memory_order_release);
+                ++head_;
+                ++batch;
+            }
+            uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+            if (dropped != dropped_reported) {
+                std::string note;
+                append_log_arg(note, dropped - dropped_reported);
+                note += " log line(s) dropped, queue full";
+                format(LogLevel::Warn, nowUs(), note, out);
+                dropped_reported = dropped;
+            }
+            flush(out, stdout);
+            flush(err, stderr);
+            if (batch > 0) continue;
+            if (stopped_.load(std::memory_order_acquire)) return;
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            writer_sleeping_.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            cv_.wait_for(lock, std::chrono::milliseconds(500),
+                         [this]() { return hasQueued() || stopped_.load(); });
+            writer_sleeping_.store(false);
+        }
+    }
+
+    static void flush(std::string& buffer, std::FILE* stream) {
+        if (buffer.empty()) return;
+        std::fwrite(buffer.data(), 1, buffer.size(), stream);
+        std::fflush(stream);
+        buffer.clear();
+    }
+
+    static int64_t nowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void writeSync(LogLevel level, int64_t time_us, const std::string& line) {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        std::string buffer;
+        format(level, time_us, line, buffer);
+        flush(buffer, level == LogLevel::Error ? stderr : stdout);
+    }
+
+    // Only called by the writer thread, or after it has stopped under sync_mutex_.
+    void format(LogLevel level, int64_t time_us, std::string_view text, std::string& out) {
+        const int64_t second = time_us / 1000000;
+        if (second != cached_second_) {
+            std::time_t t = static_cast<std::time_t>(second);
+            std::tm tm_local{}, tm_utc{};
+            localtime_r(&t, &tm_local);
+            gmtime_r(&t, &tm_utc);
+            std::strftime(local_time_, sizeof(local_time_), "%Y-%m-%d %H:%M:%S", &tm_local);
+            std::strftime(utc_time_, sizeof(utc_time_), "%Y-%m-%dT%H:%M:%S", &tm_utc);
+            cached_second_ = second;
+        }
+        char millis[8];
+        std::snprintf(millis, sizeof(millis), ".%03d", static_cast<int>(time_us / 1000 % 1000));
+
+        static constexpr const char* kNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+        static constexpr const char* kJsonNames[] = {"debug", "info", "warn", "error"};
+        const size_t index = static_cast<size_t>(level) < 4 ? static_cast<size_t>(level) : 3;
+        if (format_.load(std::memory_order_relaxed) == LogFormat::Json) {
+            out += "{\"time\":\"";
+            out += utc_time_;
+            out += millis;
+            out += "Z\",\"level\":\"";
+            out += kJsonNames[index];
+            out += "\",\"msg\":\"";
+            appendJsonEscaped(out, text);
+            out += "\"}\n";
+        } else {
+            out += '[';
+            out += kNames[index];
+            out += "] ";
+            out += local_time_;
+            out += millis;
+            out += ' ';
+            out += text;
+            out += '\n';
+        }
+    }
+
+    static void appendJsonEscaped(std::string& out, std::string_view text) {
+        for (char c : text) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                        out += buf;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+    }
+
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "kCapacity must be a power of two");
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0; // writer only
+    std::atomic<LogLevel> level_{LogLevel::Info};
+    std::atomic<LogFormat> format_{LogFormat::Text};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> stopped_{false};
+    // Set by shutdown() once the writer has stopped.
+    std::atomic<bool> synchronous_{false};
+    std::atomic<bool> writer_sleeping_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::mutex sync_mutex_;
+    std::thread writer_;
+
+    // Timestamp cache, see format()
+    int64_t cached_second_ = -1;
+    char local_time_[32] = {};
+    char utc_time_[32] = {};
+};
+
+// Shuts the logger down when main returns, so queued lines are not lost.
+class AsyncLoggerGuard {
+public:
+    AsyncLoggerGuard() = default;
+    AsyncLoggerGuard(const AsyncLoggerGuard&) = delete;
+    AsyncLoggerGuard& operator=(const AsyncLoggerGuard&) = delete;
+    ~AsyncLoggerGuard() { AsyncLogger::instance().shutdown(); }
+};
+
+// The arguments are only evaluated, and the line only built, if the level is enabled.
+#define LOG_AT(level, ...)                                        \
+    do {                                                          \
+        AsyncLogger& async_logger_ = AsyncLogger::instance();     \
+        if (async_logger_.enabled(level)) async_logger_.log(level, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+
+#endif // ASYNC_LOGGER_H
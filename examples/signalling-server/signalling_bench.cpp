@@ -0,0 +1,917 @@
+// Load generator for signalling-server: thousands of WebSocket clients on a few
+// epoll threads, negotiating offer/answer/ICE trickle in pairs per room
+#include "signalling_binary.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Every SDP and candidate starts with its send time, so the receiver can
+// measure relay latency; all clients share this process's steady clock.
+constexpr size_t kStampDigits = 20;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    size_t clients = 1000;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    double duration_s = 10.0;
+    size_t candidates = 4;
+    size_t sdp_bytes = 2500;
+    bool binary = false;
+    size_t storms = 0;
+    int server_pid = 0;
+};
+
+// Log-linear histogram of microseconds, 16 buckets per power of two, so
+// percentiles are within about 6%.
+class Histogram {
+public:
+    void record(uint64_t us) {
+        ++counts_[index(us)];
+        ++total_;
+        max_ = std::max(max_, us);
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+
+    uint64_t percentile(double p) const {
+        if (total_ == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * total_ + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(lowerBound(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int kSubBuckets = 16;
+    static constexpr int kBuckets = 48 * kSubBuckets;
+
+    static size_t index(uint64_t us) {
+        if (us < kSubBuckets) return static_cast<size_t>(us);
+        int octave = 63 - __builtin_clzll(us);
+        int sub = static_cast<int>(us >> (octave - 4)) & (kSubBuckets - 1);
+        return std::min<size_t>(static_cast<size_t>((octave - 3) * kSubBuckets + sub), kBuckets - 1);
+    }
+
+    static uint64_t lowerBound(size_t i) {
+        if (i < kSubBuckets) return i;
+        int octave = static_cast<int>(i / kSubBuckets) + 3;
+        return static_cast<uint64_t>(kSubBuckets + i % kSubBuckets) << (octave - 4);
+    }
+
+    std::array<uint64_t, kBuckets> counts_{};
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+};
+
+// What the controller asks of the workers. Each storm bumps storm_generation.
+enum class Phase : int { Connect, Negotiate, Drain, Storm, Stop };
+
+struct Control {
+    std::atomic<Phase> phase{Phase::Connect};
+    std::atomic<uint32_t> storm_generation{0};
+};
+
+enum class ConnState { Idle, Connecting, Handshake, Open };
+
+struct Room;
+
+struct Client {
+    int fd = -1;
+    ConnState state = ConnState::Idle;
+    Room* room = nullptr;
+    bool offerer = false;
+    std::string in;
+    std::string out;
+    size_t out_offset = 0;
+    bool polling_out = false;
+    int64_t connect_start_ns = 0;
+    int64_t retry_at_ns = 0;
+    uint32_t mask_state = 0;
+};
+
+// Two clients: the offerer sends an offer and the answerer replies, then both
+// trickle their candidates. A round ends when each side has all of the other's.
+struct Room {
+    std::string name;
+    Client* peers[2] = {nullptr, nullptr}; // offerer, answerer
+    bool ready = false;                    // both have joined, see onReady
+    bool in_round = false;
+    bool storm_done = false;
+    int64_t round_start_ns = 0;
+    size_t candidates_received[2] = {0, 0};
+};
+
+struct Stats {
+    Histogram setup_us;       // connect() to 101 Switching Protocols, first connect
+    Histogram storm_setup_us; // the same during reconnect storms
+    Histogram relay_us;       // send to receive, negotiate phase only
+    Histogram round_us;       // offer sent to last candidate received
+    uint64_t messages_received = 0;
+    uint64_t bytes_received = 0;
+    uint64_t messages_sent = 0;
+    uint64_t rounds = 0;
+    uint64_t connect_failures = 0;
+    uint64_t disconnects = 0;
+};
+
+// Minimal RFC 6455 client, enough for this server: one unfragmented frame per
+// message, and the accept key is not verified.
+constexpr unsigned char kOpText = 0x1;
+constexpr unsigned char kOpBinary = 0x2;
+constexpr unsigned char kOpPong = 0xa;
+
+void appendFrame(std::string& out, std::string_view payload, unsigned char opcode, uint32_t& mask_state) {
+    out += static_cast<char>(0x80 | opcode);
+    const uint64_t n = payload.size();
+    if (n < 126) {
+        out += static_cast<char>(0x80 | n);
+    } else if (n <= 0xffff) {
+        out += static_cast<char>(0x80 | 126);
+        out += static_cast<char>(n >> 8);
+        out += static_cast<char>(n & 0xff);
+    } else {
+        out += static_cast<char>(0x80 | 127);
+        for (int i = 7; i >= 0; --i) out += static_cast<char>((n >> (8 * i)) & 0xff);
+    }
+    // xorshift32: clients must mask, but the key need not be unpredictable here
+    mask_state ^= mask_state << 13;
+    mask_state ^= mask_state >> 17;
+    mask_state ^= mask_state << 5;
+    unsigned char key[4];
+    std::memcpy(key, &mask_state, 4);
+    out.append(reinterpret_cast<const char*>(key), 4);
+    const size_t start = out.size();
+    out.append(payload);
+    for (size_t i = 0; i < n; ++i) out[start + i] = static_cast<char>(out[start + i] ^ key[i & 3]);
+}
+
+void appendStamp(std::string& out, int64_t ns) {
+    char buf[kStampDigits + 1];
+    std::snprintf(buf, sizeof(buf), "%0*lld", static_cast<int>(kStampDigits), static_cast<long long>(ns));
+    out.append(buf, kStampDigits);
+}
+
+bool parseStamp(std::string_view text, int64_t& ns) {
+    if (text.size() < kStampDigits) return false;
+    auto result = std::from_chars(text.data(), text.data() + kStampDigits, ns);
+    return result.ec == std::errc() && result.ptr == text.data() + kStampDigits;
+}
+
+// The bench only has to read back what it wrote itself: compact JSON, no escapes.
+bool jsonField(std::string_view json, std::string_view key, std::string_view& value) {
+    std::string pattern = "\"" + std::string(key) + "\":\"";
+    size_t pos = json.find(pattern);
+    if (pos == std::string_view::npos) return false;
+    pos += pattern.size();
+    size_t end = json.find('"', pos);
+    if (end == std::string_view::npos) return false;
+    value = json.substr(pos, end - pos);
+    return true;
+}
+
+class Worker {
+public:
+    Worker(const Options& options, const addrinfo* address, Control& control, size_t first_room, size_t room_count)
+        : options_(options), address_(address), control_(control) {
+        clients_.reserve(room_count * 2);
+        rooms_.reserve(room_count);
+        for (size_t i = 0; i < room_count; ++i) {
+            auto room = std::make_unique<Room>();
+            room->name = "bench-" + std::to_string(first_room + i);
+            for (int side = 0; side < 2; ++side) {
+                auto client = std::make_unique<Client>();
+                client->room = room.get();
+                client->offerer = side == 0;
+                client->mask_state = static_cast<uint32_t>((first_room + i) * 2 + side) * 2654435761u | 1;
+                room->peers[side] = client.get();
+                clients_.push_back(std::move(client));
+            }
+            rooms_.push_back(std::move(room));
+        }
+
+        // SDP: stamp, then filler shaped like attribute lines, no JSON escaping needed
+        std::string filler = "v=0 o=- 4611731400430051336 2 IN IP4 127.0.0.1 s=- t=0 0 a=group:BUNDLE 0 ";
+        while (sdp_body_.size() + filler.size() < options_.sdp_bytes) sdp_body_ += filler;
+        sdp_body_.resize(std::max(options_.sdp_bytes, kStampDigits) - kStampDigits, 'a');
+    }
+
+    Worker(const Worker&) = delete;
+    Worker& operator=(const Worker&) = delete;
+
+    ~Worker() {
+        for (auto& client : clients_) closeClient(*client);
+        if (epoll_fd_ >= 0) ::close(epoll_fd_);
+    }
+
+    void run() {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) {
+            std::perror("epoll_create1");
+            return;
+        }
+        for (auto& client : clients_) connectClient(*client);
+
+        Phase phase = Phase::Connect;
+        uint32_t storm_generation = 0;
+        std::array<epoll_event, 256> events;
+        for (;;) {
+            Phase wanted = control_.phase.load(std::memory_order_acquire);
+            uint32_t generation = control_.storm_generation.load(std::memory_order_acquire);
+            if (wanted == Phase::Stop) break;
+            if (wanted == Phase::Storm && generation != storm_generation) {
+                storm_generation = generation;
+                phase = wanted;
+                beginStorm();
+            } else if (wanted != phase) {
+                phase = wanted;
+                if (phase == Phase::Negotiate) {
+                    for (auto& room : rooms_)
+                        if (room->ready && !room->in_round) startRound(*room);
+                }
+            }
+            phase_ = phase;
+
+            int n = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 10);
+            for (int i = 0; i < n; ++i) {
+                auto* client = static_cast<Client*>(events[i].data.ptr);
+                handleEvents(*client, events[i].events);
+            }
+            retryPending();
+        }
+    }
+
+    const Stats& stats() const { return stats_; }
+    std::atomic<size_t> opened{0};        // clients that completed a handshake
+    std::atomic<size_t> rooms_ready{0};
+    std::atomic<size_t> storm_rooms_done{0}; // summed over all storms
+    std::atomic<int64_t> last_open_ns{0};
+
+private:
+    void connectClient(Client& c) {
+        c.in.clear();
+        c.out.clear();
+        c.out_offset = 0;
+        c.polling_out = false;
+        c.connect_start_ns = nowNs();
+        c.fd = ::socket(address_->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (c.fd < 0) {
+            connectFailed(c);
+            return;
+        }
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        // Reset on close instead of leaving TIME_WAIT behind, so reconnect
+        // storms do not run out of ephemeral ports
+        linger abort_on_close{1, 0};
+        setsockopt(c.fd, SOL_SOCKET, SO_LINGER, &abort_on_close, sizeof(abort_on_close));
+
+        if (::connect(c.fd, address_->ai_addr, address_->ai_addrlen) < 0 && errno != EINPROGRESS) {
+            connectFailed(c);
+            return;
+        }
+        c.state = ConnState::Connecting;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.ptr = &c;
+        c.polling_out = true;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, c.fd, &event);
+    }
+
+    void connectFailed(Client& c) {
+        ++stats_.connect_failures;
+        closeClient(c);
+        c.retry_at_ns = nowNs() + 100'000'000;
+        retry_.push_back(&c);
+    }
+
+    void retryPending() {
+        if (retry_.empty()) return;
+        const int64_t now = nowNs();
+        std::vector<Client*> due;
+        retry_.erase(std::remove_if(retry_.begin(), retry_.end(),
+                                    [&](Client* c) {
+                                        if (c->retry_at_ns > now) return false;
+                                        due.push_back(c);
+                                        return true;
+                                    }),
+                     retry_.end());
+        for (Client* c : due) connectClient(*c);
+    }
+
+    // The server closed the connection or it failed: reconnect, and the room
+    // starts over once both peers are back.
+    void dropClient(Client& c) {
+        ++stats_.disconnects;
+        closeClient(c);
+        c.retry_at_ns = nowNs() + 100'000'000;
+        retry_.push_back(&c);
+    }
+
+    void closeClient(Client& c) {
+        if (c.fd < 0) return;
+        if (epoll_fd_ >= 0) epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+        ::close(c.fd);
+        c.fd = -1;
+        if (c.state == ConnState::Open) opened.fetch_sub(1, std::memory_order_relaxed);
+        c.state = ConnState::Idle;
+        Room& room = *c.room;
+        if (room.ready) rooms_ready.fetch_sub(1, std::memory_order_relaxed);
+        room.ready = false;
+        room.in_round = false;
+    }
+
+    // Drops every connection at once and reconnects; each room then has to
+    // finish one round before the storm is over.
+    void beginStorm() {
+        for (auto& client : clients_) closeClient(*client);
+        retry_.clear();
+        for (auto& room : rooms_) room->storm_done = false;
+        for (auto& client : clients_) connectClient(*client);
+    }
+
+    void handleEvents(Client& c, uint32_t events) {
+        if (c.state == ConnState::Connecting) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                connectFailed(c);
+                return;
+            }
+            if (!(events & EPOLLOUT)) return;
+            c.state = ConnState::Handshake;
+            c.out = "GET / HTTP/1.1\r\nHost: " + options_.host + ":" + options_.port +
+                    "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+            c.out_offset = 0;
+            flush(c);
+            return;
+        }
+        if (events & EPOLLOUT) {
+            flush(c);
+            if (c.fd < 0) return;
+        }
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) readAvailable(c);
+    }
+
+    void flush(Client& c) {
+        while (c.out_offset < c.out.size()) {
+            ssize_t n = ::send(c.fd, c.out.data() + c.out_offset, c.out.size() - c.out_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.out_offset += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                setPollOut(c, true);
+                return;
+            }
+            dropClient(c);
+            return;
+        }
+        c.out.clear();
+        c.out_offset = 0;
+        setPollOut(c, false);
+    }
+
+    void setPollOut(Client& c, bool on) {
+        if (c.polling_out == on) return;
+        epoll_event event{};
+        event.events = EPOLLIN | (on ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.ptr = &c;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &event);
+        c.polling_out = on;
+    }
+
+    void send(Client& c, std::string_view payload, bool binary) {
+        if (c.state != ConnState::Open) return;
+        appendFrame(c.out, payload, binary ? kOpBinary : kOpText, c.mask_state);
+        ++stats_.messages_sent;
+        if (!c.polling_out) flush(c);
+    }
+
+    void readAvailable(Client& c) {
+        char buf[65536];
+        for (;;) {
+            ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                c.in.append(buf, static_cast<size_t>(n));
+                if (static_cast<size_t>(n) < sizeof(buf)) break;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            dropClient(c); // peer closed or error
+            return;
+        }
+
+        if (c.state == ConnState::Handshake) {
+            size_t end = c.in.find("\r\n\r\n");
+            if (end == std::string::npos) return;
+            if (c.in.compare(0, 12, "HTTP/1.1 101") != 0) {
+                connectFailed(c);
+                return;
+            }
+            c.in.erase(0, end + 4);
+            onOpen(c);
+            if (c.fd < 0) return;
+        }
+        parseFrames(c);
+    }
+
+    void parseFrames(Client& c) {
+        size_t pos = 0;
+        while (c.fd >= 0) {
+            std::string_view data(c.in);
+            data.remove_prefix(pos);
+            if (data.size() < 2) break;
+            const auto b0 = static_cast<unsigned char>(data[0]);
+            const auto b1 = static_cast<unsigned char>(data[1]);
+            uint64_t length = b1 & 0x7f;
+            size_t header = 2;
+            if (length == 126) {
+                if (data.size() < 4) break;
+                length = static_cast<uint64_t>(static_cast<unsigned char>(data[2])) << 8 |
+                         static_cast<unsigned char>(data[3]);
+                header = 4;
+            } else if (length == 127) {
+                if (data.size() < 10) break;
+                length = 0;
+                for (int i = 0; i < 8; ++i) length = length << 8 | static_cast<unsigned char>(data[2 + i]);
+                header = 10;
+            }
+            if (b1 & 0x80) header += 4; // servers do not mask, but tolerate it
+            if (data.size() < header + length) break;
+            std::string payload(data.substr(header, length));
+            if (b1 & 0x80) {
+                for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<char>(payload[i] ^ data[header - 4 + (i & 3)]);
+            }
+            pos += header + length;
+
+            switch (b0 & 0x0f) {
+                case 0x1: onMessage(c, payload, false); break;
+                case 0x2: onMessage(c, payload, true); break;
+                case 0x8: dropClient(c); break;
+                case 0x9:
+                    appendFrame(c.out, payload, kOpPong, c.mask_state);
+                    if (!c.polling_out) flush(c);
+                    break;
+                default: break;
+            }
+        }
+        if (c.fd >= 0) c.in.erase(0, pos);
+    }
+
+    void onOpen(Client& c) {
+        const int64_t now = nowNs();
+        c.state = ConnState::Open;
+        (phase_ == Phase::Storm ? stats_.storm_setup_us : stats_.setup_us)
+            .record(static_cast<uint64_t>(now - c.connect_start_ns) / 1000);
+        opened.fetch_add(1, std::memory_order_relaxed);
+        last_open_ns.store(now, std::memory_order_relaxed);
+
+        std::string join;
+        if (options_.binary) {
+            BinarySignal signal;
+            signal.kind = SignalKind::Join;
+            signal.text = c.room->name;
+            encodeSignal(signal, join);
+        } else {
+            join = "{\"type\":\"Join\",\"data\":{\"room\":\"" + c.room->name + "\"}}";
+        }
+        send(c, join, options_.binary);
+        send(c, kReady, false);
+    }
+
+    // Ready is sent after joining, so receiving one proves the sender is in the
+    // room, and receiving anything proves the receiver is. Either side may join
+    // first and miss the other's Ready, so the answerer answers every Ready with
+    // another; the offerer starts once it has heard one.
+    void onReady(Client& c) {
+        Room& room = *c.room;
+        if (!c.offerer) {
+            send(c, kReady, false);
+            return;
+        }
+        if (room.ready) return;
+        room.ready = true;
+        rooms_ready.fetch_add(1, std::memory_order_relaxed);
+        if (phase_ == Phase::Negotiate || (phase_ == Phase::Storm && !room.storm_done)) startRound(room);
+    }
+
+    void startRound(Room& room) {
+        room.in_round = true;
+        room.round_start_ns = nowNs();
+        room.candidates_received[0] = room.candidates_received[1] = 0;
+        sendDescription(*room.peers[0], SignalKind::Offer);
+    }
+
+    void sendDescription(Client& c, SignalKind kind) {
+        scratch_.clear();
+        appendStamp(scratch_, nowNs());
+        scratch_ += sdp_body_;
+        if (options_.binary) {
+            BinarySignal signal;
+            signal.kind = kind;
+            signal.text = scratch_;
+            message_.clear();
+            encodeSignal(signal, message_);
+        } else {
+            message_ = kind == SignalKind::Offer ? "{\"type\":\"Offer\",\"data\":{\"sdp\":\""
+                                                 : "{\"type\":\"Answer\",\"data\":{\"sdp\":\"";
+            message_ += scratch_;
+            message_ += "\"}}";
+        }
+        send(c, message_, options_.binary);
+    }
+
+    void sendCandidates(Client& c) {
+        for (size_t i = 0; i < options_.candidates; ++i) {
+            scratch_.clear();
+            appendStamp(scratch_, nowNs());
+            scratch_ += " candidate:";
+            scratch_ += std::to_string(i + 1);
+            scratch_ += " 1 udp 2122260223 192.0.2.";
+            scratch_ += std::to_string(i + 1);
+            scratch_ += " 5";
+            scratch_ += std::to_string(1000 + i);
+            scratch_ += " typ host generation 0";
+            if (options_.binary) {
+                BinarySignal signal;
+                signal.kind = SignalKind::IceCandidate;
+                signal.text = scratch_;
+                signal.sdp_mid = "0";
+                message_.clear();
+                encodeSignal(signal, message_);
+            } else {
+                message_ = "{\"type\":\"IceCandidate\",\"data\":{\"candidate\":\"" + scratch_ +
+                           "\",\"sdp_mid\":\"0\",\"sdp_mline_index\":0}}";
+            }
+            send(c, message_, options_.binary);
+        }
+    }
+
+    void onMessage(Client& c, std::string_view payload, bool binary) {
+        SignalKind kind;
+        std::string_view text;
+        if (binary) {
+            BinarySignal signal;
+            if (!decodeSignal(payload, signal)) return;
+            kind = signal.kind;
+            text = signal.text;
+        } else {
+            std::string_view type;
+            if (!jsonField(payload, "type", type)) return;
+            if (type == "Ready") {
+                onReady(c);
+                return;
+            }
+            if (type == "Offer") kind = SignalKind::Offer;
+            else if (type == "Answer") kind = SignalKind::Answer;
+            else if (type == "IceCandidate") kind = SignalKind::IceCandidate;
+            else return;
+            if (!jsonField(payload, kind == SignalKind::IceCandidate ? "candidate" : "sdp", text)) return;
+        }
+
+        const int64_t now = nowNs();
+        if (phase_ == Phase::Negotiate) {
+            int64_t sent_ns;
+            if (parseStamp(text, sent_ns)) stats_.relay_us.record(static_cast<uint64_t>(std::max<int64_t>(0, now - sent_ns)) / 1000);
+            ++stats_.messages_received;
+            stats_.bytes_received += payload.size();
+        }
+
+        Room& room = *c.room;
+        if (!room.in_round) return;
+        switch (kind) {
+            case SignalKind::Offer:
+                if (c.offerer) return;
+                sendDescription(c, SignalKind::Answer);
+                sendCandidates(c);
+                break;
+            case SignalKind::Answer:
+                if (!c.offerer) return;
+                sendCandidates(c);
+                break;
+            case SignalKind::IceCandidate:
+                ++room.candidates_received[c.offerer ? 0 : 1];
+                if (room.candidates_received[0] >= options_.candidates && room.candidates_received[1] >= options_.candidates)
+                    finishRound(room, now);
+                break;
+            default: break;
+        }
+    }
+
+    void finishRound(Room& room, int64_t now) {
+        room.in_round = false;
+        if (phase_ == Phase::Negotiate) {
+            stats_.round_us.record(static_cast<uint64_t>(now - room.round_start_ns) / 1000);
+            ++stats_.rounds;
+            startRound(room);
+        } else if (phase_ == Phase::Storm && !room.storm_done) {
+            room.storm_done = true;
+            storm_rooms_done.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static constexpr std::string_view kReady = "{\"type\":\"Ready\",\"data\":{}}";
+
+    const Options& options_;
+    const addrinfo* address_;
+    Control& control_;
+    Phase phase_ = Phase::Connect;
+    int epoll_fd_ = -1;
+    std::vector<std::unique_ptr<Client>> clients_;
+    std::vector<std::unique_ptr<Room>> rooms_;
+    std::vector<Client*> retry_;
+    std::string sdp_body_;
+    std::string scratch_;
+    std::string message_;
+    Stats stats_;
+};
+
+// Server process sampled from /proc: resident set size and CPU time.
+struct ServerSample {
+    uint64_t rss_kb = 0;
+    uint64_t peak_rss_kb = 0;
+    double cpu_s = 0.0;
+};
+
+bool sampleServer(int pid, ServerSample& sample) {
+    if (pid <= 0) return false;
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    if (!status) return false;
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) sample.rss_kb = std::strtoull(line.c_str() + 6, nullptr, 10);
+        if (line.rfind("VmHWM:", 0) == 0) sample.peak_rss_kb = std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string content((std::istreambuf_iterator<char>(stat)), std::istreambuf_iterator<char>());
+    size_t paren = content.rfind(')');
+    if (paren == std::string::npos) return true;
+    // Fields after the command name start at 3 (state); utime and stime are 14 and 15
+    std::istringstream fields(content.substr(paren + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i == 14) utime = std::strtoull(field.c_str(), nullptr, 10);
+        if (i == 15) stime = std::strtoull(field.c_str(), nullptr, 10);
+    }
+    sample.cpu_s = static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+    return true;
+}
+
+std::string formatRss(const ServerSample& sample) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << sample.rss_kb / 1024.0 << " MiB";
+    return out.str();
+}
+
+void printLatency(const char* name, const Histogram& h, bool with_p999) {
+    std::cout << "  " << std::left << std::setw(22) << name << std::right << "p50 " << std::setw(8) << h.percentile(50)
+              << " us  p99 " << std::setw(8) << h.percentile(99) << " us";
+    if (with_p999) std::cout << "  p999 " << std::setw(8) << h.percentile(99.9) << " us";
+    std::cout << "  (" << h.count() << " samples)\n";
+}
+
+template <typename Done>
+bool waitFor(Done done, double timeout_s) {
+    const auto deadline = Clock::now() + std::chrono::duration<double>(timeout_s);
+    while (!done()) {
+        if (Clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  --host HOST        Signalling server host (default: 127.0.0.1)\n"
+              << "  --port PORT        Signalling server port (default: 8080)\n"
+              << "  --clients N        WebSocket clients, two per room (default: 1000)\n"
+              << "  --threads N        Client threads (default: one per core)\n"
+              << "  --duration SEC     Length of the negotiation phase (default: 10)\n"
+              << "  --candidates N     ICE candidates each side trickles per round (default: 4)\n"
+              << "  --sdp-bytes N      Size of each offer and answer SDP (default: 2500)\n"
+              << "  --binary           Use binary signalling frames instead of JSON\n"
+              << "  --storms N         Reconnect storms after the negotiation phase (default: 0)\n"
+              << "  --server-pid PID   Sample the server's RSS and CPU time from /proc\n"
+              << "  --help             Show this help message\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--host" && i + 1 < argc) options.host = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) options.port = argv[++i];
+        else if (arg == "--clients" && i + 1 < argc) options.clients = std::max(2ul, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--threads" && i + 1 < argc) options.threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--duration" && i + 1 < argc) options.duration_s = std::max(0.1, std::atof(argv[++i]));
+        else if (arg == "--candidates" && i + 1 < argc) options.candidates = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--sdp-bytes" && i + 1 < argc) options.sdp_bytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--binary") options.binary = true;
+        else if (arg == "--storms" && i + 1 < argc) options.storms = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--server-pid" && i + 1 < argc) options.server_pid = std::atoi(argv[++i]);
+        else if (arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    // The server drops messages over 64 KiB
+    options.sdp_bytes = std::clamp<size_t>(options.sdp_bytes, kStampDigits, 60000);
+
+    const size_t room_count = options.clients / 2;
+    options.threads = std::min(options.threads, room_count);
+
+    // Two descriptors per client would be tight under the usual 1024 soft limit
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (int rc = getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &address); rc != 0) {
+        std::cerr << "Cannot resolve " << options.host << ":" << options.port << ": " << gai_strerror(rc) << "\n";
+        return 1;
+    }
+
+    std::cout << "signalling-bench: " << room_count * 2 << " clients in " << room_count << " rooms on "
+              << options.threads << " threads, " << (options.binary ? "binary" : "JSON") << " framing, "
+              << options.sdp_bytes << "-byte SDP, " << options.candidates << " candidates per side\n";
+
+    ServerSample baseline, after_connect, after_negotiate, after_storms;
+    const bool sampling = sampleServer(options.server_pid, baseline);
+    if (options.server_pid > 0 && !sampling) std::cerr << "Cannot read /proc/" << options.server_pid << "\n";
+
+    Control control;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t t = 0, first = 0; t < options.threads; ++t) {
+        size_t count = room_count / options.threads + (t < room_count % options.threads ? 1 : 0);
+        workers.push_back(std::make_unique<Worker>(options, address, control, first, count));
+        first += count;
+    }
+    auto total = [&](auto member) {
+        size_t sum = 0;
+        for (auto& w : workers) sum += ((*w).*member).load(std::memory_order_relaxed);
+        return sum;
+    };
+
+    // Connect: measured up to the last handshake, then until every room is ready
+    const int64_t connect_start = nowNs();
+    std::vector<std::thread> threads;
+    for (auto& w : workers) threads.emplace_back([&w]() { w->run(); });
+    const bool connected = waitFor([&]() { return total(&Worker::opened) == room_count * 2; }, 60.0);
+    int64_t last_open = 0;
+    for (auto& w : workers) last_open = std::max(last_open, w->last_open_ns.load());
+    const double connect_s = static_cast<double>(last_open - connect_start) / 1e9;
+    const size_t connected_count = total(&Worker::opened);
+    if (!connected) std::cerr << "Only " << connected_count << " clients connected within 60s\n";
+    if (!waitFor([&]() { return total(&Worker::rooms_ready) == room_count; }, 10.0))
+        std::cerr << "Only " << total(&Worker::rooms_ready) << " rooms ready within 10s\n";
+    if (sampling) sampleServer(options.server_pid, after_connect);
+
+    // Negotiate: back-to-back rounds in every room
+    control.phase.store(Phase::Negotiate, std::memory_order_release);
+    const auto negotiate_start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration_s));
+    control.phase.store(Phase::Drain, std::memory_order_release);
+    const double negotiate_s = std::chrono::duration<double>(Clock::now() - negotiate_start).count();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if (sampling) sampleServer(options.server_pid, after_negotiate);
+
+    // Storms: drop everything, reconnect, and wait for a round in every room
+    std::vector<double> storm_seconds;
+    for (size_t s = 0; s < options.storms; ++s) {
+        const size_t done_before = total(&Worker::storm_rooms_done);
+        const auto storm_start = Clock::now();
+        control.storm_generation.fetch_add(1, std::memory_order_release);
+        control.phase.store(Phase::Storm, std::memory_order_release);
+        bool done = waitFor([&]() { return total(&Worker::storm_rooms_done) - done_before >= room_count; }, 120.0);
+        storm_seconds.push_back(std::chrono::duration<double>(Clock::now() - storm_start).count());
+        if (!done)
+            std::cerr << "Storm " << s + 1 << ": only " << total(&Worker::storm_rooms_done) - done_before
+                      << " rooms recovered within 120s\n";
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    if (sampling && options.storms > 0) sampleServer(options.server_pid, after_storms);
+
+    control.phase.store(Phase::Stop, std::memory_order_release);
+    for (auto& t : threads) t.join();
+
+    Stats stats;
+    for (auto& w : workers) {
+        const Stats& s = w->stats();
+        stats.setup_us.merge(s.setup_us);
+        stats.storm_setup_us.merge(s.storm_setup_us);
+        stats.relay_us.merge(s.relay_us);
+        stats.round_us.merge(s.round_us);
+        stats.messages_received += s.messages_received;
+        stats.bytes_received += s.bytes_received;
+        stats.messages_sent += s.messages_sent;
+        stats.rounds += s.rounds;
+        stats.connect_failures += s.connect_failures;
+        stats.disconnects += s.disconnects;
+    }
+    workers.clear();
+    freeaddrinfo(address);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Connection setup:\n"
+              << "  " << connected_count << " connected in " << std::setprecision(3) << connect_s << std::setprecision(1) << " s ("
+              << (connect_s > 0 ? connected_count / connect_s : 0.0) << " conn/s), " << stats.connect_failures
+              << " failed attempts\n";
+    printLatency("handshake", stats.setup_us, false);
+
+    const double msgs_per_s = stats.messages_received / negotiate_s;
+    std::cout << "Relay (" << negotiate_s << " s):\n"
+              << "  " << stats.messages_received << " messages received, " << msgs_per_s << " msg/s, "
+              << stats.bytes_received / negotiate_s / (1024 * 1024) << " MiB/s, " << stats.rounds << " rounds ("
+              << stats.rounds / negotiate_s << "/s)\n";
+    printLatency("relay latency", stats.relay_us, true);
+    printLatency("round (offer..ICE)", stats.round_us, true);
+    if (stats.disconnects > 0) std::cout << "  " << stats.disconnects << " unexpected disconnects\n";
+
+    if (sampling) {
+        const double cpu_s = after_negotiate.cpu_s - after_connect.cpu_s;
+        std::cout << "Server (pid " << options.server_pid << "):\n"
+                  << "  RSS " << formatRss(baseline) << " idle, " << formatRss(after_connect) << " connected, "
+                  << formatRss(after_negotiate) << " after relay";
+        if (options.storms > 0) std::cout << ", " << formatRss(after_storms) << " after storms";
+        const ServerSample& last = options.storms > 0 ? after_storms : after_negotiate;
+        std::cout << "; peak " << last.peak_rss_kb / 1024.0 << " MiB\n";
+        if (connected_count > 0)
+            std::cout << "  " << std::setprecision(2)
+                      << static_cast<double>(after_connect.rss_kb - std::min(after_connect.rss_kb, baseline.rss_kb)) *
+                             1024.0 / connected_count
+                      << " bytes per connection\n";
+        std::cout << std::setprecision(1) << "  CPU " << cpu_s << " s during relay ("
+                  << cpu_s / negotiate_s * 100.0 << "% of one core), "
+                  << (cpu_s > 0 ? stats.messages_received / cpu_s : 0.0) << " msg per CPU-second\n";
+    }
+
+    if (!storm_seconds.empty()) {
+        std::cout << "Reconnect storms:\n";
+        for (size_t s = 0; s < storm_seconds.size(); ++s)
+            std::cout << "  storm " << s + 1 << ": " << room_count * 2 << " clients back and every room renegotiated in "
+                      << std::setprecision(3) << storm_seconds[s] << " s ("
+                      << std::setprecision(1) << room_count * 2 / storm_seconds[s] << " conn/s)\n";
+        printLatency("reconnect handshake", stats.storm_setup_us, true);
+    }
+    return 0;
+}
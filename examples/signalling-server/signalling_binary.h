@@ -0,0 +1,92 @@
+// Binary signalling frames, the compact alternative to JSON messages
+#ifndef SIGNALLING_BINARY_H
+#define SIGNALLING_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Sent as WebSocket BINARY messages; the server relays them as BINARY, and
+// TEXT messages stay JSON ({"type": ..., "data": {...}}). Layout:
+//
+//   u8  kind
+//   u32 little-endian length, then that many bytes: the SDP, the candidate or the room
+//   IceCandidate only: u32 length and sdp_mid bytes, then u16 little-endian sdp_mline_index
+//
+// Nothing is escaped or parsed, so a peer can hand the SDP straight to
+// webrtc_session_set_remote_sdp.
+enum class SignalKind : uint8_t {
+    Offer = 1,
+    Answer = 2,
+    IceCandidate = 3,
+    Join = 4,
+};
+
+struct BinarySignal {
+    SignalKind kind = SignalKind::Offer;
+    std::string_view text; // SDP, candidate or room name
+    std::string_view sdp_mid;
+    uint16_t sdp_mline_index = 0;
+};
+
+namespace signalling_binary_detail {
+
+inline void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+inline bool getU32(std::string_view& in, uint32_t& value) {
+    if (in.size() < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    in.remove_prefix(4);
+    return true;
+}
+
+inline bool getBytes(std::string_view& in, std::string_view& value) {
+    uint32_t length;
+    if (!getU32(in, length) || in.size() < length) return false;
+    value = in.substr(0, length);
+    in.remove_prefix(length);
+    return true;
+}
+
+} // namespace signalling_binary_detail
+
+// Appends the frame for signal to out.
+inline void encodeSignal(const BinarySignal& signal, std::string& out) {
+    using namespace signalling_binary_detail;
+    out.reserve(out.size() + 1 + 4 + signal.text.size() + 4 + signal.sdp_mid.size() + 2);
+    out += static_cast<char>(signal.kind);
+    putU32(out, static_cast<uint32_t>(signal.text.size()));
+    out.append(signal.text);
+    if (signal.kind == SignalKind::IceCandidate) {
+        putU32(out, static_cast<uint32_t>(signal.sdp_mid.size()));
+        out.append(signal.sdp_mid);
+        out += static_cast<char>(signal.sdp_mline_index & 0xff);
+        out += static_cast<char>(signal.sdp_mline_index >> 8);
+    }
+}
+
+// Parses a frame; the views in signal point into frame. Returns false if the
+// frame is truncated, has trailing bytes or an unknown kind.
+inline bool decodeSignal(std::string_view frame, BinarySignal& signal) {
+    using namespace signalling_binary_detail;
+    if (frame.empty()) return false;
+    auto kind = static_cast<uint8_t>(frame[0]);
+    if (kind < static_cast<uint8_t>(SignalKind::Offer) || kind > static_cast<uint8_t>(SignalKind::Join)) return false;
+    signal = BinarySignal{};
+    signal.kind = static_cast<SignalKind>(kind);
+    frame.remove_prefix(1);
+    if (!getBytes(frame, signal.text)) return false;
+    if (signal.kind == SignalKind::IceCandidate) {
+        if (!getBytes(frame, signal.sdp_mid) || frame.size() < 2) return false;
+        signal.sdp_mline_index = static_cast<uint16_t>(static_cast<unsigned char>(frame[0]) |
+                                                       static_cast<unsigned char>(frame[1]) << 8);
+        frame.remove_prefix(2);
+    }
+    return frame.empty();
+}
+
+#endif // SIGNALLING_BINARY_H
@@ -0,0 +1,122 @@
+// Counters, latency histograms and Prometheus text output for GET /metrics
+#ifndef SIGNALLING_METRICS_H
+#define SIGNALLING_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+inline int64_t metricsNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds n to an atomic that only one thread writes, the event loop owning it.
+// A relaxed load and store rather than fetch_add: no locked instruction on the
+// hot path, and a scrape from another thread still reads a whole value.
+template <typename T>
+inline void bump(std::atomic<T>& counter, typename std::atomic<T>::value_type n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Fixed-bucket histogram of nanosecond durations, written by one event loop.
+class LatencyHistogram {
+public:
+    static constexpr std::array<int64_t, 12> kBoundsNs = {
+        10'000, 25'000, 50'000, 100'000, 250'000, 500'000,
+        1'000'000, 2'500'000, 5'000'000, 10'000'000, 25'000'000, 100'000'000,
+    };
+
+    void record(int64_t ns) {
+        size_t i = 0;
+        while (i < kBoundsNs.size() && ns > kBoundsNs[i]) ++i;
+        bump(counts_[i]);
+        bump(sum_ns_, static_cast<uint64_t>(ns > 0 ? ns : 0));
+    }
+
+    // Bucket i counts durations in (kBoundsNs[i-1], kBoundsNs[i]]; the last one is +Inf.
+    uint64_t bucket(size_t i) const { return counts_[i].load(std::memory_order_relaxed); }
+    uint64_t sumNs() const { return sum_ns_.load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<uint64_t>, kBoundsNs.size() + 1> counts_{};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+// Builds a Prometheus text exposition (format 0.0.4). Labels are passed
+// preformatted, e.g. thread="0".
+class MetricsWriter {
+public:
+    void family(std::string_view name, std::string_view type, std::string_view help) {
+        out_ += "# HELP ";
+        out_ += name;
+        out_ += ' ';
+        out_ += help;
+        out_ += "\n# TYPE ";
+        out_ += name;
+        out_ += ' ';
+        out_ += type;
+        out_ += '\n';
+    }
+
+    void sample(std::string_view name, std::string_view labels, uint64_t value) {
+        begin(name, labels);
+        char buf[24];
+        out_.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+        out_ += '\n';
+    }
+
+    void sample(std::string_view name, std::string_view labels, double value) {
+        begin(name, labels);
+        char buf[32];
+        int n = std::snprintf(buf, sizeof(buf), "%.9g", value);
+        out_.append(buf, n > 0 ? static_cast<size_t>(n) : 0);
+        out_ += '\n';
+    }
+
+    // Writes name_bucket (cumulative), name_sum in seconds and name_count.
+    void histogram(std::string_view name, std::string_view labels, const LatencyHistogram& histogram) {
+        const std::string bucket_name = std::string(name) + "_bucket";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= LatencyHistogram::kBoundsNs.size(); ++i) {
+            cumulative += histogram.bucket(i);
+            std::string bucket_labels(labels);
+            if (!bucket_labels.empty()) bucket_labels += ',';
+            bucket_labels += "le=\"";
+            if (i < LatencyHistogram::kBoundsNs.size()) {
+                char buf[32];
+                int n = std::snprintf(buf, sizeof(buf), "%g", LatencyHistogram::kBoundsNs[i] / 1e9);
+                bucket_labels.append(buf, n > 0 ? static_cast<size_t>(n) : 0);
+            } else {
+                bucket_labels += "+Inf";
+            }
+            bucket_labels += '"';
+            sample(bucket_name, bucket_labels, cumulative);
+        }
+        sample(std::string(name) + "_sum", labels, histogram.sumNs() / 1e9);
+        sample(std::string(name) + "_count", labels, cumulative);
+    }
+
+    const std::string& str() const { return out_; }
+
+private:
+    void begin(std::string_view name, std::string_view labels) {
+        out_ += name;
+        if (!labels.empty()) {
+            out_ += '{';
+            out_ += labels;
+            out_ += '}';
+        }
+        out_ += ' ';
+    }
+
+    std::string out_;
+};
+
+#endif // SIGNALLING_METRICS_H
@@ -1,220 +1,603 @@
 // Minimal C++ WebSocket Signaling Server using uWebSockets
 #include <uWebSockets/App.h>
+#include "async_logger.h"
+#include "signalling_binary.h"
+#include "signalling_metrics.h"
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
+#include <array>
+#include <memory>
+#include <thread>
 #include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <stdexcept>
 #include <mutex>
-#include <ctime>
-#include <iomanip>
-#include <sstream>
 
-struct PerSocketData {};
+// Sockets that never send a join message share the default room, so a single
+// vtk-cube and its viewer work without any room setup.
+const std::string kDefaultRoom;
+constexpr size_t kMaxRoomNameLength = 128;
+// A join is a short control message; longer messages are relayed without being scanned for one.
+constexpr size_t kMaxJoinMessageLength = 1024;
+// Event loop threads are tracked in a 64-bit mask per room.
+constexpr size_t kMaxThreads = 64;
+// Messages handed to another loop that it has not relayed yet; beyond this they are dropped.
+constexpr size_t kMaxPendingHandoffs = 4096;
+// Larger messages are dropped rather than relayed.
+constexpr size_t kMaxMessageLength = 65536;
+// Each loop's timer fires this often; how late it fires is the loop lag.
+constexpr int kLoopLagIntervalMs = 100;
 
-class Logger {
+struct RoomState;
+
+struct PerSocketData {
+    std::shared_ptr<RoomState> room; // set on open, replaced on join
+};
+
+// Finds "key": "value" anywhere in a JSON object and returns the value. Enough
+// for the join message; values with escape sequences are not supported.
+static bool findStringField(std::string_view json, std::string_view key, std::string_view& value) {
+    std::string quoted_key = "\"" + std::string(key) + "\"";
+    size_t pos = json.find(quoted_key);
+    if (pos == std::string_view::npos) return false;
+    pos = json.find_first_not_of(" \t\r\n", pos + quoted_key.size());
+    if (pos == std::string_view::npos || json[pos] != ':') return false;
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string_view::npos || json[pos] != '"') return false;
+    size_t end = json.find_first_of("\"\\", pos + 1);
+    if (end == std::string_view::npos || json[end] != '"') return false;
+    value = json.substr(pos + 1, end - pos - 1);
+    return true;
+}
+
+// {"type": "Join", "data": {"room": "name"}}, or a binary Join frame, moves the
+// sender into a room; it is handled by the server and not relayed.
+static bool parseJoinMessage(std::string_view msg, uWS::OpCode opCode, std::string_view& room) {
+    if (msg.size() > kMaxJoinMessageLength) return false;
+    if (opCode == uWS::OpCode::BINARY) {
+        BinarySignal signal;
+        if (!decodeSignal(msg, signal) || signal.kind != SignalKind::Join) return false;
+        room = signal.text;
+        return true;
+    }
+    if (msg.find("\"Join\"") == std::string_view::npos) return false;
+    std::string_view type;
+    return findStringField(msg, "type", type) && type == "Join" && findStringField(msg, "room", room);
+}
+
+// One room's membership across event loops. Each loop relays to its own
+// members through the room's uWS topic; loop_mask tells a sender which other
+// loops have members and need the message handed over.
+struct RoomState {
+    RoomState(std::string_view room) : name(room), topic("room/" + std::string(room)) {}
+
+    const std::string name;
+    const std::string topic;
+    std::atomic<uint64_t> loop_mask{0};
+    std::atomic<size_t> members{0};
+    std::array<uint32_t, kMaxThreads> loop_members{}; // guarded by the owning shard's mutex
+};
+
+// Room name -> RoomState, sharded by home thread: a room's entry lives in the
+// shard of the thread its name hashes to. Only joins and leaves take a shard
+// lock; relaying a message reads the room's atomics.
+class RoomDirectory {
 public:
-    static void error(const std::string& message) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::cerr << "[ERROR] " << getCurrentTime() << " " << message << std::endl;
+    explicit RoomDirectory(size_t shards) : shards_(std::make_unique<Shard[]>(shards)), shard_count_(shards) {}
+
+    std::shared_ptr<RoomState> join(std::string_view room, size_t loop) {
+        Shard& shard = shardFor(room);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& state = shard.rooms[std::string(room)];
+        if (!state) state = std::make_shared<RoomState>(room);
+        if (state->loop_members[loop]++ == 0) state->loop_mask.fetch_or(uint64_t{1} << loop, std::memory_order_release);
+        state->members.fetch_add(1, std::memory_order_relaxed);
+        return state;
     }
-    
-    static void info(const std::string& message) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::cout << "[INFO] " << getCurrentTime() << " " << message << std::endl;
+
+    void leave(const std::shared_ptr<RoomState>& state, size_t loop) {
+        Shard& shard = shardFor(state->name);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (--state->loop_members[loop] == 0) state->loop_mask.fetch_and(~(uint64_t{1} << loop), std::memory_order_release);
+        if (state->members.fetch_sub(1, std::memory_order_relaxed) == 1) shard.rooms.erase(state->name);
     }
-    
-    static void warn(const std::string& message) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::cout << "[WARN] " << getCurrentTime() << " " << message << std::endl;
+
+    size_t homeThread(std::string_view room) const {
+        return std::hash<std::string_view>{}(room) % shard_count_;
     }
 
-private:
-    static std::mutex mutex_;
-    
-    static std::string getCurrentTime() {
-        auto now = std::time(nullptr);
-        auto* tm = std::localtime(&now);
-        std::ostringstream oss;
-        oss << std::put_time(tm, "%Y-%m-%d %H:%M:%S");
-        return oss.str();
+    size_t roomCount() const {
+        size_t count = 0;
+        for (size_t i = 0; i < shard_count_; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            count += shards_[i].rooms.size();
+        }
+        return count;
     }
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<RoomState>> rooms;
+    };
+
+    Shard& shardFor(std::string_view room) { return shards_[homeThread(room)]; }
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_count_;
 };
 
-std::mutex Logger::mutex_;
+// One event loop's counters, exported by GET /metrics. The loop writes its own
+// with bump(); only handoffs_dropped is added to by other loops. Aligned so
+// loops never share a cache line.
+struct alignas(64) RelayCounters {
+    std::atomic<int64_t> connections{0};
+    std::atomic<uint64_t> messages_relayed{0}; // received here and relayed to the room
+    std::atomic<uint64_t> bytes_relayed{0};
+    std::atomic<uint64_t> handoffs_received{0}; // relayed here on behalf of another loop
+    std::atomic<uint64_t> joins{0};
+    std::atomic<uint64_t> dropped_empty{0};
+    std::atomic<uint64_t> dropped_oversized{0};
+    std::atomic<uint64_t> dropped_room_name{0}; // joins with a name over kMaxRoomNameLength
+    std::atomic<uint64_t> evicted{0};          // closed for exceeding maxBackpressure
+    std::atomic<uint64_t> drained{0};          // caught up after building backpressure
+    std::atomic<uint64_t> handoffs_dropped{0}; // not handed to this loop: its queue was full
+    std::atomic<int64_t> loop_lag_ns{0};       // at the last timer tick
+    LatencyHistogram relay_latency;   // received to published here and queued for other loops
+    LatencyHistogram handoff_latency; // received by another loop to published here
+};
+
+// A message relayed by another loop, waiting to be published on this one.
+struct Handoff {
+    std::shared_ptr<RoomState> room;
+    std::shared_ptr<const std::string> payload;
+    uWS::OpCode opCode;
+    int64_t received_ns; // metricsNowNs() on the sending loop
+};
+
+// An event loop thread and its app. Other loops hand messages over in
+// batches: the first message queued schedules one Loop::defer, which
+// publishes everything queued by then in a single loop iteration.
+struct Worker {
+    uWS::Loop* loop = nullptr;
+    uWS::App* app = nullptr;
+    RelayCounters counters;
+
+    // Called from other loops. Returns false if the queue is full.
+    bool handOff(Handoff handoff) {
+        std::lock_guard<std::mutex> lock(handoff_mutex);
+        if (handoffs.size() >= kMaxPendingHandoffs) return false;
+        handoffs.push_back(std::move(handoff));
+        if (!drain_scheduled) {
+            drain_scheduled = true;
+            loop->defer([this]() { drainHandoffs(); });
+        }
+        return true;
+    }
 
+    // On this worker's loop thread, every kLoopLagIntervalMs
+    void sampleLoopLag() {
+        const int64_t now = metricsNowNs();
+        if (last_lag_tick_ns > 0) {
+            int64_t lag = now - last_lag_tick_ns - int64_t{kLoopLagIntervalMs} * 1000000;
+            counters.loop_lag_ns.store(std::max<int64_t>(lag, 0), std::memory_order_relaxed);
+        }
+        last_lag_tick_ns = now;
+    }
+
+private:
+    // On this worker's loop thread
+    void drainHandoffs() {
+        {
+            std::lock_guard<std::mutex> lock(handoff_mutex);
+            batch.swap(handoffs);
+            drain_scheduled = false;
+        }
+        for (const Handoff& handoff : batch) {
+            app->publish(handoff.room->topic, *handoff.payload, handoff.opCode);
+            counters.handoff_latency.record(metricsNowNs() - handoff.received_ns);
+        }
+        bump(counters.handoffs_received, batch.size());
+        batch.clear();
+    }
+
+    std::mutex handoff_mutex;
+    std::vector<Handoff> handoffs; // guarded by handoff_mutex
+    bool drain_scheduled = false;  // guarded by handoff_mutex
+    std::vector<Handoff> batch;    // loop thread only; keeps its capacity between batches
+    int64_t last_lag_tick_ns = 0;  // loop thread only
+};
+
+// Per event loop. A socket subscribes to its room's topic and publishes to it,
+// and uWS delivers to every other subscriber on this loop; other loops with
+// members get the message through their Loop::defer queue. Handlers run on the
+// loop thread, so only the shared RoomDirectory needs locking.
 class ClientManager {
 public:
-    void addClient(uWS::WebSocket<false, true, PerSocketData>* ws) {
-        std::lock_guard<std::mutex> lock(mutex_);
+    using Socket = uWS::WebSocket<false, true, PerSocketData>;
+
+    ClientManager(size_t index, std::vector<Worker>& workers, RoomDirectory& rooms, std::atomic<size_t>& client_count)
+        : index_(index), workers_(workers), rooms_(rooms), client_count_(client_count) {}
+
+    void addClient(Socket* ws) {
         try {
-            clients_.push_back(ws);
-            Logger::info("Client connected. Total: " + std::to_string(clients_.size()));
+            enterRoom(ws, kDefaultRoom);
+            bump(counters().connections);
+            size_t total = ++client_count_;
+            LOG_INFO("Client connected. Total: ", total);
         } catch (const std::exception& e) {
-            Logger::error("Failed to add client: " + std::string(e.what()));
+            LOG_ERROR("Failed to add client: ", e.what());
             throw;
         }
     }
     
-    void removeClient(uWS::WebSocket<false, true, PerSocketData>* ws) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        try {
-            auto it = std::find(clients_.begin(), clients_.end(), ws);
-            if (it != clients_.end()) {
-                clients_.erase(it);
-                Logger::info("Client disconnected. Total: " + std::to_string(clients_.size()));
-            } else {
-                Logger::warn("Attempted to remove non-existent client");
-            }
-        } catch (const std::exception& e) {
-            Logger::error("Failed to remove client: " + std::string(e.what()));
+    // uWS drops a closing socket's subscriptions itself; only the directory needs updating.
+    void removeClient(Socket* ws, unsigned int max_backpressure) {
+        // uWS closes a socket that exceeds maxBackpressure with the backlog still
+        // buffered; nothing else leaves that much unsent
+        unsigned int buffered = ws->getBufferedAmount();
+        if (max_backpressure > 0 && buffered > max_backpressure) {
+            uint64_t evicted = workers_[index_].counters.evicted.fetch_add(1, std::memory_order_relaxed) + 1;
+            LOG_WARN("Evicted slow client with ", buffered, " bytes unsent (", evicted, " evicted on thread ", index_, ")");
         }
+        PerSocketData* data = ws->getUserData();
+        if (data->room) rooms_.leave(data->room, index_);
+        data->room.reset();
+        bump(counters().connections, -1);
+        size_t total = --client_count_;
+        LOG_INFO("Client disconnected. Total: ", total);
+    }
+
+    void joinRoom(Socket* ws, std::string_view room) {
+        PerSocketData* data = ws->getUserData();
+        if (data->room->name == room) return;
+        ws->unsubscribe(data->room->topic);
+        rooms_.leave(data->room, index_);
+        size_t members = enterRoom(ws, room);
+        bump(counters().joins);
+        LOG_DEBUG("Client joined room '", data->room->name, "' (", members, " members, home thread ",
+                  rooms_.homeThread(room), ")");
     }
     
-    void broadcastMessage(uWS::WebSocket<false, true, PerSocketData>* sender, 
-                         std::string_view message, bool verbose) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        int sent_count = 0;
-        int failed_count = 0;
-        
-        for (auto* client : clients_) {
-            if (client != sender) {
-                try {
-                    client->send(message, uWS::OpCode::TEXT);
-                    sent_count++;
-                    if (verbose) {
-                        Logger::info("Message relayed to client");
-                    }
-                } catch (const std::exception& e) {
-                    failed_count++;
-                    Logger::error("Failed to send message to client: " + std::string(e.what()));
+    // Relays with the sender's opcode, so binary signalling frames stay binary.
+    void broadcastMessage(Socket* sender, std::string_view message, uWS::OpCode opCode) {
+        const int64_t received_ns = metricsNowNs();
+        const std::shared_ptr<RoomState>& room = sender->getUserData()->room;
+        sender->publish(room->topic, message, opCode);
+
+        uint64_t other_loops = room->loop_mask.load(std::memory_order_acquire) & ~(uint64_t{1} << index_);
+        if (other_loops) {
+            // One copy shared by every loop the message is handed to
+            auto payload = std::make_shared<const std::string>(message);
+            for (size_t i = 0; other_loops; ++i, other_loops >>= 1) {
+                if (!(other_loops & 1)) continue;
+                // A stalled loop must not queue unbounded copies
+                Worker& target = workers_[i];
+                if (!target.handOff(Handoff{room, payload, opCode, received_ns})) {
+                    target.counters.handoffs_dropped.fetch_add(1, std::memory_order_relaxed);
                 }
             }
         }
-        
-        if (failed_count > 0) {
-            Logger::warn("Failed to send message to " + std::to_string(failed_count) + " clients");
-        }
-        
-        if (verbose && sent_count > 0) {
-            Logger::info("Message sent to " + std::to_string(sent_count) + " clients");
-        }
+        RelayCounters& stats = counters();
+        stats.relay_latency.record(metricsNowNs() - received_ns);
+        bump(stats.messages_relayed);
+        bump(stats.bytes_relayed, message.size());
+        LOG_DEBUG("Message relayed to room '", room->name, "' (", room->members.load(std::memory_order_relaxed) - 1,
+                  " peers)");
     }
     
+    // Called by uWS once a socket's send buffer has been flushed after building backpressure.
+    void clientDrained(Socket* ws) {
+        if (ws->getBufferedAmount() > 0) return;
+        workers_[index_].counters.drained.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("Client send buffer drained");
+    }
+
     size_t getClientCount() const {
+        return client_count_;
+    }
+
+    size_t getRoomCount() const {
+        return rooms_.roomCount();
+    }
+
+    RelayCounters& counters() {
+        return workers_[index_].counters;
+    }
+
+private:
+    // Subscribes ws to room and returns the room's member count.
+    size_t enterRoom(Socket* ws, std::string_view room) {
+        PerSocketData* data = ws->getUserData();
+        data->room = rooms_.join(room, index_);
+        ws->subscribe(data->room->topic);
+        return data->room->members.load(std::memory_order_relaxed);
+    }
+
+    const size_t index_;
+    std::vector<Worker>& workers_;
+    RoomDirectory& rooms_;
+    std::atomic<size_t>& client_count_;
+};
+
+static std::string threadLabel(size_t index) {
+    return "thread=\"" + std::to_string(index) + "\"";
+}
+
+// GET /metrics: every loop's counters labelled by thread, in Prometheus text
+// format. Only reads atomics, apart from the directory locks for the room count.
+static std::string renderMetrics(const std::vector<Worker>& workers, const RoomDirectory& rooms) {
+    MetricsWriter out;
+    auto per_thread = [&](std::string_view name, std::string_view type, std::string_view help, auto value) {
+        out.family(name, type, help);
+        for (size_t i = 0; i < workers.size(); ++i) out.sample(name, threadLabel(i), value(workers[i].counters));
+    };
+    auto load = [](const auto& counter) { return static_cast<uint64_t>(counter.load(std::memory_order_relaxed)); };
+
+    per_thread("signalling_connections", "gauge", "Open WebSocket connections.", [](const RelayCounters& c) {
+        return static_cast<uint64_t>(std::max<int64_t>(c.connections.load(std::memory_order_relaxed), 0));
+    });
+    out.family("signalling_rooms", "gauge", "Rooms with at least one member, including the default room.");
+    out.sample("signalling_rooms", "", static_cast<uint64_t>(rooms.roomCount()));
+    per_thread("signalling_messages_relayed_total", "counter", "Messages received and relayed to their room.",
+               [&](const RelayCounters& c) { return load(c.messages_relayed); });
+    per_thread("signalling_bytes_relayed_total", "counter", "Payload bytes of the relayed messages.",
+               [&](const RelayCounters& c) { return load(c.bytes_relayed); });
+    per_thread("signalling_handoffs_total", "counter", "Messages relayed on behalf of another event loop.",
+               [&](const RelayCounters& c) { return load(c.handoffs_received); });
+    per_thread("signalling_joins_total", "counter", "Room joins.",
+               [&](const RelayCounters& c) { return load(c.joins); });
+
+    out.family("signalling_messages_dropped_total", "counter", "Messages not relayed, by reason.");
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const RelayCounters& c = workers[i].counters;
+        const std::string thread = threadLabel(i);
+        out.sample("signalling_messages_dropped_total", thread + ",reason=\"empty\"", load(c.dropped_empty));
+        out.sample("signalling_messages_dropped_total", thread + ",reason=\"oversized\"", load(c.dropped_oversized));
+        out.sample("signalling_messages_dropped_total", thread + ",reason=\"room_name_too_long\"", load(c.dropped_room_name));
+        out.sample("signalling_messages_dropped_total", thread + ",reason=\"handoff_queue_full\"", load(c.handoffs_dropped));
+    }
+
+    per_thread("signalling_backpressure_evictions_total", "counter", "Clients closed for exceeding --max-backpressure.",
+               [&](const RelayCounters& c) { return load(c.evicted); });
+    per_thread("signalling_backpressure_drained_total", "counter", "Clients that caught up after building backpressure.",
+               [&](const RelayCounters& c) { return load(c.drained); });
+
+    out.family("signalling_relay_latency_seconds", "histogram",
+               "Time from receiving a message to publishing it, by where it was published.");
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const std::string thread = threadLabel(i);
+        out.histogram("signalling_relay_latency_seconds", thread + ",path=\"local\"", workers[i].counters.relay_latency);
+        out.histogram("signalling_relay_latency_seconds", thread + ",path=\"handoff\"", workers[i].counters.handoff_latency);
+    }
+
+    out.family("signalling_event_loop_lag_seconds", "gauge", "How late the event loop ran its last periodic timer.");
+    for (size_t i = 0; i < workers.size(); ++i) {
+        out.sample("signalling_event_loop_lag_seconds", threadLabel(i),
+                   workers[i].counters.loop_lag_ns.load(std::memory_order_relaxed) / 1e9);
+    }
+
+    out.family("signalling_log_lines_dropped_total", "counter", "Log lines dropped because the log queue was full.");
+    out.sample("signalling_log_lines_dropped_total", "", AsyncLogger::instance().dropped());
+    return out.str();
+}
+
+// Lets every worker finish listen() before any of them starts serving, so a
+// failure on one port binding stops them all.
+class StartupGate {
+public:
+    explicit StartupGate(size_t workers) : pending_(workers) {}
+
+    // Reports this worker's listen result; returns true if every worker succeeded.
+    bool arrive(bool ok) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!ok) failed_ = true;
+        if (--pending_ == 0) cv_.notify_all();
+        cv_.wait(lock, [this]() { return pending_ == 0; });
+        return !failed_;
+    }
+
+    bool failed() const {
         std::lock_guard<std::mutex> lock(mutex_);
-        return clients_.size();
+        return failed_;
     }
 
 private:
     mutable std::mutex mutex_;
-    std::vector<uWS::WebSocket<false, true, PerSocketData>*> clients_;
+    std::condition_variable cv_;
+    size_t pending_;
+    bool failed_ = false;
 };
 
 int main(int argc, char* argv[]) {
+    AsyncLoggerGuard logger_guard; // flushes queued lines on every return path
     try {
-        Logger::info("Starting signaling server...");
+        LOG_INFO("Starting signaling server...");
         
-        std::atomic<bool> verbose{false};
         int port = 8080;
+        size_t threads = 1;
+        // Send buffer a client may build up before the slow-consumer policy applies
+        unsigned int max_backpressure = 1024 * 1024;
+        bool evict_slow_consumers = true;
         
         for (int i = 1; i < argc; ++i) {
             try {
                 std::string arg(argv[i]);
                 if (arg == "--verbose") {
-                    verbose = true;
-                    Logger::info("Verbose mode enabled");
+                    AsyncLogger::instance().setLevel(LogLevel::Debug);
+                    LOG_INFO("Verbose mode enabled");
+                } else if (arg == "--log-json") {
+                    AsyncLogger::instance().setFormat(LogFormat::Json);
                 } else if (arg == "--port" && i + 1 < argc) {
                     port = std::stoi(argv[++i]);
                     if (port <= 0 || port > 65535) {
                         throw std::invalid_argument("Port must be between 1 and 65535");
                     }
-                    Logger::info("Using port: " + std::to_string(port));
+                    LOG_INFO("Using port: ", port);
+                } else if (arg == "--threads" && i + 1 < argc) {
+                    int n = std::stoi(argv[++i]);
+                    if (n == 0) n = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+                    if (n < 0 || n > static_cast<int>(kMaxThreads)) {
+                        throw std::invalid_argument("Threads must be between 0 and " + std::to_string(kMaxThreads));
+                    }
+                    threads = static_cast<size_t>(n);
+                    LOG_INFO("Using ", threads, " event loop threads");
+                } else if (arg == "--max-backpressure" && i + 1 < argc) {
+                    long bytes = std::stol(argv[++i]);
+                    if (bytes < 1024 || bytes > 1024L * 1024 * 1024) {
+                        throw std::invalid_argument("Backpressure limit must be between 1 KiB and 1 GiB");
+                    }
+                    max_backpressure = static_cast<unsigned int>(bytes);
+                } else if (arg == "--slow-consumer" && i + 1 < argc) {
+                    std::string policy(argv[++i]);
+                    if (policy != "close" && policy != "drop") {
+                        throw std::invalid_argument("Slow-consumer policy must be close or drop");
+                    }
+                    evict_slow_consumers = policy == "close";
                 } else if (arg == "--help") {
                     std::cout << "Usage: " << argv[0] << " [OPTIONS]\n";
                     std::cout << "Options:\n";
                     std::cout << "  --verbose    Enable verbose logging\n";
+                    std::cout << "  --log-json   Write log lines as JSON objects\n";
                     std::cout << "  --port PORT  Set server port (default: 8080)\n";
+                    std::cout << "  --threads N  Event loop threads sharing the port, 0 = one per core (default: 1)\n";
+                    std::cout << "  --max-backpressure BYTES\n";
+                    std::cout << "               Unsent bytes a client may queue (default: 1048576)\n";
+                    std::cout << "  --slow-consumer close|drop\n";
+                    std::cout << "               Past the limit, close the client or drop its messages (default: close)\n";
                     std::cout << "  --help       Show this help message\n";
+                    std::cout << "Prometheus metrics are served at http://localhost:PORT/metrics\n";
                     return 0;
                 } else {
-                    Logger::warn("Unknown argument: " + arg);
+                    LOG_WARN("Unknown argument: ", arg);
                 }
             } catch (const std::exception& e) {
-                Logger::error("Error parsing argument '" + std::string(argv[i]) + "': " + e.what());
+                LOG_ERROR("Error parsing argument '", argv[i], "': ", e.what());
                 return 1;
             }
         }
 
-        ClientManager clientManager;
+        // Every worker listens on the same port; uSockets sets SO_REUSEPORT, so the
+        // kernel spreads incoming connections across the loops.
+        std::vector<Worker> workers(threads);
+        RoomDirectory rooms(threads);
+        std::atomic<size_t> client_count{0};
+        StartupGate gate(threads);
 
-        auto app = uWS::App().ws<PerSocketData>("/*", {
-            .open = [&clientManager, &verbose](auto* ws) {
-                try {
-                    clientManager.addClient(ws);
-                } catch (const std::exception& e) {
-                    Logger::error("Failed to handle client connection: " + std::string(e.what()));
-                }
-            },
-            .message = [&clientManager, &verbose](auto* ws, std::string_view msg, uWS::OpCode) {
-                try {
-                    if (verbose) {
-                        Logger::info("Received message (" + std::to_string(msg.length()) + " bytes)");
+        auto run_worker = [&](size_t index) {
+            ClientManager clientManager(index, workers, rooms, client_count);
+
+            auto app = uWS::App().get("/metrics", [&workers, &rooms](auto* res, auto* /*req*/) {
+                res->writeHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+                    ->end(renderMetrics(workers, rooms));
+            }).ws<PerSocketData>("/*", {
+                .maxBackpressure = max_backpressure,
+                .closeOnBackpressureLimit = evict_slow_consumers,
+                .open = [&clientManager](auto* ws) {
+                    try {
+                        clientManager.addClient(ws);
+                    } catch (const std::exception& e) {
+                        LOG_ERROR("Failed to handle client connection: ", e.what());
                     }
-                    
-                    if (msg.empty()) {
-                        Logger::warn("Received empty message, ignoring");
-                        return;
+                },
+                .message = [&clientManager](auto* ws, std::string_view msg, uWS::OpCode opCode) {
+                    try {
+                        LOG_DEBUG("Received message (", msg.length(), " bytes)");
+                        
+                        if (msg.empty()) {
+                            bump(clientManager.counters().dropped_empty);
+                            LOG_WARN("Received empty message, ignoring");
+                            return;
+                        }
+                        
+                        if (msg.length() > kMaxMessageLength) {
+                            bump(clientManager.counters().dropped_oversized);
+                            LOG_WARN("Received oversized message (", msg.length(), " bytes), ignoring");
+                            return;
+                        }
+                        
+                        std::string_view room;
+                        if (parseJoinMessage(msg, opCode, room)) {
+                            if (room.size() > kMaxRoomNameLength) {
+                                bump(clientManager.counters().dropped_room_name);
+                                LOG_WARN("Room name too long (", room.size(), " bytes), ignoring join");
+                                return;
+                            }
+                            clientManager.joinRoom(ws, room);
+                            return;
+                        }
+
+                        clientManager.broadcastMessage(ws, msg, opCode);
+                    } catch (const std::exception& e) {
+                        LOG_ERROR("Failed to handle message: ", e.what());
                     }
-                    
-                    if (msg.length() > 65536) {
-                        Logger::warn("Received oversized message (" + std::to_string(msg.length()) + " bytes), ignoring");
-                        return;
+                },
+                .drain = [&clientManager](auto* ws) {
+                    clientManager.clientDrained(ws);
+                },
+                .close = [&clientManager, max_backpressure](auto* ws, int code, std::string_view msg) {
+                    try {
+                        LOG_DEBUG("Client disconnecting with code: ", code);
+                        clientManager.removeClient(ws, max_backpressure);
+                    } catch (const std::exception& e) {
+                        LOG_ERROR("Failed to handle client disconnection: ", e.what());
                     }
-                    
-                    clientManager.broadcastMessage(ws, msg, verbose);
-                } catch (const std::exception& e) {
-                    Logger::error("Failed to handle message: " + std::string(e.what()));
                 }
-            },
-            .close = [&clientManager, &verbose](auto* ws, int code, std::string_view msg) {
-                try {
-                    if (verbose) {
-                        Logger::info("Client disconnecting with code: " + std::to_string(code));
-                    }
-                    clientManager.removeClient(ws);
-                } catch (const std::exception& e) {
-                    Logger::error("Failed to handle client disconnection: " + std::string(e.what()));
+            });
+            // Published before any worker accepts a connection; see StartupGate
+            workers[index].loop = uWS::Loop::get();
+            workers[index].app = &app;
+
+            us_listen_socket_t* listen_socket = nullptr;
+            app.listen(port, [&listen_socket, index, port](auto* token) {
+                listen_socket = token;
+                if (!token) {
+                    LOG_ERROR("Failed to start server on port ", port, " (thread ", index, ")");
                 }
+            });
+
+            if (!gate.arrive(listen_socket != nullptr)) {
+                if (listen_socket) us_listen_socket_close(0, listen_socket);
+                return;
             }
-        });
-
-        bool serverStarted = false;
-        app.listen(port, [&serverStarted, port](auto* token) {
-            if (token) {
-                Logger::info("Signaling server listening on ws://localhost:" + std::to_string(port));
-                serverStarted = true;
-            } else {
-                Logger::error("Failed to start server on port " + std::to_string(port));
+            if (index == 0) {
+                LOG_INFO("Signaling server listening on ws://localhost:", port, " with ", workers.size(), " thread(s)");
+                LOG_INFO("Metrics at http://localhost:", port, "/metrics");
+                LOG_INFO("Server started successfully. Press Ctrl+C to stop.");
             }
-        });
+            // Loop lag for /metrics. A fallthrough timer does not keep the loop alive.
+            us_timer_t* lag_timer = us_create_timer(reinterpret_cast<us_loop_t*>(uWS::Loop::get()), 1, sizeof(Worker*));
+            *static_cast<Worker**>(us_timer_ext(lag_timer)) = &workers[index];
+            us_timer_set(lag_timer, [](us_timer_t* timer) {
+                (*static_cast<Worker**>(us_timer_ext(timer)))->sampleLoopLag();
+            }, kLoopLagIntervalMs, kLoopLagIntervalMs);
+            app.run();
+            us_timer_close(lag_timer);
+        };
+
+        std::vector<std::thread> loop_threads;
+        for (size_t i = 1; i < threads; ++i) loop_threads.emplace_back(run_worker, i);
+        run_worker(0);
+        for (auto& t : loop_threads) t.join();
 
-        if (!serverStarted) {
-            Logger::error("Server failed to start, check if port " + std::to_string(port) + " is available");
+        if (gate.failed()) {
+            LOG_ERROR("Server failed to start, check if port ", port, " is available");
             return 1;
         }
 
-        Logger::info("Server started successfully. Press Ctrl+C to stop.");
-        app.run();
-
     } catch (const std::exception& e) {
-        Logger::error("Fatal error: " + std::string(e.what()));
+        LOG_ERROR("Fatal error: ", e.what());
         return 1;
     } catch (...) {
-        Logger::error("Unknown fatal error occurred");
+        LOG_ERROR("Unknown fatal error occurred");
         return 1;
     }
 
-    Logger::info("Server shutting down gracefully");
+    LOG_INFO("Server shutting down gracefully");
     return 0;
 }
@@ -0,0 +1,301 @@
+//! The frame path vtk-cube uses: webrtc_session_send_frame, VP9 encode,
+//! write_sample, RTP packetization and SRTP, over a loopback connection to a
+//! viewer in the same process. Criterion reports frames/sec per resolution;
+//! a pass after each also prints encode ms/frame, allocations/frame and
+//! packets/sec. The viewer runs on its own runtime, whose allocations are
+//! not counted.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::ffi::{CStr, CString};
+use std::os::raw::{c_char, c_void};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{mpsc, Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use tokio::runtime::Runtime;
+use webrtc::api::media_engine::MediaEngine;
+use webrtc::api::APIBuilder;
+use webrtc::ice_transport::ice_candidate::RTCIceCandidateInit;
+use webrtc::peer_connection::configuration::RTCConfiguration;
+use webrtc::peer_connection::sdp::session_description::RTCSessionDescription;
+use webrtc::peer_connection::RTCPeerConnection;
+use webrtc::rtp_transceiver::rtp_codec::RTPCodecType;
+use webrtc::rtp_transceiver::rtp_transceiver_direction::RTCRtpTransceiverDirection;
+use webrtc::rtp_transceiver::RTCRtpTransceiverInit;
+use webrtc::{
+    webrtc_session_create, webrtc_session_destroy, webrtc_session_get_stats,
+    webrtc_session_send_frame_with_timestamp, webrtc_session_set_remote_description,
+    webrtc_session_set_signal_callback, webrtc_session_stats_t, webrtc_session_t,
+};
+
+const RESOLUTIONS: &[(i32, i32)] = &[(640, 480), (1280, 720), (1920, 1080)];
+const SESSION_CONFIG: &str = r#"{"encoder": {"codec": "vp9", "bitrate_kbps": 2500}}"#;
+/// Distinct frames cycled through, so the encoder always sees motion.
+const TEST_FRAMES: usize = 16;
+const REPORT_FRAMES: u64 = 120;
+/// Capture timestamps advance at 30 fps whatever the send rate, as they
+/// would for vtk-cube, so rate control behaves the same.
+const FRAME_INTERVAL_US: i64 = 33_333;
+
+static ALLOCATIONS: AtomicU64 = AtomicU64::new(0);
+
+thread_local! {
+    static UNCOUNTED: Cell<bool> = const { Cell::new(false) };
+}
+
+/// Counts allocations on every thread but the viewer's.
+struct CountingAllocator;
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count();
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        count();
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+fn count() {
+    // try_with: thread-locals are gone while a thread exits
+    if !UNCOUNTED.try_with(Cell::get).unwrap_or(true) {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAllocator = CountingAllocator;
+
+/// Packed I420 frames of a gradient with a square moving across it.
+fn test_frames(width: i32, height: i32) -> Vec<Vec<u8>> {
+    let (w, h) = (width as usize, height as usize);
+    let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+    let side = h / 4;
+    (0..TEST_FRAMES)
+        .map(|n| {
+            let mut frame = vec![128u8; w * h + 2 * cw * ch];
+            for y in 0..h {
+                for x in 0..w {
+                    frame[y * w + x] = ((x + y) * 255 / (w + h)) as u8;
+                }
+            }
+            let left = n * (w - side) / TEST_FRAMES;
+            for y in h / 2 - side / 2..h / 2 + side / 2 {
+                frame[y * w + left..y * w + left + side].fill(235);
+            }
+            frame
+        })
+        .collect()
+}
+
+extern "C" fn on_signal(msg: *const c_char, user_data: *mut c_void) {
+    let signals = unsafe { &*(user_data as *const Mutex<mpsc::Sender<String>>) };
+    let msg = unsafe { CStr::from_ptr(msg) }
+        .to_string_lossy()
+        .into_owned();
+    if let Ok(signals) = signals.lock() {
+        let _ = signals.send(msg);
+    }
+}
+
+/// A receive-only viewer that counts the RTP packets it gets. Its offer
+/// carries all its candidates.
+async fn viewer(packets: Arc<AtomicU64>) -> (Arc<RTCPeerConnection>, RTCSessionDescription) {
+    let mut m = MediaEngine::default();
+    m.register_default_codecs().unwrap();
+    let api = APIBuilder::new().with_media_engine(m).build();
+    let pc = Arc::new(
+        api.new_peer_connection(RTCConfiguration::default())
+            .await
+            .unwrap(),
+    );
+    pc.add_transceiver_from_kind(
+        RTPCodecType::Video,
+        Some(RTCRtpTransceiverInit {
+            direction: RTCRtpTransceiverDirection::Recvonly,
+            send_encodings: Vec::new(),
+        }),
+    )
+    .await
+    .unwrap();
+    // Negotiates SCTP for the session's input channel
+    pc.create_data_channel("viewer", None).await.unwrap();
+    pc.on_track(Box::new(move |track, _, _| {
+        let packets = Arc::clone(&packets);
+        Box::pin(async move {
+            while track.read_rtp().await.is_ok() {
+                packets.fetch_add(1, Ordering::Relaxed);
+            }
+        })
+    }));
+
+    let offer = pc.create_offer(None).await.unwrap();
+    let mut gathered = pc.gathering_complete_promise().await;
+    pc.set_local_description(offer).await.unwrap();
+    let _ = gathered.recv().await;
+    let offer = pc.local_description().await.unwrap();
+    (pc, offer)
+}
+
+/// A C API session streaming to an in-process viewer.
+struct Loopback {
+    session: *mut webrtc_session_t,
+    width: i32,
+    height: i32,
+    frames: Vec<Vec<u8>>,
+    sent: u64,
+    packets: Arc<AtomicU64>,
+    viewer: Arc<RTCPeerConnection>,
+    /// Read by on_signal until the session is destroyed.
+    _signals: Box<Mutex<mpsc::Sender<String>>>,
+    rt: Runtime,
+}
+
+impl Loopback {
+    /// Negotiates, then sends frames until the viewer receives one.
+    fn connect(width: i32, height: i32) -> Self {
+        let rt = tokio::runtime::Builder::new_multi_thread()
+            .enable_all()
+            .on_thread_start(|| UNCOUNTED.with(|uncounted| uncounted.set(true)))
+            .build()
+            .unwrap();
+        let packets = Arc::new(AtomicU64::new(0));
+        let (viewer, offer) = rt.block_on(viewer(Arc::clone(&packets)));
+
+        let config = CString::new(SESSION_CONFIG).unwrap();
+        let session = webrtc_session_create(config.as_ptr(), None, std::ptr::null_mut());
+        assert!(!session.is_null(), "session creation failed");
+        let (signal_tx, signal_rx) = mpsc::channel();
+        let signals = Box::new(Mutex::new(signal_tx));
+        webrtc_session_set_signal_callback(
+            session,
+            Some(on_signal),
+            &*signals as *const Mutex<mpsc::Sender<String>> as *mut c_void,
+        );
+        let offer = CString::new(serde_json::to_string(&offer).unwrap()).unwrap();
+        webrtc_session_set_remote_description(session, offer.as_ptr());
+
+        let mut loopback = Loopback {
+            session,
+            width,
+            height,
+            frames: test_frames(width, height),
+            sent: 0,
+            packets,
+            viewer,
+            _signals: signals,
+            rt,
+        };
+        let deadline = Instant::now() + Duration::from_secs(10);
+        while loopback.packets.load(Ordering::Relaxed) == 0 {
+            assert!(
+                Instant::now() < deadline,
+                "viewer received nothing within 10 s"
+            );
+            while let Ok(msg) = signal_rx.recv_timeout(Duration::from_millis(30)) {
+                loopback.apply_signal(&msg);
+            }
+            loopback.send();
+        }
+        loopback
+    }
+
+    fn apply_signal(&self, msg: &str) {
+        let value: serde_json::Value = serde_json::from_str(msg).unwrap();
+        if value.get("sdp").is_some() {
+            let answer: RTCSessionDescription = serde_json::from_value(value).unwrap();
+            self.rt
+                .block_on(self.viewer.set_remote_description(answer))
+                .unwrap();
+        } else {
+            let candidate: RTCIceCandidateInit = serde_json::from_value(value).unwrap();
+            self.rt
+                .block_on(self.viewer.add_ice_candidate(candidate))
+                .unwrap();
+        }
+    }
+
+    fn send(&mut self) {
+        let frame = &self.frames[self.sent as usize % self.frames.len()];
+        let timestamp_us = self.sent as i64 * FRAME_INTERVAL_US;
+        webrtc_session_send_frame_with_timestamp(
+            self.session,
+            self.width,
+            self.height,
+            frame.as_ptr(),
+            timestamp_us,
+        );
+        self.sent += 1;
+    }
+
+    fn stats(&self) -> webrtc_session_stats_t {
+        // A plain C struct, all of whose fields are overwritten
+        let mut stats: webrtc_session_stats_t = unsafe { std::mem::zeroed() };
+        assert_eq!(webrtc_session_get_stats(self.session, &mut stats), 0);
+        stats
+    }
+
+    /// What criterion does not measure, over REPORT_FRAMES frames sent back
+    /// to back.
+    fn report(&mut self) {
+        // Starts a new encode time window
+        self.stats();
+        let packets = self.packets.load(Ordering::Relaxed);
+        let allocations = ALLOCATIONS.load(Ordering::Relaxed);
+        let started = Instant::now();
+        for _ in 0..REPORT_FRAMES {
+            self.send();
+        }
+        let elapsed = started.elapsed().as_secs_f64();
+        // Packets are written from the session's runtime after send returns
+        std::thread::sleep(Duration::from_millis(100));
+        let allocations = ALLOCATIONS.load(Ordering::Relaxed) - allocations;
+        let packets = self.packets.load(Ordering::Relaxed) - packets;
+        let stats = self.stats();
+        println!(
+            "{}x{}: {:.1} frames/s, encode p50 {:.2} ms p99 {:.2} ms, {:.0} allocations/frame, {:.0} packets/s ({:.1}/frame)",
+            self.width,
+            self.height,
+            REPORT_FRAMES as f64 / elapsed,
+            stats.encode_time_p50_us as f64 / 1e3,
+            stats.encode_time_p99_us as f64 / 1e3,
+            allocations as f64 / REPORT_FRAMES as f64,
+            packets as f64 / elapsed,
+            packets as f64 / REPORT_FRAMES as f64,
+        );
+    }
+}
+
+impl Drop for Loopback {
+    fn drop(&mut self) {
+        webrtc_session_destroy(self.session);
+        let _ = self.rt.block_on(self.viewer.close());
+    }
+}
+
+fn benchmark_send_frame(c: &mut Criterion) {
+    let mut g = c.benchmark_group("c_api_send_frame");
+    g.sample_size(10)
+        .measurement_time(Duration::from_secs(10))
+        .throughput(Throughput::Elements(1));
+    for &(width, height) in RESOLUTIONS {
+        let mut loopback = Loopback::connect(width, height);
+        g.bench_function(
+            BenchmarkId::from_parameter(format!("{}x{}", width, height)),
+            |b| b.iter(|| loopback.send()),
+        );
+        loopback.report();
+    }
+    g.finish();
+}
+
+criterion_group!(benches, benchmark_send_frame);
+criterion_main!(benches);
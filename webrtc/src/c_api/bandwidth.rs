@@ -0,0 +1,236 @@
+//! Adaptive bitrate: turns the receiver's RTCP feedback into an encoder target
+//! bitrate and a resolution budget.
+//!
+//! The controller follows the loss-based half of Google Congestion Control:
+//! above 10% loss the target drops in proportion to the loss, below 2% it grows
+//! by 8% per report, and in between it holds. REMB, when the receiver sends it,
+//! caps the target.
+
+use std::os::raw::c_void;
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+
+use log::{debug, info};
+use rtcp::payload_feedbacks::full_intra_request::FullIntraRequest;
+use rtcp::payload_feedbacks::picture_loss_indication::PictureLossIndication;
+use rtcp::payload_feedbacks::receiver_estimated_maximum_bitrate::ReceiverEstimatedMaximumBitrate;
+use rtcp::receiver_report::ReceiverReport;
+
+use super::config::AdaptiveBitrateConfig;
+use super::fanout::KeyframeRequests;
+use crate::rtp_transceiver::rtp_sender::RTCRtpSender;
+
+/// Mirrors `webrtc_bitrate_target_t` in webrtc_c_api.h.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct webrtc_bitrate_target_t {
+    pub bitrate_kbps: u32,
+    pub max_pixels: u32,
+}
+
+pub type WebrtcBitrateCallbackT = extern "C" fn(target: *const webrtc_bitrate_target_t, user_data: *mut c_void);
+
+const HIGH_LOSS: f64 = 0.10;
+const LOW_LOSS: f64 = 0.02;
+const INCREASE_FACTOR: f64 = 1.08;
+/// Smaller changes are applied to the encoder but not reported through the callback.
+const REPORT_THRESHOLD: f64 = 0.05;
+
+pub(crate) struct BitrateController {
+    min_kbps: u32,
+    max_kbps: u32,
+    kbps_per_megapixel: u32,
+    target_kbps: u32,
+    remb_kbps: Option<u32>,
+}
+
+impl BitrateController {
+    /// Starts at `start_kbps`, the encoder's configured bitrate.
+    pub(crate) fn new(config: &AdaptiveBitrateConfig, start_kbps: u32) -> Self {
+        let max_kbps = config.max_bitrate_kbps.unwrap_or(start_kbps).max(start_kbps);
+        let min_kbps = config.min_bitrate_kbps.min(start_kbps);
+        BitrateController {
+            min_kbps,
+            max_kbps,
+            kbps_per_megapixel: config.kbps_per_megapixel.max(1),
+            target_kbps: start_kbps.clamp(min_kbps, max_kbps),
+            remb_kbps: None,
+        }
+    }
+
+    pub(crate) fn target_kbps(&self) -> u32 {
+        self.target_kbps
+    }
+
+    /// Largest frame, in pixels, that the current target can encode well.
+    pub(crate) fn max_pixels(&self) -> u32 {
+        (self.target_kbps as u64 * 1_000_000 / self.kbps_per_megapixel as u64).min(u32::MAX as u64) as u32
+    }
+
+    /// Applies a receiver report's loss fraction (0..1).
+    pub(crate) fn on_loss(&mut self, fraction_lost: f64) -> u32 {
+        let target = self.target_kbps as f64;
+        let target = if fraction_lost > HIGH_LOSS {
+            target * (1.0 - 0.5 * fraction_lost)
+        } else if fraction_lost < LOW_LOSS {
+            target * INCREASE_FACTOR
+        } else {
+            target
+        };
+        self.set_target(target)
+    }
+
+    /// Applies a REMB estimate in bits/s.
+    pub(crate) fn on_remb(&mut self, bitrate_bps: f32) -> u32 {
+        self.remb_kbps = Some((bitrate_bps / 1000.0) as u32);
+        self.set_target(self.target_kbps as f64)
+    }
+
+    fn set_target(&mut self, target: f64) -> u32 {
+        let ceiling = self.remb_kbps.map_or(self.max_kbps, |remb| remb.min(self.max_kbps));
+        self.target_kbps = (target as u32).min(ceiling).max(self.min_kbps);
+        self.target_kbps
+    }
+}
+
+/// The controller's output, shared between the RTCP reader task (writer), the
+/// encoder (reader, once per frame) and the application callback.
+pub(crate) struct BandwidthEstimate {
+    controller: Mutex<BitrateController>,
+    target_kbps: AtomicU32,
+    max_pixels: AtomicU64,
+    callback: Mutex<Option<(WebrtcBitrateCallbackT, usize)>>,
+    reported: Mutex<Option<webrtc_bitrate_target_t>>,
+}
+
+impl BandwidthEstimate {
+    pub(crate) fn new(controller: BitrateController) -> Self {
+        BandwidthEstimate {
+            target_kbps: AtomicU32::new(controller.target_kbps()),
+            max_pixels: AtomicU64::new(controller.max_pixels() as u64),
+            controller: Mutex::new(controller),
+            callback: Mutex::new(None),
+            reported: Mutex::new(None),
+        }
+    }
+
+    pub(crate) fn target(&self) -> webrtc_bitrate_target_t {
+        webrtc_bitrate_target_t {
+            bitrate_kbps: self.target_kbps.load(Ordering::Relaxed),
+            max_pixels: self.max_pixels.load(Ordering::Relaxed) as u32,
+        }
+    }
+
+    /// Sets the callback and reports the current target to it right away.
+    pub(crate) fn set_callback(&self, callback: Option<WebrtcBitrateCallbackT>, user_data: *mut c_void) {
+        *self.callback.lock().unwrap() = callback.map(|cb| (cb, user_data as usize));
+        *self.reported.lock().unwrap() = None;
+        self.report();
+    }
+
+    fn update(&self, f: impl FnOnce(&mut BitrateController)) {
+        {
+            let mut controller = self.controller.lock().unwrap();
+            f(&mut controller);
+            self.target_kbps.store(controller.target_kbps(), Ordering::Relaxed);
+            self.max_pixels.store(controller.max_pixels() as u64, Ordering::Relaxed);
+        }
+        self.report();
+    }
+
+    fn report(&self) {
+        let target = self.target();
+        {
+            let mut reported = self.reported.lock().unwrap();
+            if let Some(last) = *reported {
+                let change = (target.bitrate_kbps as f64 - last.bitrate_kbps as f64).abs() / last.bitrate_kbps.max(1) as f64;
+                if change < REPORT_THRESHOLD {
+                    return;
+                }
+            }
+            *reported = Some(target);
+        }
+        info!("Target bitrate {} kbps, max {} pixels", target.bitrate_kbps, target.max_pixels);
+        // Called without the lock, so the callback may replace itself
+        let callback = *self.callback.lock().unwrap();
+        if let Some((callback, user_data)) = callback {
+            callback(&target, user_data as *mut c_void);
+        }
+    }
+}
+
+/// Reads the sender's RTCP until the connection closes. One runs for every
+/// sender: the stats interceptor only sees the packets this pulls through it,
+/// so without it `webrtc_session_get_stats` would miss NACK, PLI, FIR and the
+/// remote RTT. Loss and REMB feed `estimate` when adaptive bitrate is on;
+/// PLI and FIR are passed on to `keyframes`.
+pub(crate) async fn run_rtcp_reader(
+    sender: Arc<RTCRtpSender>,
+    estimate: Option<Arc<BandwidthEstimate>>,
+    keyframes: Arc<KeyframeRequests>,
+) {
+    while let Ok((packets, _)) = sender.read_rtcp().await {
+        for packet in packets {
+            let any = packet.as_any();
+            if any.is::<PictureLossIndication>() || any.is::<FullIntraRequest>() {
+                debug!("Receiver requested a keyframe");
+                keyframes.request();
+                continue;
+            }
+            let Some(ref estimate) = estimate else { continue };
+            if let Some(rr) = any.downcast_ref::<ReceiverReport>() {
+                if let Some(lost) = rr.reports.iter().map(|r| r.fraction_lost).max() {
+                    let fraction = lost as f64 / 256.0;
+                    estimate.update(|c| {
+                        let kbps = c.on_loss(fraction);
+                        debug!("RTCP loss {:.1}% -> {} kbps", fraction * 100.0, kbps);
+                    });
+                }
+            } else if let Some(remb) = any.downcast_ref::<ReceiverEstimatedMaximumBitrate>() {
+                estimate.update(|c| {
+                    let kbps = c.on_remb(remb.bitrate);
+                    debug!("REMB {} bps -> {} kbps", remb.bitrate, kbps);
+                });
+            }
+        }
+    }
+}
+
+/// Most halvings the encoder applies on its own when the caller keeps sending
+/// frames larger than the budget.
+pub(crate) const MAX_SCALE_STEPS: u32 = 3;
+/// Scaling back up waits until the larger size fits the budget with this much room.
+const UPSCALE_HEADROOM: f64 = 1.3;
+
+/// Number of 2x downscales to apply to a `width` x `height` frame so it fits in
+/// `max_pixels`, given the `current` number. Steps down at once, steps back up
+/// one level at a time and only with headroom, so the size does not flap.
+pub(crate) fn scale_steps(width: u32, height: u32, max_pixels: u32, current: u32) -> u32 {
+    let pixels = |steps: u32| (width >> steps) as u64 * (height >> steps) as u64;
+    let mut steps = 0;
+    while steps < MAX_SCALE_STEPS && pixels(steps) > max_pixels as u64 {
+        steps += 1;
+    }
+    if steps < current {
+        let up = current - 1;
+        if pixels(up) as f64 * UPSCALE_HEADROOM <= max_pixels as f64 {
+            return up;
+        }
+        return current;
+    }
+    steps
+}
+
+/// Simulcast layer to forward to a receiver whose target is `target_kbps`,
+/// given each layer's bitrate (largest first) and the layer it gets now.
+/// The largest layer that fits is chosen; like `scale_steps`, moving to a
+/// larger layer than `current` needs headroom.
+pub(crate) fn choose_layer(bitrates_kbps: &[u32], target_kbps: u32, current: Option<usize>) -> usize {
+    let fits = |layer: usize, headroom: f64| bitrates_kbps[layer] as f64 * headroom <= target_kbps as f64;
+    let smallest = bitrates_kbps.len() - 1;
+    let layer = (0..smallest).find(|&l| fits(l, 1.0)).unwrap_or(smallest);
+    match current {
+        Some(current) if layer < current => (layer..current).find(|&l| fits(l, UPSCALE_HEADROOM)).unwrap_or(current),
+        _ => layer,
+    }
+}
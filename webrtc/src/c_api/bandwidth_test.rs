@@ -0,0 +1,77 @@
+use super::bandwidth::*;
+use super::config::AdaptiveBitrateConfig;
+
+fn controller(start_kbps: u32, max_kbps: Option<u32>) -> BitrateController {
+    let config = AdaptiveBitrateConfig {
+        min_bitrate_kbps: 150,
+        max_bitrate_kbps: max_kbps,
+        kbps_per_megapixel: 400,
+    };
+    BitrateController::new(&config, start_kbps)
+}
+
+#[test]
+fn test_high_loss_decreases_to_floor() {
+    let mut c = controller(1000, None);
+    assert_eq!(c.on_loss(0.2), 900);
+    for _ in 0..50 {
+        c.on_loss(0.5);
+    }
+    assert_eq!(c.target_kbps(), 150);
+}
+
+#[test]
+fn test_low_loss_increases_to_ceiling() {
+    let mut c = controller(1000, Some(2000));
+    assert_eq!(c.on_loss(0.0), 1080);
+    // Moderate loss holds the target.
+    assert_eq!(c.on_loss(0.05), 1080);
+    for _ in 0..50 {
+        c.on_loss(0.0);
+    }
+    assert_eq!(c.target_kbps(), 2000);
+}
+
+#[test]
+fn test_remb_caps_target() {
+    let mut c = controller(1000, Some(3000));
+    assert_eq!(c.on_remb(600_000.0), 600);
+    assert_eq!(c.on_loss(0.0), 600);
+    assert_eq!(c.on_remb(5_000_000.0), 600);
+    assert_eq!(c.on_loss(0.0), 648);
+}
+
+#[test]
+fn test_max_pixels_follows_target() {
+    let c = controller(400, None);
+    assert_eq!(c.max_pixels(), 1_000_000);
+}
+
+#[test]
+fn test_scale_steps_hysteresis() {
+    // 1920x1080 is 2073600 pixels; each step quarters it.
+    assert_eq!(scale_steps(1920, 1080, 3_000_000, 0), 0);
+    assert_eq!(scale_steps(1920, 1080, 600_000, 0), 1);
+    assert_eq!(scale_steps(1920, 1080, 100_000, 0), 3);
+    assert_eq!(scale_steps(1920, 1080, 1, 0), MAX_SCALE_STEPS);
+    // Fits at step 0 but without headroom: stays at 1.
+    assert_eq!(scale_steps(1920, 1080, 2_100_000, 1), 1);
+    assert_eq!(scale_steps(1920, 1080, 2_800_000, 1), 0);
+    // Scales up one step at a time.
+    assert_eq!(scale_steps(1920, 1080, 3_000_000, 3), 2);
+}
+
+#[test]
+fn test_choose_layer_steps_down_at_once_and_up_with_headroom() {
+    let layers = [2500, 600, 150];
+    assert_eq!(choose_layer(&layers, 3000, None), 0);
+    assert_eq!(choose_layer(&layers, 1000, None), 1);
+    // Below every layer: the smallest is still sent.
+    assert_eq!(choose_layer(&layers, 100, None), 2);
+    assert_eq!(choose_layer(&layers, 700, Some(0)), 1);
+    // 2600 fits the full layer but without 30% headroom.
+    assert_eq!(choose_layer(&layers, 2600, Some(1)), 1);
+    assert_eq!(choose_layer(&layers, 3300, Some(1)), 0);
+    // From the smallest layer, a jump skips straight to the largest that fits with headroom.
+    assert_eq!(choose_layer(&layers, 2600, Some(2)), 1);
+}
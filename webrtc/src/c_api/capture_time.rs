@@ -0,0 +1,89 @@
+//! The library's monotonic clock and the abs-capture-time RTP header extension
+//! (http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time), which
+//! carries each frame's capture time to the receiver as an NTP timestamp.
+
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+use bytes::BufMut;
+use rtp::extension::abs_send_time_extension::unix2ntp;
+use rtp::extension::HeaderExtension;
+use util::marshal::{Marshal, MarshalSize};
+
+use crate::api::media_engine::MediaEngine;
+use crate::rtp_transceiver::rtp_codec::{RTCRtpHeaderExtensionCapability, RTPCodecType};
+
+pub(crate) const ABS_CAPTURE_TIME_URI: &str = "http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time";
+
+/// The short form: the capture timestamp without a clock offset estimate.
+const ABS_CAPTURE_TIME_SIZE: usize = 8;
+
+lazy_static! {
+    /// Read together once, so monotonic times map to wall time at a fixed
+    /// offset. Later steps of the system clock are not followed.
+    static ref CLOCK_ORIGIN: (Instant, SystemTime) = (Instant::now(), SystemTime::now());
+}
+
+/// Microseconds on the library's monotonic clock (`webrtc_monotonic_time_us`).
+pub(crate) fn monotonic_us() -> i64 {
+    CLOCK_ORIGIN.0.elapsed().as_micros() as i64
+}
+
+/// Unix time in microseconds of a time on the library's monotonic clock.
+pub(crate) fn unix_us(monotonic_us: i64) -> i64 {
+    let origin_unix_us = CLOCK_ORIGIN.1.duration_since(UNIX_EPOCH).unwrap_or_default().as_micros() as i64;
+    origin_unix_us + monotonic_us
+}
+
+/// 64-bit NTP timestamp (UQ32.32 seconds since 1900) of a Unix time.
+pub(crate) fn ntp_timestamp(unix_us: i64) -> u64 {
+    unix2ntp(UNIX_EPOCH + Duration::from_micros(unix_us.max(0) as u64))
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct AbsCaptureTime {
+    pub ntp_timestamp: u64,
+}
+
+impl AbsCaptureTime {
+    /// For a frame captured at `monotonic_us` on the library's clock.
+    pub(crate) fn at(monotonic_us: i64) -> Self {
+        AbsCaptureTime {
+            ntp_timestamp: ntp_timestamp(unix_us(monotonic_us)),
+        }
+    }
+
+    pub(crate) fn header_extension(self) -> HeaderExtension {
+        HeaderExtension::Custom {
+            uri: ABS_CAPTURE_TIME_URI.into(),
+            extension: Box::new(self),
+        }
+    }
+}
+
+impl MarshalSize for AbsCaptureTime {
+    fn marshal_size(&self) -> usize {
+        ABS_CAPTURE_TIME_SIZE
+    }
+}
+
+impl Marshal for AbsCaptureTime {
+    fn marshal_to(&self, mut buf: &mut [u8]) -> Result<usize, util::Error> {
+        if buf.remaining_mut() < ABS_CAPTURE_TIME_SIZE {
+            return Err(rtp::Error::ErrBufferTooSmall.into());
+        }
+        buf.put_u64(self.ntp_timestamp);
+        Ok(ABS_CAPTURE_TIME_SIZE)
+    }
+}
+
+/// Offers abs-capture-time for video. Packets only carry it on connections
+/// where the remote side negotiated it too.
+pub(crate) fn register(media_engine: &mut MediaEngine) -> crate::error::Result<()> {
+    media_engine.register_header_extension(
+        RTCRtpHeaderExtensionCapability {
+            uri: ABS_CAPTURE_TIME_URI.to_owned(),
+        },
+        RTPCodecType::Video,
+        None,
+    )
+}
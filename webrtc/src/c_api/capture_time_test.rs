@@ -0,0 +1,33 @@
+use util::marshal::Marshal;
+
+use super::capture_time::*;
+
+#[test]
+fn ntp_timestamp_of_unix_time() {
+    // 2^32 fractions per second, counted from 1900
+    assert_eq!(ntp_timestamp(0), 0x83AA7E80 << 32);
+    assert_eq!(ntp_timestamp(1_500_000), (0x83AA7E81 << 32) | 0x8000_0000);
+}
+
+#[test]
+fn monotonic_times_map_to_unix_at_a_fixed_offset() {
+    let now = monotonic_us();
+    assert_eq!(unix_us(now + 1_000) - unix_us(now), 1_000);
+    let wall_us = std::time::SystemTime::now()
+        .duration_since(std::time::UNIX_EPOCH)
+        .unwrap()
+        .as_micros() as i64;
+    assert!((unix_us(monotonic_us()) - wall_us).abs() < 1_000_000);
+}
+
+#[test]
+fn abs_capture_time_marshals_short_form() {
+    let ext = AbsCaptureTime {
+        ntp_timestamp: 0x0102_0304_0506_0708,
+    };
+    let mut buf = [0u8; 8];
+    assert_eq!(ext.marshal_to(&mut buf).unwrap(), 8);
+    assert_eq!(buf, [1, 2, 3, 4, 5, 6, 7, 8]);
+    assert!(ext.marshal_to(&mut [0u8; 7]).is_err());
+    assert_eq!(ext.header_extension().uri(), ABS_CAPTURE_TIME_URI);
+}
@@ -0,0 +1,60 @@
+//! Completion callbacks for the `_async` C API calls. They return once the
+//! work is queued on the session's runtime, and report its outcome later
+//! from a runtime thread instead of the caller blocking on it.
+
+use std::ffi::CString;
+use std::os::raw::{c_char, c_int, c_void};
+
+use log::{debug, error};
+
+/// `status` is 0 on success, with `result` the call's JSON output or null,
+/// and -1 on failure, with `result` the error message. `result` is only
+/// valid during the callback.
+pub type WebrtcCompletionCallbackT = extern "C" fn(status: c_int, result: *const c_char, user_data: *mut c_void);
+
+/// Called exactly once, by `complete`. Without a callback, failures are
+/// logged and nothing else reports them.
+#[derive(Clone, Copy)]
+pub(crate) struct Completion {
+    cb: Option<WebrtcCompletionCallbackT>,
+    user_data: usize,
+    what: &'static str,
+}
+
+impl Completion {
+    pub(crate) fn new(what: &'static str, cb: Option<WebrtcCompletionCallbackT>, user_data: *mut c_void) -> Self {
+        Completion {
+            cb,
+            user_data: user_data as usize,
+            what,
+        }
+    }
+
+    /// For the calls without a callback, whose failures are only logged.
+    pub(crate) fn none(what: &'static str) -> Self {
+        Self::new(what, None, std::ptr::null_mut())
+    }
+
+    /// The C API call this completes, for its log messages.
+    pub(crate) fn what(&self) -> &'static str {
+        self.what
+    }
+
+    pub(crate) fn complete(self, result: Result<Option<String>, String>) {
+        let (status, text) = match result {
+            Ok(value) => (0, value),
+            Err(e) => {
+                if self.cb.is_some() {
+                    debug!("{}: {}", self.what, e);
+                } else {
+                    error!("{}: {}", self.what, e);
+                }
+                (-1, Some(e))
+            }
+        };
+        let Some(cb) = self.cb else { return };
+        // An interior NUL would only come from a peer's SDP echoed in an error
+        let text = text.map(|text| CString::new(text.replace('\0', " ")).unwrap_or_default());
+        cb(status, text.as_ref().map_or(std::ptr::null(), |text| text.as_ptr()), self.user_data as *mut c_void);
+    }
+}
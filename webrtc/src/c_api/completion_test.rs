@@ -0,0 +1,38 @@
+use std::ffi::CStr;
+use std::os::raw::{c_char, c_int, c_void};
+use std::sync::Mutex;
+
+use super::completion::*;
+
+extern "C" fn on_complete(status: c_int, result: *const c_char, user_data: *mut c_void) {
+    let calls = unsafe { &*(user_data as *const Mutex<Vec<(c_int, Option<String>)>>) };
+    let result = (!result.is_null()).then(|| unsafe { CStr::from_ptr(result) }.to_str().unwrap().to_owned());
+    calls.lock().unwrap().push((status, result));
+}
+
+fn completion(calls: &Mutex<Vec<(c_int, Option<String>)>>) -> Completion {
+    Completion::new("test", Some(on_complete), calls as *const _ as *mut c_void)
+}
+
+#[test]
+fn completion_reports_success_and_value() {
+    let calls = Mutex::new(Vec::new());
+    completion(&calls).complete(Ok(None));
+    completion(&calls).complete(Ok(Some(r#"{"a":1}"#.to_owned())));
+    assert_eq!(
+        *calls.lock().unwrap(),
+        vec![(0, None), (0, Some(r#"{"a":1}"#.to_owned()))]
+    );
+}
+
+#[test]
+fn completion_reports_errors() {
+    let calls = Mutex::new(Vec::new());
+    completion(&calls).complete(Err("bad\0sdp".to_owned()));
+    assert_eq!(*calls.lock().unwrap(), vec![(-1, Some("bad sdp".to_owned()))]);
+}
+
+#[test]
+fn completion_without_callback_only_logs() {
+    Completion::none("test").complete(Err("ignored".to_owned()));
+}
@@ -0,0 +1,418 @@
+//! The `config_json` arguments of `webrtc_session_create`, `webrtc_context_create`,
+//! `webrtc_simulcast_create` and `webrtc_context_create_fanout`.
+
+use std::ffi::CStr;
+use std::os::raw::c_char;
+
+use serde::Deserialize;
+
+use super::bandwidth::MAX_SCALE_STEPS;
+use super::encoder_backend::{self, LIBVPX};
+
+/// Session settings. Every field is optional; a null or empty string gives the defaults.
+#[derive(Debug, Default, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct SessionConfig {
+    pub encoder: EncoderConfig,
+    /// Encode on a dedicated thread instead of the caller's.
+    pub async_encode: Option<AsyncEncodeConfig>,
+    /// Adapt the encoder bitrate and frame size to the receiver's RTCP feedback.
+    pub adaptive_bitrate: Option<AdaptiveBitrateConfig>,
+    /// Keep the encoder's last input so `webrtc_session_repeat_frame` can encode it again.
+    pub repeat_frames: bool,
+    /// Stamp video packets with each frame's capture time (abs-capture-time).
+    /// Frame timestamps must then be on the `webrtc_monotonic_time_us` clock.
+    pub abs_capture_time: bool,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub(crate) enum Codec {
+    Vp8,
+    Vp9,
+    H264,
+    H265,
+}
+
+impl Codec {
+    pub(crate) fn mime_type(self) -> &'static str {
+        match self {
+            Codec::Vp8 => "video/VP8",
+            Codec::Vp9 => "video/VP9",
+            Codec::H264 => "video/H264",
+            Codec::H265 => "video/HEVC",
+        }
+    }
+}
+
+/// libvpx encode deadline: how much time each frame may take.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub(crate) enum Deadline {
+    Realtime,
+    Good,
+    Best,
+}
+
+#[derive(Debug, Clone, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct EncoderConfig {
+    /// `libvpx`, or the name of a backend registered with `webrtc_register_encoder_backend`.
+    pub backend: String,
+    pub codec: Codec,
+    /// Target bitrate in kbit/s.
+    pub bitrate_kbps: u32,
+    /// How far rate control may overshoot the target; defaults to the target.
+    pub max_bitrate_kbps: Option<u32>,
+    /// libvpx speed: higher is faster and lower quality. VP9 takes -9..9, VP8 -16..16.
+    pub cpu_used: i32,
+    pub deadline: Deadline,
+    /// Encoder threads; 0 uses the available cores, up to 8.
+    pub threads: u32,
+    /// VP9 only: log2 of the tile column count. Defaults to one column per thread.
+    pub tile_columns_log2: Option<u32>,
+    /// Maximum frames between keyframes; 0 leaves placement to the encoder.
+    pub keyframe_interval: u32,
+    /// Lets the decoder recover from lost packets without a keyframe, at some cost in bitrate.
+    pub error_resilient: bool,
+}
+
+impl Default for EncoderConfig {
+    fn default() -> Self {
+        EncoderConfig {
+            backend: LIBVPX.to_owned(),
+            codec: Codec::Vp9,
+            bitrate_kbps: 1000,
+            max_bitrate_kbps: None,
+            cpu_used: 8,
+            deadline: Deadline::Realtime,
+            threads: 0,
+            tile_columns_log2: None,
+            keyframe_interval: 0,
+            error_resilient: true,
+        }
+    }
+}
+
+impl EncoderConfig {
+    /// `threads`, with 0 resolved to the available cores (at most 8).
+    pub(crate) fn resolved_threads(&self) -> u32 {
+        if self.threads > 0 {
+            return self.threads;
+        }
+        std::thread::available_parallelism()
+            .map(|n| n.get().min(8) as u32)
+            .unwrap_or(1)
+    }
+
+    pub(crate) fn is_libvpx(&self) -> bool {
+        self.backend == LIBVPX
+    }
+
+    fn validate(&self) -> Result<(), String> {
+        if !encoder_backend::is_registered(&self.backend) {
+            return Err(format!("encoder.backend \"{}\" is not registered", self.backend));
+        }
+        // cpu_used, deadline and tile columns only mean something to libvpx
+        let cpu_used_range = match self.codec {
+            Codec::Vp8 => -16..=16,
+            Codec::Vp9 => -9..=9,
+            _ if self.is_libvpx() => {
+                return Err(format!("libvpx cannot encode {:?}; use vp8 or vp9, or another encoder.backend", self.codec))
+            }
+            _ => i32::MIN..=i32::MAX,
+        };
+        if self.is_libvpx() && !cpu_used_range.contains(&self.cpu_used) {
+            return Err(format!(
+                "encoder.cpu_used {} is outside {}..={}",
+                self.cpu_used,
+                cpu_used_range.start(),
+                cpu_used_range.end()
+            ));
+        }
+        if self.bitrate_kbps == 0 {
+            return Err("encoder.bitrate_kbps must be positive".to_owned());
+        }
+        if matches!(self.max_bitrate_kbps, Some(max) if max < self.bitrate_kbps) {
+            return Err("encoder.max_bitrate_kbps is below bitrate_kbps".to_owned());
+        }
+        if matches!(self.tile_columns_log2, Some(log2) if log2 > 6) {
+            return Err("encoder.tile_columns_log2 must be at most 6".to_owned());
+        }
+        Ok(())
+    }
+}
+
+#[derive(Debug, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct AsyncEncodeConfig {
+    /// Frames that may wait for the encoder thread.
+    pub queue_depth: usize,
+    pub drop_policy: DropPolicy,
+}
+
+impl Default for AsyncEncodeConfig {
+    fn default() -> Self {
+        AsyncEncodeConfig {
+            queue_depth: 2,
+            drop_policy: DropPolicy::DropOldest,
+        }
+    }
+}
+
+/// What to do with a new frame when the encode queue is full.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Deserialize)]
+#[serde(rename_all = "snake_case")]
+pub(crate) enum DropPolicy {
+    /// Discard the oldest queued frame to make room; keeps latency lowest.
+    DropOldest,
+    /// Discard the new frame.
+    DropNewest,
+    /// Wait until the encoder thread makes room.
+    Block,
+}
+
+#[derive(Debug, Clone, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct AdaptiveBitrateConfig {
+    /// Floor for the target bitrate, in kbit/s.
+    pub min_bitrate_kbps: u32,
+    /// Ceiling for the target bitrate; defaults to `encoder.bitrate_kbps`, where adaptation starts.
+    pub max_bitrate_kbps: Option<u32>,
+    /// Bitrate one megapixel per frame needs; sets the frame size budget for a target.
+    pub kbps_per_megapixel: u32,
+}
+
+impl Default for AdaptiveBitrateConfig {
+    fn default() -> Self {
+        AdaptiveBitrateConfig {
+            min_bitrate_kbps: 150,
+            max_bitrate_kbps: None,
+            kbps_per_megapixel: 400,
+        }
+    }
+}
+
+impl SessionConfig {
+    pub(crate) fn parse(json: &str) -> Result<Self, String> {
+        if json.trim().is_empty() {
+            return Ok(SessionConfig::default());
+        }
+        let config: SessionConfig = serde_json::from_str(json).map_err(|e| e.to_string())?;
+        config.encoder.validate()?;
+        if let Some(ref a) = config.async_encode {
+            if a.queue_depth == 0 {
+                return Err("async_encode.queue_depth must be at least 1".to_owned());
+            }
+        }
+        if let Some(ref a) = config.adaptive_bitrate {
+            if a.min_bitrate_kbps == 0 || a.kbps_per_megapixel == 0 {
+                return Err("adaptive_bitrate.min_bitrate_kbps and kbps_per_megapixel must be positive".to_owned());
+            }
+            if a.min_bitrate_kbps > config.encoder.bitrate_kbps {
+                return Err("adaptive_bitrate.min_bitrate_kbps is above encoder.bitrate_kbps".to_owned());
+            }
+            if matches!(a.max_bitrate_kbps, Some(max) if max < config.encoder.bitrate_kbps) {
+                return Err("adaptive_bitrate.max_bitrate_kbps is below encoder.bitrate_kbps".to_owned());
+            }
+        }
+        Ok(config)
+    }
+
+    /// # Safety
+    /// `json` must be null or a valid NUL-terminated string.
+    pub(crate) unsafe fn from_c_str(json: *const c_char) -> Result<Self, String> {
+        if json.is_null() {
+            return Ok(SessionConfig::default());
+        }
+        let json = CStr::from_ptr(json).to_str().map_err(|e| e.to_string())?;
+        Self::parse(json)
+    }
+}
+
+/// Settings for a `webrtc_simulcast_t`.
+#[derive(Debug, Default, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct SimulcastConfig {
+    /// Settings shared by every layer's encoder; `bitrate_kbps` is the full-size layer's
+    /// rate when `layers` is not given.
+    pub encoder: EncoderConfig,
+    /// Largest first. Defaults to full, half and quarter size.
+    pub layers: Vec<LayerConfig>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Deserialize)]
+#[serde(deny_unknown_fields)]
+pub(crate) struct LayerConfig {
+    /// The layer is the input halved this many times.
+    pub scale_down_log2: u32,
+    pub bitrate_kbps: u32,
+}
+
+/// Most layers a simulcast source encodes.
+pub(crate) const MAX_SIMULCAST_LAYERS: usize = 4;
+
+impl SimulcastConfig {
+    pub(crate) fn parse(json: &str) -> Result<Self, String> {
+        let mut config: SimulcastConfig = if json.trim().is_empty() {
+            SimulcastConfig::default()
+        } else {
+            serde_json::from_str(json).map_err(|e| e.to_string())?
+        };
+        config.encoder.validate()?;
+        if config.layers.is_empty() {
+            // Each halving quarters the pixels; the bitrate follows, with a floor
+            let full = config.encoder.bitrate_kbps;
+            config.layers = (0..3)
+                .map(|steps| LayerConfig {
+                    scale_down_log2: steps,
+                    bitrate_kbps: (full >> (2 * steps)).max(100.min(full)),
+                })
+                .collect();
+        }
+        if config.layers.len() > MAX_SIMULCAST_LAYERS {
+            return Err(format!("at most {} layers", MAX_SIMULCAST_LAYERS));
+        }
+        for (i, layer) in config.layers.iter().enumerate() {
+            if layer.scale_down_log2 > MAX_SCALE_STEPS {
+                return Err(format!("layers[].scale_down_log2 must be at most {}", MAX_SCALE_STEPS));
+            }
+            if layer.bitrate_kbps == 0 {
+                return Err("layers[].bitrate_kbps must be positive".to_owned());
+            }
+            if i > 0 && layer.scale_down_log2 <= config.layers[i - 1].scale_down_log2 {
+                return Err("layers must go from largest to smallest".to_owned());
+            }
+        }
+        Ok(config)
+    }
+
+    /// # Safety
+    /// `json` must be null or a valid NUL-terminated string.
+    pub(crate) unsafe fn from_c_str(json: *const c_char) -> Result<Self, String> {
+        if json.is_null() {
+            return Self::parse("");
+        }
+        let json = CStr::from_ptr(json).to_str().map_err(|e| e.to_string())?;
+        Self::parse(json)
+    }
+}
+
+/// Settings for a `webrtc_fanout_t`: the one video stream its sessions share.
+#[derive(Debug, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct FanOutConfig {
+    pub encoder: EncoderConfig,
+    pub repeat_frames: bool,
+    pub abs_capture_time: bool,
+    /// Keyframe requests from viewers within this long of the last keyframe
+    /// wait for the interval to pass, so joining viewers share one keyframe.
+    pub keyframe_min_interval_ms: u32,
+}
+
+impl Default for FanOutConfig {
+    fn default() -> Self {
+        FanOutConfig {
+            encoder: EncoderConfig::default(),
+            repeat_frames: false,
+            abs_capture_time: false,
+            keyframe_min_interval_ms: 300,
+        }
+    }
+}
+
+impl FanOutConfig {
+    pub(crate) fn parse(json: &str) -> Result<Self, String> {
+        if json.trim().is_empty() {
+            return Ok(FanOutConfig::default());
+        }
+        let config: FanOutConfig = serde_json::from_str(json).map_err(|e| e.to_string())?;
+        config.encoder.validate()?;
+        if config.keyframe_min_interval_ms > 10_000 {
+            return Err("keyframe_min_interval_ms must be at most 10000".to_owned());
+        }
+        Ok(config)
+    }
+
+    /// # Safety
+    /// `json` must be null or a valid NUL-terminated string.
+    pub(crate) unsafe fn from_c_str(json: *const c_char) -> Result<Self, String> {
+        if json.is_null() {
+            return Ok(FanOutConfig::default());
+        }
+        let json = CStr::from_ptr(json).to_str().map_err(|e| e.to_string())?;
+        Self::parse(json)
+    }
+}
+
+/// Settings for a `webrtc_context_t`, shared by every session created in it.
+#[derive(Debug, Deserialize)]
+#[serde(default, deny_unknown_fields)]
+pub(crate) struct ContextConfig {
+    /// Runtime worker threads for all sessions; 0 uses the available cores, up to 4.
+    pub worker_threads: usize,
+    /// Threads the runtime may start for blocking work such as name lookups.
+    pub blocking_threads: usize,
+    /// Send every session's ICE traffic through one UDP socket bound to this port;
+    /// 0 picks a free port. Without it each session binds its own ports.
+    pub udp_mux_port: Option<u16>,
+    /// Peer connections kept ready for new sessions, with their candidates gathered.
+    pub warm_connections: usize,
+    /// The only codecs sessions in the context may encode, and the only ones
+    /// offered in answers; empty allows every codec.
+    pub codecs: Vec<Codec>,
+}
+
+/// Most connections a context keeps warm; each holds its ICE sockets open.
+pub(crate) const MAX_WARM_CONNECTIONS: usize = 64;
+
+impl Default for ContextConfig {
+    fn default() -> Self {
+        ContextConfig {
+            worker_threads: 0,
+            blocking_threads: 2,
+            udp_mux_port: None,
+            warm_connections: 0,
+            codecs: Vec::new(),
+        }
+    }
+}
+
+impl ContextConfig {
+    /// `worker_threads`, with 0 resolved to the available cores (at most 4).
+    pub(crate) fn resolved_worker_threads(&self) -> usize {
+        if self.worker_threads > 0 {
+            return self.worker_threads;
+        }
+        std::thread::available_parallelism()
+            .map(|n| n.get().min(4))
+            .unwrap_or(1)
+    }
+
+    pub(crate) fn parse(json: &str) -> Result<Self, String> {
+        if json.trim().is_empty() {
+            return Ok(ContextConfig::default());
+        }
+        let config: ContextConfig = serde_json::from_str(json).map_err(|e| e.to_string())?;
+        if config.worker_threads > 256 {
+            return Err("worker_threads must be at most 256".to_owned());
+        }
+        if config.blocking_threads == 0 || config.blocking_threads > 256 {
+            return Err("blocking_threads must be between 1 and 256".to_owned());
+        }
+        if config.warm_connections > MAX_WARM_CONNECTIONS {
+            return Err(format!("warm_connections must be at most {}", MAX_WARM_CONNECTIONS));
+        }
+        Ok(config)
+    }
+
+    /// # Safety
+    /// `json` must be null or a valid NUL-terminated string.
+    pub(crate) unsafe fn from_c_str(json: *const c_char) -> Result<Self, String> {
+        if json.is_null() {
+            return Ok(ContextConfig::default());
+        }
+        let json = CStr::from_ptr(json).to_str().map_err(|e| e.to_string())?;
+        Self::parse(json)
+    }
+}
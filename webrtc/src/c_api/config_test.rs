@@ -0,0 +1,151 @@
+use super::config::*;
+
+#[test]
+fn test_empty_config_is_default() {
+    for json in ["", "  ", "{}"] {
+        let config = SessionConfig::parse(json).unwrap();
+        assert!(config.async_encode.is_none());
+        assert!(!config.repeat_frames);
+        assert!(!config.abs_capture_time);
+    }
+    assert!(SessionConfig::parse(r#"{"repeat_frames": true}"#).unwrap().repeat_frames);
+    assert!(SessionConfig::parse(r#"{"abs_capture_time": true}"#).unwrap().abs_capture_time);
+}
+
+#[test]
+fn test_async_encode_config() {
+    let config = SessionConfig::parse(r#"{"async_encode": {}}"#).unwrap();
+    let a = config.async_encode.unwrap();
+    assert_eq!(a.queue_depth, 2);
+    assert_eq!(a.drop_policy, DropPolicy::DropOldest);
+
+    let config = SessionConfig::parse(r#"{"async_encode": {"queue_depth": 4, "drop_policy": "block"}}"#).unwrap();
+    let a = config.async_encode.unwrap();
+    assert_eq!(a.queue_depth, 4);
+    assert_eq!(a.drop_policy, DropPolicy::Block);
+}
+
+#[test]
+fn test_invalid_config_is_rejected() {
+    assert!(SessionConfig::parse("not json").is_err());
+    assert!(SessionConfig::parse(r#"{"async_encode": {"queue_depth": 0}}"#).is_err());
+    assert!(SessionConfig::parse(r#"{"async_encode": {"drop_policy": "sometimes"}}"#).is_err());
+    assert!(SessionConfig::parse(r#"{"asnyc_encode": {}}"#).is_err());
+}
+
+#[test]
+fn test_encoder_config() {
+    let config = SessionConfig::parse("").unwrap();
+    assert_eq!(config.encoder.codec, Codec::Vp9);
+    assert_eq!(config.encoder.deadline, Deadline::Realtime);
+
+    let config = SessionConfig::parse(
+        r#"{"encoder": {"codec": "vp8", "bitrate_kbps": 2500, "max_bitrate_kbps": 4000, "cpu_used": -12,
+            "deadline": "good", "threads": 4, "keyframe_interval": 120, "error_resilient": false}}"#,
+    )
+    .unwrap();
+    let e = config.encoder;
+    assert_eq!(e.codec, Codec::Vp8);
+    assert_eq!(e.bitrate_kbps, 2500);
+    assert_eq!(e.max_bitrate_kbps, Some(4000));
+    assert_eq!(e.cpu_used, -12);
+    assert_eq!(e.deadline, Deadline::Good);
+    assert_eq!(e.resolved_threads(), 4);
+    assert_eq!(e.keyframe_interval, 120);
+    assert!(!e.error_resilient);
+    assert_eq!(e.codec.mime_type(), "video/VP8");
+}
+
+#[test]
+fn test_invalid_encoder_config_is_rejected() {
+    for json in [
+        r#"{"encoder": {"codec": "h264"}}"#,
+        r#"{"encoder": {"codec": "av1"}}"#,
+        r#"{"encoder": {"cpu_used": -12}}"#,
+        r#"{"encoder": {"bitrate_kbps": 0}}"#,
+        r#"{"encoder": {"bitrate_kbps": 2000, "max_bitrate_kbps": 1000}}"#,
+        r#"{"encoder": {"tile_columns_log2": 7}}"#,
+    ] {
+        assert!(SessionConfig::parse(json).is_err(), "{}", json);
+    }
+}
+
+#[test]
+fn test_adaptive_bitrate_config() {
+    let config = SessionConfig::parse(r#"{"adaptive_bitrate": {}}"#).unwrap();
+    let a = config.adaptive_bitrate.unwrap();
+    assert_eq!(a.min_bitrate_kbps, 150);
+    assert_eq!(a.max_bitrate_kbps, None);
+    assert_eq!(a.kbps_per_megapixel, 400);
+    assert!(SessionConfig::parse("{}").unwrap().adaptive_bitrate.is_none());
+
+    for json in [
+        r#"{"adaptive_bitrate": {"min_bitrate_kbps": 0}}"#,
+        r#"{"adaptive_bitrate": {"min_bitrate_kbps": 2000}}"#,
+        r#"{"adaptive_bitrate": {"max_bitrate_kbps": 500}}"#,
+        r#"{"adaptive_bitrate": {"kbps_per_megapixel": 0}}"#,
+    ] {
+        assert!(SessionConfig::parse(json).is_err(), "{}", json);
+    }
+}
+
+#[test]
+fn test_context_config() {
+    let config = ContextConfig::parse("").unwrap();
+    assert_eq!(config.worker_threads, 0);
+    assert_eq!(config.blocking_threads, 2);
+    assert_eq!(config.udp_mux_port, None);
+    assert_eq!(config.warm_connections, 0);
+    assert!(config.codecs.is_empty());
+    assert!((1..=4).contains(&config.resolved_worker_threads()));
+
+    let config = ContextConfig::parse(r#"{"worker_threads": 6, "udp_mux_port": 5000}"#).unwrap();
+    assert_eq!(config.resolved_worker_threads(), 6);
+    assert_eq!(config.udp_mux_port, Some(5000));
+
+    let config = ContextConfig::parse(r#"{"warm_connections": 4, "codecs": ["vp9", "h264"]}"#).unwrap();
+    assert_eq!(config.warm_connections, 4);
+    assert_eq!(config.codecs, vec![Codec::Vp9, Codec::H264]);
+
+    for json in [
+        r#"{"blocking_threads": 0}"#,
+        r#"{"worker_threads": 1000}"#,
+        r#"{"udp_mux_port": 70000}"#,
+        r#"{"threads": 2}"#,
+        r#"{"warm_connections": 65}"#,
+        r#"{"codecs": ["av1"]}"#,
+    ] {
+        assert!(ContextConfig::parse(json).is_err(), "{}", json);
+    }
+}
+
+#[test]
+fn test_simulcast_config() {
+    let config = SimulcastConfig::parse(r#"{"encoder": {"bitrate_kbps": 3200}}"#).unwrap();
+    let layers: Vec<_> = config.layers.iter().map(|l| (l.scale_down_log2, l.bitrate_kbps)).collect();
+    assert_eq!(layers, [(0, 3200), (1, 800), (2, 200)]);
+    assert_eq!(SimulcastConfig::parse("").unwrap().layers[2].bitrate_kbps, 100);
+
+    let config = SimulcastConfig::parse(
+        r#"{"layers": [{"scale_down_log2": 0, "bitrate_kbps": 2500}, {"scale_down_log2": 2, "bitrate_kbps": 300}]}"#,
+    )
+    .unwrap();
+    assert_eq!(config.layers.len(), 2);
+
+    let wrong_order = r#"{"layers": [{"scale_down_log2": 1, "bitrate_kbps": 800}, {"scale_down_log2": 0, "bitrate_kbps": 2500}]}"#;
+    assert!(SimulcastConfig::parse(wrong_order).is_err());
+    assert!(SimulcastConfig::parse(r#"{"layers": [{"scale_down_log2": 4, "bitrate_kbps": 100}]}"#).is_err());
+    assert!(SimulcastConfig::parse(r#"{"layers": [{"scale_down_log2": 0, "bitrate_kbps": 0}]}"#).is_err());
+}
+
+#[test]
+fn test_fanout_config() {
+    let config = FanOutConfig::parse("").unwrap();
+    assert_eq!(config.keyframe_min_interval_ms, 300);
+    let config = FanOutConfig::parse(r#"{"encoder": {"codec": "vp8"}, "repeat_frames": true, "keyframe_min_interval_ms": 0}"#).unwrap();
+    assert_eq!(config.encoder.codec, Codec::Vp8);
+    assert!(config.repeat_frames);
+    assert!(FanOutConfig::parse(r#"{"keyframe_min_interval_ms": 60000}"#).is_err());
+    // Per-viewer settings belong to the sessions
+    assert!(FanOutConfig::parse(r#"{"adaptive_bitrate": {}}"#).is_err());
+}
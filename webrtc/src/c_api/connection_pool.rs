@@ -0,0 +1,241 @@
+//! Session startup. A new peer connection costs a DTLS certificate, a copy of
+//! the media engine and, once the offer arrives, ICE gathering. Connections
+//! here share one certificate, their media engines register only the codecs
+//! the sessions encode, and gathering starts as soon as the connection exists.
+//! A context can also keep `warm_connections` of them ready, refilled in the
+//! background as sessions take them.
+
+use std::collections::{HashMap, VecDeque};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant, SystemTime};
+
+use interceptor::registry::Registry;
+use rcgen::KeyPair;
+
+use super::capture_time;
+use super::config::Codec;
+use crate::api::interceptor_registry::configure_rtcp_reports;
+use crate::api::media_engine::MediaEngine;
+use crate::api::{APIBuilder, API};
+use crate::data_channel::data_channel_init::RTCDataChannelInit;
+use crate::peer_connection::certificate::RTCCertificate;
+use crate::peer_connection::configuration::RTCConfiguration;
+use crate::peer_connection::RTCPeerConnection;
+use crate::rtp_transceiver::rtp_codec::RTPCodecType;
+
+/// A certificate is replaced once it has less than this left, so no
+/// connection is created with one about to expire.
+const CERTIFICATE_RENEW_BEFORE: Duration = Duration::from_secs(24 * 60 * 60);
+
+/// Warm connections older than this are closed rather than handed out: their
+/// host candidates may no longer match the machine's interfaces.
+pub(crate) const WARM_CONNECTION_MAX_AGE: Duration = Duration::from_secs(10 * 60);
+
+/// Sender and receiver reports. Without sender reports the viewer's receiver
+/// reports carry no round trip time, and it cannot map RTP timestamps to
+/// capture times.
+pub(crate) fn interceptor_registry() -> Registry {
+    configure_rtcp_reports(Registry::new())
+}
+
+/// A media engine with the default entries (every profile) for `codecs`, or
+/// every default codec if `codecs` is empty, plus abs-capture-time.
+pub(crate) fn media_engine(codecs: &[Codec]) -> Result<MediaEngine, String> {
+    let mut media_engine = MediaEngine::default();
+    if codecs.is_empty() {
+        media_engine
+            .register_default_codecs()
+            .map_err(|e| format!("failed to register default codecs: {}", e))?;
+    } else {
+        let mut defaults = MediaEngine::default();
+        defaults
+            .register_default_codecs()
+            .map_err(|e| format!("failed to register default codecs: {}", e))?;
+        for codec in defaults.video_codecs {
+            if codecs.iter().any(|c| c.mime_type().eq_ignore_ascii_case(&codec.capability.mime_type)) {
+                media_engine
+                    .register_codec(codec, RTPCodecType::Video)
+                    .map_err(|e| format!("failed to register codec: {}", e))?;
+            }
+        }
+    }
+    capture_time::register(&mut media_engine)
+        .map_err(|e| format!("failed to register the abs-capture-time extension: {}", e))?;
+    Ok(media_engine)
+}
+
+/// One certificate for many connections, generated on first use and renewed
+/// before it expires.
+#[derive(Default)]
+pub(crate) struct CertificateCache {
+    current: Mutex<Option<RTCCertificate>>,
+}
+
+impl CertificateCache {
+    pub(crate) fn get(&self) -> Result<RTCCertificate, String> {
+        let mut current = self.current.lock().map_err(|e| e.to_string())?;
+        let fresh = current.as_ref().map_or(false, |certificate| {
+            certificate
+                .expires
+                .duration_since(SystemTime::now())
+                .map_or(false, |left| left > CERTIFICATE_RENEW_BEFORE)
+        });
+        if !fresh {
+            let key_pair = KeyPair::generate_for(&rcgen::PKCS_ECDSA_P256_SHA256).map_err(|e| e.to_string())?;
+            *current = Some(RTCCertificate::from_key_pair(key_pair).map_err(|e| e.to_string())?);
+        }
+        Ok(current.clone().unwrap())
+    }
+}
+
+lazy_static! {
+    /// For `webrtc_session_create` sessions, which have no context to keep them in.
+    static ref STANDALONE_APIS: Mutex<HashMap<Codec, Arc<API>>> = Mutex::new(HashMap::new());
+    static ref STANDALONE_CERTIFICATE: CertificateCache = CertificateCache::default();
+}
+
+/// The API for a context-less session encoding `codec`, built on first use.
+pub(crate) fn standalone_api(codec: Codec) -> Result<Arc<API>, String> {
+    let mut apis = STANDALONE_APIS.lock().map_err(|e| e.to_string())?;
+    if let Some(api) = apis.get(&codec) {
+        return Ok(Arc::clone(api));
+    }
+    let api = Arc::new(
+        APIBuilder::new()
+            .with_media_engine(media_engine(&[codec])?)
+            .with_interceptor_registry(interceptor_registry())
+            .build(),
+    );
+    apis.insert(codec, Arc::clone(&api));
+    Ok(api)
+}
+
+pub(crate) fn standalone_certificate() -> Result<RTCCertificate, String> {
+    STANDALONE_CERTIFICATE.get()
+}
+
+/// A peer connection ready for everything but the session's track: the input
+/// data channel is created and ICE gathering has started, so the offer can be
+/// answered with candidates already in hand.
+pub(crate) async fn new_peer_connection(api: &API, certificate: RTCCertificate) -> Result<Arc<RTCPeerConnection>, String> {
+    let configuration = RTCConfiguration {
+        certificates: vec![certificate],
+        ..Default::default()
+    };
+    let pc = api
+        .new_peer_connection(configuration)
+        .await
+        .map_err(|e| format!("failed to create peer connection: {}", e))?;
+    let pc = Arc::new(pc);
+    let dc_init = RTCDataChannelInit {
+        ordered: Some(true),
+        ..Default::default()
+    };
+    pc.create_data_channel("input", Some(dc_init))
+        .await
+        .map_err(|e| format!("failed to create data channel: {}", e))?;
+    pc.start_ice_gathering()
+        .await
+        .map_err(|e| format!("failed to start ICE gathering: {}", e))?;
+    Ok(pc)
+}
+
+struct PoolState<C> {
+    ready: VecDeque<(Instant, C)>,
+    /// Connections being created to refill the pool.
+    filling: usize,
+    hits: u64,
+    misses: u64,
+}
+
+/// Reported by `webrtc_context_get_stats`.
+pub(crate) struct PoolStats {
+    pub ready: usize,
+    pub hits: u64,
+    pub misses: u64,
+}
+
+/// Warm connections waiting for a session. The pool only does the
+/// bookkeeping; the context creates and closes the connections.
+pub(crate) struct ConnectionPool<C> {
+    size: usize,
+    state: Mutex<PoolState<C>>,
+}
+
+impl<C> ConnectionPool<C> {
+    pub(crate) fn new(size: usize) -> Self {
+        ConnectionPool {
+            size,
+            state: Mutex::new(PoolState {
+                ready: VecDeque::new(),
+                filling: 0,
+                hits: 0,
+                misses: 0,
+            }),
+        }
+    }
+
+    /// The youngest warm connection, if there is one, and the ones too old to
+    /// hand out, which the caller closes.
+    pub(crate) fn take(&self, now: Instant) -> (Option<C>, Vec<C>) {
+        let mut state = match self.state.lock() {
+            Ok(state) => state,
+            Err(_) => return (None, Vec::new()),
+        };
+        let mut stale = Vec::new();
+        while matches!(state.ready.front(), Some((created, _)) if now.duration_since(*created) > WARM_CONNECTION_MAX_AGE) {
+            stale.extend(state.ready.pop_front().map(|(_, pc)| pc));
+        }
+        let warm = state.ready.pop_back().map(|(_, pc)| pc);
+        if warm.is_some() {
+            state.hits += 1;
+        } else if self.size > 0 {
+            state.misses += 1;
+        }
+        (warm, stale)
+    }
+
+    /// How many connections to start creating so that ready and in-flight
+    /// ones add up to the pool size. They count as in flight until
+    /// `finish_filling`.
+    pub(crate) fn start_filling(&self) -> usize {
+        let mut state = match self.state.lock() {
+            Ok(state) => state,
+            Err(_) => return 0,
+        };
+        let wanted = self.size.saturating_sub(state.ready.len() + state.filling);
+        state.filling += wanted;
+        wanted
+    }
+
+    /// Adds a connection created by a refill; `None` for one that failed.
+    pub(crate) fn finish_filling(&self, pc: Option<C>, now: Instant) {
+        if let Ok(mut state) = self.state.lock() {
+            state.filling = state.filling.saturating_sub(1);
+            state.ready.extend(pc.map(|pc| (now, pc)));
+        }
+    }
+
+    /// Empties the pool, for the caller to close what it held.
+    pub(crate) fn drain(&self) -> Vec<C> {
+        match self.state.lock() {
+            Ok(mut state) => state.ready.drain(..).map(|(_, pc)| pc).collect(),
+            Err(_) => Vec::new(),
+        }
+    }
+
+    pub(crate) fn stats(&self) -> PoolStats {
+        match self.state.lock() {
+            Ok(state) => PoolStats {
+                ready: state.ready.len(),
+                hits: state.hits,
+                misses: state.misses,
+            },
+            Err(_) => PoolStats {
+                ready: 0,
+                hits: 0,
+                misses: 0,
+            },
+        }
+    }
+}
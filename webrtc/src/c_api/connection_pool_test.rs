@@ -0,0 +1,52 @@
+use std::time::{Duration, Instant};
+
+use super::connection_pool::*;
+
+#[test]
+fn test_pool_fills_to_size() {
+    let pool = ConnectionPool::<u32>::new(3);
+    let now = Instant::now();
+    assert_eq!(pool.start_filling(), 3);
+    // In-flight connections count towards the size
+    assert_eq!(pool.start_filling(), 0);
+    pool.finish_filling(Some(1), now);
+    pool.finish_filling(None, now);
+    pool.finish_filling(Some(2), now);
+    assert_eq!(pool.stats().ready, 2);
+    // The failed one is replaced
+    assert_eq!(pool.start_filling(), 1);
+}
+
+#[test]
+fn test_pool_hands_out_youngest_and_counts_misses() {
+    let pool = ConnectionPool::<u32>::new(2);
+    let now = Instant::now();
+    pool.start_filling();
+    pool.finish_filling(Some(1), now);
+    pool.finish_filling(Some(2), now + Duration::from_secs(1));
+    assert_eq!(pool.take(now + Duration::from_secs(2)), (Some(2), vec![]));
+    assert_eq!(pool.take(now + Duration::from_secs(2)), (Some(1), vec![]));
+    assert_eq!(pool.take(now + Duration::from_secs(2)), (None, vec![]));
+    let stats = pool.stats();
+    assert_eq!((stats.ready, stats.hits, stats.misses), (0, 2, 1));
+}
+
+#[test]
+fn test_pool_returns_stale_connections() {
+    let pool = ConnectionPool::<u32>::new(2);
+    let now = Instant::now();
+    pool.start_filling();
+    pool.finish_filling(Some(1), now);
+    pool.finish_filling(Some(2), now + WARM_CONNECTION_MAX_AGE);
+    let later = now + WARM_CONNECTION_MAX_AGE + Duration::from_secs(1);
+    assert_eq!(pool.take(later), (Some(2), vec![1]));
+    assert_eq!(pool.stats().ready, 0);
+}
+
+#[test]
+fn test_empty_pool_counts_no_misses() {
+    let pool = ConnectionPool::<u32>::new(0);
+    assert_eq!(pool.start_filling(), 0);
+    assert_eq!(pool.take(Instant::now()), (None, vec![]));
+    assert_eq!(pool.stats().misses, 0);
+}
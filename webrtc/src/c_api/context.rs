@@ -0,0 +1,204 @@
+//! `webrtc_context_t`: one tokio runtime, API and optional UDP mux shared by
+//! every session created in it. A session then costs a peer connection rather
+//! than a thread pool, and the runtime's threads are bounded by the context
+//! config however many sessions there are. With `warm_connections` the
+//! context also keeps peer connections ready for new sessions; see
+//! c_api::connection_pool.
+
+use std::ops::Deref;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Instant;
+
+use ice::network_type::NetworkType;
+use ice::udp_mux::{UDPMuxDefault, UDPMuxParams};
+use ice::udp_network::UDPNetwork;
+use log::{debug, info, warn};
+use tokio::runtime::{Builder, Handle, Runtime};
+
+use crate::api::setting_engine::SettingEngine;
+use crate::api::{APIBuilder, API};
+use crate::c_api::config::{Codec, ContextConfig};
+use crate::c_api::connection_pool::{self, CertificateCache, ConnectionPool, PoolStats};
+use crate::peer_connection::RTCPeerConnection;
+
+pub(crate) struct SharedContext {
+    pub(crate) api: Arc<API>,
+    /// The codecs the media engine registered; empty for every default codec.
+    codecs: Vec<Codec>,
+    certificate: CertificateCache,
+    pool: Arc<ConnectionPool<Arc<RTCPeerConnection>>>,
+    sessions: AtomicUsize,
+    // Declared last: the UDP mux in `api` reads on it.
+    runtime: Runtime,
+}
+
+impl SharedContext {
+    pub(crate) fn new(config: &ContextConfig) -> Result<Self, String> {
+        let worker_threads = config.resolved_worker_threads();
+        let runtime = Builder::new_multi_thread()
+            .worker_threads(worker_threads)
+            .max_blocking_threads(config.blocking_threads)
+            .thread_name("webrtc-context")
+            .enable_all()
+            .build()
+            .map_err(|e| format!("failed to create runtime: {}", e))?;
+
+        let media_engine = connection_pool::media_engine(&config.codecs)?;
+
+        let mut setting_engine = SettingEngine::default();
+        // UDPMuxDefault starts its reader task with tokio::spawn, so it is created on the runtime
+        if let Some(port) = config.udp_mux_port {
+            let mux = runtime.block_on(async {
+                let socket = tokio::net::UdpSocket::bind(("0.0.0.0", port)).await?;
+                let address = socket.local_addr()?;
+                Ok::<_, std::io::Error>((UDPMuxDefault::new(UDPMuxParams::new(socket)), address))
+            });
+            let (mux, address) = mux.map_err(|e| format!("failed to bind UDP mux port {}: {}", port, e))?;
+            info!("Context UDP mux listening on {}", address);
+            // The mux socket is IPv4
+            setting_engine.set_network_types(vec![NetworkType::Udp4]);
+            setting_engine.set_udp_network(UDPNetwork::Muxed(mux));
+        }
+
+        // Each peer connection still takes its own copy of the media engine,
+        // since negotiation records the codecs and extensions per connection.
+        let api = APIBuilder::new()
+            .with_media_engine(media_engine)
+            .with_setting_engine(setting_engine)
+            .with_interceptor_registry(connection_pool::interceptor_registry())
+            .build();
+
+        info!(
+            "Context runtime: {} worker threads, {} warm connection(s)",
+            worker_threads, config.warm_connections
+        );
+        let context = SharedContext {
+            api: Arc::new(api),
+            codecs: config.codecs.clone(),
+            certificate: CertificateCache::default(),
+            pool: Arc::new(ConnectionPool::new(config.warm_connections)),
+            sessions: AtomicUsize::new(0),
+            runtime,
+        };
+        // Generated now rather than by the first session
+        context.certificate.get()?;
+        context.refill_pool();
+        Ok(context)
+    }
+
+    pub(crate) fn handle(&self) -> &Handle {
+        self.runtime.handle()
+    }
+
+    /// Whether sessions in this context can encode `codec`.
+    pub(crate) fn supports(&self, codec: Codec) -> bool {
+        self.codecs.is_empty() || self.codecs.contains(&codec)
+    }
+
+    /// A peer connection for a new session: a warm one from the pool if there
+    /// is one, otherwise a new one. Either way the pool is topped up again.
+    pub(crate) async fn peer_connection(&self) -> Result<Arc<RTCPeerConnection>, String> {
+        let (warm, stale) = self.pool.take(Instant::now());
+        for pc in stale {
+            debug!("Closing a warm connection that went unused");
+            self.runtime.spawn(async move {
+                let _ = pc.close().await;
+            });
+        }
+        self.refill_pool();
+        match warm {
+            Some(pc) => Ok(pc),
+            None => connection_pool::new_peer_connection(&self.api, self.certificate.get()?).await,
+        }
+    }
+
+    /// Starts creating connections on the runtime until the pool is full.
+    fn refill_pool(&self) {
+        for _ in 0..self.pool.start_filling() {
+            let certificate = match self.certificate.get() {
+                Ok(certificate) => certificate,
+                Err(e) => {
+                    warn!("Cannot warm a connection: {}", e);
+                    self.pool.finish_filling(None, Instant::now());
+                    continue;
+                }
+            };
+            // The task holds what it needs rather than the context, whose
+            // runtime must not be dropped from one of its own tasks
+            let api = Arc::clone(&self.api);
+            let pool = Arc::clone(&self.pool);
+            self.runtime.spawn(async move {
+                let pc = match connection_pool::new_peer_connection(&api, certificate).await {
+                    Ok(pc) => Some(pc),
+                    Err(e) => {
+                        warn!("Cannot warm a connection: {}", e);
+                        None
+                    }
+                };
+                pool.finish_filling(pc, Instant::now());
+            });
+        }
+    }
+
+    pub(crate) fn pool_stats(&self) -> PoolStats {
+        self.pool.stats()
+    }
+
+    /// Sessions created in this context that have not been destroyed yet.
+    pub(crate) fn session_count(&self) -> usize {
+        self.sessions.load(Ordering::Relaxed)
+    }
+}
+
+/// The runtime a session runs on: its own, from `webrtc_session_create`, or
+/// its context's, which it keeps alive. Derefs to the runtime's handle.
+pub(crate) enum SessionRuntime {
+    Owned(Runtime),
+    Shared(Arc<SharedContext>),
+}
+
+impl SessionRuntime {
+    pub(crate) fn shared(context: &Arc<SharedContext>) -> Self {
+        context.sessions.fetch_add(1, Ordering::Relaxed);
+        SessionRuntime::Shared(Arc::clone(context))
+    }
+
+    pub(crate) fn handle(&self) -> &Handle {
+        match self {
+            SessionRuntime::Owned(runtime) => runtime.handle(),
+            SessionRuntime::Shared(context) => context.handle(),
+        }
+    }
+}
+
+impl Deref for SessionRuntime {
+    type Target = Handle;
+
+    fn deref(&self) -> &Handle {
+        self.handle()
+    }
+}
+
+impl Drop for SharedContext {
+    fn drop(&mut self) {
+        let warm = self.pool.drain();
+        if warm.is_empty() {
+            return;
+        }
+        // Dropped from a thread outside the runtime, by the last session or webrtc_context_destroy
+        self.runtime.block_on(async {
+            for pc in warm {
+                let _ = pc.close().await;
+            }
+        });
+    }
+}
+
+impl Drop for SessionRuntime {
+    fn drop(&mut self) {
+        if let SessionRuntime::Shared(context) = self {
+            context.sessions.fetch_sub(1, Ordering::Relaxed);
+        }
+    }
+}
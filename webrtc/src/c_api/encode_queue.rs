@@ -0,0 +1,321 @@
+//! Asynchronous encoding: a bounded frame queue drained by a dedicated encoder
+//! thread, so `webrtc_session_send_frame*` return without waiting for libvpx.
+
+use std::collections::VecDeque;
+use std::sync::atomic::Ordering;
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::JoinHandle;
+
+use log::error;
+
+use super::config::{AsyncEncodeConfig, DropPolicy};
+use super::video_frame::{webrtc_video_frame_t, FrameRelease, VideoFrame, WEBRTC_FRAME_FLAG_KEYFRAME};
+use super::video_sender::{FrameCounters, VideoSender};
+
+/// A frame waiting for the encoder thread. Frames with a release callback keep
+/// borrowing the caller's planes until the frame is dropped; frames without one
+/// are copied, because the caller may reuse its buffer as soon as it returns.
+pub(crate) struct QueuedFrame {
+    /// Points either at the caller's planes or into `storage`.
+    desc: webrtc_video_frame_t,
+    storage: Vec<u8>,
+    _release: FrameRelease,
+}
+
+// The planes stay valid until `_release` runs (borrowed) or are owned here.
+unsafe impl Send for QueuedFrame {}
+
+impl QueuedFrame {
+    /// Validates `raw` so errors still reach the caller, then borrows or copies it.
+    ///
+    /// # Safety
+    /// As for `VideoFrame::from_raw`.
+    unsafe fn new(raw: &webrtc_video_frame_t, release: FrameRelease, mut storage: Vec<u8>) -> Result<Self, String> {
+        let frame = VideoFrame::from_raw(raw)?;
+        let mut desc = *raw;
+        desc.release = None;
+        if !release.is_set() {
+            let shapes = frame.format.plane_shapes(frame.width as usize, frame.height as usize);
+            storage.clear();
+            let mut offsets = [0usize; 3];
+            for (i, &(row_bytes, rows)) in shapes.iter().enumerate() {
+                offsets[i] = storage.len();
+                for row in 0..rows {
+                    let start = row * frame.strides[i];
+                    storage.extend_from_slice(&frame.planes[i][start..start + row_bytes]);
+                }
+            }
+            // Only now that storage has stopped growing are its addresses stable.
+            for (i, &(row_bytes, _)) in shapes.iter().enumerate() {
+                desc.planes[i] = storage.as_ptr().add(offsets[i]);
+                desc.strides[i] = row_bytes as i32;
+            }
+        }
+        Ok(QueuedFrame {
+            desc,
+            storage,
+            _release: release,
+        })
+    }
+
+    fn is_keyframe(&self) -> bool {
+        self.desc.flags & WEBRTC_FRAME_FLAG_KEYFRAME != 0
+    }
+
+    /// Takes over a forced keyframe from a frame dropped in its favour.
+    fn set_keyframe(&mut self) {
+        self.desc.flags |= WEBRTC_FRAME_FLAG_KEYFRAME;
+    }
+
+    fn frame(&self) -> VideoFrame<'_> {
+        unsafe { VideoFrame::from_raw(&self.desc) }.expect("queued frames are validated on submit")
+    }
+
+    /// Releases the frame and keeps its copy buffer for reuse.
+    fn into_storage(self) -> Vec<u8> {
+        self.storage
+    }
+}
+
+/// Work for the encoder thread.
+enum Job {
+    Frame(QueuedFrame),
+    /// `VideoSender::repeat` with this timestamp and keyframe flag.
+    Repeat(i64, bool),
+}
+
+struct QueueState {
+    frames: VecDeque<QueuedFrame>,
+    /// A repeat waiting for the encoder; any queued frame supersedes it.
+    repeat: Option<(i64, bool)>,
+    /// Copy buffers of encoded frames, reused for the next copies.
+    spare: Vec<Vec<u8>>,
+    closed: bool,
+}
+
+pub(crate) struct EncodeQueue {
+    state: Mutex<QueueState>,
+    not_empty: Condvar,
+    not_full: Condvar,
+    depth: usize,
+    policy: DropPolicy,
+    counters: Arc<FrameCounters>,
+}
+
+impl EncodeQueue {
+    fn new(config: &AsyncEncodeConfig, counters: Arc<FrameCounters>) -> Self {
+        EncodeQueue {
+            state: Mutex::new(QueueState {
+                frames: VecDeque::with_capacity(config.queue_depth),
+                repeat: None,
+                spare: Vec::new(),
+                closed: false,
+            }),
+            not_empty: Condvar::new(),
+            not_full: Condvar::new(),
+            depth: config.queue_depth,
+            policy: config.drop_policy,
+            counters,
+        }
+    }
+
+    /// Queues a frame, applying the drop policy when the queue is full. Returns
+    /// once the frame is queued or dropped; only `DropPolicy::Block` waits. A
+    /// dropped frame's keyframe flag moves to the frame kept in its place.
+    ///
+    /// # Safety
+    /// As for `VideoFrame::from_raw`.
+    pub(crate) unsafe fn submit(&self, raw: &webrtc_video_frame_t, release: FrameRelease) -> Result<(), String> {
+        let mut state = self.state.lock().unwrap();
+        if self.policy == DropPolicy::DropNewest && state.frames.len() >= self.depth {
+            // Checked before the copy, which such a drop never needs
+            let valid = VideoFrame::from_raw(raw).map(|_| ());
+            if valid.is_ok() {
+                self.counters.submitted.fetch_add(1, Ordering::Relaxed);
+                self.drop_newest(&mut state, raw.flags & WEBRTC_FRAME_FLAG_KEYFRAME != 0);
+            }
+            drop(state);
+            // Releases the frame outside the lock
+            drop(release);
+            return valid;
+        }
+        let storage = if release.is_set() {
+            Vec::new()
+        } else {
+            state.spare.pop().unwrap_or_default()
+        };
+        drop(state);
+        let mut frame = QueuedFrame::new(raw, release, storage)?;
+        self.counters.submitted.fetch_add(1, Ordering::Relaxed);
+
+        let mut state = self.state.lock().unwrap();
+        let mut evicted = None;
+        if state.frames.len() >= self.depth {
+            match self.policy {
+                // The queue filled up while the frame was copied
+                DropPolicy::DropNewest => {
+                    self.drop_newest(&mut state, frame.is_keyframe());
+                    drop(state);
+                    self.recycle(frame.into_storage());
+                    return Ok(());
+                }
+                DropPolicy::DropOldest => {
+                    evicted = state.frames.pop_front();
+                    if evicted.as_ref().is_some_and(QueuedFrame::is_keyframe) {
+                        match state.frames.front_mut() {
+                            Some(next) => next.set_keyframe(),
+                            None => frame.set_keyframe(),
+                        }
+                    }
+                }
+                DropPolicy::Block => {
+                    state = self
+                        .not_full
+                        .wait_while(state, |s| s.frames.len() >= self.depth && !s.closed)
+                        .unwrap();
+                    if state.closed {
+                        drop(state);
+                        return Err("session is closing".to_owned());
+                    }
+                }
+            }
+        }
+        if evicted.is_some() {
+            self.counters.dropped.fetch_add(1, Ordering::Relaxed);
+        }
+        state.frames.push_back(frame);
+        drop(state);
+        self.not_empty.notify_one();
+        // Release callbacks run outside the lock.
+        if let Some(evicted) = evicted {
+            self.recycle(evicted.into_storage());
+        }
+        Ok(())
+    }
+
+    /// Counts a frame dropped under `DropPolicy::DropNewest`, handing a forced
+    /// keyframe to the newest frame still queued.
+    fn drop_newest(&self, state: &mut QueueState, keyframe: bool) {
+        if keyframe {
+            if let Some(newest) = state.frames.back_mut() {
+                newest.set_keyframe();
+            }
+        }
+        self.counters.dropped.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Asks the encoder thread to repeat its last frame. Ignored while frames
+    /// are queued, since they bring newer content anyway; a keyframe request
+    /// is kept if it merges with a pending repeat.
+    pub(crate) fn submit_repeat(&self, timestamp_us: i64, keyframe: bool) {
+        let mut state = self.state.lock().unwrap();
+        if state.closed || !state.frames.is_empty() {
+            return;
+        }
+        let keyframe = keyframe || matches!(state.repeat, Some((_, true)));
+        state.repeat = Some((timestamp_us, keyframe));
+        drop(state);
+        self.not_empty.notify_one();
+    }
+
+    /// The next job; blocks until there is one. None once closed.
+    fn pop(&self) -> Option<Job> {
+        let mut state = self
+            .not_empty
+            .wait_while(self.state.lock().unwrap(), |s| {
+                s.frames.is_empty() && s.repeat.is_none() && !s.closed
+            })
+            .unwrap();
+        if state.closed {
+            return None;
+        }
+        if let Some(frame) = state.frames.pop_front() {
+            state.repeat = None;
+            drop(state);
+            self.not_full.notify_one();
+            return Some(Job::Frame(frame));
+        }
+        state.repeat.take().map(|(timestamp_us, keyframe)| Job::Repeat(timestamp_us, keyframe))
+    }
+
+    fn recycle(&self, storage: Vec<u8>) {
+        if storage.capacity() > 0 {
+            let mut state = self.state.lock().unwrap();
+            // One spare per queue slot plus the frame being encoded is enough.
+            if state.spare.len() <= self.depth {
+                state.spare.push(storage);
+            }
+        }
+    }
+
+    /// Stops the encoder thread and releases every frame still queued.
+    fn close(&self) {
+        let frames = {
+            let mut state = self.state.lock().unwrap();
+            state.closed = true;
+            std::mem::take(&mut state.frames)
+        };
+        drop(frames);
+        self.not_empty.notify_all();
+        self.not_full.notify_all();
+    }
+
+    pub(crate) fn len(&self) -> usize {
+        self.state.lock().unwrap().frames.len()
+    }
+}
+
+/// Owns the encoder thread; dropping it stops the thread after the frame in progress.
+pub(crate) struct AsyncEncoder {
+    queue: Arc<EncodeQueue>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl AsyncEncoder {
+    pub(crate) fn start(
+        mut sender: VideoSender,
+        config: &AsyncEncodeConfig,
+        counters: Arc<FrameCounters>,
+    ) -> std::io::Result<Self> {
+        let queue = Arc::new(EncodeQueue::new(config, counters));
+        let thread_queue = Arc::clone(&queue);
+        let thread = std::thread::Builder::new()
+            .name("webrtc-encoder".to_owned())
+            .spawn(move || {
+                while let Some(job) = thread_queue.pop() {
+                    match job {
+                        Job::Frame(frame) => {
+                            if let Err(e) = sender.send(&frame.frame()) {
+                                error!("{}", e);
+                            }
+                            thread_queue.recycle(frame.into_storage());
+                        }
+                        Job::Repeat(timestamp_us, keyframe) => {
+                            if let Err(e) = sender.repeat(timestamp_us, keyframe) {
+                                error!("{}", e);
+                            }
+                        }
+                    }
+                }
+            })?;
+        Ok(AsyncEncoder {
+            queue,
+            thread: Some(thread),
+        })
+    }
+
+    pub(crate) fn queue(&self) -> Arc<EncodeQueue> {
+        Arc::clone(&self.queue)
+    }
+}
+
+impl Drop for AsyncEncoder {
+    fn drop(&mut self) {
+        self.queue.close();
+        if let Some(thread) = self.thread.take() {
+            if thread.join().is_err() {
+                error!("Encoder thread panicked");
+            }
+        }
+    }
+}
@@ -0,0 +1,223 @@
+//! Encoder backends. `libvpx` is built in; an application can register more
+//! through `webrtc_register_encoder_backend`, typically hardware encoders
+//! (NVENC, VAAPI, VideoToolbox) for H.264 and H.265, and select one by name
+//! with `encoder.backend` in `config_json`.
+
+use std::collections::HashMap;
+use std::os::raw::{c_int, c_void};
+use std::sync::Mutex;
+
+use bytes::Bytes;
+
+use super::config::Codec;
+use super::video_frame::{webrtc_video_frame_t, I420Image, WEBRTC_FRAME_FLAG_KEYFRAME, WEBRTC_PIXEL_FORMAT_I420};
+use super::vpx_encoder::VpxEncoder;
+
+/// The built-in backend's name in `encoder.backend`.
+pub(crate) const LIBVPX: &str = "libvpx";
+
+pub const WEBRTC_CODEC_VP8: c_int = 0;
+pub const WEBRTC_CODEC_VP9: c_int = 1;
+pub const WEBRTC_CODEC_H264: c_int = 2;
+pub const WEBRTC_CODEC_H265: c_int = 3;
+
+/// Encoder settings handed to a registered backend's `create`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct webrtc_encoder_params_t {
+    pub codec: c_int,
+    pub width: u32,
+    pub height: u32,
+    pub bitrate_kbps: u32,
+    pub max_bitrate_kbps: u32,
+    /// 0 leaves keyframe placement to the encoder.
+    pub keyframe_interval: u32,
+    pub threads: u32,
+}
+
+/// Receives one encoded frame; `data` is only valid during the call.
+pub type WebrtcEncodedOutputT = extern "C" fn(data: *const u8, len: usize, output_context: *mut c_void);
+
+pub type WebrtcEncoderCreateT = extern "C" fn(params: *const webrtc_encoder_params_t, user_data: *mut c_void) -> *mut c_void;
+pub type WebrtcEncoderEncodeT = extern "C" fn(
+    encoder: *mut c_void,
+    frame: *const webrtc_video_frame_t,
+    output: WebrtcEncodedOutputT,
+    output_context: *mut c_void,
+) -> c_int;
+pub type WebrtcEncoderSetBitrateT = extern "C" fn(encoder: *mut c_void, bitrate_kbps: u32) -> c_int;
+pub type WebrtcEncoderDestroyT = extern "C" fn(encoder: *mut c_void);
+
+#[repr(C)]
+pub struct webrtc_encoder_backend_t {
+    pub create: Option<WebrtcEncoderCreateT>,
+    pub encode: Option<WebrtcEncoderEncodeT>,
+    pub set_bitrate: Option<WebrtcEncoderSetBitrateT>,
+    pub destroy: Option<WebrtcEncoderDestroyT>,
+    pub user_data: *mut c_void,
+}
+
+/// A registered backend, with the user data pointer kept as an address.
+#[derive(Clone, Copy)]
+struct Backend {
+    create: WebrtcEncoderCreateT,
+    encode: WebrtcEncoderEncodeT,
+    set_bitrate: Option<WebrtcEncoderSetBitrateT>,
+    destroy: WebrtcEncoderDestroyT,
+    user_data: usize,
+}
+
+lazy_static! {
+    static ref BACKENDS: Mutex<HashMap<String, Backend>> = Mutex::new(HashMap::new());
+}
+
+/// Adds or replaces the backend called `name`.
+pub(crate) fn register(name: &str, backend: &webrtc_encoder_backend_t) -> Result<(), String> {
+    if name.is_empty() || name == LIBVPX {
+        return Err(format!("\"{}\" cannot be registered", name));
+    }
+    let backend = match (backend.create, backend.encode, backend.destroy) {
+        (Some(create), Some(encode), Some(destroy)) => Backend {
+            create,
+            encode,
+            set_bitrate: backend.set_bitrate,
+            destroy,
+            user_data: backend.user_data as usize,
+        },
+        _ => return Err("create, encode and destroy are required".to_owned()),
+    };
+    BACKENDS.lock().map_err(|e| e.to_string())?.insert(name.to_owned(), backend);
+    Ok(())
+}
+
+pub(crate) fn is_registered(name: &str) -> bool {
+    name == LIBVPX || BACKENDS.lock().map_or(false, |backends| backends.contains_key(name))
+}
+
+/// What the senders need from an encoder, whichever backend it comes from.
+pub(crate) trait VideoEncoder: Send {
+    /// The frame size the encoder was created for.
+    fn size(&self) -> (u32, u32);
+    fn set_bitrate(&mut self, kbps: u32) -> Result<(), String>;
+    /// Encodes one I420 frame into zero or more packets. `image` may be reused
+    /// once this returns.
+    fn encode(&mut self, pts: i64, image: &I420Image<'_>, force_keyframe: bool) -> Result<Vec<Bytes>, String>;
+}
+
+impl VideoEncoder for VpxEncoder {
+    fn size(&self) -> (u32, u32) {
+        VpxEncoder::size(self)
+    }
+
+    fn set_bitrate(&mut self, kbps: u32) -> Result<(), String> {
+        VpxEncoder::set_bitrate(self, kbps)
+    }
+
+    fn encode(&mut self, pts: i64, image: &I420Image<'_>, force_keyframe: bool) -> Result<Vec<Bytes>, String> {
+        Ok(VpxEncoder::encode(self, pts, image, force_keyframe)?
+            .map(|pkt| Bytes::copy_from_slice(pkt.data))
+            .collect())
+    }
+}
+
+pub(crate) fn codec_id(codec: Codec) -> c_int {
+    match codec {
+        Codec::Vp8 => WEBRTC_CODEC_VP8,
+        Codec::Vp9 => WEBRTC_CODEC_VP9,
+        Codec::H264 => WEBRTC_CODEC_H264,
+        Codec::H265 => WEBRTC_CODEC_H265,
+    }
+}
+
+/// An encoder from a registered backend.
+struct ExternalEncoder {
+    backend: Backend,
+    encoder: *mut c_void,
+    width: u32,
+    height: u32,
+    bitrate_kbps: u32,
+}
+
+// The backend's encoder is only used by one thread at a time, like libvpx's
+unsafe impl Send for ExternalEncoder {}
+
+/// Creates an encoder from the backend called `name`.
+pub(crate) fn create(name: &str, params: &webrtc_encoder_params_t) -> Result<Box<dyn VideoEncoder>, String> {
+    let backend = match BACKENDS.lock().map_err(|e| e.to_string())?.get(name) {
+        Some(backend) => *backend,
+        None => return Err(format!("no encoder backend \"{}\" is registered", name)),
+    };
+    let encoder = (backend.create)(params, backend.user_data as *mut c_void);
+    if encoder.is_null() {
+        return Err(format!("encoder backend \"{}\" could not create an encoder", name));
+    }
+    Ok(Box::new(ExternalEncoder {
+        backend,
+        encoder,
+        width: params.width,
+        height: params.height,
+        bitrate_kbps: params.bitrate_kbps,
+    }))
+}
+
+extern "C" fn collect_packet(data: *const u8, len: usize, output_context: *mut c_void) {
+    if data.is_null() || len == 0 {
+        return;
+    }
+    let packets = unsafe { &mut *(output_context as *mut Vec<Bytes>) };
+    packets.push(Bytes::copy_from_slice(unsafe { std::slice::from_raw_parts(data, len) }));
+}
+
+impl VideoEncoder for ExternalEncoder {
+    fn size(&self) -> (u32, u32) {
+        (self.width, self.height)
+    }
+
+    fn set_bitrate(&mut self, kbps: u32) -> Result<(), String> {
+        if kbps == self.bitrate_kbps {
+            return Ok(());
+        }
+        // Without set_bitrate the backend keeps the rate it was created with
+        let Some(set_bitrate) = self.backend.set_bitrate else {
+            return Err(format!("backend's bitrate is fixed at {} kbps", self.bitrate_kbps));
+        };
+        if set_bitrate(self.encoder, kbps) != 0 {
+            return Err("backend rejected the bitrate".to_owned());
+        }
+        self.bitrate_kbps = kbps;
+        Ok(())
+    }
+
+    fn encode(&mut self, pts: i64, image: &I420Image<'_>, force_keyframe: bool) -> Result<Vec<Bytes>, String> {
+        if image.width != self.width || image.height != self.height {
+            return Err(format!(
+                "frame is {}x{}, encoder is {}x{}",
+                image.width, image.height, self.width, self.height
+            ));
+        }
+        // The caller's planes are passed on as they are; strides included
+        let frame = webrtc_video_frame_t {
+            format: WEBRTC_PIXEL_FORMAT_I420,
+            width: image.width as c_int,
+            height: image.height as c_int,
+            planes: [image.planes[0].as_ptr(), image.planes[1].as_ptr(), image.planes[2].as_ptr()],
+            strides: [image.strides[0] as c_int, image.strides[1] as c_int, image.strides[2] as c_int],
+            timestamp_us: pts,
+            flags: if force_keyframe { WEBRTC_FRAME_FLAG_KEYFRAME } else { 0 },
+            release: None,
+            release_user_data: std::ptr::null_mut(),
+        };
+        let mut packets: Vec<Bytes> = Vec::new();
+        let status = (self.backend.encode)(self.encoder, &frame, collect_packet, &mut packets as *mut Vec<Bytes> as *mut c_void);
+        if status != 0 {
+            return Err(format!("backend encode failed with {}", status));
+        }
+        Ok(packets)
+    }
+}
+
+impl Drop for ExternalEncoder {
+    fn drop(&mut self) {
+        (self.backend.destroy)(self.encoder);
+    }
+}
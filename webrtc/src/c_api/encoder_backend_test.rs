@@ -0,0 +1,120 @@
+use std::os::raw::{c_int, c_void};
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use super::config::*;
+use super::encoder_backend::*;
+use super::video_frame::{webrtc_video_frame_t, I420Image, WEBRTC_FRAME_FLAG_KEYFRAME};
+
+static DESTROYED: AtomicUsize = AtomicUsize::new(0);
+
+struct FakeEncoder {
+    params: webrtc_encoder_params_t,
+    frames: u8,
+}
+
+extern "C" fn fake_create(params: *const webrtc_encoder_params_t, user_data: *mut c_void) -> *mut c_void {
+    assert_eq!(user_data as usize, 42);
+    let params = unsafe { *params };
+    Box::into_raw(Box::new(FakeEncoder { params, frames: 0 })) as *mut c_void
+}
+
+// Emits [frame count, keyframe flag, first luma byte, luma stride]
+extern "C" fn fake_encode(
+    encoder: *mut c_void,
+    frame: *const webrtc_video_frame_t,
+    output: WebrtcEncodedOutputT,
+    output_context: *mut c_void,
+) -> c_int {
+    let encoder = unsafe { &mut *(encoder as *mut FakeEncoder) };
+    let frame = unsafe { &*frame };
+    assert_eq!((frame.width as u32, frame.height as u32), (encoder.params.width, encoder.params.height));
+    encoder.frames += 1;
+    let packet = [
+        encoder.frames,
+        (frame.flags & WEBRTC_FRAME_FLAG_KEYFRAME) as u8,
+        unsafe { *frame.planes[0] },
+        frame.strides[0] as u8,
+    ];
+    output(packet.as_ptr(), packet.len(), output_context);
+    0
+}
+
+extern "C" fn fake_destroy(encoder: *mut c_void) {
+    drop(unsafe { Box::from_raw(encoder as *mut FakeEncoder) });
+    DESTROYED.fetch_add(1, Ordering::SeqCst);
+}
+
+fn fake_backend() -> webrtc_encoder_backend_t {
+    webrtc_encoder_backend_t {
+        create: Some(fake_create),
+        encode: Some(fake_encode),
+        set_bitrate: None,
+        destroy: Some(fake_destroy),
+        user_data: 42 as *mut c_void,
+    }
+}
+
+#[test]
+fn test_registered_backend_encodes_caller_planes() {
+    register("fake", &fake_backend()).unwrap();
+    let params = webrtc_encoder_params_t {
+        codec: WEBRTC_CODEC_H264,
+        width: 4,
+        height: 2,
+        bitrate_kbps: 1000,
+        max_bitrate_kbps: 1000,
+        keyframe_interval: 0,
+        threads: 1,
+    };
+    let mut encoder = create("fake", &params).unwrap();
+    assert_eq!(encoder.size(), (4, 2));
+    // Without set_bitrate the rate is fixed at creation
+    assert!(encoder.set_bitrate(1000).is_ok());
+    assert!(encoder.set_bitrate(500).is_err());
+
+    let y = [7u8; 16];
+    let uv = [128u8; 4];
+    let image = I420Image {
+        width: 4,
+        height: 2,
+        planes: [&y, &uv, &uv],
+        strides: [8, 2, 2],
+    };
+    let packets = encoder.encode(0, &image, true).unwrap();
+    assert_eq!(&packets[0][..], &[1, 1, 7, 8]);
+    let packets = encoder.encode(33_000, &image, false).unwrap();
+    assert_eq!(&packets[0][..], &[2, 0, 7, 8]);
+
+    let wrong_size = I420Image { width: 2, ..image };
+    assert!(encoder.encode(66_000, &wrong_size, false).is_err());
+
+    let destroyed = DESTROYED.load(Ordering::SeqCst);
+    drop(encoder);
+    assert_eq!(DESTROYED.load(Ordering::SeqCst), destroyed + 1);
+}
+
+#[test]
+fn test_backend_registration_is_checked() {
+    assert!(register(LIBVPX, &fake_backend()).is_err());
+    let incomplete = webrtc_encoder_backend_t {
+        encode: None,
+        ..fake_backend()
+    };
+    assert!(register("incomplete", &incomplete).is_err());
+    assert!(create("missing", &unsafe { std::mem::zeroed() }).is_err());
+}
+
+#[test]
+fn test_config_selects_backend() {
+    register("fake-h264", &fake_backend()).unwrap();
+    let config = SessionConfig::parse(r#"{"encoder": {"backend": "fake-h264", "codec": "h264"}}"#).unwrap();
+    assert!(!config.encoder.is_libvpx());
+    assert_eq!(config.encoder.codec.mime_type(), "video/H264");
+    let config = SessionConfig::parse(r#"{"encoder": {"backend": "fake-h264", "codec": "h265"}}"#).unwrap();
+    assert_eq!(config.encoder.codec.mime_type(), "video/HEVC");
+    // libvpx-only settings do not apply to other backends
+    assert!(SessionConfig::parse(r#"{"encoder": {"backend": "fake-h264", "cpu_used": 99}}"#).is_ok());
+
+    assert!(SessionConfig::parse(r#"{"encoder": {"backend": "nvenc-missing"}}"#).is_err());
+    assert!(SessionConfig::parse(r#"{"encoder": {"codec": "h265"}}"#).is_err());
+}
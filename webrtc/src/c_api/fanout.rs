@@ -0,0 +1,114 @@
+//! `webrtc_fanout_t`: one encoder and one track shared by many sessions, for
+//! broadcast-style viewing. The track is bound to every session's peer
+//! connection, so each frame is encoded and packetized once and only the RTP
+//! header is rewritten per viewer; the payload `Bytes` are shared. Viewers'
+//! PLI and FIR requests are coalesced into at most one keyframe per interval.
+
+use std::sync::atomic::{AtomicBool, AtomicI64, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
+
+use super::config::{Codec, FanOutConfig};
+use super::context::SharedContext;
+use super::video_sender::{FrameCounters, TrackWriter, VideoSender};
+use crate::rtp_transceiver::rtp_codec::RTCRtpCodecCapability;
+use crate::track::track_local::track_local_static_sample::TrackLocalStaticSample;
+
+/// Keyframe requests from any number of viewers, answered by one encoder.
+pub(crate) struct KeyframeRequests {
+    min_interval_us: i64,
+    pending: AtomicBool,
+    /// On the library clock; `i64::MIN` before the first keyframe.
+    last_keyframe_us: AtomicI64,
+    pub requested: AtomicU64,
+    /// Keyframes encoded because of a request.
+    pub answered: AtomicU64,
+}
+
+impl KeyframeRequests {
+    pub(crate) fn new(min_interval: Duration) -> Self {
+        KeyframeRequests {
+            min_interval_us: min_interval.as_micros() as i64,
+            pending: AtomicBool::new(false),
+            last_keyframe_us: AtomicI64::new(i64::MIN),
+            requested: AtomicU64::new(0),
+            answered: AtomicU64::new(0),
+        }
+    }
+
+    pub(crate) fn request(&self) {
+        self.requested.fetch_add(1, Ordering::Relaxed);
+        self.pending.store(true, Ordering::Release);
+    }
+
+    /// Whether the frame encoded at `now_us` is to be a keyframe. A `forced`
+    /// one satisfies every request made so far; otherwise a pending request is
+    /// answered once `min_interval` has passed since the last keyframe.
+    pub(crate) fn next_is_keyframe(&self, now_us: i64, forced: bool) -> bool {
+        if forced {
+            self.pending.store(false, Ordering::Release);
+        } else {
+            let last = self.last_keyframe_us.load(Ordering::Relaxed);
+            if last != i64::MIN && now_us - last < self.min_interval_us {
+                return false;
+            }
+            if !self.pending.swap(false, Ordering::AcqRel) {
+                return false;
+            }
+            self.answered.fetch_add(1, Ordering::Relaxed);
+        }
+        self.last_keyframe_us.store(now_us, Ordering::Relaxed);
+        true
+    }
+}
+
+pub(crate) struct FanOut {
+    pub video_track: Arc<TrackLocalStaticSample>,
+    pub codec: Codec,
+    pub configured_bitrate_kbps: u32,
+    pub abs_capture_time: bool,
+    pub repeat_frames: bool,
+    pub sender: Arc<Mutex<VideoSender>>,
+    pub counters: Arc<FrameCounters>,
+    pub keyframes: Arc<KeyframeRequests>,
+    /// Sessions created from this fan-out that have not been destroyed yet.
+    pub viewers: AtomicUsize,
+    // Declared last: the sender spawns its writes on the context's runtime.
+    pub context: Arc<SharedContext>,
+}
+
+impl FanOut {
+    pub(crate) fn new(context: Arc<SharedContext>, config: &FanOutConfig) -> Self {
+        let video_track = Arc::new(TrackLocalStaticSample::new(
+            RTCRtpCodecCapability {
+                mime_type: config.encoder.codec.mime_type().to_owned(),
+                ..Default::default()
+            },
+            "video".to_owned(),
+            "webrtc-rs".to_owned(),
+        ));
+        let counters = Arc::new(FrameCounters::default());
+        let keyframes = Arc::new(KeyframeRequests::new(Duration::from_millis(config.keyframe_min_interval_ms as u64)));
+        let mut sender = VideoSender::new(
+            Arc::new(TrackWriter::new(Arc::clone(&video_track), context.handle())),
+            Arc::clone(&counters),
+            config.encoder.clone(),
+            None,
+            config.repeat_frames,
+            config.abs_capture_time,
+        );
+        sender.set_keyframe_requests(Arc::clone(&keyframes));
+        FanOut {
+            video_track,
+            codec: config.encoder.codec,
+            configured_bitrate_kbps: config.encoder.bitrate_kbps,
+            abs_capture_time: config.abs_capture_time,
+            repeat_frames: config.repeat_frames,
+            sender: Arc::new(Mutex::new(sender)),
+            counters,
+            keyframes,
+            viewers: AtomicUsize::new(0),
+            context,
+        }
+    }
+}
@@ -0,0 +1,40 @@
+use std::sync::atomic::Ordering;
+use std::time::Duration;
+
+use super::fanout::*;
+
+#[test]
+fn test_requests_coalesce_into_one_keyframe() {
+    let requests = KeyframeRequests::new(Duration::from_millis(300));
+    assert!(!requests.next_is_keyframe(0, false));
+    for _ in 0..20 {
+        requests.request();
+    }
+    assert!(requests.next_is_keyframe(1_000, false));
+    assert!(!requests.next_is_keyframe(34_000, false));
+    assert_eq!(requests.requested.load(Ordering::Relaxed), 20);
+    assert_eq!(requests.answered.load(Ordering::Relaxed), 1);
+}
+
+#[test]
+fn test_requests_wait_for_min_interval() {
+    let requests = KeyframeRequests::new(Duration::from_millis(300));
+    requests.request();
+    assert!(requests.next_is_keyframe(0, false));
+    requests.request();
+    assert!(!requests.next_is_keyframe(100_000, false));
+    assert!(!requests.next_is_keyframe(299_999, false));
+    // Still pending, so answered once the interval is over
+    assert!(requests.next_is_keyframe(300_000, false));
+}
+
+#[test]
+fn test_forced_keyframe_satisfies_pending_requests() {
+    let requests = KeyframeRequests::new(Duration::from_millis(300));
+    requests.request();
+    assert!(requests.next_is_keyframe(0, true));
+    assert!(!requests.next_is_keyframe(1_000_000, false));
+    assert_eq!(requests.answered.load(Ordering::Relaxed), 0);
+    // A forced keyframe is never held back
+    assert!(requests.next_is_keyframe(1_000, true));
+}
@@ -0,0 +1,235 @@
+//! Binary input events from the "input" data channel. Each message carries one
+//! or more fixed-size little-endian records, which are decoded straight into a
+//! bounded lock-free ring; the application drains it in batches with
+//! `webrtc_session_poll_input`, typically once per rendered frame.
+
+use std::cell::UnsafeCell;
+use std::os::raw::c_void;
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+pub const WEBRTC_INPUT_POINTER_MOVE: u8 = 1;
+pub const WEBRTC_INPUT_POINTER_DOWN: u8 = 2;
+pub const WEBRTC_INPUT_POINTER_UP: u8 = 3;
+pub const WEBRTC_INPUT_WHEEL: u8 = 4;
+pub const WEBRTC_INPUT_KEY_DOWN: u8 = 5;
+pub const WEBRTC_INPUT_KEY_UP: u8 = 6;
+
+pub const WEBRTC_INPUT_POLL_COALESCE_MOVES: u32 = 1 << 0;
+
+/// Size of one event on the wire.
+pub(crate) const WIRE_EVENT_SIZE: usize = 32;
+
+/// Default ring capacity: several seconds of 1 kHz pointer input.
+pub(crate) const INPUT_QUEUE_CAPACITY: usize = 4096;
+
+/// Mirrors `webrtc_input_event_t` in webrtc_c_api.h.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct webrtc_input_event_t {
+    pub kind: u8,
+    pub button: u8,
+    pub buttons: u8,
+    pub modifiers: u8,
+    pub key: u32,
+    pub x: f32,
+    pub y: f32,
+    pub delta_x: f32,
+    pub delta_y: f32,
+    pub timestamp_us: i64,
+    pub received_us: i64,
+}
+
+pub type WebrtcInputReadyCallbackT = extern "C" fn(user_data: *mut c_void);
+
+/// Decodes one wire record; None if the type is unknown.
+///
+/// Layout: u8 type, u8 button, u8 buttons, u8 modifiers, u32 key, f32 x, f32 y,
+/// f32 delta_x, f32 delta_y, f64 timestamp in milliseconds.
+pub(crate) fn decode_event(record: &[u8; WIRE_EVENT_SIZE], received_us: i64) -> Option<webrtc_input_event_t> {
+    let kind = record[0];
+    if !(WEBRTC_INPUT_POINTER_MOVE..=WEBRTC_INPUT_KEY_UP).contains(&kind) {
+        return None;
+    }
+    let u32_at = |i: usize| u32::from_le_bytes([record[i], record[i + 1], record[i + 2], record[i + 3]]);
+    let f32_at = |i: usize| f32::from_bits(u32_at(i));
+    let mut timestamp_ms = [0u8; 8];
+    timestamp_ms.copy_from_slice(&record[24..32]);
+    Some(webrtc_input_event_t {
+        kind,
+        button: record[1],
+        buttons: record[2],
+        modifiers: record[3],
+        key: u32_at(4),
+        x: f32_at(8),
+        y: f32_at(12),
+        delta_x: f32_at(16),
+        delta_y: f32_at(20),
+        timestamp_us: (f64::from_le_bytes(timestamp_ms) * 1000.0) as i64,
+        received_us,
+    })
+}
+
+struct Slot {
+    /// Vyukov sequence: equals the position when free, position + 1 when full.
+    seq: AtomicUsize,
+    event: UnsafeCell<webrtc_input_event_t>,
+}
+
+/// Bounded multi-producer, multi-consumer ring of input events. Pushing and
+/// popping take no locks and allocate nothing; when the ring is full new
+/// events are dropped and counted.
+pub(crate) struct InputQueue {
+    slots: Box<[Slot]>,
+    mask: usize,
+    head: AtomicUsize,
+    tail: AtomicUsize,
+    dropped: AtomicU64,
+    /// Set by producers, cleared by the consumer: the ready callback runs once
+    /// per drain rather than once per message.
+    pending: AtomicBool,
+    ready_callback: Mutex<Option<(WebrtcInputReadyCallbackT, usize)>>,
+}
+
+// Slots are only accessed by the thread that won them through the sequence numbers.
+unsafe impl Send for InputQueue {}
+unsafe impl Sync for InputQueue {}
+
+impl InputQueue {
+    /// `capacity` is rounded up to a power of two.
+    pub(crate) fn new(capacity: usize) -> Self {
+        let capacity = capacity.max(2).next_power_of_two();
+        let slots = (0..capacity)
+            .map(|i| Slot {
+                seq: AtomicUsize::new(i),
+                event: UnsafeCell::new(webrtc_input_event_t::default()),
+            })
+            .collect();
+        InputQueue {
+            slots,
+            mask: capacity - 1,
+            head: AtomicUsize::new(0),
+            tail: AtomicUsize::new(0),
+            dropped: AtomicU64::new(0),
+            pending: AtomicBool::new(false),
+            ready_callback: Mutex::new(None),
+        }
+    }
+
+    pub(crate) fn set_ready_callback(&self, callback: Option<WebrtcInputReadyCallbackT>, user_data: *mut c_void) {
+        *self.ready_callback.lock().unwrap() = callback.map(|cb| (cb, user_data as usize));
+    }
+
+    /// Events dropped because the ring was full.
+    pub(crate) fn dropped(&self) -> u64 {
+        self.dropped.load(Ordering::Relaxed)
+    }
+
+    pub(crate) fn push(&self, event: webrtc_input_event_t) -> bool {
+        let mut pos = self.head.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let seq = slot.seq.load(Ordering::Acquire);
+            let diff = seq.wrapping_sub(pos) as isize;
+            if diff == 0 {
+                match self
+                    .head
+                    .compare_exchange_weak(pos, pos.wrapping_add(1), Ordering::Relaxed, Ordering::Relaxed)
+                {
+                    Ok(_) => {
+                        unsafe { *slot.event.get() = event };
+                        slot.seq.store(pos.wrapping_add(1), Ordering::Release);
+                        return true;
+                    }
+                    Err(current) => pos = current,
+                }
+            } else if diff < 0 {
+                self.dropped.fetch_add(1, Ordering::Relaxed);
+                return false;
+            } else {
+                pos = self.head.load(Ordering::Relaxed);
+            }
+        }
+    }
+
+    pub(crate) fn pop(&self) -> Option<webrtc_input_event_t> {
+        let mut pos = self.tail.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let seq = slot.seq.load(Ordering::Acquire);
+            let diff = seq.wrapping_sub(pos.wrapping_add(1)) as isize;
+            if diff == 0 {
+                match self
+                    .tail
+                    .compare_exchange_weak(pos, pos.wrapping_add(1), Ordering::Relaxed, Ordering::Relaxed)
+                {
+                    Ok(_) => {
+                        let event = unsafe { *slot.event.get() };
+                        slot.seq.store(pos.wrapping_add(self.mask + 1), Ordering::Release);
+                        return Some(event);
+                    }
+                    Err(current) => pos = current,
+                }
+            } else if diff < 0 {
+                return None;
+            } else {
+                pos = self.tail.load(Ordering::Relaxed);
+            }
+        }
+    }
+
+    /// Queues every record of a data channel message, then runs the ready
+    /// callback if the consumer has drained since the last one. Returns the
+    /// number of events queued, or an error if the message is not a whole
+    /// number of records.
+    pub(crate) fn push_message(&self, data: &[u8], received_us: i64) -> Result<usize, String> {
+        if data.is_empty() || data.len() % WIRE_EVENT_SIZE != 0 {
+            return Err(format!("{} bytes is not a whole number of input events", data.len()));
+        }
+        let mut queued = 0;
+        for chunk in data.chunks_exact(WIRE_EVENT_SIZE) {
+            let record: &[u8; WIRE_EVENT_SIZE] = chunk.try_into().unwrap();
+            if let Some(event) = decode_event(record, received_us) {
+                if self.push(event) {
+                    queued += 1;
+                }
+            }
+        }
+        if queued > 0 && !self.pending.swap(true, Ordering::AcqRel) {
+            // Called without the lock, so the callback may replace itself
+            let callback = *self.ready_callback.lock().unwrap();
+            if let Some((cb, user_data)) = callback {
+                cb(user_data as *mut c_void);
+            }
+        }
+        Ok(queued)
+    }
+
+    /// Moves up to `out.len()` events into `out` and returns how many. With
+    /// `coalesce_moves`, a run of pointer moves with the same buttons and
+    /// modifiers becomes its last move, keeping the first one's received_us.
+    pub(crate) fn drain(&self, out: &mut [webrtc_input_event_t], coalesce_moves: bool) -> usize {
+        // Cleared first, so events queued from here on trigger the callback again
+        self.pending.store(false, Ordering::Release);
+        let mut n = 0;
+        while n < out.len() {
+            let Some(event) = self.pop() else { break };
+            if coalesce_moves && n > 0 && is_same_move(&out[n - 1], &event) {
+                let received_us = out[n - 1].received_us;
+                out[n - 1] = event;
+                out[n - 1].received_us = received_us;
+                continue;
+            }
+            out[n] = event;
+            n += 1;
+        }
+        n
+    }
+}
+
+fn is_same_move(a: &webrtc_input_event_t, b: &webrtc_input_event_t) -> bool {
+    a.kind == WEBRTC_INPUT_POINTER_MOVE
+        && b.kind == WEBRTC_INPUT_POINTER_MOVE
+        && a.buttons == b.buttons
+        && a.modifiers == b.modifiers
+}
@@ -0,0 +1,115 @@
+use super::input::*;
+
+fn record(kind: u8, buttons: u8, x: f32, y: f32, timestamp_ms: f64) -> [u8; WIRE_EVENT_SIZE] {
+    let mut r = [0u8; WIRE_EVENT_SIZE];
+    r[0] = kind;
+    r[2] = buttons;
+    r[4..8].copy_from_slice(&u32::from(b'r').to_le_bytes());
+    r[8..12].copy_from_slice(&x.to_le_bytes());
+    r[12..16].copy_from_slice(&y.to_le_bytes());
+    r[20..24].copy_from_slice(&(-3.0f32).to_le_bytes());
+    r[24..32].copy_from_slice(&timestamp_ms.to_le_bytes());
+    r
+}
+
+#[test]
+fn decode_event_reads_wire_layout() {
+    let event = decode_event(&record(WEBRTC_INPUT_WHEEL, 1, 0.25, 0.75, 1.5), 42).unwrap();
+    assert_eq!(event.kind, WEBRTC_INPUT_WHEEL);
+    assert_eq!(event.buttons, 1);
+    assert_eq!(event.key, u32::from(b'r'));
+    assert_eq!((event.x, event.y, event.delta_y), (0.25, 0.75, -3.0));
+    assert_eq!(event.timestamp_us, 1500);
+    assert_eq!(event.received_us, 42);
+
+    assert!(decode_event(&record(0, 0, 0.0, 0.0, 0.0), 0).is_none());
+    assert!(decode_event(&record(7, 0, 0.0, 0.0, 0.0), 0).is_none());
+}
+
+#[test]
+fn push_message_rejects_partial_records() {
+    let queue = InputQueue::new(8);
+    assert!(queue.push_message(&[], 0).is_err());
+    assert!(queue.push_message(&[1u8; WIRE_EVENT_SIZE + 1], 0).is_err());
+    assert!(queue.pop().is_none());
+
+    let mut message = record(WEBRTC_INPUT_POINTER_DOWN, 1, 0.5, 0.5, 0.0).to_vec();
+    message.extend_from_slice(&record(9, 0, 0.0, 0.0, 0.0));
+    assert_eq!(queue.push_message(&message, 0), Ok(1));
+}
+
+#[test]
+fn full_queue_drops_newest() {
+    let queue = InputQueue::new(4);
+    for i in 0..6 {
+        queue.push(decode_event(&record(WEBRTC_INPUT_KEY_DOWN, 0, i as f32, 0.0, 0.0), 0).unwrap());
+    }
+    assert_eq!(queue.dropped(), 2);
+    let mut out = [webrtc_input_event_t::default(); 8];
+    assert_eq!(queue.drain(&mut out, false), 4);
+    assert_eq!(out[3].x, 3.0);
+    // Slots are reusable once drained
+    assert!(queue.push(out[0]));
+    assert_eq!(queue.drain(&mut out, false), 1);
+}
+
+#[test]
+fn drain_coalesces_runs_of_moves() {
+    let queue = InputQueue::new(16);
+    let moves = [
+        (WEBRTC_INPUT_POINTER_MOVE, 0, 0.1, 1),
+        (WEBRTC_INPUT_POINTER_MOVE, 0, 0.2, 2),
+        (WEBRTC_INPUT_POINTER_DOWN, 1, 0.2, 3),
+        (WEBRTC_INPUT_POINTER_MOVE, 1, 0.3, 4),
+        (WEBRTC_INPUT_POINTER_MOVE, 1, 0.4, 5),
+        (WEBRTC_INPUT_POINTER_MOVE, 1, 0.5, 6),
+    ];
+    for &(kind, buttons, x, received_us) in &moves {
+        queue.push(decode_event(&record(kind, buttons, x, 0.0, 0.0), received_us).unwrap());
+    }
+    let mut out = [webrtc_input_event_t::default(); 8];
+    assert_eq!(queue.drain(&mut out, true), 3);
+    assert_eq!((out[0].x, out[0].received_us), (0.2, 1));
+    assert_eq!(out[1].kind, WEBRTC_INPUT_POINTER_DOWN);
+    assert_eq!((out[2].x, out[2].received_us), (0.5, 4));
+}
+
+#[test]
+fn ready_callback_runs_once_per_drain() {
+    use std::os::raw::c_void;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    extern "C" fn on_ready(user_data: *mut c_void) {
+        unsafe { &*(user_data as *const AtomicUsize) }.fetch_add(1, Ordering::Relaxed);
+    }
+
+    let calls = AtomicUsize::new(0);
+    let queue = InputQueue::new(16);
+    queue.set_ready_callback(Some(on_ready), &calls as *const AtomicUsize as *mut c_void);
+    let message = record(WEBRTC_INPUT_POINTER_MOVE, 0, 0.0, 0.0, 0.0);
+    queue.push_message(&message, 0).unwrap();
+    queue.push_message(&message, 0).unwrap();
+    assert_eq!(calls.load(Ordering::Relaxed), 1);
+
+    let mut out = [webrtc_input_event_t::default(); 4];
+    queue.drain(&mut out, false);
+    queue.push_message(&message, 0).unwrap();
+    assert_eq!(calls.load(Ordering::Relaxed), 2);
+}
+
+#[test]
+fn ready_callback_may_unregister_itself() {
+    use std::os::raw::c_void;
+
+    extern "C" fn unregister(user_data: *mut c_void) {
+        unsafe { &*(user_data as *const InputQueue) }.set_ready_callback(None, std::ptr::null_mut());
+    }
+
+    let queue = InputQueue::new(16);
+    queue.set_ready_callback(Some(unregister), &queue as *const InputQueue as *mut c_void);
+    let message = record(WEBRTC_INPUT_POINTER_MOVE, 0, 0.0, 0.0, 0.0);
+    queue.push_message(&message, 0).unwrap();
+    let mut out = [webrtc_input_event_t::default(); 4];
+    assert_eq!(queue.drain(&mut out, false), 1);
+    queue.push_message(&message, 0).unwrap();
+}
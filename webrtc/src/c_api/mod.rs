@@ -0,0 +1,50 @@
+//! Support code for the C API exported from the crate root: session and
+//! context config, the shared context runtime and its warm peer connections,
+//! frame descriptors and pixel format conversion, the libvpx encoder,
+//! registered encoder backends and the optional encoder thread, RTCP-driven
+//! adaptive bitrate, session stats, typed signalling, completion callbacks
+//! for the non-blocking calls, the binary input event queue, the capture
+//! clock behind abs-capture-time, simulcast layers forwarded to many
+//! sessions, and one encoded stream fanned out to many sessions.
+
+#[cfg(test)]
+mod bandwidth_test;
+#[cfg(test)]
+mod capture_time_test;
+#[cfg(test)]
+mod completion_test;
+#[cfg(test)]
+mod config_test;
+#[cfg(test)]
+mod connection_pool_test;
+#[cfg(test)]
+mod encoder_backend_test;
+#[cfg(test)]
+mod fanout_test;
+#[cfg(test)]
+mod input_test;
+#[cfg(test)]
+mod session_stats_test;
+#[cfg(test)]
+mod signal_test;
+#[cfg(test)]
+mod simulcast_test;
+#[cfg(test)]
+mod video_frame_test;
+
+pub(crate) mod bandwidth;
+pub(crate) mod capture_time;
+pub(crate) mod completion;
+pub(crate) mod config;
+pub(crate) mod connection_pool;
+pub(crate) mod context;
+pub(crate) mod encode_queue;
+pub(crate) mod encoder_backend;
+pub(crate) mod fanout;
+pub(crate) mod input;
+pub(crate) mod session_stats;
+pub(crate) mod signal;
+pub(crate) mod simulcast;
+pub(crate) mod video_frame;
+pub(crate) mod video_sender;
+pub(crate) mod vpx_encoder;
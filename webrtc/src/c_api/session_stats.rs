@@ -0,0 +1,171 @@
+//! Measurements behind `webrtc_session_get_stats`. The frame path only touches
+//! atomics, and transport figures are collected by a background task, so
+//! reading the stats never waits on the encoder or builds a report.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use crate::peer_connection::RTCPeerConnection;
+use crate::stats::StatsReportType;
+
+/// How often the transport stats are refreshed from the peer connection.
+pub(crate) const TRANSPORT_STATS_INTERVAL: Duration = Duration::from_secs(1);
+
+/// Sub-buckets per power of two; bounds the percentile error to about 9%.
+const SUB_BUCKETS: usize = 8;
+/// Exact below 8 us, then `SUB_BUCKETS` per octave up to 2^26 us (67 s); longer
+/// samples land in the last bucket.
+const BUCKETS: usize = 24 * SUB_BUCKETS;
+
+/// Log-linear histogram of durations in microseconds. `record` may be called
+/// from any thread; `take` is meant for a single reader.
+pub(crate) struct LatencyHistogram {
+    buckets: [AtomicU64; BUCKETS],
+    max_us: AtomicU64,
+}
+
+/// Percentiles of the samples recorded since the previous `take`.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub(crate) struct LatencySummary {
+    pub count: u64,
+    pub p50_us: u64,
+    pub p99_us: u64,
+    pub max_us: u64,
+}
+
+impl Default for LatencyHistogram {
+    fn default() -> Self {
+        LatencyHistogram {
+            buckets: std::array::from_fn(|_| AtomicU64::new(0)),
+            max_us: AtomicU64::new(0),
+        }
+    }
+}
+
+fn bucket_index(us: u64) -> usize {
+    if us < SUB_BUCKETS as u64 {
+        return us as usize;
+    }
+    let octave = 63 - us.leading_zeros() as usize;
+    let sub = (us >> (octave - 3)) as usize & (SUB_BUCKETS - 1);
+    ((octave - 2) * SUB_BUCKETS + sub).min(BUCKETS - 1)
+}
+
+/// Smallest value that falls into bucket `index`.
+fn bucket_floor(index: usize) -> u64 {
+    if index < SUB_BUCKETS {
+        return index as u64;
+    }
+    let octave = index / SUB_BUCKETS + 2;
+    let sub = (index % SUB_BUCKETS) as u64;
+    (SUB_BUCKETS as u64 + sub) << (octave - 3)
+}
+
+impl LatencyHistogram {
+    pub(crate) fn record(&self, duration: Duration) {
+        let us = duration.as_micros().min(u64::MAX as u128) as u64;
+        self.buckets[bucket_index(us)].fetch_add(1, Ordering::Relaxed);
+        self.max_us.fetch_max(us, Ordering::Relaxed);
+    }
+
+    /// Summarizes and clears the histogram. Percentiles are bucket floors.
+    pub(crate) fn take(&self) -> LatencySummary {
+        let mut counts = [0u64; BUCKETS];
+        for (count, bucket) in counts.iter_mut().zip(&self.buckets) {
+            *count = bucket.swap(0, Ordering::Relaxed);
+        }
+        let max_us = self.max_us.swap(0, Ordering::Relaxed);
+        let total: u64 = counts.iter().sum();
+        if total == 0 {
+            return LatencySummary::default();
+        }
+        let percentile = |p: f64| {
+            let rank = ((total as f64 * p).ceil() as u64).max(1);
+            let mut seen = 0;
+            for (i, &count) in counts.iter().enumerate() {
+                seen += count;
+                if seen >= rank {
+                    return bucket_floor(i).min(max_us);
+                }
+            }
+            max_us
+        };
+        LatencySummary {
+            count: total,
+            p50_us: percentile(0.50),
+            p99_us: percentile(0.99),
+            max_us,
+        }
+    }
+}
+
+/// Outbound RTP and round-trip figures from the peer connection's stats report.
+#[derive(Debug, Default, Clone, Copy)]
+pub(crate) struct TransportStats {
+    pub bytes_sent: u64,
+    pub packets_sent: u64,
+    /// Over the last refresh interval.
+    pub send_bitrate_kbps: u32,
+    /// None until a receiver report answers one of the sender reports.
+    pub rtt_ms: Option<f64>,
+    pub nack_count: u64,
+    pub pli_count: u64,
+    pub fir_count: u64,
+}
+
+impl TransportStats {
+    pub(crate) fn from_report<'a>(reports: impl Iterator<Item = &'a StatsReportType>) -> Self {
+        let mut stats = TransportStats::default();
+        for report in reports {
+            match report {
+                StatsReportType::OutboundRTP(rtp) if rtp.kind == "video" => {
+                    stats.bytes_sent += rtp.bytes_sent;
+                    stats.packets_sent += rtp.packets_sent;
+                    stats.nack_count += rtp.nack_count;
+                    stats.pli_count += rtp.pli_count.unwrap_or(0);
+                    stats.fir_count += rtp.fir_count.unwrap_or(0);
+                }
+                // The stats interceptor keeps round trips in milliseconds
+                StatsReportType::RemoteInboundRTP(remote) if remote.kind == "video" => {
+                    stats.rtt_ms = remote.round_trip_time.or(stats.rtt_ms);
+                }
+                _ => {}
+            }
+        }
+        stats
+    }
+}
+
+/// Latest `TransportStats`, refreshed by `run_transport_stats_poller`.
+#[derive(Default)]
+pub(crate) struct TransportStatsCache {
+    latest: Mutex<TransportStats>,
+}
+
+impl TransportStatsCache {
+    pub(crate) fn get(&self) -> TransportStats {
+        *self.latest.lock().unwrap()
+    }
+}
+
+/// Collects the peer connection's stats every `TRANSPORT_STATS_INTERVAL`
+/// until the session aborts the task.
+pub(crate) async fn run_transport_stats_poller(pc: Arc<RTCPeerConnection>, cache: Arc<TransportStatsCache>) {
+    let mut interval = tokio::time::interval(TRANSPORT_STATS_INTERVAL);
+    let mut last: Option<(Instant, u64)> = None;
+    loop {
+        interval.tick().await;
+        let report = pc.get_stats().await;
+        let mut stats = TransportStats::from_report(report.reports.values());
+        let now = Instant::now();
+        if let Some((at, bytes)) = last {
+            let secs = now.duration_since(at).as_secs_f64();
+            if secs > 0.0 {
+                stats.send_bitrate_kbps = (stats.bytes_sent.saturating_sub(bytes) as f64 * 8.0 / 1000.0 / secs) as u32;
+            }
+        }
+        last = Some((now, stats.bytes_sent));
+        *cache.latest.lock().unwrap() = stats;
+    }
+}
@@ -0,0 +1,75 @@
+use std::time::Duration;
+
+use tokio::time::Instant;
+
+use super::session_stats::*;
+use crate::stats::{RTCStatsType, RemoteInboundRTPStats, StatsReportType};
+
+#[test]
+fn test_empty_histogram_summary_is_zero() {
+    let histogram = LatencyHistogram::default();
+    assert_eq!(histogram.take(), LatencySummary::default());
+}
+
+#[test]
+fn test_percentiles_are_within_a_bucket() {
+    let histogram = LatencyHistogram::default();
+    // 98 fast frames around 2 ms, two slow ones at 40 ms.
+    for _ in 0..98 {
+        histogram.record(Duration::from_micros(2000));
+    }
+    histogram.record(Duration::from_micros(40_000));
+    histogram.record(Duration::from_micros(40_000));
+    let summary = histogram.take();
+    assert_eq!(summary.count, 100);
+    assert!((1800..=2000).contains(&summary.p50_us), "{:?}", summary);
+    assert!((36_000..=40_000).contains(&summary.p99_us), "{:?}", summary);
+    assert_eq!(summary.max_us, 40_000);
+}
+
+#[test]
+fn test_take_resets() {
+    let histogram = LatencyHistogram::default();
+    histogram.record(Duration::from_micros(5));
+    assert_eq!(
+        histogram.take(),
+        LatencySummary {
+            count: 1,
+            p50_us: 5,
+            p99_us: 5,
+            max_us: 5
+        }
+    );
+    assert_eq!(histogram.take().count, 0);
+    // Beyond the last bucket still counts, capped at the recorded maximum.
+    histogram.record(Duration::from_secs(600));
+    let summary = histogram.take();
+    assert_eq!(summary.max_us, 600_000_000);
+    assert!(summary.p99_us <= summary.max_us);
+}
+
+fn remote_inbound(kind: &str, round_trip_time: Option<f64>) -> StatsReportType {
+    StatsReportType::RemoteInboundRTP(RemoteInboundRTPStats {
+        timestamp: Instant::now(),
+        stats_type: RTCStatsType::RemoteInboundRTP,
+        id: format!("RTCRemoteInboundRTP{}Stream_1", kind),
+        ssrc: 1,
+        kind: kind.to_owned(),
+        packets_received: 100,
+        packets_lost: 0,
+        local_id: "RTCOutboundRTPVideoStream_1".to_owned(),
+        round_trip_time,
+        total_round_trip_time: round_trip_time.unwrap_or(0.0),
+        fraction_lost: 0.0,
+        round_trip_time_measurements: round_trip_time.is_some() as u64,
+    })
+}
+
+#[test]
+fn test_rtt_comes_from_the_video_receiver_report() {
+    let reports = [remote_inbound("audio", Some(90.0)), remote_inbound("video", Some(12.5))];
+    assert_eq!(TransportStats::from_report(reports.iter()).rtt_ms, Some(12.5));
+    // Until a receiver report answers a sender report
+    let reports = [remote_inbound("video", None)];
+    assert_eq!(TransportStats::from_report(reports.iter()).rtt_ms, None);
+}
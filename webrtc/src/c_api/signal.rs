@@ -0,0 +1,203 @@
+//! Signalling in both directions without JSON on the caller's side: typed
+//! descriptions and candidates in, and `webrtc_signal_t` out. The JSON
+//! callback remains for callers that relay the library's messages verbatim.
+
+use std::ffi::{CStr, CString};
+use std::os::raw::{c_char, c_int, c_void};
+use std::sync::Mutex;
+
+use log::error;
+
+use crate::ice_transport::ice_candidate::RTCIceCandidateInit;
+use crate::peer_connection::sdp::sdp_type::RTCSdpType;
+use crate::peer_connection::sdp::session_description::RTCSessionDescription;
+
+pub const WEBRTC_SDP_TYPE_OFFER: c_int = 0;
+pub const WEBRTC_SDP_TYPE_ANSWER: c_int = 1;
+pub const WEBRTC_SDP_TYPE_PRANSWER: c_int = 2;
+
+pub const WEBRTC_SIGNAL_SDP: c_int = 0;
+pub const WEBRTC_SIGNAL_CANDIDATE: c_int = 1;
+
+/// Mirrors `webrtc_signal_t` in webrtc_c_api.h. The strings are NUL-terminated
+/// and only valid during the callback.
+#[repr(C)]
+pub struct webrtc_signal_t {
+    pub kind: c_int,
+    pub sdp_type: c_int,
+    pub sdp: *const c_char,
+    pub sdp_len: usize,
+    pub candidate: *const c_char,
+    pub candidate_len: usize,
+    pub sdp_mid: *const c_char,
+    pub sdp_mline_index: c_int,
+}
+
+pub type WebrtcSignalCallbackT = extern "C" fn(msg: *const c_char, user_data: *mut c_void);
+pub type WebrtcSignalMessageCallbackT = extern "C" fn(signal: *const webrtc_signal_t, user_data: *mut c_void);
+
+pub(crate) fn sdp_type_from_c(sdp_type: c_int) -> Option<RTCSdpType> {
+    match sdp_type {
+        WEBRTC_SDP_TYPE_OFFER => Some(RTCSdpType::Offer),
+        WEBRTC_SDP_TYPE_ANSWER => Some(RTCSdpType::Answer),
+        WEBRTC_SDP_TYPE_PRANSWER => Some(RTCSdpType::Pranswer),
+        _ => None,
+    }
+}
+
+fn sdp_type_to_c(sdp_type: RTCSdpType) -> Option<c_int> {
+    match sdp_type {
+        RTCSdpType::Offer => Some(WEBRTC_SDP_TYPE_OFFER),
+        RTCSdpType::Answer => Some(WEBRTC_SDP_TYPE_ANSWER),
+        RTCSdpType::Pranswer => Some(WEBRTC_SDP_TYPE_PRANSWER),
+        _ => None,
+    }
+}
+
+/// Builds a description from `len` bytes of SDP, which need not be NUL-terminated.
+///
+/// # Safety
+/// `sdp` must point to `len` readable bytes.
+pub(crate) unsafe fn description_from_c(sdp_type: c_int, sdp: *const c_char, len: usize) -> Result<RTCSessionDescription, String> {
+    let sdp_type = sdp_type_from_c(sdp_type).ok_or_else(|| format!("unknown SDP type {}", sdp_type))?;
+    if sdp.is_null() {
+        return Err("null SDP".to_owned());
+    }
+    let bytes = std::slice::from_raw_parts(sdp as *const u8, len);
+    let sdp = std::str::from_utf8(bytes).map_err(|e| e.to_string())?.to_owned();
+    Ok(RTCSessionDescription {
+        sdp_type,
+        sdp,
+        ..Default::default()
+    })
+}
+
+/// `sdp_mid` may be null and a negative `sdp_mline_index` means none.
+///
+/// # Safety
+/// `candidate` and a non-null `sdp_mid` must be valid NUL-terminated strings.
+pub(crate) unsafe fn candidate_from_c(
+    candidate: *const c_char,
+    sdp_mid: *const c_char,
+    sdp_mline_index: c_int,
+) -> Result<RTCIceCandidateInit, String> {
+    if candidate.is_null() {
+        return Err("null candidate".to_owned());
+    }
+    let candidate = CStr::from_ptr(candidate).to_str().map_err(|e| e.to_string())?.to_owned();
+    let sdp_mid = if sdp_mid.is_null() {
+        None
+    } else {
+        Some(CStr::from_ptr(sdp_mid).to_str().map_err(|e| e.to_string())?.to_owned())
+    };
+    let sdp_mline_index = match sdp_mline_index {
+        i if i < 0 => None,
+        i => Some(u16::try_from(i).map_err(|_| format!("sdp_mline_index {} is out of range", i))?),
+    };
+    Ok(RTCIceCandidateInit {
+        candidate,
+        sdp_mid,
+        sdp_mline_index,
+        username_fragment: None,
+    })
+}
+
+#[derive(Clone, Copy)]
+enum Callback {
+    Json(WebrtcSignalCallbackT, usize),
+    Typed(WebrtcSignalMessageCallbackT, usize),
+}
+
+/// Where the session's answers and local candidates go. Setting either
+/// callback replaces the other.
+#[derive(Default)]
+pub(crate) struct SignalSink {
+    callback: Mutex<Option<Callback>>,
+}
+
+impl SignalSink {
+    pub(crate) fn set_json(&self, cb: Option<WebrtcSignalCallbackT>, user_data: *mut c_void) {
+        *self.callback.lock().unwrap() = cb.map(|cb| Callback::Json(cb, user_data as usize));
+    }
+
+    pub(crate) fn set_typed(&self, cb: Option<WebrtcSignalMessageCallbackT>, user_data: *mut c_void) {
+        *self.callback.lock().unwrap() = cb.map(|cb| Callback::Typed(cb, user_data as usize));
+    }
+
+    fn callback(&self) -> Option<Callback> {
+        *self.callback.lock().unwrap()
+    }
+
+    pub(crate) fn send_description(&self, desc: &RTCSessionDescription) {
+        match self.callback() {
+            Some(Callback::Json(cb, user_data)) => match serde_json::to_string(desc) {
+                Ok(json) => call_json(cb, json, user_data),
+                Err(e) => error!("Failed to serialize session description: {}", e),
+            },
+            Some(Callback::Typed(cb, user_data)) => {
+                let Some(sdp_type) = sdp_type_to_c(desc.sdp_type) else {
+                    error!("Cannot signal a {} description", desc.sdp_type);
+                    return;
+                };
+                let sdp = match CString::new(desc.sdp.as_str()) {
+                    Ok(sdp) => sdp,
+                    Err(e) => {
+                        error!("Failed to create CString: {}", e);
+                        return;
+                    }
+                };
+                let signal = webrtc_signal_t {
+                    kind: WEBRTC_SIGNAL_SDP,
+                    sdp_type,
+                    sdp: sdp.as_ptr(),
+                    sdp_len: desc.sdp.len(),
+                    candidate: std::ptr::null(),
+                    candidate_len: 0,
+                    sdp_mid: std::ptr::null(),
+                    sdp_mline_index: -1,
+                };
+                cb(&signal, user_data as *mut c_void);
+            }
+            None => {}
+        }
+    }
+
+    pub(crate) fn send_candidate(&self, init: &RTCIceCandidateInit) {
+        match self.callback() {
+            Some(Callback::Json(cb, user_data)) => match serde_json::to_string(init) {
+                Ok(json) => call_json(cb, json, user_data),
+                Err(e) => error!("Failed to serialize ICE candidate: {}", e),
+            },
+            Some(Callback::Typed(cb, user_data)) => {
+                let candidate = CString::new(init.candidate.as_str());
+                let sdp_mid = CString::new(init.sdp_mid.as_deref().unwrap_or(""));
+                let (candidate, sdp_mid) = match (candidate, sdp_mid) {
+                    (Ok(candidate), Ok(sdp_mid)) => (candidate, sdp_mid),
+                    _ => {
+                        error!("Failed to create CString for ICE candidate");
+                        return;
+                    }
+                };
+                let signal = webrtc_signal_t {
+                    kind: WEBRTC_SIGNAL_CANDIDATE,
+                    sdp_type: -1,
+                    sdp: std::ptr::null(),
+                    sdp_len: 0,
+                    candidate: candidate.as_ptr(),
+                    candidate_len: init.candidate.len(),
+                    sdp_mid: sdp_mid.as_ptr(),
+                    sdp_mline_index: init.sdp_mline_index.map_or(-1, c_int::from),
+                };
+                cb(&signal, user_data as *mut c_void);
+            }
+            None => {}
+        }
+    }
+}
+
+fn call_json(cb: WebrtcSignalCallbackT, json: String, user_data: usize) {
+    match CString::new(json) {
+        Ok(cstr) => cb(cstr.as_ptr(), user_data as *mut c_void),
+        Err(e) => error!("Failed to create CString: {}", e),
+    }
+}
@@ -0,0 +1,96 @@
+use std::ffi::{CStr, CString};
+use std::os::raw::{c_char, c_void};
+use std::sync::Mutex;
+
+use super::signal::*;
+use crate::ice_transport::ice_candidate::RTCIceCandidateInit;
+use crate::peer_connection::sdp::sdp_type::RTCSdpType;
+use crate::peer_connection::sdp::session_description::RTCSessionDescription;
+
+#[test]
+fn description_from_c_reads_only_len_bytes() {
+    let sdp = b"v=0\r\nGARBAGE";
+    let desc = unsafe { description_from_c(WEBRTC_SDP_TYPE_OFFER, sdp.as_ptr() as *const c_char, 5) }.unwrap();
+    assert_eq!(desc.sdp_type, RTCSdpType::Offer);
+    assert_eq!(desc.sdp, "v=0\r\n");
+}
+
+#[test]
+fn description_from_c_rejects_bad_input() {
+    let sdp = b"v=0";
+    assert!(unsafe { description_from_c(7, sdp.as_ptr() as *const c_char, 3) }.is_err());
+    assert!(unsafe { description_from_c(WEBRTC_SDP_TYPE_ANSWER, std::ptr::null(), 0) }.is_err());
+    let invalid = [0xffu8, 0xfe];
+    assert!(unsafe { description_from_c(WEBRTC_SDP_TYPE_ANSWER, invalid.as_ptr() as *const c_char, 2) }.is_err());
+}
+
+#[test]
+fn candidate_from_c_maps_optional_fields() {
+    let candidate = CString::new("candidate:1 1 udp 2130706431 10.0.0.1 5000 typ host").unwrap();
+    let mid = CString::new("0").unwrap();
+    let cand = unsafe { candidate_from_c(candidate.as_ptr(), mid.as_ptr(), 0) }.unwrap();
+    assert_eq!(cand.sdp_mid.as_deref(), Some("0"));
+    assert_eq!(cand.sdp_mline_index, Some(0));
+
+    let cand = unsafe { candidate_from_c(candidate.as_ptr(), std::ptr::null(), -1) }.unwrap();
+    assert_eq!(cand.sdp_mid, None);
+    assert_eq!(cand.sdp_mline_index, None);
+
+    assert!(unsafe { candidate_from_c(candidate.as_ptr(), std::ptr::null(), 70000) }.is_err());
+    assert!(unsafe { candidate_from_c(std::ptr::null(), std::ptr::null(), 0) }.is_err());
+}
+
+static RECEIVED: Mutex<Vec<String>> = Mutex::new(Vec::new());
+
+extern "C" fn on_typed(signal: *const webrtc_signal_t, _: *mut c_void) {
+    let signal = unsafe { &*signal };
+    let text = match signal.kind {
+        WEBRTC_SIGNAL_SDP => {
+            let sdp = unsafe { CStr::from_ptr(signal.sdp) }.to_str().unwrap();
+            assert_eq!(sdp.len(), signal.sdp_len);
+            format!("sdp {} {}", signal.sdp_type, sdp)
+        }
+        _ => {
+            let candidate = unsafe { CStr::from_ptr(signal.candidate) }.to_str().unwrap();
+            let mid = unsafe { CStr::from_ptr(signal.sdp_mid) }.to_str().unwrap();
+            format!("candidate {} {} {}", candidate, mid, signal.sdp_mline_index)
+        }
+    };
+    RECEIVED.lock().unwrap().push(text);
+}
+
+extern "C" fn on_json(msg: *const c_char, _: *mut c_void) {
+    RECEIVED.lock().unwrap().push(unsafe { CStr::from_ptr(msg) }.to_str().unwrap().to_owned());
+}
+
+#[test]
+fn sink_delivers_to_the_latest_callback() {
+    let sink = SignalSink::default();
+    let answer = RTCSessionDescription {
+        sdp_type: RTCSdpType::Answer,
+        sdp: "v=0".to_owned(),
+        ..Default::default()
+    };
+    let candidate = RTCIceCandidateInit {
+        candidate: "candidate:1".to_owned(),
+        sdp_mid: Some("0".to_owned()),
+        sdp_mline_index: Some(0),
+        username_fragment: None,
+    };
+    sink.send_description(&answer); // no callback yet: dropped
+
+    sink.set_typed(Some(on_typed), std::ptr::null_mut());
+    sink.send_description(&answer);
+    sink.send_candidate(&candidate);
+
+    sink.set_json(Some(on_json), std::ptr::null_mut());
+    sink.send_description(&answer);
+
+    let received = RECEIVED.lock().unwrap();
+    assert_eq!(received.len(), 3);
+    assert_eq!(received[0], format!("sdp {} v=0", WEBRTC_SDP_TYPE_ANSWER));
+    assert_eq!(received[1], "candidate candidate:1 0 0");
+    let json: serde_json::Value = serde_json::from_str(&received[2]).unwrap();
+    assert_eq!(json["type"], "answer");
+    assert_eq!(json["sdp"], "v=0");
+}
@@ -0,0 +1,251 @@
+//! Simulcast: one rendered frame encoded at several sizes, with each
+//! subscribed session forwarded the layer its receiver can take, like an SFU.
+//! Each frame is converted once, downscaled once per halving and encoded once
+//! per layer that has a subscriber, however many sessions receive it.
+
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, Weak};
+
+use bytes::Bytes;
+use log::{info, warn};
+
+use super::bandwidth::{self, BandwidthEstimate};
+use super::capture_time;
+use super::config::SimulcastConfig;
+use super::encoder_backend::VideoEncoder;
+use super::fanout::KeyframeRequests;
+use super::video_frame::{I420Buffer, I420Image, VideoFrame};
+use super::video_sender::{create_encoder, frame_duration, FrameCounters, TrackWriter};
+
+/// A session's end of a simulcast source: its track's writer and how to pick
+/// its layer. The source holds it weakly, so dropping it unsubscribes.
+pub(crate) struct Subscription {
+    pub writer: Arc<TrackWriter>,
+    pub counters: Arc<FrameCounters>,
+    /// Picks the layer when `fixed_layer` is not set; without it the largest layer is sent.
+    pub estimate: Option<Arc<BandwidthEstimate>>,
+    pub fixed_layer: Option<usize>,
+    pub abs_capture_time: bool,
+    /// The session's viewer asking for a keyframe, answered on its current layer.
+    pub keyframes: Arc<KeyframeRequests>,
+}
+
+/// Reported by `webrtc_simulcast_get_layer_stats`.
+#[derive(Default)]
+pub(crate) struct LayerStats {
+    pub width: AtomicU32,
+    pub height: AtomicU32,
+    pub subscribers: AtomicU32,
+    pub frames_encoded: AtomicU64,
+    pub keyframes: AtomicU64,
+}
+
+struct Layer {
+    /// Created on the first frame the layer has a subscriber for.
+    encoder: Option<Box<dyn VideoEncoder>>,
+    force_keyframe: bool,
+    first_timestamp_us: i64,
+    last_pts: Option<i64>,
+}
+
+struct Subscriber {
+    subscription: Weak<Subscription>,
+    layer: Option<usize>,
+    last_timestamp_us: Option<i64>,
+}
+
+// Everything send touches, under one lock
+struct SourceState {
+    layers: Vec<Layer>,
+    subscribers: Vec<Subscriber>,
+    /// Conversion target for frames that are not already I420.
+    scratch: I420Buffer,
+    /// One buffer per downscale step, shared by the layers.
+    scaled: Vec<I420Buffer>,
+    width: u32,
+    height: u32,
+}
+
+pub(crate) struct SimulcastSource {
+    config: SimulcastConfig,
+    state: Mutex<SourceState>,
+    /// Subscriptions added since the last frame, so subscribing never waits on an encode.
+    pending: Mutex<Vec<Weak<Subscription>>>,
+    stats: Vec<LayerStats>,
+}
+
+impl SimulcastSource {
+    pub(crate) fn new(config: SimulcastConfig) -> Self {
+        let deepest = config.layers.last().map_or(0, |l| l.scale_down_log2);
+        let layers = config
+            .layers
+            .iter()
+            .map(|_| Layer {
+                encoder: None,
+                force_keyframe: true,
+                first_timestamp_us: 0,
+                last_pts: None,
+            })
+            .collect();
+        let stats = config.layers.iter().map(|_| LayerStats::default()).collect();
+        SimulcastSource {
+            state: Mutex::new(SourceState {
+                layers,
+                subscribers: Vec::new(),
+                scratch: I420Buffer::default(),
+                scaled: (0..deepest).map(|_| I420Buffer::default()).collect(),
+                width: 0,
+                height: 0,
+            }),
+            pending: Mutex::new(Vec::new()),
+            stats,
+            config,
+        }
+    }
+
+    pub(crate) fn config(&self) -> &SimulcastConfig {
+        &self.config
+    }
+
+    pub(crate) fn layer_stats(&self, layer: usize) -> &LayerStats {
+        &self.stats[layer]
+    }
+
+    /// The subscription receives from the next frame on, starting with a keyframe.
+    pub(crate) fn subscribe(&self, subscription: &Arc<Subscription>) {
+        if let Ok(mut pending) = self.pending.lock() {
+            pending.push(Arc::downgrade(subscription));
+        }
+    }
+
+    /// Encodes `frame` for every layer someone receives and forwards each
+    /// subscriber its layer's packets. A subscriber that changes layer, and the
+    /// first frame of a new one, is sent a keyframe of its new layer, as is one
+    /// whose viewer has asked for a keyframe.
+    pub(crate) fn send(&self, frame: &VideoFrame<'_>) -> Result<(), String> {
+        let mut state = self.state.lock().map_err(|e| e.to_string())?;
+        let SourceState {
+            layers,
+            subscribers,
+            scratch,
+            scaled,
+            width,
+            height,
+        } = &mut *state;
+        if let Ok(mut pending) = self.pending.lock() {
+            subscribers.extend(pending.drain(..).map(|subscription| Subscriber {
+                subscription,
+                layer: None,
+                last_timestamp_us: None,
+            }));
+        }
+        subscribers.retain(|s| s.subscription.strong_count() > 0);
+
+        if (frame.width, frame.height) != (*width, *height) {
+            for layer in layers.iter_mut() {
+                layer.encoder = None;
+            }
+            *width = frame.width;
+            *height = frame.height;
+        }
+
+        // Pick each subscriber's layer
+        let bitrates: Vec<u32> = self.config.layers.iter().map(|l| l.bitrate_kbps).collect();
+        let mut wanted = vec![0u32; layers.len()];
+        let mut live = Vec::with_capacity(subscribers.len());
+        let now_us = capture_time::monotonic_us();
+        for subscriber in subscribers.iter_mut() {
+            let subscription = match subscriber.subscription.upgrade() {
+                Some(subscription) => subscription,
+                None => continue,
+            };
+            let layer = match (subscription.fixed_layer, &subscription.estimate) {
+                (Some(layer), _) => layer,
+                (None, Some(estimate)) => bandwidth::choose_layer(&bitrates, estimate.target().bitrate_kbps, subscriber.layer),
+                (None, None) => 0,
+            };
+            let switched = subscriber.layer != Some(layer);
+            if switched {
+                if let Some(previous) = subscriber.layer {
+                    info!("Simulcast subscriber moved from layer {} to {}", previous, layer);
+                }
+                subscriber.layer = Some(layer);
+            }
+            // A switch's keyframe also answers the viewer's pending requests
+            if subscription.keyframes.next_is_keyframe(now_us, switched) {
+                layers[layer].force_keyframe = true;
+            }
+            wanted[layer] += 1;
+            live.push((subscriber, subscription));
+        }
+        for (stats, &count) in self.stats.iter().zip(&wanted) {
+            stats.subscribers.store(count, Ordering::Relaxed);
+        }
+        let deepest = match wanted.iter().rposition(|&count| count > 0) {
+            Some(layer) => self.config.layers[layer].scale_down_log2 as usize,
+            None => return Ok(()),
+        };
+
+        // Convert once and halve once per step, only as far as a subscribed layer needs
+        let mut images: Vec<I420Image<'_>> = Vec::with_capacity(deepest + 1);
+        images.push(frame.to_i420(scratch));
+        for buffer in scaled.iter_mut().take(deepest) {
+            let half = images.last().unwrap().downscale_half(buffer);
+            images.push(half);
+        }
+
+        let codec = self.config.encoder.codec;
+        let mut encoded: Vec<Option<Vec<Bytes>>> = vec![None; layers.len()];
+        for (index, layer) in layers.iter_mut().enumerate() {
+            if wanted[index] == 0 {
+                continue;
+            }
+            let image = &images[self.config.layers[index].scale_down_log2 as usize];
+            if layer.encoder.is_none() {
+                let bitrate_kbps = self.config.layers[index].bitrate_kbps;
+                layer.encoder = Some(create_encoder(&self.config.encoder, image.width, image.height, bitrate_kbps)?);
+                layer.first_timestamp_us = frame.timestamp_us;
+                layer.last_pts = None;
+                layer.force_keyframe = true;
+                self.stats[index].width.store(image.width, Ordering::Relaxed);
+                self.stats[index].height.store(image.height, Ordering::Relaxed);
+            }
+            // Pts are kept strictly increasing even if the caller's clock repeats a value
+            let mut pts = frame.timestamp_us - layer.first_timestamp_us;
+            if let Some(last) = layer.last_pts {
+                pts = pts.max(last + 1);
+            }
+            layer.last_pts = Some(pts);
+            let keyframe = frame.keyframe || layer.force_keyframe;
+            layer.force_keyframe = false;
+            let packets = layer
+                .encoder
+                .as_mut()
+                .unwrap()
+                .encode(pts, image, keyframe)
+                .map_err(|e| format!("{:?} encode failed: {}", codec, e))?;
+            self.stats[index].frames_encoded.fetch_add(1, Ordering::Relaxed);
+            if keyframe {
+                self.stats[index].keyframes.fetch_add(1, Ordering::Relaxed);
+            }
+            encoded[index] = Some(packets);
+        }
+
+        for (subscriber, subscription) in live {
+            let packets = match subscriber.layer.and_then(|layer| encoded[layer].as_ref()) {
+                Some(packets) => packets.clone(),
+                None => {
+                    warn!("Simulcast subscriber's layer was not encoded");
+                    continue;
+                }
+            };
+            let duration = frame_duration(subscriber.last_timestamp_us, frame.timestamp_us);
+            subscriber.last_timestamp_us = Some(frame.timestamp_us);
+            subscription.counters.submitted.fetch_add(1, Ordering::Relaxed);
+            subscription.counters.encoded.fetch_add(1, Ordering::Relaxed);
+            let capture_time_us = subscription.abs_capture_time.then_some(frame.timestamp_us);
+            subscription.writer.write(packets, duration, capture_time_us);
+        }
+        Ok(())
+    }
+}
@@ -0,0 +1,96 @@
+use std::os::raw::{c_int, c_void};
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+use std::time::Duration;
+
+use super::config::SimulcastConfig;
+use super::encoder_backend::*;
+use super::fanout::KeyframeRequests;
+use super::simulcast::*;
+use super::video_frame::{webrtc_video_frame_t, PixelFormat, VideoFrame};
+use super::video_sender::{FrameCounters, TrackWriter};
+use crate::rtp_transceiver::rtp_codec::RTCRtpCodecCapability;
+use crate::track::track_local::track_local_static_sample::TrackLocalStaticSample;
+
+extern "C" fn null_create(_params: *const webrtc_encoder_params_t, _user_data: *mut c_void) -> *mut c_void {
+    Box::into_raw(Box::new(0u8)) as *mut c_void
+}
+
+extern "C" fn null_encode(
+    _encoder: *mut c_void,
+    _frame: *const webrtc_video_frame_t,
+    _output: WebrtcEncodedOutputT,
+    _output_context: *mut c_void,
+) -> c_int {
+    0
+}
+
+extern "C" fn null_destroy(encoder: *mut c_void) {
+    drop(unsafe { Box::from_raw(encoder as *mut u8) });
+}
+
+fn subscription(rt: &tokio::runtime::Runtime, fixed_layer: usize) -> Arc<Subscription> {
+    let codec = RTCRtpCodecCapability {
+        mime_type: "video/H264".to_owned(),
+        ..Default::default()
+    };
+    let track = Arc::new(TrackLocalStaticSample::new(codec, "video".to_owned(), "simulcast".to_owned()));
+    Arc::new(Subscription {
+        writer: Arc::new(TrackWriter::new(track, rt.handle())),
+        counters: Arc::new(FrameCounters::default()),
+        estimate: None,
+        fixed_layer: Some(fixed_layer),
+        abs_capture_time: false,
+        keyframes: Arc::new(KeyframeRequests::new(Duration::ZERO)),
+    })
+}
+
+#[test]
+fn test_keyframe_request_is_answered_on_the_subscribers_layer() {
+    let backend = webrtc_encoder_backend_t {
+        create: Some(null_create),
+        encode: Some(null_encode),
+        set_bitrate: None,
+        destroy: Some(null_destroy),
+        user_data: std::ptr::null_mut(),
+    };
+    register("simulcast-null", &backend).unwrap();
+    let config = SimulcastConfig::parse(
+        r#"{"encoder": {"backend": "simulcast-null", "codec": "h264"},
+            "layers": [{"scale_down_log2": 0, "bitrate_kbps": 1000}, {"scale_down_log2": 1, "bitrate_kbps": 300}]}"#,
+    )
+    .unwrap();
+    let rt = tokio::runtime::Builder::new_current_thread().build().unwrap();
+    let source = SimulcastSource::new(config);
+    let full = subscription(&rt, 0);
+    let half = subscription(&rt, 1);
+    source.subscribe(&full);
+    source.subscribe(&half);
+
+    let (y, chroma) = ([16u8; 32], [128u8; 16]);
+    let send = |timestamp_us| {
+        let frame = VideoFrame {
+            format: PixelFormat::I420,
+            width: 8,
+            height: 4,
+            planes: [&y, &chroma[..8], &chroma[8..]],
+            strides: [8, 4, 4],
+            timestamp_us,
+            keyframe: false,
+        };
+        source.send(&frame).unwrap();
+    };
+    let keyframes = |layer| source.layer_stats(layer).keyframes.load(Ordering::Relaxed);
+
+    // Each layer starts with a keyframe, then sends none until asked
+    send(0);
+    send(33_000);
+    assert_eq!((keyframes(0), keyframes(1)), (1, 1));
+
+    half.keyframes.request();
+    send(66_000);
+    assert_eq!((keyframes(0), keyframes(1)), (1, 2));
+    assert_eq!(half.keyframes.answered.load(Ordering::Relaxed), 1);
+    send(99_000);
+    assert_eq!((keyframes(0), keyframes(1)), (1, 2));
+}
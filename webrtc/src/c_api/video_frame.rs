@@ -0,0 +1,343 @@
+//! Frame descriptors accepted by `webrtc_session_send_frame_ex`, and their
+//! conversion to the I420 images the encoder consumes.
+
+use std::os::raw::{c_int, c_void};
+
+pub type WebrtcFrameReleaseCallbackT = extern "C" fn(user_data: *mut c_void);
+
+pub const WEBRTC_PIXEL_FORMAT_I420: c_int = 0;
+pub const WEBRTC_PIXEL_FORMAT_NV12: c_int = 1;
+pub const WEBRTC_PIXEL_FORMAT_RGBA: c_int = 2;
+pub const WEBRTC_PIXEL_FORMAT_BGRA: c_int = 3;
+
+/// Encode this frame as a keyframe.
+pub const WEBRTC_FRAME_FLAG_KEYFRAME: u32 = 1 << 0;
+
+/// Mirrors `webrtc_video_frame_t` in webrtc_c_api.h.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct webrtc_video_frame_t {
+    pub format: c_int,
+    pub width: c_int,
+    pub height: c_int,
+    pub planes: [*const u8; 3],
+    pub strides: [c_int; 3],
+    pub timestamp_us: i64,
+    pub flags: u32,
+    pub release: Option<WebrtcFrameReleaseCallbackT>,
+    pub release_user_data: *mut c_void,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) enum PixelFormat {
+    I420,
+    Nv12,
+    Rgba,
+    Bgra,
+}
+
+impl PixelFormat {
+    pub(crate) fn from_raw(format: c_int) -> Option<Self> {
+        match format {
+            WEBRTC_PIXEL_FORMAT_I420 => Some(PixelFormat::I420),
+            WEBRTC_PIXEL_FORMAT_NV12 => Some(PixelFormat::Nv12),
+            WEBRTC_PIXEL_FORMAT_RGBA => Some(PixelFormat::Rgba),
+            WEBRTC_PIXEL_FORMAT_BGRA => Some(PixelFormat::Bgra),
+            _ => None,
+        }
+    }
+
+    /// Bytes per row and number of rows of each plane.
+    pub(crate) fn plane_shapes(self, width: usize, height: usize) -> Vec<(usize, usize)> {
+        let (cw, ch) = (chroma_len(width), chroma_len(height));
+        match self {
+            PixelFormat::I420 => vec![(width, height), (cw, ch), (cw, ch)],
+            PixelFormat::Nv12 => vec![(width, height), (2 * cw, ch)],
+            PixelFormat::Rgba | PixelFormat::Bgra => vec![(4 * width, height)],
+        }
+    }
+}
+
+/// Hands the caller's buffer back: calls the frame's release callback, if any,
+/// exactly once when dropped.
+pub(crate) struct FrameRelease {
+    callback: Option<WebrtcFrameReleaseCallbackT>,
+    user_data: *mut c_void,
+}
+
+// The C API allows release callbacks to run on any thread.
+unsafe impl Send for FrameRelease {}
+
+impl FrameRelease {
+    pub(crate) fn new(frame: &webrtc_video_frame_t) -> Self {
+        FrameRelease {
+            callback: frame.release,
+            user_data: frame.release_user_data,
+        }
+    }
+
+    /// Whether the caller is waiting for the buffer, i.e. lends it to us until release.
+    pub(crate) fn is_set(&self) -> bool {
+        self.callback.is_some()
+    }
+}
+
+impl Drop for FrameRelease {
+    fn drop(&mut self) {
+        if let Some(callback) = self.callback {
+            callback(self.user_data);
+        }
+    }
+}
+
+/// Chroma samples covering `len` luma samples in 4:2:0.
+pub(crate) fn chroma_len(len: usize) -> usize {
+    (len + 1) / 2
+}
+
+/// Borrowed I420 image: Y, U and V planes with their row strides.
+#[derive(Clone, Copy)]
+pub(crate) struct I420Image<'a> {
+    pub width: u32,
+    pub height: u32,
+    pub planes: [&'a [u8]; 3],
+    pub strides: [usize; 3],
+}
+
+impl I420Image<'_> {
+    /// Halves the image in both directions into `out` with a 2x2 box filter;
+    /// odd sizes round up and pair the last row and column with themselves.
+    pub(crate) fn downscale_half<'b>(&self, out: &'b mut I420Buffer) -> I420Image<'b> {
+        let (width, height) = (chroma_len(self.width as usize), chroma_len(self.height as usize));
+        out.resize(width, height);
+        let (cw, ch) = (chroma_len(width), chroma_len(height));
+        let src_w = self.width as usize;
+        let src_h = self.height as usize;
+        let src_sizes = [(src_w, src_h), (chroma_len(src_w), chroma_len(src_h)), (chroma_len(src_w), chroma_len(src_h))];
+        let dst_sizes = [(width, height), (cw, ch), (cw, ch)];
+        for (i, dst) in [&mut out.y, &mut out.u, &mut out.v].into_iter().enumerate() {
+            downscale_plane_half(self.planes[i], self.strides[i], src_sizes[i], dst, dst_sizes[i].0);
+        }
+        I420Image {
+            width: width as u32,
+            height: height as u32,
+            planes: [&out.y, &out.u, &out.v],
+            strides: [width, cw, cw],
+        }
+    }
+}
+
+/// Conversion output for formats the encoder cannot take directly. Kept per
+/// encoder so steady-state conversion does not allocate.
+#[derive(Default)]
+pub(crate) struct I420Buffer {
+    y: Vec<u8>,
+    u: Vec<u8>,
+    v: Vec<u8>,
+}
+
+impl I420Buffer {
+    fn resize_chroma(&mut self, width: usize, height: usize) {
+        let size = chroma_len(width) * chroma_len(height);
+        self.u.resize(size, 0);
+        self.v.resize(size, 0);
+    }
+
+    fn resize(&mut self, width: usize, height: usize) {
+        self.y.resize(width * height, 0);
+        self.resize_chroma(width, height);
+    }
+
+    /// Copies `image` into the buffer, tightly packed.
+    pub(crate) fn copy_from(&mut self, image: &I420Image<'_>) {
+        let (width, height) = (image.width as usize, image.height as usize);
+        self.resize(width, height);
+        let sizes = [(width, height), (chroma_len(width), chroma_len(height)), (chroma_len(width), chroma_len(height))];
+        for (i, dst) in [&mut self.y, &mut self.u, &mut self.v].into_iter().enumerate() {
+            let (row_bytes, rows) = sizes[i];
+            for row in 0..rows {
+                let start = row * image.strides[i];
+                dst[row * row_bytes..(row + 1) * row_bytes].copy_from_slice(&image.planes[i][start..start + row_bytes]);
+            }
+        }
+    }
+
+    /// The buffer as a tightly packed `width` x `height` image, as filled by
+    /// `copy_from`, `downscale_half` or RGB conversion.
+    pub(crate) fn image(&self, width: u32, height: u32) -> I420Image<'_> {
+        let cw = chroma_len(width as usize);
+        I420Image {
+            width,
+            height,
+            planes: [&self.y, &self.u, &self.v],
+            strides: [width as usize, cw, cw],
+        }
+    }
+}
+
+/// A validated `webrtc_video_frame_t`.
+pub(crate) struct VideoFrame<'a> {
+    pub format: PixelFormat,
+    pub width: u32,
+    pub height: u32,
+    pub planes: [&'a [u8]; 3],
+    pub strides: [usize; 3],
+    pub timestamp_us: i64,
+    pub keyframe: bool,
+}
+
+impl<'a> VideoFrame<'a> {
+    /// Checks the descriptor and borrows its planes. A stride of 0 means the
+    /// plane is tightly packed.
+    ///
+    /// # Safety
+    /// Every plane the format uses must point to at least `stride * rows` bytes.
+    pub(crate) unsafe fn from_raw(frame: &'a webrtc_video_frame_t) -> Result<Self, String> {
+        let format = PixelFormat::from_raw(frame.format)
+            .ok_or_else(|| format!("unknown pixel format {}", frame.format))?;
+        if frame.width <= 0 || frame.height <= 0 {
+            return Err(format!("invalid dimensions {}x{}", frame.width, frame.height));
+        }
+        let (width, height) = (frame.width as usize, frame.height as usize);
+
+        let mut planes: [&'a [u8]; 3] = [&[]; 3];
+        let mut strides = [0usize; 3];
+        for (i, (row_bytes, rows)) in format.plane_shapes(width, height).into_iter().enumerate() {
+            if frame.planes[i].is_null() {
+                return Err(format!("plane {} is null", i));
+            }
+            let stride = match frame.strides[i] {
+                0 => row_bytes,
+                s if s > 0 && s as usize >= row_bytes => s as usize,
+                s => return Err(format!("plane {} stride {} is less than {} bytes", i, s, row_bytes)),
+            };
+            // The last row only needs its visible bytes.
+            planes[i] = std::slice::from_raw_parts(frame.planes[i], stride * (rows - 1) + row_bytes);
+            strides[i] = stride;
+        }
+
+        Ok(VideoFrame {
+            format,
+            width: width as u32,
+            height: height as u32,
+            planes,
+            strides,
+            timestamp_us: frame.timestamp_us,
+            keyframe: frame.flags & WEBRTC_FRAME_FLAG_KEYFRAME != 0,
+        })
+    }
+
+    /// The frame as I420. I420 input is passed through without copying, NV12
+    /// only has its chroma de-interleaved, and RGB input is converted with
+    /// BT.601 limited range into `scratch`.
+    pub(crate) fn to_i420<'b>(&'b self, scratch: &'b mut I420Buffer) -> I420Image<'b> {
+        let (width, height) = (self.width as usize, self.height as usize);
+        let cw = chroma_len(width);
+        match self.format {
+            PixelFormat::I420 => I420Image {
+                width: self.width,
+                height: self.height,
+                planes: self.planes,
+                strides: self.strides,
+            },
+            PixelFormat::Nv12 => {
+                scratch.resize_chroma(width, height);
+                deinterleave_uv(self.planes[1], self.strides[1], cw, chroma_len(height), &mut scratch.u, &mut scratch.v);
+                I420Image {
+                    width: self.width,
+                    height: self.height,
+                    planes: [self.planes[0], &scratch.u, &scratch.v],
+                    strides: [self.strides[0], cw, cw],
+                }
+            }
+            PixelFormat::Rgba | PixelFormat::Bgra => {
+                scratch.resize(width, height);
+                let order = if self.format == PixelFormat::Rgba { [0, 1, 2] } else { [2, 1, 0] };
+                rgb32_to_i420(self.planes[0], self.strides[0], order, width, height, scratch);
+                I420Image {
+                    width: self.width,
+                    height: self.height,
+                    planes: [&scratch.y, &scratch.u, &scratch.v],
+                    strides: [width, cw, cw],
+                }
+            }
+        }
+    }
+}
+
+fn downscale_plane_half(src: &[u8], stride: usize, (width, height): (usize, usize), dst: &mut [u8], dst_width: usize) {
+    let pairs = width / 2;
+    for (y, dst_row) in dst.chunks_exact_mut(dst_width).enumerate() {
+        let [top, bottom] = [2 * y, (2 * y + 1).min(height - 1)].map(|r| &src[r * stride..r * stride + width]);
+        // Whole 2x2 blocks, written as straight-line u16 sums over both rows so
+        // the compiler vectorizes them (SSE2/AVX2 or NEON).
+        for ((out, t), b) in dst_row[..pairs].iter_mut().zip(top.chunks_exact(2)).zip(bottom.chunks_exact(2)) {
+            let sum = t[0] as u16 + t[1] as u16 + b[0] as u16 + b[1] as u16;
+            *out = ((sum + 2) >> 2) as u8;
+        }
+        if width % 2 == 1 {
+            let last = width - 1;
+            dst_row[pairs] = ((2 * (top[last] as u16 + bottom[last] as u16) + 2) >> 2) as u8;
+        }
+    }
+}
+
+fn deinterleave_uv(uv: &[u8], stride: usize, cw: usize, ch: usize, u: &mut [u8], v: &mut [u8]) {
+    for row in 0..ch {
+        let src = &uv[row * stride..row * stride + 2 * cw];
+        let (u_row, v_row) = (&mut u[row * cw..(row + 1) * cw], &mut v[row * cw..(row + 1) * cw]);
+        for (x, pair) in src.chunks_exact(2).enumerate() {
+            u_row[x] = pair[0];
+            v_row[x] = pair[1];
+        }
+    }
+}
+
+// BT.601 limited range in 8.8 fixed point, the same coefficients and rounding
+// as the vtk-cube example's converter so both produce identical frames.
+fn luma(r: i32, g: i32, b: i32) -> u8 {
+    ((66 * r + 129 * g + 25 * b + (16 << 8) + 128) >> 8) as u8
+}
+
+fn chroma_u(r: i32, g: i32, b: i32) -> u8 {
+    ((-38 * r - 74 * g + 112 * b + 0x8080) >> 8) as u8
+}
+
+fn chroma_v(r: i32, g: i32, b: i32) -> u8 {
+    ((112 * r - 94 * g - 18 * b + 0x8080) >> 8) as u8
+}
+
+/// Converts 32-bit RGB pixels to I420. `order` gives the byte offsets of R, G
+/// and B within a pixel. Chroma averages each 2x2 block; the last row and
+/// column of odd sizes are paired with themselves.
+fn rgb32_to_i420(src: &[u8], stride: usize, order: [usize; 3], width: usize, height: usize, out: &mut I420Buffer) {
+    let cw = chroma_len(width);
+    let pixel = |row: usize, x: usize| {
+        let p = &src[row * stride + 4 * x..];
+        [p[order[0]] as i32, p[order[1]] as i32, p[order[2]] as i32]
+    };
+    for cy in 0..chroma_len(height) {
+        let rows = [2 * cy, (2 * cy + 1).min(height - 1)];
+        for row in rows {
+            for x in 0..width {
+                let [r, g, b] = pixel(row, x);
+                out.y[row * width + x] = luma(r, g, b);
+            }
+        }
+        for cx in 0..cw {
+            let cols = [2 * cx, (2 * cx + 1).min(width - 1)];
+            let mut sum = [0i32; 3];
+            for row in rows {
+                for x in cols {
+                    let p = pixel(row, x);
+                    for c in 0..3 {
+                        sum[c] += p[c];
+                    }
+                }
+            }
+            let [r, g, b] = sum.map(|s| (s + 2) >> 2);
+            out.u[cy * cw + cx] = chroma_u(r, g, b);
+            out.v[cy * cw + cx] = chroma_v(r, g, b);
+        }
+    }
+}
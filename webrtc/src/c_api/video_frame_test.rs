@@ -0,0 +1,139 @@
+use std::ptr;
+
+use super::video_frame::*;
+
+fn descriptor(format: i32, width: i32, height: i32, planes: [*const u8; 3], strides: [i32; 3]) -> webrtc_video_frame_t {
+    webrtc_video_frame_t {
+        format,
+        width,
+        height,
+        planes,
+        strides,
+        timestamp_us: 0,
+        flags: 0,
+        release: None,
+        release_user_data: ptr::null_mut(),
+    }
+}
+
+#[test]
+fn test_i420_with_padding_is_borrowed() {
+    // 4x2 frame, Y rows padded to 8 bytes, chroma rows to 4.
+    let y = [10u8; 16];
+    let u = [20u8; 4];
+    let v = [30u8; 4];
+    let raw = descriptor(WEBRTC_PIXEL_FORMAT_I420, 4, 2, [y.as_ptr(), u.as_ptr(), v.as_ptr()], [8, 4, 4]);
+    let frame = unsafe { VideoFrame::from_raw(&raw) }.unwrap();
+    let mut scratch = I420Buffer::default();
+    let image = frame.to_i420(&mut scratch);
+    assert_eq!(image.strides, [8, 4, 4]);
+    assert_eq!(image.planes[0].as_ptr(), y.as_ptr());
+    assert_eq!(image.planes[0].len(), 8 + 4);
+    assert_eq!(image.planes[1].len(), 2);
+}
+
+#[test]
+fn test_packed_strides_default_to_row_size() {
+    let buf = [0u8; 3 * 3 + 2 * 2 * 2];
+    let raw = descriptor(
+        WEBRTC_PIXEL_FORMAT_I420,
+        3,
+        3,
+        [buf.as_ptr(), buf[9..].as_ptr(), buf[13..].as_ptr()],
+        [0, 0, 0],
+    );
+    let frame = unsafe { VideoFrame::from_raw(&raw) }.unwrap();
+    assert_eq!(frame.strides, [3, 2, 2]);
+}
+
+#[test]
+fn test_invalid_descriptors_are_rejected() {
+    let buf = [0u8; 64];
+    let p = buf.as_ptr();
+    let bad_format = descriptor(7, 4, 4, [p, p, p], [0, 0, 0]);
+    assert!(unsafe { VideoFrame::from_raw(&bad_format) }.is_err());
+    let short_stride = descriptor(WEBRTC_PIXEL_FORMAT_RGBA, 4, 2, [p, ptr::null(), ptr::null()], [8, 0, 0]);
+    assert!(unsafe { VideoFrame::from_raw(&short_stride) }.is_err());
+    let missing_plane = descriptor(WEBRTC_PIXEL_FORMAT_NV12, 4, 2, [p, ptr::null(), ptr::null()], [0, 0, 0]);
+    assert!(unsafe { VideoFrame::from_raw(&missing_plane) }.is_err());
+    let empty = descriptor(WEBRTC_PIXEL_FORMAT_I420, 0, 2, [p, p, p], [0, 0, 0]);
+    assert!(unsafe { VideoFrame::from_raw(&empty) }.is_err());
+}
+
+#[test]
+fn test_nv12_chroma_is_deinterleaved() {
+    let y = [16u8; 4 * 2];
+    let uv = [1u8, 2, 3, 4];
+    let raw = descriptor(WEBRTC_PIXEL_FORMAT_NV12, 4, 2, [y.as_ptr(), uv.as_ptr(), ptr::null()], [0, 0, 0]);
+    let frame = unsafe { VideoFrame::from_raw(&raw) }.unwrap();
+    let mut scratch = I420Buffer::default();
+    let image = frame.to_i420(&mut scratch);
+    assert_eq!(image.planes[0].as_ptr(), y.as_ptr());
+    assert_eq!(image.planes[1], &[1, 3]);
+    assert_eq!(image.planes[2], &[2, 4]);
+}
+
+#[test]
+fn test_rgb_conversion() {
+    // 3x1 BGRA: white, black, pure red (stored as B, G, R, A).
+    let bgra = [255u8, 255, 255, 255, 0, 0, 0, 255, 0, 0, 255, 255];
+    let raw = descriptor(WEBRTC_PIXEL_FORMAT_BGRA, 3, 1, [bgra.as_ptr(), ptr::null(), ptr::null()], [0, 0, 0]);
+    let frame = unsafe { VideoFrame::from_raw(&raw) }.unwrap();
+    let mut scratch = I420Buffer::default();
+    let image = frame.to_i420(&mut scratch);
+    assert_eq!(image.planes[0], &[235, 16, 82]);
+    // White and black average to mid grey: neutral chroma.
+    assert_eq!(image.planes[1][0], 128);
+    assert_eq!(image.planes[2][0], 128);
+    // Red alone in the odd last column.
+    assert_eq!(image.planes[1][1], 90);
+    assert_eq!(image.planes[2][1], 240);
+
+    // The same pixels as RGBA give the same frame.
+    let rgba = [255u8, 255, 255, 255, 0, 0, 0, 255, 255, 0, 0, 255];
+    let raw = descriptor(WEBRTC_PIXEL_FORMAT_RGBA, 3, 1, [rgba.as_ptr(), ptr::null(), ptr::null()], [0, 0, 0]);
+    let frame = unsafe { VideoFrame::from_raw(&raw) }.unwrap();
+    let mut scratch2 = I420Buffer::default();
+    let image2 = frame.to_i420(&mut scratch2);
+    assert_eq!(image2.planes[0], &[235, 16, 82]);
+    assert_eq!(image2.planes[1], &[128, 90]);
+}
+
+#[test]
+fn test_downscale_half_rounds_odd_sizes_up() {
+    let y = [10u8, 20, 30, 40, 50, 60, 70, 80, 90];
+    let u = [1u8, 2, 3, 4];
+    let v = [5u8, 6, 7, 8];
+    let image = I420Image {
+        width: 3,
+        height: 3,
+        planes: [&y, &u, &v],
+        strides: [3, 2, 2],
+    };
+    let mut out = I420Buffer::default();
+    let half = image.downscale_half(&mut out);
+    assert_eq!((half.width, half.height), (2, 2));
+    assert_eq!(half.strides, [2, 1, 1]);
+    // The right column and bottom row pair with themselves.
+    assert_eq!(half.planes[0], &[30, 45, 75, 90][..]);
+    assert_eq!(half.planes[1], &[3][..]);
+    assert_eq!(half.planes[2], &[7][..]);
+}
+
+#[test]
+fn test_copy_from_packs_padded_image() {
+    // 4x2 frame, Y rows padded to 8 bytes: the copy outlives the caller's planes.
+    let y: Vec<u8> = (0..16).collect();
+    let u = [20u8, 21, 0, 0];
+    let v = [30u8, 31, 0, 0];
+    let raw = descriptor(WEBRTC_PIXEL_FORMAT_I420, 4, 2, [y.as_ptr(), u.as_ptr(), v.as_ptr()], [8, 4, 4]);
+    let frame = unsafe { VideoFrame::from_raw(&raw) }.unwrap();
+    let mut scratch = I420Buffer::default();
+    let mut held = I420Buffer::default();
+    held.copy_from(&frame.to_i420(&mut scratch));
+    let image = held.image(4, 2);
+    assert_eq!(image.strides, [4, 2, 2]);
+    assert_eq!(image.planes[0], &[0, 1, 2, 3, 8, 9, 10, 11]);
+    assert_eq!(image.planes[1], &[20, 21]);
+    assert_eq!(image.planes[2], &[30, 31]);
+}
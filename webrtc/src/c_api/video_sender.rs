@@ -0,0 +1,362 @@
+//! Encodes frames and writes them to the session's video track.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use bytes::Bytes;
+use log::{error, info, warn};
+use rtp::extension::HeaderExtension;
+use tokio::runtime::Handle;
+use tokio::sync::mpsc;
+
+use super::bandwidth::{self, BandwidthEstimate};
+use super::capture_time::{self, AbsCaptureTime};
+use super::config::{Codec, EncoderConfig};
+use super::encoder_backend::{self, webrtc_encoder_params_t, VideoEncoder};
+use super::fanout::KeyframeRequests;
+use super::session_stats::LatencyHistogram;
+use super::video_frame::{I420Buffer, PixelFormat, VideoFrame};
+use super::vpx_encoder::{VpxCodec, VpxConfig, VpxEncoder};
+use crate::media::Sample;
+use crate::track::track_local::track_local_static_sample::TrackLocalStaticSample;
+
+/// Encoder timebase: pts are microseconds since the encoder's first frame.
+const ENCODER_TIMEBASE: [i32; 2] = [1, 1_000_000];
+/// RTP duration of the first frame, before there is a previous timestamp to diff against.
+const DEFAULT_FRAME_DURATION: Duration = Duration::from_millis(33);
+/// Encoded frames a track writer may fall behind by, about two seconds at
+/// 30 fps. Past that the network is not keeping up and frames are dropped.
+const WRITE_QUEUE_FRAMES: usize = 64;
+
+/// Frame counts reported by `webrtc_session_get_encode_queue_stats` and
+/// `webrtc_session_get_stats`.
+#[derive(Default)]
+pub(crate) struct FrameCounters {
+    pub submitted: AtomicU64,
+    pub encoded: AtomicU64,
+    pub dropped: AtomicU64,
+    /// Encoded again by `webrtc_session_repeat_frame`; not counted in `encoded`.
+    pub repeated: AtomicU64,
+    /// Conversion, scaling and encoding of each frame.
+    pub encode_time: LatencyHistogram,
+}
+
+/// Where the encoder's last input image is, for repeating it.
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum LastInput {
+    None,
+    /// The last of `scaled`.
+    Scaled,
+    /// `scratch`, holding a converted RGB frame.
+    Scratch,
+    /// `held`: the caller's planes are only borrowed, so they were copied.
+    Held,
+}
+
+// Structure to hold the encoder state
+struct EncoderState {
+    encoder: Box<dyn VideoEncoder>,
+    /// Conversion target for frames that are not already I420.
+    scratch: I420Buffer,
+    /// One buffer per downscale step.
+    scaled: Vec<I420Buffer>,
+    /// Copy of the last input when it lives in none of the buffers above.
+    held: I420Buffer,
+    last_input: LastInput,
+    /// Input frame size; the encoder runs at this halved `scale_steps` times.
+    width: u32,
+    height: u32,
+    scale_steps: u32,
+    frame_count: u64,
+    first_timestamp_us: i64,
+    last_timestamp_us: Option<i64>,
+    last_pts: i64,
+    /// The rate last asked of the encoder, which only hears of changes.
+    bitrate_kbps: u32,
+}
+
+impl EncoderState {
+    /// Maps a capture timestamp to the encoder pts and the RTP duration of the
+    /// previous-to-current frame interval. Pts are kept strictly increasing even
+    /// if the caller's clock repeats a value.
+    fn advance(&mut self, timestamp_us: i64) -> (i64, Duration) {
+        let duration = frame_duration(self.last_timestamp_us, timestamp_us);
+        let mut pts = timestamp_us - self.first_timestamp_us;
+        if self.frame_count > 0 && pts <= self.last_pts {
+            pts = self.last_pts + 1;
+        }
+        self.frame_count += 1;
+        self.last_pts = pts;
+        self.last_timestamp_us = Some(timestamp_us);
+        (pts, duration)
+    }
+}
+
+/// RTP duration from the previous frame's capture timestamp to this one's.
+pub(crate) fn frame_duration(last_timestamp_us: Option<i64>, timestamp_us: i64) -> Duration {
+    match last_timestamp_us {
+        Some(last) if timestamp_us > last => Duration::from_micros((timestamp_us - last) as u64),
+        _ => DEFAULT_FRAME_DURATION,
+    }
+}
+
+/// Creates an encoder for `config` at the given size and bitrate, from the configured backend.
+pub(crate) fn create_encoder(c: &EncoderConfig, width: u32, height: u32, bitrate_kbps: u32) -> Result<Box<dyn VideoEncoder>, String> {
+    let threads = c.resolved_threads();
+    // Keep the configured overshoot ratio at whatever the current target is.
+    let max_bitrate_kbps =
+        (c.max_bitrate_kbps.unwrap_or(c.bitrate_kbps) as u64 * bitrate_kbps as u64 / c.bitrate_kbps as u64) as u32;
+    let codec = match c.codec {
+        Codec::Vp8 if c.is_libvpx() => VpxCodec::Vp8,
+        Codec::Vp9 if c.is_libvpx() => VpxCodec::Vp9,
+        _ => {
+            info!(
+                "Creating {:?} encoder on backend {}: {}x{}, {} kbps",
+                c.codec, c.backend, width, height, bitrate_kbps
+            );
+            let params = webrtc_encoder_params_t {
+                codec: encoder_backend::codec_id(c.codec),
+                width,
+                height,
+                bitrate_kbps,
+                max_bitrate_kbps,
+                keyframe_interval: c.keyframe_interval,
+                threads,
+            };
+            return encoder_backend::create(&c.backend, &params);
+        }
+    };
+    info!(
+        "Creating {:?} encoder: {}x{}, {} kbps, cpu-used {}, {:?} deadline, {} threads",
+        c.codec, width, height, bitrate_kbps, c.cpu_used, c.deadline, threads
+    );
+    let encoder = VpxEncoder::new(&VpxConfig {
+        width,
+        height,
+        timebase: ENCODER_TIMEBASE,
+        codec,
+        bitrate_kbps,
+        max_bitrate_kbps,
+        cpu_used: c.cpu_used,
+        deadline: c.deadline,
+        threads,
+        tile_columns_log2: c.tile_columns_log2,
+        keyframe_interval: c.keyframe_interval,
+        error_resilient: c.error_resilient,
+    })
+    .map_err(|e| format!("Failed to create {:?} encoder: {}", c.codec, e))?;
+    Ok(Box::new(encoder))
+}
+
+pub(crate) struct VideoSender {
+    writer: Arc<TrackWriter>,
+    counters: Arc<FrameCounters>,
+    config: EncoderConfig,
+    /// Set when adaptive bitrate is enabled.
+    estimate: Option<Arc<BandwidthEstimate>>,
+    /// Keep the last input image for `repeat`.
+    retain_last: bool,
+    /// Send frame timestamps as abs-capture-time.
+    abs_capture_time: bool,
+    /// Receivers' keyframe requests, answered on the next frame.
+    keyframe_requests: Option<Arc<KeyframeRequests>>,
+    encoder_state: Option<EncoderState>,
+}
+
+impl VideoSender {
+    pub(crate) fn new(
+        writer: Arc<TrackWriter>,
+        counters: Arc<FrameCounters>,
+        config: EncoderConfig,
+        estimate: Option<Arc<BandwidthEstimate>>,
+        retain_last: bool,
+        abs_capture_time: bool,
+    ) -> Self {
+        VideoSender {
+            writer,
+            counters,
+            config,
+            estimate,
+            retain_last,
+            abs_capture_time,
+            keyframe_requests: None,
+            encoder_state: None,
+        }
+    }
+
+    pub(crate) fn set_keyframe_requests(&mut self, requests: Arc<KeyframeRequests>) {
+        self.keyframe_requests = Some(requests);
+    }
+
+    fn next_is_keyframe(&self, forced: bool) -> bool {
+        match self.keyframe_requests {
+            Some(ref requests) => requests.next_is_keyframe(capture_time::monotonic_us(), forced),
+            None => forced,
+        }
+    }
+
+    /// Encodes one frame on the calling thread and queues its packets on the
+    /// track. The encoder is (re)created whenever the frame size or, with
+    /// adaptive bitrate, the downscale step changes; a new target bitrate is
+    /// applied to the running encoder.
+    pub(crate) fn send(&mut self, frame: &VideoFrame<'_>) -> Result<(), String> {
+        let started = Instant::now();
+        let (w, h) = (frame.width, frame.height);
+        let target = self.estimate.as_ref().map(|e| e.target());
+        let bitrate_kbps = target.map_or(self.config.bitrate_kbps, |t| t.bitrate_kbps);
+        let current_steps = match self.encoder_state {
+            Some(ref state) if state.width == w && state.height == h => Some(state.scale_steps),
+            _ => None,
+        };
+        let scale_steps = target.map_or(0, |t| bandwidth::scale_steps(w, h, t.max_pixels, current_steps.unwrap_or(0)));
+        if current_steps != Some(scale_steps) {
+            // Each halving rounds up, as `I420Image::downscale_half` does.
+            let round = (1 << scale_steps) - 1;
+            let encoder = create_encoder(&self.config, (w + round) >> scale_steps, (h + round) >> scale_steps, bitrate_kbps)?;
+            // A new encoder restarts pts but the RTP clock carries on from the last frame.
+            let last_timestamp_us = self.encoder_state.as_ref().and_then(|s| s.last_timestamp_us);
+            self.encoder_state = Some(EncoderState {
+                encoder,
+                scratch: I420Buffer::default(),
+                scaled: (0..scale_steps).map(|_| I420Buffer::default()).collect(),
+                held: I420Buffer::default(),
+                last_input: LastInput::None,
+                width: w,
+                height: h,
+                scale_steps,
+                frame_count: 0,
+                first_timestamp_us: frame.timestamp_us,
+                last_timestamp_us,
+                last_pts: 0,
+                bitrate_kbps,
+            });
+        }
+        let codec = self.config.codec;
+        let keyframe = self.next_is_keyframe(frame.keyframe);
+        let state = self.encoder_state.as_mut().unwrap();
+        if bitrate_kbps != state.bitrate_kbps {
+            state.bitrate_kbps = bitrate_kbps;
+            if let Err(e) = state.encoder.set_bitrate(bitrate_kbps) {
+                warn!("Failed to set bitrate to {} kbps: {}", bitrate_kbps, e);
+            }
+        }
+
+        let (pts, duration) = state.advance(frame.timestamp_us);
+        let mut image = frame.to_i420(&mut state.scratch);
+        for buffer in state.scaled.iter_mut() {
+            image = image.downscale_half(buffer);
+        }
+        if self.retain_last {
+            state.last_input = if !state.scaled.is_empty() {
+                LastInput::Scaled
+            } else if matches!(frame.format, PixelFormat::Rgba | PixelFormat::Bgra) {
+                LastInput::Scratch
+            } else {
+                state.held.copy_from(&image);
+                LastInput::Held
+            };
+        }
+        let packets = state
+            .encoder
+            .encode(pts, &image, keyframe)
+            .map_err(|e| format!("{:?} encode failed: {}", codec, e))?;
+        self.counters.encoded.fetch_add(1, Ordering::Relaxed);
+        self.counters.encode_time.record(started.elapsed());
+        self.writer.write(packets, duration, self.abs_capture_time.then_some(frame.timestamp_us));
+        Ok(())
+    }
+
+    /// Encodes the last input image again, stamped `timestamp_us`, without
+    /// conversion or scaling. An unchanged image costs the encoder little and
+    /// codes to a few bytes unless `keyframe` is set.
+    pub(crate) fn repeat(&mut self, timestamp_us: i64, keyframe: bool) -> Result<(), String> {
+        if !self.retain_last {
+            return Err("repeat_frames is not enabled in config_json".to_owned());
+        }
+        let codec = self.config.codec;
+        let keyframe = self.next_is_keyframe(keyframe);
+        let state = match self.encoder_state {
+            Some(ref mut state) if state.last_input != LastInput::None => state,
+            _ => return Err("no frame to repeat".to_owned()),
+        };
+        let (pts, duration) = state.advance(timestamp_us);
+        let (width, height) = state.encoder.size();
+        let image = match state.last_input {
+            LastInput::Scaled => state.scaled.last().unwrap().image(width, height),
+            LastInput::Scratch => state.scratch.image(width, height),
+            _ => state.held.image(width, height),
+        };
+        let packets = state
+            .encoder
+            .encode(pts, &image, keyframe)
+            .map_err(|e| format!("{:?} encode failed: {}", codec, e))?;
+        self.counters.repeated.fetch_add(1, Ordering::Relaxed);
+        self.writer.write(packets, duration, self.abs_capture_time.then_some(timestamp_us));
+        Ok(())
+    }
+}
+
+struct EncodedFrame {
+    samples: Vec<Sample>,
+    extensions: Vec<HeaderExtension>,
+}
+
+/// Writes a track's frames from one task on the session's runtime, in the
+/// order they were queued, so RTP sequence numbers and timestamps go out in
+/// order even when frames are encoded faster than they are sent. Every
+/// sender of the track shares it.
+pub(crate) struct TrackWriter {
+    frames: mpsc::Sender<EncodedFrame>,
+}
+
+impl TrackWriter {
+    pub(crate) fn new(video_track: Arc<TrackLocalStaticSample>, rt: &Handle) -> Self {
+        let (frames, mut queue) = mpsc::channel::<EncodedFrame>(WRITE_QUEUE_FRAMES);
+        // Ends once every sender holding the writer is gone
+        rt.spawn(async move {
+            while let Some(frame) = queue.recv().await {
+                for sample in &frame.samples {
+                    if let Err(e) = video_track.write_sample_with_extensions(sample, &frame.extensions).await {
+                        error!("Failed to write sample: {}", e);
+                        break;
+                    }
+                }
+            }
+        });
+        TrackWriter { frames }
+    }
+
+    /// Queues one frame's packets. With `capture_time_us`, every packet
+    /// carries it as abs-capture-time; it is left out on connections that
+    /// did not negotiate the extension.
+    pub(crate) fn write(&self, packets: Vec<Bytes>, duration: Duration, capture_time_us: Option<i64>) {
+        // Only the last packet advances the RTP clock, so every packet of
+        // a frame carries the same timestamp.
+        let last = packets.len().saturating_sub(1);
+        let samples: Vec<Sample> = packets
+            .into_iter()
+            .enumerate()
+            .map(|(i, data)| Sample {
+                data,
+                duration: if i == last { duration } else { Duration::ZERO },
+                ..Default::default()
+            })
+            .collect();
+        if samples.is_empty() {
+            return;
+        }
+        let extensions: Vec<HeaderExtension> = capture_time_us
+            .map(|us| AbsCaptureTime::at(us).header_extension())
+            .into_iter()
+            .collect();
+        match self.frames.try_send(EncodedFrame { samples, extensions }) {
+            Ok(()) => {}
+            // The receiver's next keyframe request repairs the gap
+            Err(mpsc::error::TrySendError::Full(_)) => {
+                warn!("Track writer is {} frames behind, dropping a frame", WRITE_QUEUE_FRAMES)
+            }
+            Err(mpsc::error::TrySendError::Closed(_)) => error!("Track writer has stopped"),
+        }
+    }
+}
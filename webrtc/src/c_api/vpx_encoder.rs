@@ -0,0 +1,248 @@
+//! Minimal safe wrapper over the libvpx encoder. Unlike the `vpx-encode`
+//! crate it takes images with arbitrary plane strides, so callers' buffers can
+//! be encoded without repacking, and it can force keyframes.
+
+use std::ffi::CStr;
+use std::marker::PhantomData;
+use std::os::raw::{c_int, c_long, c_ulong};
+use std::{mem, ptr, slice};
+
+use vpx_sys::*;
+
+use super::config::Deadline;
+use super::video_frame::I420Image;
+
+/// `VPX_EFLAG_FORCE_KF` from vpx_encoder.h.
+const VPX_EFLAG_FORCE_KF: c_long = 1 << 0;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) enum VpxCodec {
+    Vp8,
+    Vp9,
+}
+
+pub(crate) struct VpxConfig {
+    pub width: u32,
+    pub height: u32,
+    pub timebase: [c_int; 2],
+    pub codec: VpxCodec,
+    /// Target bitrate in kbit/s.
+    pub bitrate_kbps: u32,
+    /// Rate control overshoot limit in kbit/s.
+    pub max_bitrate_kbps: u32,
+    pub cpu_used: i32,
+    pub deadline: Deadline,
+    pub threads: u32,
+    /// VP9 only; None derives it from `threads`.
+    pub tile_columns_log2: Option<u32>,
+    /// 0 leaves keyframe placement to the encoder.
+    pub keyframe_interval: u32,
+    pub error_resilient: bool,
+}
+
+pub(crate) struct VpxEncoder {
+    ctx: vpx_codec_ctx_t,
+    /// Kept for `vpx_codec_enc_config_set`, which takes a whole configuration.
+    cfg: vpx_codec_enc_cfg_t,
+    width: u32,
+    height: u32,
+    deadline: c_ulong,
+}
+
+// The codec context is only ever used through &mut self.
+unsafe impl Send for VpxEncoder {}
+
+/// One compressed frame, borrowed from the encoder until the next encode call.
+pub(crate) struct EncodedFrame<'a> {
+    pub data: &'a [u8],
+    pub key: bool,
+    pub pts: i64,
+}
+
+pub(crate) struct Packets<'a> {
+    ctx: *mut vpx_codec_ctx_t,
+    iter: vpx_codec_iter_t,
+    _encoder: PhantomData<&'a mut VpxEncoder>,
+}
+
+fn error_string(ctx: Option<&vpx_codec_ctx_t>, err: vpx_codec_err_t) -> String {
+    let message = unsafe { CStr::from_ptr(vpx_codec_err_to_string(err)) }.to_string_lossy();
+    let detail = ctx
+        .map(|ctx| unsafe { vpx_codec_error_detail(ctx) })
+        .filter(|d| !d.is_null())
+        .map(|d| unsafe { CStr::from_ptr(d) }.to_string_lossy().into_owned());
+    match detail {
+        Some(detail) => format!("{} ({})", message, detail),
+        None => message.into_owned(),
+    }
+}
+
+impl VpxEncoder {
+    pub(crate) fn new(config: &VpxConfig) -> Result<Self, String> {
+        let iface = unsafe {
+            match config.codec {
+                VpxCodec::Vp8 => vpx_codec_vp8_cx(),
+                VpxCodec::Vp9 => vpx_codec_vp9_cx(),
+            }
+        };
+        let mut cfg: vpx_codec_enc_cfg_t = unsafe { mem::zeroed() };
+        let err = unsafe { vpx_codec_enc_config_default(iface, &mut cfg, 0) };
+        if err != vpx_codec_err_t::VPX_CODEC_OK {
+            return Err(error_string(None, err));
+        }
+        cfg.g_w = config.width;
+        cfg.g_h = config.height;
+        cfg.g_timebase.num = config.timebase[0];
+        cfg.g_timebase.den = config.timebase[1];
+        cfg.g_threads = config.threads;
+        cfg.g_error_resilient = if config.error_resilient { VPX_ERROR_RESILIENT_DEFAULT } else { 0 };
+        // No lookahead: every frame comes out of the encode call that took it in.
+        cfg.g_lag_in_frames = 0;
+        cfg.rc_end_usage = vpx_rc_mode::VPX_CBR;
+        cfg.rc_target_bitrate = config.bitrate_kbps;
+        let overshoot = (config.max_bitrate_kbps.saturating_sub(config.bitrate_kbps)) as u64 * 100
+            / config.bitrate_kbps.max(1) as u64;
+        cfg.rc_overshoot_pct = overshoot.min(1000) as u32;
+        if config.keyframe_interval > 0 {
+            cfg.kf_mode = vpx_kf_mode::VPX_KF_AUTO;
+            cfg.kf_max_dist = config.keyframe_interval;
+        }
+
+        let mut ctx: vpx_codec_ctx_t = unsafe { mem::zeroed() };
+        let err = unsafe { vpx_codec_enc_init_ver(&mut ctx, iface, &cfg, 0, VPX_ENCODER_ABI_VERSION as c_int) };
+        if err != vpx_codec_err_t::VPX_CODEC_OK {
+            return Err(error_string(Some(&ctx), err));
+        }
+        let mut encoder = VpxEncoder {
+            ctx,
+            cfg,
+            width: config.width,
+            height: config.height,
+            deadline: match config.deadline {
+                Deadline::Realtime => VPX_DL_REALTIME as c_ulong,
+                Deadline::Good => VPX_DL_GOOD_QUALITY as c_ulong,
+                Deadline::Best => VPX_DL_BEST_QUALITY as c_ulong,
+            },
+        };
+
+        encoder.control(vp8e_enc_control_id::VP8E_SET_CPUUSED as c_int, config.cpu_used, "cpu_used")?;
+        if config.codec == VpxCodec::Vp9 {
+            let tile_columns_log2 = config
+                .tile_columns_log2
+                .unwrap_or_else(|| 31 - config.threads.max(1).leading_zeros());
+            encoder.control(
+                vp8e_enc_control_id::VP9E_SET_TILE_COLUMNS as c_int,
+                tile_columns_log2 as c_int,
+                "tile_columns_log2",
+            )?;
+            if config.threads > 1 {
+                encoder.control(vp8e_enc_control_id::VP9E_SET_ROW_MT as c_int, 1, "row_mt")?;
+            }
+        }
+        Ok(encoder)
+    }
+
+    pub(crate) fn bitrate_kbps(&self) -> u32 {
+        self.cfg.rc_target_bitrate
+    }
+
+    /// The frame size the encoder was created for.
+    pub(crate) fn size(&self) -> (u32, u32) {
+        (self.width, self.height)
+    }
+
+    /// Changes the target bitrate without restarting the stream; the overshoot
+    /// limit stays the same percentage of the target.
+    pub(crate) fn set_bitrate(&mut self, kbps: u32) -> Result<(), String> {
+        if kbps == self.cfg.rc_target_bitrate {
+            return Ok(());
+        }
+        let previous = mem::replace(&mut self.cfg.rc_target_bitrate, kbps);
+        let err = unsafe { vpx_codec_enc_config_set(&mut self.ctx, &self.cfg) };
+        if err != vpx_codec_err_t::VPX_CODEC_OK {
+            self.cfg.rc_target_bitrate = previous;
+            return Err(error_string(Some(&self.ctx), err));
+        }
+        Ok(())
+    }
+
+    fn control(&mut self, id: c_int, value: c_int, name: &str) -> Result<(), String> {
+        let err = unsafe { vpx_codec_control_(&mut self.ctx, id, value) };
+        if err != vpx_codec_err_t::VPX_CODEC_OK {
+            return Err(format!("{}: {}", name, error_string(Some(&self.ctx), err)));
+        }
+        Ok(())
+    }
+
+    /// Encodes one frame, which must match the configured size. libvpx copies
+    /// the image into its own lookahead buffer, so `image` may be reused as
+    /// soon as this returns.
+    pub(crate) fn encode(&mut self, pts: i64, image: &I420Image<'_>, force_keyframe: bool) -> Result<Packets<'_>, String> {
+        if image.width != self.width || image.height != self.height {
+            return Err(format!(
+                "frame is {}x{}, encoder is {}x{}",
+                image.width, image.height, self.width, self.height
+            ));
+        }
+        let mut img: vpx_image_t = unsafe { mem::zeroed() };
+        let wrapped = unsafe {
+            vpx_img_wrap(
+                &mut img,
+                vpx_img_fmt::VPX_IMG_FMT_I420,
+                image.width,
+                image.height,
+                1,
+                image.planes[0].as_ptr() as *mut u8,
+            )
+        };
+        if wrapped.is_null() {
+            return Err("vpx_img_wrap failed".to_owned());
+        }
+        // vpx_img_wrap assumes packed planes; point it at the caller's.
+        for i in 0..3 {
+            img.planes[i] = image.planes[i].as_ptr() as *mut u8;
+            img.stride[i] = image.strides[i] as c_int;
+        }
+
+        let flags = if force_keyframe { VPX_EFLAG_FORCE_KF } else { 0 };
+        let err = unsafe { vpx_codec_encode(&mut self.ctx, &img, pts, 1, flags, self.deadline) };
+        if err != vpx_codec_err_t::VPX_CODEC_OK {
+            return Err(error_string(Some(&self.ctx), err));
+        }
+        Ok(Packets {
+            ctx: &mut self.ctx,
+            iter: ptr::null(),
+            _encoder: PhantomData,
+        })
+    }
+}
+
+impl Drop for VpxEncoder {
+    fn drop(&mut self) {
+        unsafe {
+            vpx_codec_destroy(&mut self.ctx);
+        }
+    }
+}
+
+impl<'a> Iterator for Packets<'a> {
+    type Item = EncodedFrame<'a>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        loop {
+            let pkt = unsafe { vpx_codec_get_cx_data(self.ctx, &mut self.iter) };
+            if pkt.is_null() {
+                return None;
+            }
+            let pkt = unsafe { &*pkt };
+            if pkt.kind == vpx_codec_cx_pkt_kind::VPX_CODEC_CX_FRAME_PKT {
+                let frame = unsafe { &pkt.data.frame };
+                return Some(EncodedFrame {
+                    data: unsafe { slice::from_raw_parts(frame.buf as *const u8, frame.sz as usize) },
+                    key: frame.flags & VPX_FRAME_IS_KEY != 0,
+                    pts: frame.pts,
+                });
+            }
+        }
+    }
+}
@@ -24,6 +24,7 @@ pub mod error;
 /// Set of constructors for WebRTC primitives. Subject to deprecation in future.
 pub mod api;
 
+mod c_api;
 pub mod dtls_transport;
 pub mod rtp_transceiver;
 pub mod sctp_transport;
@@ -45,78 +46,436 @@ pub(crate) const GENERATED_CERTIFICATE_ORIGIN: &str = "WebRTC";
 
 use std::ffi::{CStr, CString};
 use std::os::raw::{c_int, c_void};
-use std::sync::{Arc, Mutex};
-use bytes::Bytes;
+use std::sync::{Arc, Mutex, Once};
+use std::time::Duration;
 use log::{debug, error, info, warn};
-use crate::api::media_engine::MediaEngine;
-use crate::api::APIBuilder;
 use crate::peer_connection::RTCPeerConnection;
-use crate::peer_connection::configuration::RTCConfiguration;
 use crate::peer_connection::sdp::session_description::RTCSessionDescription;
 use crate::peer_connection::peer_connection_state::RTCPeerConnectionState;
 use crate::rtp_transceiver::rtp_codec::RTCRtpCodecCapability;
 use crate::track::track_local::track_local_static_sample::TrackLocalStaticSample;
 use crate::track::track_local::TrackLocal;
-use crate::media::Sample;
 use crate::ice_transport::ice_candidate::RTCIceCandidateInit;
-use crate::data_channel::data_channel_init::RTCDataChannelInit;
-use tokio::runtime::Runtime;
-use vpx_encode::{Encoder, Config, VideoCodecId};
+use tokio::runtime::{Handle, Runtime};
+use tokio::sync::mpsc;
+use tokio::task::JoinHandle;
+use crate::c_api::bandwidth::{self, BandwidthEstimate, BitrateController, WebrtcBitrateCallbackT};
+use crate::c_api::capture_time;
+use crate::c_api::completion::{Completion, WebrtcCompletionCallbackT};
+use crate::c_api::config::{Codec, ContextConfig, FanOutConfig, SessionConfig, SimulcastConfig};
+use crate::c_api::connection_pool;
+use crate::c_api::context::{SessionRuntime, SharedContext};
+use crate::c_api::encode_queue::{AsyncEncoder, EncodeQueue};
+use crate::c_api::encoder_backend::{self, webrtc_encoder_backend_t};
+use crate::c_api::fanout::{FanOut, KeyframeRequests};
+use crate::c_api::input::{
+    webrtc_input_event_t, InputQueue, WebrtcInputReadyCallbackT, INPUT_QUEUE_CAPACITY, WEBRTC_INPUT_POLL_COALESCE_MOVES,
+};
+use crate::c_api::session_stats::{self, TransportStatsCache};
+use crate::c_api::simulcast::{SimulcastSource, Subscription};
+use crate::c_api::signal::{self, SignalSink, WebrtcSignalCallbackT, WebrtcSignalMessageCallbackT};
+use crate::c_api::video_frame::{
+    chroma_len, webrtc_video_frame_t, FrameRelease, VideoFrame, WEBRTC_FRAME_FLAG_KEYFRAME, WEBRTC_PIXEL_FORMAT_I420,
+};
+use crate::c_api::video_sender::{FrameCounters, TrackWriter, VideoSender};
+use std::sync::atomic::Ordering;
 use std::os::raw::c_char;
 // Remove incorrect Codec import
 
 // Define the callback types with proper Rust naming conventions
 pub type WebrtcInputCallbackT = extern "C" fn(data: *const c_void, len: c_int, user_data: *mut c_void);
-pub type WebrtcSignalCallbackT = extern "C" fn(msg: *const c_char, user_data: *mut c_void);
 
-// Structure to hold the encoder state
-struct EncoderState {
-    encoder: Encoder,
-    width: u32,
-    height: u32,
-    frame_count: u64,
+/// Monotonic microseconds, used when the caller does not supply a capture timestamp.
+fn monotonic_timestamp_us() -> i64 {
+    capture_time::monotonic_us()
 }
 
 // Structure to hold the WebRTC session state
 struct WebrtcSession {
     pc: Arc<RTCPeerConnection>,
-    video_track: Arc<TrackLocalStaticSample>,
-    signal_cb: Option<WebrtcSignalCallbackT>,
-    signal_user_data: *mut c_void,
+    signal: Arc<SignalSink>,
     input_cb: Option<WebrtcInputCallbackT>,
     input_user_data: *mut c_void,
-    encoder_state: Option<EncoderState>,
-    rt: Runtime,
+    /// Binary input events, drained by webrtc_session_poll_input.
+    input: Arc<InputQueue>,
+    video: VideoPath,
+    frame_counters: Arc<FrameCounters>,
+    /// Set when config_json enables adaptive_bitrate.
+    bandwidth: Option<Arc<BandwidthEstimate>>,
+    /// encoder.bitrate_kbps, reported as the target without adaptive_bitrate.
+    configured_bitrate_kbps: u32,
+    transport_stats: Arc<TransportStatsCache>,
+    /// Writes the session's own track; None for a fan-out's sessions, whose
+    /// track the fan-out writes.
+    track_writer: Option<Arc<TrackWriter>>,
+    codec: Codec,
+    abs_capture_time: bool,
+    /// Set by webrtc_session_subscribe_simulcast; dropping it unsubscribes.
+    simulcast: Mutex<Option<Arc<Subscription>>>,
+    /// Set for sessions created by webrtc_fanout_create_session, whose track and encoder it owns.
+    fanout: Option<Arc<FanOut>>,
+    /// Asks the session's encoder, the fan-out's or its simulcast layer's for a keyframe.
+    keyframes: Arc<KeyframeRequests>,
+    /// repeat_frames, from the session's config or the fan-out's.
+    repeat_frames: bool,
+    /// Guards install_peer_handlers, which either signal callback setter may run.
+    peer_handlers: Once,
+    /// Run for the session's lifetime; aborted on drop, since a context's
+    /// runtime outlives its sessions.
+    tasks: Vec<JoinHandle<()>>,
+    // Declared last: the encoder thread above must stop before the runtime it spawns on.
+    rt: SessionRuntime,
+}
+
+impl Drop for WebrtcSession {
+    fn drop(&mut self) {
+        for task in &self.tasks {
+            task.abort();
+        }
+        if let Some(ref fanout) = self.fanout {
+            fanout.viewers.fetch_sub(1, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Where send_frame hands frames: encoded on the caller's thread, or queued
+/// for the encoder thread when config_json enables async_encode.
+enum VideoPath {
+    Sync(Arc<Mutex<VideoSender>>),
+    Async(AsyncEncoder),
+}
+
+/// VideoPath with the session lock released.
+#[derive(Clone)]
+enum FrameTarget {
+    Sync(Arc<Mutex<VideoSender>>, Arc<FrameCounters>),
+    Async(Arc<EncodeQueue>),
+}
+
+#[repr(C)]
+pub struct webrtc_encode_queue_stats_t {
+    pub submitted: u64,
+    pub encoded: u64,
+    pub dropped: u64,
+    pub queued: u32,
+}
+
+#[repr(C)]
+pub struct webrtc_session_stats_t {
+    pub frames_submitted: u64,
+    pub frames_encoded: u64,
+    pub frames_dropped: u64,
+    pub frames_repeated: u64,
+    pub encode_queue_depth: u32,
+    pub encode_time_samples: u32,
+    pub encode_time_p50_us: u32,
+    pub encode_time_p99_us: u32,
+    pub encode_time_max_us: u32,
+    pub target_bitrate_kbps: u32,
+    pub send_bitrate_kbps: u32,
+    pub bytes_sent: u64,
+    pub packets_sent: u64,
+    pub rtt_ms: f64,
+    pub nack_count: u64,
+    pub pli_count: u64,
+    pub fir_count: u64,
+}
+
+/// A remote description or ICE candidate from the caller, with its completion.
+enum SignalOp {
+    Description(RTCSessionDescription, Completion),
+    Candidate(RTCIceCandidateInit, Completion),
+}
+
+/// Signalling and diagnostics go through this, not the session lock, so a
+/// signalling thread never waits on stats or setup calls, nor they on it.
+struct SessionPeer {
+    pc: Arc<RTCPeerConnection>,
+    signal: Arc<SignalSink>,
+    rt: Handle,
+    /// Drained by one task, so each op starts once the one queued before it
+    /// has completed: a candidate never races the description it belongs to.
+    ops: mpsc::UnboundedSender<SignalOp>,
+}
+
+impl SessionPeer {
+    fn new(pc: Arc<RTCPeerConnection>, signal: Arc<SignalSink>, rt: Handle) -> Self {
+        let (ops, queued) = mpsc::unbounded_channel();
+        rt.spawn(run_signal_ops(Arc::clone(&pc), Arc::clone(&signal), queued));
+        SessionPeer { pc, signal, rt, ops }
+    }
+
+    fn queue(&self, op: SignalOp) {
+        // The task only stops with the runtime
+        if let Err(mpsc::error::SendError(op)) = self.ops.send(op) {
+            let (SignalOp::Description(_, done) | SignalOp::Candidate(_, done)) = op;
+            done.complete(Err("session runtime has stopped".to_owned()));
+        }
+    }
 }
 
 #[repr(C)]
 pub struct webrtc_session_t {
     inner: Mutex<Option<WebrtcSession>>,
+    /// Also held outside the session lock, so polling never waits on it.
+    input: Arc<InputQueue>,
+    /// Fixed at creation, so the frame path takes no session lock.
+    frames: FrameTarget,
+    peer: SessionPeer,
 }
 
 unsafe impl Send for webrtc_session_t {}
 unsafe impl Sync for webrtc_session_t {}
 
+/// Runtime, API and UDP mux shared by the sessions created in it; see c_api::context.
+#[repr(C)]
+pub struct webrtc_context_t {
+    inner: Arc<SharedContext>,
+}
+
 #[no_mangle]
-pub extern "C" fn webrtc_session_create(
-    _config_json: *const c_char,
+pub extern "C" fn webrtc_context_create(config_json: *const c_char) -> *mut webrtc_context_t {
+    let config = match unsafe { ContextConfig::from_c_str(config_json) } {
+        Ok(config) => config,
+        Err(e) => {
+            error!("Invalid context config: {}", e);
+            return std::ptr::null_mut();
+        }
+    };
+    match SharedContext::new(&config) {
+        Ok(context) => Box::into_raw(Box::new(webrtc_context_t {
+            inner: Arc::new(context),
+        })),
+        Err(e) => {
+            error!("Failed to create context: {}", e);
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Sessions still open keep the runtime alive; it stops when the last one is destroyed.
+#[no_mangle]
+pub extern "C" fn webrtc_context_destroy(context: *mut webrtc_context_t) {
+    if context.is_null() {
+        return;
+    }
+    let context = unsafe { Box::from_raw(context) };
+    let open = context.inner.session_count();
+    if open > 0 {
+        info!("Context released with {} session(s) still open", open);
+    }
+}
+
+#[repr(C)]
+pub struct webrtc_context_stats_t {
+    pub sessions: u32,
+    pub warm_connections: u32,
+    pub warm_hits: u64,
+    pub warm_misses: u64,
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_context_get_stats(context: *mut webrtc_context_t, stats: *mut webrtc_context_stats_t) -> c_int {
+    if context.is_null() || stats.is_null() {
+        error!("Null pointer in webrtc_context_get_stats");
+        return -1;
+    }
+    let context = unsafe { &(*context).inner };
+    let pool = context.pool_stats();
+    unsafe {
+        *stats = webrtc_context_stats_t {
+            sessions: context.session_count() as u32,
+            warm_connections: pool.ready as u32,
+            warm_hits: pool.hits,
+            warm_misses: pool.misses,
+        };
+    }
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_context_create_session(
+    context: *mut webrtc_context_t,
+    config_json: *const c_char,
     input_cb: Option<WebrtcInputCallbackT>,
     user_data: *mut c_void,
 ) -> *mut webrtc_session_t {
-    // Set up media engine with default codecs
-    let mut m = MediaEngine::default();
-    
-    match m.register_default_codecs() {
-        Ok(_) => debug!("Registered default codecs"),
+    if context.is_null() {
+        error!("Null context pointer in webrtc_context_create_session");
+        return std::ptr::null_mut();
+    }
+    let context = Arc::clone(unsafe { &(*context).inner });
+    let config = match unsafe { SessionConfig::from_c_str(config_json) } {
+        Ok(config) => config,
         Err(e) => {
-            error!("Failed to register default codecs: {}", e);
+            error!("Invalid session config: {}", e);
             return std::ptr::null_mut();
         }
+    };
+    if !context.supports(config.encoder.codec) {
+        error!("Invalid session config: the context's codecs do not include {:?}", config.encoder.codec);
+        return std::ptr::null_mut();
     }
-    
-    // Create API with media engine
-    let api = APIBuilder::new().with_media_engine(m).build();
-    
+    create_session(&config, SessionRuntime::shared(&context), input_cb, user_data, None)
+}
+
+/// One encoder and track shared by the sessions created from it; see c_api::fanout.
+#[repr(C)]
+pub struct webrtc_fanout_t {
+    inner: Arc<FanOut>,
+}
+
+#[repr(C)]
+pub struct webrtc_fanout_stats_t {
+    pub viewers: u32,
+    pub frames_encoded: u64,
+    pub keyframe_requests: u64,
+    pub keyframes_for_requests: u64,
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_context_create_fanout(context: *mut webrtc_context_t, config_json: *const c_char) -> *mut webrtc_fanout_t {
+    if context.is_null() {
+        error!("Null context pointer in webrtc_context_create_fanout");
+        return std::ptr::null_mut();
+    }
+    let context = Arc::clone(unsafe { &(*context).inner });
+    let config = match unsafe { FanOutConfig::from_c_str(config_json) } {
+        Ok(config) => config,
+        Err(e) => {
+            error!("Invalid fan-out config: {}", e);
+            return std::ptr::null_mut();
+        }
+    };
+    if !context.supports(config.encoder.codec) {
+        error!("Invalid fan-out config: the context's codecs do not include {:?}", config.encoder.codec);
+        return std::ptr::null_mut();
+    }
+    info!(
+        "Fan-out {:?} at {} kbps, keyframes at most every {} ms",
+        config.encoder.codec, config.encoder.bitrate_kbps, config.keyframe_min_interval_ms
+    );
+    Box::into_raw(Box::new(webrtc_fanout_t {
+        inner: Arc::new(FanOut::new(context, &config)),
+    }))
+}
+
+/// Sessions created from the fan-out keep its encoder and track alive.
+#[no_mangle]
+pub extern "C" fn webrtc_fanout_destroy(fanout: *mut webrtc_fanout_t) {
+    if fanout.is_null() {
+        return;
+    }
+    drop(unsafe { Box::from_raw(fanout) });
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_fanout_create_session(
+    fanout: *mut webrtc_fanout_t,
+    config_json: *const c_char,
+    input_cb: Option<WebrtcInputCallbackT>,
+    user_data: *mut c_void,
+) -> *mut webrtc_session_t {
+    if fanout.is_null() {
+        error!("Null fan-out pointer in webrtc_fanout_create_session");
+        return std::ptr::null_mut();
+    }
+    let fanout = Arc::clone(unsafe { &(*fanout).inner });
+    let config = match unsafe { SessionConfig::from_c_str(config_json) } {
+        Ok(config) => config,
+        Err(e) => {
+            error!("Invalid session config: {}", e);
+            return std::ptr::null_mut();
+        }
+    };
+    if config.adaptive_bitrate.is_some() || config.async_encode.is_some() {
+        error!("Invalid session config: adaptive_bitrate and async_encode do not apply to a fan-out's sessions");
+        return std::ptr::null_mut();
+    }
+    create_session(&config, SessionRuntime::shared(&fanout.context), input_cb, user_data, Some(&fanout))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_fanout_send_frame(fanout: *mut webrtc_fanout_t, frame: *const webrtc_video_frame_t) -> c_int {
+    if frame.is_null() {
+        error!("Null frame pointer in webrtc_fanout_send_frame");
+        return -1;
+    }
+    let raw = unsafe { &*frame };
+    let _release = FrameRelease::new(raw);
+    if fanout.is_null() {
+        error!("Null fan-out pointer in webrtc_fanout_send_frame");
+        return -1;
+    }
+    let fanout = unsafe { &(*fanout).inner };
+    let result = unsafe { VideoFrame::from_raw(raw) }.and_then(|frame| {
+        fanout.counters.submitted.fetch_add(1, Ordering::Relaxed);
+        let mut sender = fanout.sender.lock().map_err(|e| e.to_string())?;
+        sender.send(&frame)
+    });
+    match result {
+        Ok(()) => 0,
+        Err(e) => {
+            error!("webrtc_fanout_send_frame: {}", e);
+            -1
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_fanout_repeat_frame(fanout: *mut webrtc_fanout_t, timestamp_us: i64, flags: u32) -> c_int {
+    if fanout.is_null() {
+        error!("Null fan-out pointer in webrtc_fanout_repeat_frame");
+        return -1;
+    }
+    let fanout = unsafe { &(*fanout).inner };
+    let keyframe = flags & WEBRTC_FRAME_FLAG_KEYFRAME != 0;
+    let result = fanout
+        .sender
+        .lock()
+        .map_err(|e| e.to_string())
+        .and_then(|mut sender| sender.repeat(timestamp_us, keyframe));
+    match result {
+        Ok(()) => 0,
+        Err(e) => {
+            error!("webrtc_fanout_repeat_frame: {}", e);
+            -1
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_fanout_get_stats(fanout: *mut webrtc_fanout_t, stats: *mut webrtc_fanout_stats_t) -> c_int {
+    if fanout.is_null() || stats.is_null() {
+        error!("Null pointer in webrtc_fanout_get_stats");
+        return -1;
+    }
+    let fanout = unsafe { &(*fanout).inner };
+    unsafe {
+        *stats = webrtc_fanout_stats_t {
+            viewers: fanout.viewers.load(Ordering::Relaxed) as u32,
+            frames_encoded: fanout.counters.encoded.load(Ordering::Relaxed),
+            keyframe_requests: fanout.keyframes.requested.load(Ordering::Relaxed),
+            keyframes_for_requests: fanout.keyframes.answered.load(Ordering::Relaxed),
+        };
+    }
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_create(
+    config_json: *const c_char,
+    input_cb: Option<WebrtcInputCallbackT>,
+    user_data: *mut c_void,
+) -> *mut webrtc_session_t {
+    let config = match unsafe { SessionConfig::from_c_str(config_json) } {
+        Ok(config) => config,
+        Err(e) => {
+            error!("Invalid session config: {}", e);
+            return std::ptr::null_mut();
+        }
+    };
+
     // Create runtime for async operations
     let rt = match Runtime::new() {
         Ok(rt) => rt,
@@ -125,432 +484,1015 @@ pub extern "C" fn webrtc_session_create(
             return std::ptr::null_mut();
         }
     };
-    
-    // Set up peer connection and video track
-    let (pc, video_track) = match rt.block_on(async {
-        // Create peer connection with default configuration
-        let pc = match api.new_peer_connection(RTCConfiguration::default()).await {
-            Ok(pc) => Arc::new(pc),
-            Err(e) => {
-                error!("Failed to create peer connection: {}", e);
-                return Err(e);
-            }
-        };
-        
-        // Create video track with VP9 codec
-        let video_track = Arc::new(TrackLocalStaticSample::new(
-            RTCRtpCodecCapability {
-                mime_type: "video/VP9".to_owned(),
-                ..Default::default()
-            },
-            "video".to_owned(),
-            "webrtc-rs".to_owned(),
-        ));
-        
-        // Add track to peer connection
-        match pc.add_track(Arc::clone(&video_track) as Arc<dyn TrackLocal + Send + Sync>).await {
-            Ok(_) => (),
-            Err(e) => {
-                error!("Failed to add track: {}", e);
-                return Err(e);
+
+    create_session(&config, SessionRuntime::Owned(rt), input_cb, user_data, None)
+}
+
+/// Builds the peer connection, track and video path on `rt`. A session of
+/// `fanout` adds the fan-out's track and sends through its encoder.
+fn create_session(
+    config: &SessionConfig,
+    rt: SessionRuntime,
+    input_cb: Option<WebrtcInputCallbackT>,
+    user_data: *mut c_void,
+    fanout: Option<&Arc<FanOut>>,
+) -> *mut webrtc_session_t {
+    // Set up peer connection and video track. The connection comes with its
+    // input data channel and with ICE gathering under way, warm from the
+    // context's pool when it has one.
+    let (pc, video_track, rtp_sender) = match rt.block_on(async {
+        let pc = match rt {
+            SessionRuntime::Shared(ref context) => context.peer_connection().await?,
+            SessionRuntime::Owned(_) => {
+                let api = connection_pool::standalone_api(config.encoder.codec)?;
+                connection_pool::new_peer_connection(&api, connection_pool::standalone_certificate()?).await?
             }
-        }
-        
-        // Create data channel for input events - prefix with underscore to mark as intentionally unused
-        let dc_init = RTCDataChannelInit {
-            ordered: Some(true),
-            ..Default::default()
         };
-        
-        // Create data channel with label "input"
-        let _dc = match pc.create_data_channel("input", Some(dc_init)).await {
-            Ok(dc) => dc,
-            Err(e) => {
-                error!("Failed to create data channel: {}", e);
-                return Err(e);
-            }
+
+        // Create video track with the configured codec
+        let video_track = match fanout {
+            Some(fanout) => Arc::clone(&fanout.video_track),
+            None => Arc::new(TrackLocalStaticSample::new(
+                RTCRtpCodecCapability {
+                    mime_type: config.encoder.codec.mime_type().to_owned(),
+                    ..Default::default()
+                },
+                "video".to_owned(),
+                "webrtc-rs".to_owned(),
+            )),
         };
-        
-        Ok((pc, video_track))
+
+        // Add track to peer connection
+        let rtp_sender = pc
+            .add_track(Arc::clone(&video_track) as Arc<dyn TrackLocal + Send + Sync>)
+            .await
+            .map_err(|e| format!("failed to add track: {}", e))?;
+        Ok::<_, String>((pc, video_track, rtp_sender))
     }) {
         Ok(result) => result,
-        Err(_) => return std::ptr::null_mut(),
+        Err(e) => {
+            error!("Failed to create session: {}", e);
+            return std::ptr::null_mut();
+        }
     };
-    
+
+    // The receiver's RTCP asks for keyframes and, with adaptive_bitrate,
+    // drives the bitrate; without it the encoder keeps its configured rate.
+    // A fan-out viewer's RTCP asks the shared encoder for keyframes. The
+    // reader runs in every case, since the stats interceptor only counts
+    // what it reads.
+    let keyframes = match fanout {
+        Some(fanout) => Arc::clone(&fanout.keyframes),
+        None => Arc::new(KeyframeRequests::new(Duration::ZERO)),
+    };
+    let bandwidth = match fanout {
+        Some(_) => None,
+        None => config.adaptive_bitrate.as_ref().map(|adaptive| {
+            let controller = BitrateController::new(adaptive, config.encoder.bitrate_kbps);
+            Arc::new(BandwidthEstimate::new(controller))
+        }),
+    };
+    let mut tasks = vec![rt.spawn(bandwidth::run_rtcp_reader(rtp_sender, bandwidth.clone(), Arc::clone(&keyframes)))];
+
+    let transport_stats = Arc::new(TransportStatsCache::default());
+    tasks.push(rt.spawn(session_stats::run_transport_stats_poller(Arc::clone(&pc), Arc::clone(&transport_stats))));
+
+    let (video, frame_counters, track_writer) = match fanout {
+        Some(fanout) => {
+            fanout.viewers.fetch_add(1, Ordering::Relaxed);
+            (VideoPath::Sync(Arc::clone(&fanout.sender)), Arc::clone(&fanout.counters), None)
+        }
+        None => {
+            let frame_counters = Arc::new(FrameCounters::default());
+            // Shared with any simulcast subscription, which writes the same track
+            let track_writer = Arc::new(TrackWriter::new(video_track, rt.handle()));
+            let mut sender = VideoSender::new(
+                Arc::clone(&track_writer),
+                Arc::clone(&frame_counters),
+                config.encoder.clone(),
+                bandwidth.clone(),
+                config.repeat_frames,
+                config.abs_capture_time,
+            );
+            sender.set_keyframe_requests(Arc::clone(&keyframes));
+            let video = match config.async_encode {
+                Some(ref async_config) => match AsyncEncoder::start(sender, async_config, Arc::clone(&frame_counters)) {
+                    Ok(encoder) => {
+                        info!(
+                            "Async encode: queue depth {}, {:?}",
+                            async_config.queue_depth, async_config.drop_policy
+                        );
+                        VideoPath::Async(encoder)
+                    }
+                    Err(e) => {
+                        error!("Failed to start encoder thread: {}", e);
+                        return std::ptr::null_mut();
+                    }
+                },
+                None => VideoPath::Sync(Arc::new(Mutex::new(sender))),
+            };
+            (video, frame_counters, Some(track_writer))
+        }
+    };
+
     // Create WebRTC session
+    let input = Arc::new(InputQueue::new(INPUT_QUEUE_CAPACITY));
+    let signal = Arc::new(SignalSink::default());
+    let peer = SessionPeer::new(Arc::clone(&pc), Arc::clone(&signal), rt.handle().clone());
     let session = WebrtcSession {
         pc,
-        video_track,
-        signal_cb: None,
-        signal_user_data: std::ptr::null_mut(),
+        signal,
         input_cb,
         input_user_data: user_data,
-        encoder_state: None,
+        input: Arc::clone(&input),
+        video,
+        frame_counters,
+        bandwidth,
+        configured_bitrate_kbps: fanout.map_or(config.encoder.bitrate_kbps, |f| f.configured_bitrate_kbps),
+        transport_stats,
+        track_writer,
+        codec: fanout.map_or(config.encoder.codec, |f| f.codec),
+        abs_capture_time: fanout.map_or(config.abs_capture_time, |f| f.abs_capture_time),
+        simulcast: Mutex::new(None),
+        fanout: fanout.cloned(),
+        keyframes,
+        repeat_frames: fanout.map_or(config.repeat_frames, |f| f.repeat_frames),
+        peer_handlers: Once::new(),
+        tasks,
         rt,
     };
-    
-    // Allocate session
-    Box::into_raw(Box::new(webrtc_session_t {
-        inner: Mutex::new(Some(session)),
-    }))
+    
+    // Allocate session
+    Box::into_raw(Box::new(webrtc_session_t {
+        frames: session.frame_target(),
+        inner: Mutex::new(Some(session)),
+        input,
+        peer,
+    }))
+}
+
+/// Runs `f` on the session, or returns -1 if the pointer is null or the session is gone.
+fn with_session(session: *mut webrtc_session_t, what: &str, f: impl FnOnce(&WebrtcSession) -> c_int) -> c_int {
+    if session.is_null() {
+        error!("Null session pointer in {}", what);
+        return -1;
+    }
+    let session = unsafe { &*session };
+    let guard = match session.inner.lock() {
+        Ok(guard) => guard,
+        Err(e) => {
+            error!("Failed to lock session mutex: {}", e);
+            return -1;
+        }
+    };
+    match *guard {
+        Some(ref s) => f(s),
+        None => -1,
+    }
+}
+
+/// Forwards local ICE candidates, connection state and the input data channel.
+/// Installed by whichever signal callback setter runs first; the callback
+/// itself is looked up for each message.
+fn install_peer_handlers(s: &WebrtcSession) {
+    // Clone for async closure
+    let pc = Arc::clone(&s.pc);
+    let signal = Arc::clone(&s.signal);
+    let keyframes = Arc::clone(&s.keyframes);
+    let repeat = s.repeat_frames.then(|| s.frame_target());
+
+    // Handle ICE candidates and connection state changes
+    s.rt.spawn(async move {
+        // Set up ICE candidate handler
+        pc.on_ice_candidate(Box::new(move |cand| {
+            let signal = Arc::clone(&signal);
+
+            Box::pin(async move {
+                if let Some(c) = cand {
+                    match c.to_json() {
+                        Ok(init) => signal.send_candidate(&init),
+                        Err(e) => error!("Failed to convert ICE candidate to JSON: {}", e),
+                    }
+                }
+            })
+        }));
+        
+        // Set up connection state handler
+        pc.on_peer_connection_state_change(Box::new(move |state| {
+            let keyframes = Arc::clone(&keyframes);
+            let repeat = repeat.clone();
+            Box::pin(async move {
+                match state {
+                    RTCPeerConnectionState::Connected => {
+                        info!("PeerConnection Connected");
+                        send_first_frame(&keyframes, repeat);
+                    },
+                    RTCPeerConnectionState::Failed => {
+                        error!("PeerConnection Failed");
+                    },
+                    RTCPeerConnectionState::Disconnected => {
+                        warn!("PeerConnection Disconnected");
+                    },
+                    RTCPeerConnectionState::Closed => {
+                        info!("PeerConnection Closed");
+                    },
+                    _ => {}
+                }
+            })
+        }));
+    });
+    
+    // Also set up a data channel handler for the peer connection
+    let pc = Arc::clone(&s.pc);
+    let input_cb = s.input_cb;
+    let input_user_data = s.input_user_data as usize;
+    let input = Arc::clone(&s.input);
+    
+    s.rt.spawn(async move {
+        pc.on_data_channel(Box::new(move |dc| {
+            let input_cb = input_cb;
+            let input_user_data = input_user_data;
+            let input = Arc::clone(&input);
+            
+            Box::pin(async move {
+                let label = dc.label(); // Remove .await
+                info!("New DataChannel: {}", label);
+                
+                if label == "input" {
+                    dc.on_message(Box::new(move |msg| {
+                        let input_cb = input_cb;
+                        let input_user_data = input_user_data;
+                        let input = Arc::clone(&input);
+                        
+                        Box::pin(async move {
+                            // Binary messages are input events, decoded into the queue without allocating
+                            if !msg.is_string {
+                                if let Err(e) = input.push_message(&msg.data, monotonic_timestamp_us()) {
+                                    warn!("Dropped input message: {}", e);
+                                }
+                                return;
+                            }
+                            if let Some(cb_fn) = input_cb {
+                                let data = msg.data.as_ref();
+                                cb_fn(
+                                    data.as_ptr() as *const c_void,
+                                    data.len() as c_int,
+                                    input_user_data as *mut c_void,
+                                );
+                            }
+                        })
+                    }));
+                }
+            })
+        }));
+    });
+}
+
+/// Frames sent before the viewer connected reached no one, so its first frame
+/// must be a keyframe. With repeat_frames the last one is encoded again right
+/// away, rather than the viewer waiting for the next frame the caller sends.
+fn send_first_frame(keyframes: &KeyframeRequests, repeat: Option<FrameTarget>) {
+    keyframes.request();
+    match repeat {
+        Some(FrameTarget::Sync(sender, _)) => {
+            tokio::task::spawn_blocking(move || {
+                let result = sender.lock().map_err(|e| e.to_string()).and_then(|mut sender| sender.repeat(monotonic_timestamp_us(), false));
+                // Nothing to repeat before the first frame, which is a keyframe anyway
+                if let Err(e) = result {
+                    debug!("No first frame to repeat: {}", e);
+                }
+            });
+        }
+        Some(FrameTarget::Async(queue)) => queue.submit_repeat(monotonic_timestamp_us(), false),
+        None => {}
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_signal_callback(
+    session: *mut webrtc_session_t,
+    cb: Option<WebrtcSignalCallbackT>,
+    user_data: *mut c_void,
+) {
+    with_session(session, "webrtc_session_set_signal_callback", |s| {
+        s.signal.set_json(cb, user_data);
+        s.peer_handlers.call_once(|| install_peer_handlers(s));
+        0
+    });
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_signal_message_callback(
+    session: *mut webrtc_session_t,
+    cb: Option<WebrtcSignalMessageCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    with_session(session, "webrtc_session_set_signal_message_callback", |s| {
+        s.signal.set_typed(cb, user_data);
+        s.peer_handlers.call_once(|| install_peer_handlers(s));
+        0
+    })
+}
+
+/// Runs `f` on the session's signalling half, which takes no session lock, or
+/// returns -1 if the pointer is null.
+fn with_peer(session: *mut webrtc_session_t, what: &str, f: impl FnOnce(&SessionPeer)) -> c_int {
+    if session.is_null() {
+        error!("Null session pointer in {}", what);
+        return -1;
+    }
+    f(unsafe { &(*session).peer });
+    0
+}
+
+/// Parses a NUL-terminated JSON string from the caller.
+///
+/// # Safety
+/// A non-null `json` must be a valid NUL-terminated string.
+unsafe fn from_json<T: serde::de::DeserializeOwned>(json: *const c_char) -> Result<T, String> {
+    if json.is_null() {
+        return Err("null JSON".to_owned());
+    }
+    CStr::from_ptr(json)
+        .to_str()
+        .map_err(|e| e.to_string())
+        .and_then(|json| serde_json::from_str(json).map_err(|e| e.to_string()))
+}
+
+/// Applies the caller's signalling in the order it was queued, until the
+/// session's `SessionPeer` is dropped.
+async fn run_signal_ops(pc: Arc<RTCPeerConnection>, signal: Arc<SignalSink>, mut ops: mpsc::UnboundedReceiver<SignalOp>) {
+    while let Some(op) = ops.recv().await {
+        match op {
+            SignalOp::Description(sdp, done) => done.complete(apply_remote_description(&pc, &signal, sdp).await),
+            SignalOp::Candidate(cand, done) => done.complete(apply_ice_candidate(&pc, cand).await),
+        }
+    }
+}
+
+/// Applies a remote description and, for an offer, signals the answer.
+async fn apply_remote_description(
+    pc: &RTCPeerConnection,
+    signal: &SignalSink,
+    sdp: RTCSessionDescription,
+) -> Result<Option<String>, String> {
+    // Set remote description
+    info!("Setting remote description: {}", sdp.sdp_type);
+    pc.set_remote_description(sdp)
+        .await
+        .map_err(|e| format!("failed to set remote description: {}", e))?;
+
+    // Check if remote description is an offer
+    if pc.remote_description().await.map(|rd| rd.sdp_type == "offer".into()).unwrap_or(false) {
+        info!("Creating answer");
+        let answer = pc
+            .create_answer(None)
+            .await
+            .map_err(|e| format!("failed to create answer: {}", e))?;
+
+        // Set local description
+        pc.set_local_description(answer.clone())
+            .await
+            .map_err(|e| format!("failed to set local description: {}", e))?;
+
+        signal.send_description(&answer);
+    }
+    Ok(None)
+}
+
+async fn apply_ice_candidate(pc: &RTCPeerConnection, cand: RTCIceCandidateInit) -> Result<Option<String>, String> {
+    pc.add_ice_candidate(cand)
+        .await
+        .map(|()| None)
+        .map_err(|e| format!("failed to add ICE candidate: {}", e))
+}
+
+fn set_remote_description_json(
+    session: *mut webrtc_session_t,
+    sdp_json: *const c_char,
+    done: Completion,
+) -> c_int {
+    let what = done.what();
+    let sdp: RTCSessionDescription = match unsafe { from_json(sdp_json) } {
+        Ok(sdp) => sdp,
+        Err(e) => {
+            error!("{}: failed to parse SDP JSON: {}", what, e);
+            return -1;
+        }
+    };
+    with_peer(session, what, |peer| peer.queue(SignalOp::Description(sdp, done)))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_remote_description(
+    session: *mut webrtc_session_t,
+    sdp_json: *const c_char,
+) {
+    set_remote_description_json(session, sdp_json, Completion::none("webrtc_session_set_remote_description"));
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_remote_description_async(
+    session: *mut webrtc_session_t,
+    sdp_json: *const c_char,
+    cb: Option<WebrtcCompletionCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    set_remote_description_json(session, sdp_json, Completion::new("webrtc_session_set_remote_description_async", cb, user_data))
+}
+
+fn set_remote_sdp(
+    session: *mut webrtc_session_t,
+    sdp_type: c_int,
+    sdp: *const c_char,
+    len: usize,
+    done: Completion,
+) -> c_int {
+    let what = done.what();
+    let sdp = match unsafe { signal::description_from_c(sdp_type, sdp, len) } {
+        Ok(sdp) => sdp,
+        Err(e) => {
+            error!("{}: {}", what, e);
+            return -1;
+        }
+    };
+    with_peer(session, what, |peer| peer.queue(SignalOp::Description(sdp, done)))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_remote_sdp(
+    session: *mut webrtc_session_t,
+    sdp_type: c_int,
+    sdp: *const c_char,
+    len: usize,
+) -> c_int {
+    set_remote_sdp(session, sdp_type, sdp, len, Completion::none("webrtc_session_set_remote_sdp"))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_remote_sdp_async(
+    session: *mut webrtc_session_t,
+    sdp_type: c_int,
+    sdp: *const c_char,
+    len: usize,
+    cb: Option<WebrtcCompletionCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    set_remote_sdp(session, sdp_type, sdp, len, Completion::new("webrtc_session_set_remote_sdp_async", cb, user_data))
+}
+
+fn add_ice_candidate_json(
+    session: *mut webrtc_session_t,
+    candidate_json: *const c_char,
+    done: Completion,
+) -> c_int {
+    let what = done.what();
+    let cand: RTCIceCandidateInit = match unsafe { from_json(candidate_json) } {
+        Ok(cand) => cand,
+        Err(e) => {
+            error!("{}: failed to parse ICE candidate JSON: {}", what, e);
+            return -1;
+        }
+    };
+    with_peer(session, what, |peer| peer.queue(SignalOp::Candidate(cand, done)))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_add_ice_candidate(
+    session: *mut webrtc_session_t,
+    candidate_json: *const c_char,
+) {
+    add_ice_candidate_json(session, candidate_json, Completion::none("webrtc_session_add_ice_candidate"));
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_add_ice_candidate_async(
+    session: *mut webrtc_session_t,
+    candidate_json: *const c_char,
+    cb: Option<WebrtcCompletionCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    add_ice_candidate_json(session, candidate_json, Completion::new("webrtc_session_add_ice_candidate_async", cb, user_data))
+}
+
+fn add_candidate(
+    session: *mut webrtc_session_t,
+    candidate: *const c_char,
+    sdp_mid: *const c_char,
+    sdp_mline_index: c_int,
+    done: Completion,
+) -> c_int {
+    let what = done.what();
+    let cand = match unsafe { signal::candidate_from_c(candidate, sdp_mid, sdp_mline_index) } {
+        Ok(cand) => cand,
+        Err(e) => {
+            error!("{}: {}", what, e);
+            return -1;
+        }
+    };
+    with_peer(session, what, |peer| peer.queue(SignalOp::Candidate(cand, done)))
 }
 
 #[no_mangle]
-pub extern "C" fn webrtc_session_set_signal_callback(
+pub extern "C" fn webrtc_session_add_candidate(
     session: *mut webrtc_session_t,
-    cb: Option<WebrtcSignalCallbackT>,
+    candidate: *const c_char,
+    sdp_mid: *const c_char,
+    sdp_mline_index: c_int,
+) -> c_int {
+    add_candidate(session, candidate, sdp_mid, sdp_mline_index, Completion::none("webrtc_session_add_candidate"))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_add_candidate_async(
+    session: *mut webrtc_session_t,
+    candidate: *const c_char,
+    sdp_mid: *const c_char,
+    sdp_mline_index: c_int,
+    cb: Option<WebrtcCompletionCallbackT>,
     user_data: *mut c_void,
+) -> c_int {
+    add_candidate(session, candidate, sdp_mid, sdp_mline_index, Completion::new("webrtc_session_add_candidate_async", cb, user_data))
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_send_frame(
+    session: *mut webrtc_session_t,
+    width: c_int,
+    height: c_int,
+    yuv: *const u8,
 ) {
-    if session.is_null() {
-        error!("Null session pointer in webrtc_session_set_signal_callback");
+    webrtc_session_send_frame_with_timestamp(session, width, height, yuv, monotonic_timestamp_us());
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_send_frame_with_timestamp(
+    session: *mut webrtc_session_t,
+    width: c_int,
+    height: c_int,
+    yuv: *const u8,
+    timestamp_us: i64,
+) {
+    if yuv.is_null() || width <= 0 || height <= 0 {
+        error!("Invalid frame in webrtc_session_send_frame: {:?} {}x{}", yuv, width, height);
         return;
     }
-    
-    let session = unsafe { &mut *session };
-    let mut guard = match session.inner.lock() {
-        Ok(guard) => guard,
+
+    // Packed I420: the chroma planes follow the luma plane.
+    let luma_size = width as usize * height as usize;
+    let chroma_size = chroma_len(width as usize) * chroma_len(height as usize);
+    let frame = webrtc_video_frame_t {
+        format: WEBRTC_PIXEL_FORMAT_I420,
+        width,
+        height,
+        planes: unsafe { [yuv, yuv.add(luma_size), yuv.add(luma_size + chroma_size)] },
+        strides: [0; 3],
+        timestamp_us,
+        flags: 0,
+        release: None,
+        release_user_data: std::ptr::null_mut(),
+    };
+    webrtc_session_send_frame_ex(session, &frame);
+}
+
+impl WebrtcSession {
+    fn frame_target(&self) -> FrameTarget {
+        match self.video {
+            VideoPath::Sync(ref sender) => FrameTarget::Sync(Arc::clone(sender), Arc::clone(&self.frame_counters)),
+            VideoPath::Async(ref encoder) => FrameTarget::Async(encoder.queue()),
+        }
+    }
+}
+
+/// Where the session's frames go, read without the session lock.
+fn frame_target<'a>(session: *mut webrtc_session_t) -> &'a FrameTarget {
+    unsafe { &(*session).frames }
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_send_frame_ex(
+    session: *mut webrtc_session_t,
+    frame: *const webrtc_video_frame_t,
+) -> c_int {
+    if frame.is_null() {
+        error!("Null frame pointer in webrtc_session_send_frame_ex");
+        return -1;
+    }
+    let raw = unsafe { &*frame };
+    // Dropping `release` hands the buffer back, once the frame has been
+    // encoded, dropped or rejected: on this thread in sync mode, on the
+    // encoder thread in async mode.
+    let release = FrameRelease::new(raw);
+    if session.is_null() {
+        error!("Null session pointer in webrtc_session_send_frame_ex");
+        return -1;
+    }
+    let result = match frame_target(session) {
+        FrameTarget::Sync(sender, counters) => unsafe { VideoFrame::from_raw(raw) }.and_then(|frame| {
+            counters.submitted.fetch_add(1, Ordering::Relaxed);
+            let mut sender = sender.lock().map_err(|e| e.to_string())?;
+            sender.send(&frame)
+        }),
+        FrameTarget::Async(queue) => unsafe { queue.submit(raw, release) },
+    };
+    match result {
+        Ok(()) => 0,
         Err(e) => {
-            error!("Failed to lock session mutex: {}", e);
-            return;
+            error!("webrtc_session_send_frame_ex: {}", e);
+            -1
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_repeat_frame(session: *mut webrtc_session_t, timestamp_us: i64, flags: u32) -> c_int {
+    if session.is_null() {
+        error!("Null session pointer in webrtc_session_repeat_frame");
+        return -1;
+    }
+    let keyframe = flags & WEBRTC_FRAME_FLAG_KEYFRAME != 0;
+    let result = match frame_target(session) {
+        FrameTarget::Sync(sender, _) => sender.lock().map_err(|e| e.to_string()).and_then(|mut sender| sender.repeat(timestamp_us, keyframe)),
+        FrameTarget::Async(queue) => {
+            queue.submit_repeat(timestamp_us, keyframe);
+            Ok(())
         }
     };
-    
-    if let Some(ref mut s) = *guard {
-        // Set callback and user data
-        s.signal_cb = cb;
-        s.signal_user_data = user_data;
-        
-        // Clone for async closure
-        let pc = Arc::clone(&s.pc);
-        let user_data_val = user_data as usize;
-        let callback = cb;
-        
-        // Handle ICE candidates and connection state changes
-        s.rt.spawn(async move {
-            // Set up ICE candidate handler
-            pc.on_ice_candidate(Box::new(move |cand| {
-                let cb = callback;
-                let user_data_val = user_data_val;
-                
-                Box::pin(async move {
-                    if let Some(c) = cand {
-                        // Convert candidate to JSON
-                        match c.to_json() {
-                            Ok(json) => {
-                                match serde_json::to_string(&json) {
-                                    Ok(json_str) => {
-                                        if let Some(cb_fn) = cb {
-                                            match CString::new(json_str) {
-                                                Ok(cstr) => {
-                                                    cb_fn(cstr.as_ptr(), user_data_val as *mut c_void);
-                                                },
-                                                Err(e) => error!("Failed to create CString: {}", e),
-                                            }
-                                        }
-                                    },
-                                    Err(e) => error!("Failed to serialize ICE candidate: {}", e),
-                                }
-                            },
-                            Err(e) => error!("Failed to convert ICE candidate to JSON: {}", e),
-                        }
-                    }
-                })
-            }));
-            
-            // Set up connection state handler
-            pc.on_peer_connection_state_change(Box::new(move |state| {
-                Box::pin(async move {
-                    match state {
-                        RTCPeerConnectionState::Connected => {
-                            info!("PeerConnection Connected");
-                        },
-                        RTCPeerConnectionState::Failed => {
-                            error!("PeerConnection Failed");
-                        },
-                        RTCPeerConnectionState::Disconnected => {
-                            warn!("PeerConnection Disconnected");
-                        },
-                        RTCPeerConnectionState::Closed => {
-                            info!("PeerConnection Closed");
-                        },
-                        _ => {}
-                    }
-                })
-            }));
-        });
-        
-        // Also set up a data channel handler for the peer connection
-        let pc = Arc::clone(&s.pc);
-        let input_cb = s.input_cb;
-        let input_user_data = s.input_user_data as usize;
-        
-        s.rt.spawn(async move {
-            pc.on_data_channel(Box::new(move |dc| {
-                let input_cb = input_cb;
-                let input_user_data = input_user_data;
-                
-                Box::pin(async move {
-                    let label = dc.label(); // Remove .await
-                    info!("New DataChannel: {}", label);
-                    
-                    if label == "input" {
-                        dc.on_message(Box::new(move |msg| {
-                            let input_cb = input_cb;
-                            let input_user_data = input_user_data;
-                            
-                            Box::pin(async move {
-                                if let Some(cb_fn) = input_cb {
-                                    let data = msg.data.as_ref();
-                                    cb_fn(
-                                        data.as_ptr() as *const c_void,
-                                        data.len() as c_int,
-                                        input_user_data as *mut c_void,
-                                    );
-                                }
-                            })
-                        }));
-                    }
-                })
-            }));
-        });
+    match result {
+        Ok(()) => 0,
+        Err(e) => {
+            error!("webrtc_session_repeat_frame: {}", e);
+            -1
+        }
     }
 }
 
 #[no_mangle]
-pub extern "C" fn webrtc_session_set_remote_description(
+pub extern "C" fn webrtc_session_get_encode_queue_stats(
     session: *mut webrtc_session_t,
-    sdp_json: *const c_char,
-) {
-    if session.is_null() || sdp_json.is_null() {
-        error!("Null pointer in webrtc_session_set_remote_description");
-        return;
+    stats: *mut webrtc_encode_queue_stats_t,
+) -> c_int {
+    if session.is_null() || stats.is_null() {
+        error!("Null pointer in webrtc_session_get_encode_queue_stats");
+        return -1;
     }
-    
-    let session = unsafe { &mut *session };
-    let sdp_json = match unsafe { CStr::from_ptr(sdp_json).to_str() } {
-        Ok(s) => s.to_string(),
+    let session = unsafe { &*session };
+    let guard = match session.inner.lock() {
+        Ok(guard) => guard,
         Err(e) => {
-            error!("Failed to convert SDP JSON to string: {}", e);
-            return;
+            error!("Failed to lock session mutex: {}", e);
+            return -1;
         }
     };
-    
-    let mut guard = match session.inner.lock() {
+    let s = match *guard {
+        Some(ref s) => s,
+        None => return -1,
+    };
+    let queued = match s.video {
+        VideoPath::Sync(_) => 0,
+        VideoPath::Async(ref encoder) => encoder.queue().len() as u32,
+    };
+    let counters = &s.frame_counters;
+    unsafe {
+        *stats = webrtc_encode_queue_stats_t {
+            submitted: counters.submitted.load(Ordering::Relaxed),
+            encoded: counters.encoded.load(Ordering::Relaxed),
+            dropped: counters.dropped.load(Ordering::Relaxed),
+            queued,
+        };
+    }
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_get_stats(session: *mut webrtc_session_t, stats: *mut webrtc_session_stats_t) -> c_int {
+    if session.is_null() || stats.is_null() {
+        error!("Null pointer in webrtc_session_get_stats");
+        return -1;
+    }
+    let session = unsafe { &*session };
+    let guard = match session.inner.lock() {
         Ok(guard) => guard,
         Err(e) => {
             error!("Failed to lock session mutex: {}", e);
-            return;
+            return -1;
         }
     };
-    
-    if let Some(ref mut s) = *guard {
-        let pc = Arc::clone(&s.pc);
-        let cb = s.signal_cb;
-        let user_data_val = s.signal_user_data as usize;
-        let rt = &s.rt;
-        
-        rt.spawn(async move {
-            // Parse SDP from JSON
-            let sdp: RTCSessionDescription = match serde_json::from_str(&sdp_json) {
-                Ok(sdp) => sdp,
-                Err(e) => {
-                    error!("Failed to parse SDP JSON: {}", e);
-                    return;
-                }
-            };
-            
-            // Set remote description
-            info!("Setting remote description: {}", sdp.sdp_type);
-            if let Err(e) = pc.set_remote_description(sdp).await {
-                error!("Failed to set remote description: {}", e);
-                return;
-            }
-            
-            // Check if remote description is an offer
-            if pc.remote_description().await.map(|rd| rd.sdp_type == "offer".into()).unwrap_or(false) {
-                info!("Creating answer");
-                let answer = match pc.create_answer(None).await {
-                    Ok(answer) => answer,
-                    Err(e) => {
-                        error!("Failed to create answer: {}", e);
-                        return;
-                    }
-                };
-                
-                // Set local description
-                if let Err(e) = pc.set_local_description(answer.clone()).await {
-                    error!("Failed to set local description: {}", e);
-                    return;
-                }
-                
-                // Serialize answer to JSON
-                let answer_json = match serde_json::to_string(&answer) {
-                    Ok(json) => json,
-                    Err(e) => {
-                        error!("Failed to serialize answer: {}", e);
-                        return;
-                    }
-                };
-                
-                // Send answer to callback
-                if let Some(cb_fn) = cb {
-                    match CString::new(answer_json) {
-                        Ok(cstr) => {
-                            cb_fn(cstr.as_ptr(), user_data_val as *mut c_void);
-                        },
-                        Err(e) => error!("Failed to create CString: {}", e),
-                    }
-                }
-            }
-        });
+    let s = match *guard {
+        Some(ref s) => s,
+        None => return -1,
+    };
+    let encode_queue_depth = match s.video {
+        VideoPath::Sync(_) => 0,
+        VideoPath::Async(ref encoder) => encoder.queue().len() as u32,
+    };
+    let target_bitrate_kbps = s
+        .bandwidth
+        .as_ref()
+        .map_or(s.configured_bitrate_kbps, |b| b.target().bitrate_kbps);
+    let counters = &s.frame_counters;
+    let encode_time = counters.encode_time.take();
+    let transport = s.transport_stats.get();
+    let clamp = |us: u64| us.min(u32::MAX as u64) as u32;
+    unsafe {
+        *stats = webrtc_session_stats_t {
+            frames_submitted: counters.submitted.load(Ordering::Relaxed),
+            frames_encoded: counters.encoded.load(Ordering::Relaxed),
+            frames_dropped: counters.dropped.load(Ordering::Relaxed),
+            frames_repeated: counters.repeated.load(Ordering::Relaxed),
+            encode_queue_depth,
+            encode_time_samples: clamp(encode_time.count),
+            encode_time_p50_us: clamp(encode_time.p50_us),
+            encode_time_p99_us: clamp(encode_time.p99_us),
+            encode_time_max_us: clamp(encode_time.max_us),
+            target_bitrate_kbps,
+            send_bitrate_kbps: transport.send_bitrate_kbps,
+            bytes_sent: transport.bytes_sent,
+            packets_sent: transport.packets_sent,
+            rtt_ms: transport.rtt_ms.unwrap_or(-1.0),
+            nack_count: transport.nack_count,
+            pli_count: transport.pli_count,
+            fir_count: transport.fir_count,
+        };
     }
+    0
 }
 
 #[no_mangle]
-pub extern "C" fn webrtc_session_add_ice_candidate(
+pub extern "C" fn webrtc_session_set_bitrate_callback(
     session: *mut webrtc_session_t,
-    candidate_json: *const c_char,
-) {
-    if session.is_null() || candidate_json.is_null() {
-        error!("Null pointer in webrtc_session_add_ice_candidate");
-        return;
+    cb: Option<WebrtcBitrateCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    if session.is_null() {
+        error!("Null session pointer in webrtc_session_set_bitrate_callback");
+        return -1;
     }
-    
-    let session = unsafe { &mut *session };
-    let candidate_json = match unsafe { CStr::from_ptr(candidate_json).to_str() } {
-        Ok(s) => s.to_string(),
+    let session = unsafe { &*session };
+    let estimate = match session.inner.lock() {
+        Ok(guard) => match *guard {
+            Some(ref s) => s.bandwidth.clone(),
+            None => return -1,
+        },
         Err(e) => {
-            error!("Failed to convert ICE candidate JSON to string: {}", e);
-            return;
+            error!("Failed to lock session mutex: {}", e);
+            return -1;
         }
     };
-    
-    let mut guard = match session.inner.lock() {
-        Ok(guard) => guard,
+    match estimate {
+        // Outside the session lock: the callback runs right away with the current target.
+        Some(estimate) => {
+            estimate.set_callback(cb, user_data);
+            0
+        }
+        None => {
+            warn!("webrtc_session_set_bitrate_callback: adaptive_bitrate is not enabled in config_json");
+            -1
+        }
+    }
+}
+
+/// A multi-resolution encoder whose layers are forwarded to subscribed sessions; see c_api::simulcast.
+#[repr(C)]
+pub struct webrtc_simulcast_t {
+    inner: Arc<SimulcastSource>,
+}
+
+#[repr(C)]
+pub struct webrtc_simulcast_layer_stats_t {
+    pub width: u32,
+    pub height: u32,
+    pub bitrate_kbps: u32,
+    pub subscribers: u32,
+    pub frames_encoded: u64,
+    pub keyframes: u64,
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_simulcast_create(config_json: *const c_char) -> *mut webrtc_simulcast_t {
+    let config = match unsafe { SimulcastConfig::from_c_str(config_json) } {
+        Ok(config) => config,
         Err(e) => {
-            error!("Failed to lock session mutex: {}", e);
-            return;
+            error!("Invalid simulcast config: {}", e);
+            return std::ptr::null_mut();
         }
     };
-    
-    if let Some(ref mut s) = *guard {
-        let pc = Arc::clone(&s.pc);
-        let rt = &s.rt;
-        
-        rt.spawn(async move {
-            // Parse ICE candidate from JSON
-            let cand: RTCIceCandidateInit = match serde_json::from_str(&candidate_json) {
-                Ok(cand) => cand,
-                Err(e) => {
-                    error!("Failed to parse ICE candidate JSON: {}", e);
-                    return;
-                }
-            };
-            
-            // Add ICE candidate
-            if let Err(e) = pc.add_ice_candidate(cand).await {
-                error!("Failed to add ICE candidate: {}", e);
-            }
-        });
-    }
+    let layers: Vec<String> = config
+        .layers
+        .iter()
+        .map(|l| format!("1/{} at {} kbps", 1 << l.scale_down_log2, l.bitrate_kbps))
+        .collect();
+    info!("Simulcast {:?}: {}", config.encoder.codec, layers.join(", "));
+    Box::into_raw(Box::new(webrtc_simulcast_t {
+        inner: Arc::new(SimulcastSource::new(config)),
+    }))
 }
 
+/// Subscribed sessions stop receiving frames; they stay subscribed to nothing until unsubscribed.
 #[no_mangle]
-pub extern "C" fn webrtc_session_send_frame(
-    session: *mut webrtc_session_t,
-    width: c_int,
-    height: c_int,
-    yuv: *const u8,
-) {
-    if session.is_null() || yuv.is_null() {
-        error!("Null pointer in webrtc_session_send_frame");
+pub extern "C" fn webrtc_simulcast_destroy(simulcast: *mut webrtc_simulcast_t) {
+    if simulcast.is_null() {
         return;
     }
-    
-    if width <= 0 || height <= 0 {
-        error!("Invalid dimensions in webrtc_session_send_frame: {}x{}", width, height);
-        return;
+    drop(unsafe { Box::from_raw(simulcast) });
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_simulcast_send_frame(
+    simulcast: *mut webrtc_simulcast_t,
+    frame: *const webrtc_video_frame_t,
+) -> c_int {
+    if frame.is_null() {
+        error!("Null frame pointer in webrtc_simulcast_send_frame");
+        return -1;
     }
-    
-    let session = unsafe { &mut *session };
-    let w = width as u32;
-    let h = height as u32;
-    
-    // Calculate YUV buffer size (YUV420)
-    let yuv_size = (w * h * 3 / 2) as usize;
-    let yuv_slice = unsafe { std::slice::from_raw_parts(yuv, yuv_size) };
-    
-    let mut guard = match session.inner.lock() {
-        Ok(guard) => guard,
+    let raw = unsafe { &*frame };
+    // Encoding is synchronous, so the buffer goes back before this returns.
+    let _release = FrameRelease::new(raw);
+    if simulcast.is_null() {
+        error!("Null simulcast pointer in webrtc_simulcast_send_frame");
+        return -1;
+    }
+    let source = unsafe { &(*simulcast).inner };
+    match unsafe { VideoFrame::from_raw(raw) }.and_then(|frame| source.send(&frame)) {
+        Ok(()) => 0,
         Err(e) => {
-            error!("Failed to lock session mutex: {}", e);
-            return;
+            error!("webrtc_simulcast_send_frame: {}", e);
+            -1
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_simulcast_get_layer_stats(
+    simulcast: *mut webrtc_simulcast_t,
+    layer: c_int,
+    stats: *mut webrtc_simulcast_layer_stats_t,
+) -> c_int {
+    if simulcast.is_null() || stats.is_null() {
+        error!("Null pointer in webrtc_simulcast_get_layer_stats");
+        return -1;
+    }
+    let source = unsafe { &(*simulcast).inner };
+    let index = match usize::try_from(layer) {
+        Ok(index) if index < source.config().layers.len() => index,
+        _ => {
+            error!("webrtc_simulcast_get_layer_stats: no layer {}", layer);
+            return -1;
         }
     };
+    let counters = source.layer_stats(index);
+    unsafe {
+        *stats = webrtc_simulcast_layer_stats_t {
+            width: counters.width.load(Ordering::Relaxed),
+            height: counters.height.load(Ordering::Relaxed),
+            bitrate_kbps: source.config().layers[index].bitrate_kbps,
+            subscribers: counters.subscribers.load(Ordering::Relaxed),
+            frames_encoded: counters.frames_encoded.load(Ordering::Relaxed),
+            keyframes: counters.keyframes.load(Ordering::Relaxed),
+        };
+    }
+    0
+}
 
-    // Extract needed values and drop the guard before async work
-    let (video_track, rt, encoder_state_ptr) = if let Some(ref mut s) = *guard {
-        let video_track = Arc::clone(&s.video_track);
-        let rt = s.rt.handle().clone();
-        let need_new_encoder = match s.encoder_state {
-            Some(ref state) => state.width != w || state.height != h,
-            None => true,
+#[no_mangle]
+pub extern "C" fn webrtc_session_subscribe_simulcast(
+    session: *mut webrtc_session_t,
+    simulcast: *mut webrtc_simulcast_t,
+    layer: c_int,
+) -> c_int {
+    if simulcast.is_null() {
+        error!("Null simulcast pointer in webrtc_session_subscribe_simulcast");
+        return -1;
+    }
+    let source = unsafe { &(*simulcast).inner };
+    let layers = source.config().layers.len();
+    let fixed_layer = match layer {
+        -1 => None,
+        l if l >= 0 && (l as usize) < layers => Some(l as usize),
+        l => {
+            error!("webrtc_session_subscribe_simulcast: layer {} out of range 0..{}", l, layers);
+            return -1;
+        }
+    };
+    with_session(session, "webrtc_session_subscribe_simulcast", |s| {
+        let Some(ref track_writer) = s.track_writer else {
+            error!("webrtc_session_subscribe_simulcast: the session's track belongs to a fan-out");
+            return -1;
         };
-        if need_new_encoder {
-            info!("Creating VP9 encoder: {}x{}", w, h);
-            match Encoder::new(Config {
-                width: w,
-                height: h,
-                timebase: [1, 30],
-                bitrate: 1_000_000,
-                codec: VideoCodecId::VP9,
-            }) {
-                Ok(encoder) => {
-                    s.encoder_state = Some(EncoderState {
-                        encoder,
-                        width: w,
-                        height: h,
-                        frame_count: 0,
-                    });
-                }
-                Err(e) => {
-                    error!("Failed to create VP9 encoder: {}", e);
-                    return;
-                }
+        if s.codec != source.config().encoder.codec {
+            error!(
+                "webrtc_session_subscribe_simulcast: session track is {:?}, simulcast encodes {:?}",
+                s.codec,
+                source.config().encoder.codec
+            );
+            return -1;
+        }
+        let subscription = Arc::new(Subscription {
+            writer: Arc::clone(track_writer),
+            counters: Arc::clone(&s.frame_counters),
+            estimate: s.bandwidth.clone(),
+            fixed_layer,
+            abs_capture_time: s.abs_capture_time,
+            keyframes: Arc::clone(&s.keyframes),
+        });
+        source.subscribe(&subscription);
+        match s.simulcast.lock() {
+            // Replaces, and so ends, any earlier subscription
+            Ok(mut current) => *current = Some(subscription),
+            Err(e) => {
+                error!("Failed to lock simulcast subscription: {}", e);
+                return -1;
             }
         }
-        let encoder_state_ptr = s.encoder_state.as_mut().unwrap() as *mut EncoderState;
-        (video_track, rt, encoder_state_ptr)
-    } else {
-        return;
+        0
+    })
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_unsubscribe_simulcast(session: *mut webrtc_session_t) -> c_int {
+    with_session(session, "webrtc_session_unsubscribe_simulcast", |s| match s.simulcast.lock() {
+        Ok(mut current) => {
+            *current = None;
+            0
+        }
+        Err(e) => {
+            error!("Failed to lock simulcast subscription: {}", e);
+            -1
+        }
+    })
+}
+
+/// Registers an encoder backend under `name`, for `encoder.backend` in config_json.
+#[no_mangle]
+pub extern "C" fn webrtc_register_encoder_backend(name: *const c_char, backend: *const webrtc_encoder_backend_t) -> c_int {
+    if name.is_null() || backend.is_null() {
+        error!("Null pointer in webrtc_register_encoder_backend");
+        return -1;
+    }
+    let name = match unsafe { CStr::from_ptr(name) }.to_str() {
+        Ok(name) => name,
+        Err(e) => {
+            error!("webrtc_register_encoder_backend: {}", e);
+            return -1;
+        }
     };
-    drop(guard);
-
-    // SAFETY: encoder_state_ptr is valid because we have exclusive access and no one else can access it until this function returns
-    let encoder_state = unsafe { &mut *encoder_state_ptr };
-    encoder_state.frame_count += 1;
-    let pts: i64 = (encoder_state.frame_count * 3000) as i64;
-    match encoder_state.encoder.encode(pts, yuv_slice) {
-        Ok(packets) => {
-            for pkt in packets {
-                let sample = Sample {
-                    data: Bytes::from(pkt.data),
-                    duration: std::time::Duration::from_millis(33),
-                    ..Default::default()
-                };
-                let video_track = Arc::clone(&video_track);
-                rt.spawn(async move {
-                    if let Err(e) = video_track.write_sample(&sample).await {
-                        error!("Failed to write sample: {}", e);
-                    }
-                });
-            }
+    match encoder_backend::register(name, unsafe { &*backend }) {
+        Ok(()) => {
+            info!("Registered encoder backend {}", name);
+            0
         }
         Err(e) => {
-            error!("VP9 encode failed: {}", e);
+            error!("webrtc_register_encoder_backend: {}", e);
+            -1
         }
     }
-    return;
+}
+
+/// The clock of `webrtc_input_event_t::received_us`.
+#[no_mangle]
+pub extern "C" fn webrtc_monotonic_time_us() -> i64 {
+    monotonic_timestamp_us()
+}
+
+/// Unix time of a `webrtc_monotonic_time_us` value, at the offset used for abs-capture-time.
+#[no_mangle]
+pub extern "C" fn webrtc_monotonic_to_unix_us(monotonic_us: i64) -> i64 {
+    capture_time::unix_us(monotonic_us)
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_poll_input(
+    session: *mut webrtc_session_t,
+    events: *mut webrtc_input_event_t,
+    max_events: c_int,
+    flags: u32,
+) -> c_int {
+    if session.is_null() || (events.is_null() && max_events > 0) {
+        error!("Null pointer in webrtc_session_poll_input");
+        return -1;
+    }
+    if max_events <= 0 {
+        return 0;
+    }
+    let session = unsafe { &*session };
+    let out = unsafe { std::slice::from_raw_parts_mut(events, max_events as usize) };
+    session.input.drain(out, flags & WEBRTC_INPUT_POLL_COALESCE_MOVES != 0) as c_int
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_set_input_ready_callback(
+    session: *mut webrtc_session_t,
+    cb: Option<WebrtcInputReadyCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    if session.is_null() {
+        error!("Null session pointer in webrtc_session_set_input_ready_callback");
+        return -1;
+    }
+    let session = unsafe { &*session };
+    session.input.set_ready_callback(cb, user_data);
+    0
 }
 
 #[no_mangle]
@@ -586,56 +1528,64 @@ pub extern "C" fn webrtc_session_destroy(session: *mut webrtc_session_t) {
     // Session will be dropped when guard is dropped
 }
 
-#[no_mangle]
-pub extern "C" fn webrtc_session_get_diagnostics(session: *mut webrtc_session_t) -> *mut c_char {
-    use std::ffi::CString;
-    use std::ptr;
+/// Local ICE credentials and the selected candidate pair, as JSON.
+async fn diagnostics(pc: Arc<RTCPeerConnection>) -> Result<String, String> {
     use serde_json::json;
 
-    if session.is_null() {
-        return ptr::null_mut();
+    let mut diagnostics = json!({});
+    // Local ICE credentials
+    if let Some(params) = pc.get_local_ice_parameters().await {
+        diagnostics["local_ice_ufrag"] = json!(params.username_fragment);
+        diagnostics["local_ice_pwd"] = json!(params.password);
     }
-    let session = unsafe { &mut *session };
-    let guard = match session.inner.lock() {
-        Ok(guard) => guard,
-        Err(_) => return ptr::null_mut(),
-    };
-    if let Some(ref s) = *guard {
-        let pc = Arc::clone(&s.pc);
-        let rt = &s.rt;
-        // Block on async to get ICE info
-        let result: Result<serde_json::Value, ()> = rt.block_on(async move {
-            let mut diagnostics = json!({});
-            // Local ICE credentials
-            if let Some(params) = pc.get_local_ice_parameters().await {
-                diagnostics["local_ice_ufrag"] = json!(params.username_fragment);
-                diagnostics["local_ice_pwd"] = json!(params.password);
-            }
-            // Selected candidate pair (if available)
-            if let Some(pair) = pc.sctp().transport().ice_transport().get_selected_candidate_pair().await {
-                let local = pair.local_candidate();
-                let remote = pair.remote_candidate();
-                diagnostics["selected_local_candidate"] = json!({
-                    "address": local.address,
-                    "port": local.port,
-                    "type": format!("{:?}", local.typ),
-                });
-                diagnostics["selected_remote_candidate"] = json!({
-                    "address": remote.address,
-                    "port": remote.port,
-                    "type": format!("{:?}", remote.typ),
-                });
-            }
-            Ok(diagnostics)
+    // Selected candidate pair (if available)
+    if let Some(pair) = pc.sctp().transport().ice_transport().get_selected_candidate_pair().await {
+        let local = pair.local_candidate();
+        let remote = pair.remote_candidate();
+        diagnostics["selected_local_candidate"] = json!({
+            "address": local.address,
+            "port": local.port,
+            "type": format!("{:?}", local.typ),
         });
-        drop(guard);
-        if let Ok(json_val) = result {
-            if let Ok(json_str) = serde_json::to_string(&json_val) {
-                if let Ok(cstr) = CString::new(json_str) {
-                    return cstr.into_raw();
-                }
-            }
+        diagnostics["selected_remote_candidate"] = json!({
+            "address": remote.address,
+            "port": remote.port,
+            "type": format!("{:?}", remote.typ),
+        });
+    }
+    serde_json::to_string(&diagnostics).map_err(|e| e.to_string())
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_get_diagnostics(session: *mut webrtc_session_t) -> *mut c_char {
+    if session.is_null() {
+        return std::ptr::null_mut();
+    }
+    let peer = unsafe { &(*session).peer };
+    // Blocks the caller, but not the session: no lock is held meanwhile
+    let result = peer
+        .rt
+        .block_on(diagnostics(Arc::clone(&peer.pc)))
+        .and_then(|json| CString::new(json).map_err(|e| e.to_string()));
+    match result {
+        Ok(json) => json.into_raw(),
+        Err(e) => {
+            error!("webrtc_session_get_diagnostics: {}", e);
+            std::ptr::null_mut()
         }
     }
-    ptr::null_mut()
+}
+
+#[no_mangle]
+pub extern "C" fn webrtc_session_get_diagnostics_async(
+    session: *mut webrtc_session_t,
+    cb: Option<WebrtcCompletionCallbackT>,
+    user_data: *mut c_void,
+) -> c_int {
+    const WHAT: &str = "webrtc_session_get_diagnostics_async";
+    with_peer(session, WHAT, |peer| {
+        let pc = Arc::clone(&peer.pc);
+        let done = Completion::new(WHAT, cb, user_data);
+        peer.rt.spawn(async move { done.complete(diagnostics(pc).await.map(Some)) });
+    })
 }
@@ -2120,6 +2120,18 @@ impl RTCPeerConnection {
         gathering_complete_rx
     }
 
+    /// start_ice_gathering gathers local candidates before any description is set,
+    /// so that a later answer already carries them; set_local_description then finds
+    /// gathering under way and does not start it again. Candidates found before an
+    /// on_ice_candidate handler is set are only sent in that description.
+    pub(crate) async fn start_ice_gathering(&self) -> Result<()> {
+        if self.internal.ice_gatherer.state() == RTCIceGathererState::New {
+            self.internal.ice_gatherer.gather().await
+        } else {
+            Ok(())
+        }
+    }
+
     /// Returns the internal [`RTCDtlsTransport`].
     pub fn dtls_transport(&self) -> Arc<RTCDtlsTransport> {
         Arc::clone(&self.internal.dtls_transport)